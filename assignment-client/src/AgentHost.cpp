@@ -0,0 +1,169 @@
+//
+//  AgentHost.cpp
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 HighFidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+
+#include <QtCore/QEventLoop>
+#include <QtCore/QStringList>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkRequest>
+#include <QtNetwork/QNetworkReply>
+
+#include <NodeList.h>
+#include <PacketHeaders.h>
+#include <ParticlesScriptingInterface.h>
+#include <ScriptEngine.h>
+#include <UUID.h>
+
+#include "AgentScriptWorker.h"
+#include "AgentHost.h"
+#include "HostedAgent.h"
+
+const char AGENT_HOST_LOGGING_NAME[] = "agent-host";
+
+const char INSTANCES_PER_PROCESS_OPTION[] = "--instancesPerProcess";
+const char SCRIPT_FRAME_BUDGET_OPTION[] = "--scriptFrameBudgetUsecs";
+const int MAX_INSTANCES_PER_PROCESS = 1024;
+
+// the value after the option in a payload of space separated options, empty if the option isn't there
+static QString payloadOptionValue(const QByteArray& payload, const char* option) {
+    QStringList options = QString(payload).split(" ", QString::SkipEmptyParts);
+    int optionIndex = options.indexOf(option);
+    return (optionIndex >= 0 && optionIndex + 1 < options.size()) ? options.at(optionIndex + 1) : QString();
+}
+
+int AgentHost::instancesPerProcessForPayload(const QByteArray& payload) {
+    int instances = payloadOptionValue(payload, INSTANCES_PER_PROCESS_OPTION).toInt();
+    return std::max(1, std::min(instances, MAX_INSTANCES_PER_PROCESS));
+}
+
+AgentHost::AgentHost(const QByteArray& packet) :
+    ThreadedAssignment(packet),
+    _voxelEditSender(),
+    _particleEditSender(),
+    _instances(instancesPerProcessForPayload(getPayload())),
+    _frameBudgetUsecs(DEFAULT_AGENT_SCRIPT_FRAME_BUDGET_USECS),
+    _runningWorkers(0)
+{
+    quint64 frameBudgetUsecs = payloadOptionValue(getPayload(), SCRIPT_FRAME_BUDGET_OPTION).toULongLong();
+    if (frameBudgetUsecs > 0) {
+        _frameBudgetUsecs = frameBudgetUsecs;
+    }
+
+    ScriptEngine::getVoxelsScriptingInterface()->setPacketSender(&_voxelEditSender);
+    ScriptEngine::getParticlesScriptingInterface()->setPacketSender(&_particleEditSender);
+}
+
+AgentHost::~AgentHost() {
+    // each worker stops its thread and deletes the engines it still has
+    foreach (AgentScriptWorker* worker, _workers) {
+        delete worker;
+    }
+}
+
+void AgentHost::processDatagram(const QByteArray& dataByteArray, const HifiSockAddr& senderSockAddr) {
+    PacketType datagramPacketType = packetTypeForPacket(dataByteArray);
+    if (datagramPacketType == PacketTypeJurisdiction) {
+        int headerBytes = numBytesForPacketHeader(dataByteArray);
+        // PacketType_JURISDICTION, first byte is the node type...
+        switch (dataByteArray[headerBytes]) {
+            case NodeType::VoxelServer:
+                ScriptEngine::getVoxelsScriptingInterface()->getJurisdictionListener()->queueReceivedPacket(senderSockAddr,
+                                                                                                             dataByteArray);
+                break;
+            case NodeType::ParticleServer:
+                ScriptEngine::getParticlesScriptingInterface()->getJurisdictionListener()->queueReceivedPacket(senderSockAddr,
+                                                                                                                dataByteArray);
+                break;
+        }
+    } else if (datagramPacketType == PacketTypeParticleAddResponse) {
+        // this will keep creatorTokenIDs to IDs mapped correctly
+        Particle::handleAddParticleResponse(dataByteArray);
+
+        // also give our local particle tree a chance to remap any internal locally created particles, the scripts are
+        // using it from the worker threads
+        _particleTree.lockForWrite();
+        _particleTree.handleAddParticleResponse(dataByteArray);
+        _particleTree.unlock();
+    } else {
+        NodeList::getInstance()->processNodeData(senderSockAddr, dataByteArray);
+    }
+}
+
+void AgentHost::run() {
+    commonInit(AGENT_HOST_LOGGING_NAME, NodeType::Agent);
+
+    NodeList* nodeList = NodeList::getInstance();
+    nodeList->addSetOfNodeTypesToNodeInterestSet(NodeSet() << NodeType::AudioMixer << NodeType::AvatarMixer);
+
+    // figure out the URL for the script for this agent assignment
+    QString scriptURLString("http://%1:8080/assignment/%2");
+    scriptURLString = scriptURLString.arg(nodeList->getDomainIP().toString(), uuidStringWithoutCurlyBraces(_uuid));
+
+    QNetworkAccessManager *networkManager = new QNetworkAccessManager(this);
+    QNetworkReply *reply = networkManager->get(QNetworkRequest(QUrl(scriptURLString)));
+
+    qDebug() << "Downloading script at" << scriptURLString;
+
+    QEventLoop loop;
+    QObject::connect(reply, SIGNAL(finished()), &loop, SLOT(quit()));
+
+    loop.exec();
+
+    QString scriptContents(reply->readAll());
+
+    qDebug() << "Running" << _instances << "instances of the script with a frame budget of" << _frameBudgetUsecs
+        << "usecs each";
+
+    // tell the script engines about our local particle tree
+    ScriptEngine::getParticlesScriptingInterface()->setParticleTree(&_particleTree);
+
+    int numberOfWorkers = std::max(1, std::min(_instances, QThread::idealThreadCount()));
+    for (int i = 0; i < numberOfWorkers; i++) {
+        AgentScriptWorker* worker = new AgentScriptWorker(i, _frameBudgetUsecs);
+        connect(worker, SIGNAL(finished()), this, SLOT(workerFinished()));
+        worker->initialize(true);
+        _workers.append(worker);
+    }
+    _runningWorkers = numberOfWorkers;
+
+    for (int i = 0; i < _instances; i++) {
+        ScriptEngine* scriptEngine = new ScriptEngine(scriptContents);
+
+        // the host releases the shared edit senders once per frame for every engine
+        scriptEngine->setReleasesEditMessages(false);
+
+        // initialized here since init() also initializes the scripting interfaces all the engines share
+        scriptEngine->init();
+
+        // each engine gets its own Agent and Avatar objects, like the engine of an Agent
+        new HostedAgent(scriptEngine);
+
+        AgentScriptWorker* worker = _workers[i % numberOfWorkers];
+        scriptEngine->moveToThread(worker->thread());
+        worker->addScript(scriptEngine);
+    }
+
+    QTimer* releaseEditMessagesTimer = new QTimer(this);
+    connect(releaseEditMessagesTimer, SIGNAL(timeout()), this, SLOT(releaseEditMessages()));
+    releaseEditMessagesTimer->start(VISUAL_DATA_CALLBACK_USECS / 1000);
+}
+
+void AgentHost::releaseEditMessages() {
+    ScriptEngine::releaseEditMessages();
+}
+
+void AgentHost::workerFinished() {
+    if (--_runningWorkers == 0) {
+        // send whatever the last scripts to finish left queued
+        releaseEditMessages();
+        setFinished(true);
+    }
+}
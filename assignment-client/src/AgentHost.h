@@ -0,0 +1,57 @@
+//
+//  AgentHost.h
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 HighFidelity, Inc. All rights reserved.
+//
+
+#ifndef __hifi__AgentHost__
+#define __hifi__AgentHost__
+
+#include <QtCore/QVector>
+
+#include <ParticleEditPacketSender.h>
+#include <ParticleTree.h>
+#include <ThreadedAssignment.h>
+#include <VoxelEditPacketSender.h>
+
+class AgentScriptWorker;
+
+/// default share of a frame each script may use before it's throttled
+const quint64 DEFAULT_AGENT_SCRIPT_FRAME_BUDGET_USECS = 4000;
+
+/// Runs many instances of an agent script in one assignment-client process, for scripts that would otherwise take a
+/// process each. The instances share the process's node, its jurisdiction listeners and its edit senders, which the
+/// host releases once per frame for all of them, and are spread across a few AgentScriptWorker threads. Since they
+/// share one node they can't each be an avatar, so avatar scripts still need an Agent each.
+class AgentHost : public ThreadedAssignment {
+    Q_OBJECT
+public:
+    AgentHost(const QByteArray& packet);
+    ~AgentHost();
+
+    /// the number of instances of the script an assignment's payload asks each process to run, one if it doesn't say
+    static int instancesPerProcessForPayload(const QByteArray& payload);
+
+public slots:
+    void run();
+
+    void processDatagram(const QByteArray& dataByteArray, const HifiSockAddr& senderSockAddr);
+
+private slots:
+    void releaseEditMessages();
+    void workerFinished();
+
+private:
+    ParticleTree _particleTree;
+    VoxelEditPacketSender _voxelEditSender;
+    ParticleEditPacketSender _particleEditSender;
+
+    int _instances;
+    quint64 _frameBudgetUsecs;
+    QVector<AgentScriptWorker*> _workers;
+    int _runningWorkers;
+};
+
+#endif /* defined(__hifi__AgentHost__) */
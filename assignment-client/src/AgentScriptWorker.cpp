@@ -0,0 +1,130 @@
+//
+//  AgentScriptWorker.cpp
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 HighFidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+
+#include <ScriptEngine.h>
+#include <SharedUtil.h>
+
+#include "AgentScriptWorker.h"
+
+const quint64 THROTTLE_REPORT_INTERVAL_USECS = 10 * 1000 * 1000;
+
+AgentScriptWorker::AgentScriptWorker(int workerNumber, quint64 frameBudgetUsecs) :
+    _workerNumber(workerNumber),
+    _frameBudgetUsecs(frameBudgetUsecs),
+    _frameScheduler(QString("AgentScriptWorker %1").arg(workerNumber), VISUAL_DATA_CALLBACK_USECS),
+    _hasHadScripts(false),
+    _lastThrottleReport(0)
+{
+}
+
+AgentScriptWorker::~AgentScriptWorker() {
+    // stop the thread before the engines it runs go away
+    terminate();
+
+    foreach (const AgentScript& script, _scripts) {
+        delete script._scriptEngine;
+    }
+    foreach (ScriptEngine* scriptEngine, _addedScripts) {
+        delete scriptEngine;
+    }
+}
+
+void AgentScriptWorker::addScript(ScriptEngine* scriptEngine) {
+    QMutexLocker locker(&_addedScriptsMutex);
+    _addedScripts.append(scriptEngine);
+}
+
+int AgentScriptWorker::getScriptCount() {
+    QMutexLocker locker(&_addedScriptsMutex);
+    return _scripts.size() + _addedScripts.size();
+}
+
+void AgentScriptWorker::startAddedScripts() {
+    QList<ScriptEngine*> addedScripts;
+    {
+        QMutexLocker locker(&_addedScriptsMutex);
+        addedScripts.swap(_addedScripts);
+    }
+    foreach (ScriptEngine* scriptEngine, addedScripts) {
+        scriptEngine->start();
+
+        QMutexLocker locker(&_addedScriptsMutex);
+        _scripts.append(AgentScript(scriptEngine));
+        _hasHadScripts = true;
+    }
+}
+
+void AgentScriptWorker::runScriptFrame(AgentScript& script) {
+    if (script._overrunDebtUsecs > 0) {
+        script._overrunDebtUsecs -= std::min(script._overrunDebtUsecs, _frameBudgetUsecs);
+        script._throttledFrames++;
+        script._throttledFramesSinceReport++;
+        return;
+    }
+
+    quint64 startedAt = usecTimestampNow();
+    script._scriptEngine->runFrame();
+    quint64 elapsed = usecTimestampNow() - startedAt;
+
+    if (elapsed > _frameBudgetUsecs) {
+        script._overrunDebtUsecs = elapsed - _frameBudgetUsecs;
+    }
+}
+
+bool AgentScriptWorker::process() {
+    _frameScheduler.waitForNextFrame();
+
+    startAddedScripts();
+
+    // timers of every engine on this thread fire here
+    QCoreApplication::processEvents();
+
+    for (int i = 0; i < _scripts.size(); i++) {
+        if (!_scripts[i]._scriptEngine->isFinished()) {
+            runScriptFrame(_scripts[i]);
+        }
+    }
+
+    quint64 now = usecTimestampNow();
+    if (now - _lastThrottleReport >= THROTTLE_REPORT_INTERVAL_USECS) {
+        for (int i = 0; i < _scripts.size(); i++) {
+            AgentScript& script = _scripts[i];
+            if (script._throttledFramesSinceReport > 0) {
+                qDebug() << "AgentScriptWorker" << _workerNumber << "throttled script" << i << "for"
+                    << script._throttledFramesSinceReport << "frames in the last"
+                    << THROTTLE_REPORT_INTERVAL_USECS / 1000000 << "seconds," << script._throttledFrames << "in all";
+                script._throttledFramesSinceReport = 0;
+            }
+        }
+        _lastThrottleReport = now;
+    }
+
+    // finished engines are finished here rather than from runFrame(), since a script can stop itself from a timer
+    for (int i = _scripts.size() - 1; i >= 0; i--) {
+        ScriptEngine* scriptEngine = _scripts[i]._scriptEngine;
+        if (scriptEngine->isFinished()) {
+            scriptEngine->finish();
+
+            QMutexLocker locker(&_addedScriptsMutex);
+            _scripts.removeAt(i);
+            delete scriptEngine;
+        }
+    }
+
+    // keep going until every script we were given has finished
+    if (_hasHadScripts && getScriptCount() == 0) {
+        _frameScheduler.printStats();
+        return false;
+    }
+    return true;
+}
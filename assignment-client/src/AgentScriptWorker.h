@@ -0,0 +1,67 @@
+//
+//  AgentScriptWorker.h
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 HighFidelity, Inc. All rights reserved.
+//
+//  One of the threads of an AgentHost, ticks its share of the host's script engines once per visual data frame.
+//
+
+#ifndef __hifi__AgentScriptWorker__
+#define __hifi__AgentScriptWorker__
+
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+
+#include <FrameScheduler.h>
+#include <GenericThread.h>
+
+class ScriptEngine;
+
+/// a script engine and how far it has run over its frame budget
+class AgentScript {
+public:
+    AgentScript(ScriptEngine* scriptEngine) : _scriptEngine(scriptEngine), _overrunDebtUsecs(0),
+        _throttledFrames(0), _throttledFramesSinceReport(0) { }
+    ScriptEngine* _scriptEngine;
+    quint64 _overrunDebtUsecs;
+    quint64 _throttledFrames;
+    quint64 _throttledFramesSinceReport;
+};
+
+/// Runs script engines on a thread of its own. Every frame it processes the thread's events, which fires the scripts'
+/// timers, and then runs a frame of each engine. An engine whose frame takes longer than the frame budget goes into
+/// debt by the overrun, and skips frames, paying back one budget each, until the debt is paid.
+class AgentScriptWorker : public GenericThread {
+    Q_OBJECT
+public:
+    AgentScriptWorker(int workerNumber, quint64 frameBudgetUsecs);
+    ~AgentScriptWorker();
+
+    /// Hands the engine over to the worker, which starts it on its next frame and deletes it once it has finished. The
+    /// caller must already have moved the engine to the worker's thread.
+    void addScript(ScriptEngine* scriptEngine);
+
+    /// the number of engines added that haven't finished yet
+    int getScriptCount();
+
+    virtual bool process();
+
+private:
+    void startAddedScripts();
+    void runScriptFrame(AgentScript& script);
+
+    int _workerNumber;
+    quint64 _frameBudgetUsecs;
+    FrameScheduler _frameScheduler;
+
+    QMutex _addedScriptsMutex;
+    QList<ScriptEngine*> _addedScripts;
+    QList<AgentScript> _scripts;
+    bool _hasHadScripts;
+
+    quint64 _lastThrottleReport;
+};
+
+#endif /* defined(__hifi__AgentScriptWorker__) */
@@ -10,12 +10,15 @@
 #include <QtCore/QTimer>
 
 #include <Assignment.h>
+#include <DatagramCapture.h>
 #include <Logging.h>
 #include <NodeList.h>
 #include <PacketHeaders.h>
 #include <SharedUtil.h>
+#include <Trace.h>
 
 #include "AssignmentFactory.h"
+#include "DatagramReplayer.h"
 
 #include "AssignmentClient.h"
 
@@ -26,7 +29,10 @@ int hifiSockAddrMeta = qRegisterMetaType<HifiSockAddr>("HifiSockAddr");
 
 AssignmentClient::AssignmentClient(int &argc, char **argv) :
     QCoreApplication(argc, argv),
-    _currentAssignment(NULL)
+    _currentAssignment(NULL),
+    _datagramCapture(NULL),
+    _datagramReplayer(NULL),
+    _traceFilename()
 {
     // register meta type is required for queued invoke method on Assignment subclasses
     
@@ -54,6 +60,9 @@ AssignmentClient::AssignmentClient(int &argc, char **argv) :
     // create a NodeList as an unassigned client
     NodeList* nodeList = NodeList::createInstance(NodeType::Unassigned);
     
+    // optionally emulate a WAN link on our node socket for every assignment we run
+    nodeList->getNodeSocket().parseImpairmentArguments(argc, (const char**) argv);
+    
     const char CUSTOM_ASSIGNMENT_SERVER_HOSTNAME_OPTION[] = "-a";
     const char CUSTOM_ASSIGNMENT_SERVER_PORT_OPTION[] = "-p";
     
@@ -82,6 +91,49 @@ AssignmentClient::AssignmentClient(int &argc, char **argv) :
         nodeList->setAssignmentServerSocket(customAssignmentSocket);
     }
     
+    // a capture records everything we receive (including the assignment itself) so it can be replayed later
+    const char CAPTURE_DATAGRAMS_OPTION[] = "--captureDatagrams";
+    const char* captureFilename = getCmdOption(argc, (const char**) argv, CAPTURE_DATAGRAMS_OPTION);
+    if (captureFilename) {
+        _datagramCapture = new DatagramCaptureWriter(captureFilename);
+    }
+    
+    // trace everything the assignments do and dump it as Chrome trace JSON each time one finishes
+    const char TRACE_FILE_OPTION[] = "--traceFile";
+    const char* traceFilename = getCmdOption(argc, (const char**) argv, TRACE_FILE_OPTION);
+    if (traceFilename) {
+        _traceFilename = traceFilename;
+        Trace::setEnabled(true);
+    }
+    
+    const char REPLAY_DATAGRAMS_OPTION[] = "--replayDatagrams";
+    const char REPLAY_SPEED_OPTION[] = "--replaySpeed";
+    const char* replayFilename = getCmdOption(argc, (const char**) argv, REPLAY_DATAGRAMS_OPTION);
+    
+    if (replayFilename) {
+        const char* replaySpeedString = getCmdOption(argc, (const char**) argv, REPLAY_SPEED_OPTION);
+        float replaySpeed = replaySpeedString ? atof(replaySpeedString) : 1.0f;
+        
+        _datagramReplayer = new DatagramReplayer(replayFilename, replaySpeed, this);
+        
+        if (!_datagramReplayer->isValid()) {
+            qDebug() << "Nothing to replay in" << replayFilename;
+            QMetaObject::invokeMethod(this, "quit", Qt::QueuedConnection);
+            return;
+        }
+        
+        // the capture stands in for the network - nothing we send should leave the box and nothing else should get in
+        NetworkImpairment blackHole;
+        blackHole.lossRate = 1.0f;
+        nodeList->getNodeSocket().setDefaultImpairment(blackHole);
+        
+        connect(_datagramReplayer, &DatagramReplayer::datagramReplayed, this, &AssignmentClient::processDatagram);
+        connect(_datagramReplayer, SIGNAL(finished()), SLOT(quit()));
+        
+        QMetaObject::invokeMethod(_datagramReplayer, "start", Qt::QueuedConnection);
+        return;
+    }
+    
     // call a timer function every ASSIGNMENT_REQUEST_INTERVAL_MSECS to ask for assignment, if required
     qDebug() << "Waiting for assignment -" << _requestAssignment;
     
@@ -94,6 +146,14 @@ AssignmentClient::AssignmentClient(int &argc, char **argv) :
             Qt::QueuedConnection);
 }
 
+AssignmentClient::~AssignmentClient() {
+    delete _datagramCapture;
+    
+    if (!_traceFilename.isEmpty()) {
+        Trace::writeChromeTraceFile(_traceFilename);
+    }
+}
+
 void AssignmentClient::sendAssignmentRequest() {
     if (!_currentAssignment) {
         NodeList::getInstance()->sendAssignment(_requestAssignment);
@@ -111,55 +171,67 @@ void AssignmentClient::readPendingDatagrams() {
         nodeList->getNodeSocket().readDatagram(receivedPacket.data(), receivedPacket.size(),
                                                senderSockAddr.getAddressPointer(), senderSockAddr.getPortPointer());
         
-        if (packetVersionMatch(receivedPacket)) {
+        if (_datagramCapture) {
+            _datagramCapture->recordDatagram(receivedPacket, senderSockAddr);
+        }
+        
+        processDatagram(receivedPacket, senderSockAddr);
+    }
+}
+
+void AssignmentClient::processDatagram(const QByteArray& receivedPacket, const HifiSockAddr& senderSockAddr) {
+    NodeList* nodeList = NodeList::getInstance();
+    
+    if (packetVersionMatch(receivedPacket)) {
+        if (_currentAssignment) {
+            // have the threaded current assignment handle this datagram
+            // when replaying we wait for it so the replayer can time how long the assignment took to get to it
+            QMetaObject::invokeMethod(_currentAssignment, "processDatagram",
+                                      _datagramReplayer ? Qt::BlockingQueuedConnection : Qt::QueuedConnection,
+                                      Q_ARG(QByteArray, receivedPacket),
+                                      Q_ARG(HifiSockAddr, senderSockAddr));
+        } else if (packetTypeForPacket(receivedPacket) == PacketTypeCreateAssignment) {
+            
             if (_currentAssignment) {
-                // have the threaded current assignment handle this datagram
-                QMetaObject::invokeMethod(_currentAssignment, "processDatagram", Qt::QueuedConnection,
-                                          Q_ARG(QByteArray, receivedPacket),
-                                          Q_ARG(HifiSockAddr, senderSockAddr));
-            } else if (packetTypeForPacket(receivedPacket) == PacketTypeCreateAssignment) {
+                qDebug() << "Dropping received assignment since we are currently running one.";
+            } else {
+                // construct the deployed assignment from the packet data
+                _currentAssignment = AssignmentFactory::unpackAssignment(receivedPacket);
                 
                 if (_currentAssignment) {
-                    qDebug() << "Dropping received assignment since we are currently running one.";
-                } else {
-                    // construct the deployed assignment from the packet data
-                    _currentAssignment = AssignmentFactory::unpackAssignment(receivedPacket);
+                    qDebug() << "Received an assignment -" << *_currentAssignment;
+                    
+                    // switch our nodelist domain IP and port to whoever sent us the assignment
+                    
+                    nodeList->setDomainSockAddr(senderSockAddr);
+                    nodeList->setOwnerUUID(_currentAssignment->getUUID());
+                    
+                    qDebug() << "Destination IP for assignment is" << nodeList->getDomainIP().toString();
                     
-                    if (_currentAssignment) {
-                        qDebug() << "Received an assignment -" << *_currentAssignment;
-                        
-                        // switch our nodelist domain IP and port to whoever sent us the assignment
-                        
-                        nodeList->setDomainSockAddr(senderSockAddr);
-                        nodeList->setOwnerUUID(_currentAssignment->getUUID());
-                        
-                        qDebug() << "Destination IP for assignment is" << nodeList->getDomainIP().toString();
-                        
-                        // start the deployed assignment
-                        QThread* workerThread = new QThread(this);
-                        
-                        connect(workerThread, SIGNAL(started()), _currentAssignment, SLOT(run()));
-                        
-                        connect(_currentAssignment, SIGNAL(finished()), this, SLOT(assignmentCompleted()));
-                        connect(_currentAssignment, SIGNAL(finished()), workerThread, SLOT(quit()));
-                        connect(_currentAssignment, SIGNAL(finished()), _currentAssignment, SLOT(deleteLater()));
-                        connect(workerThread, SIGNAL(finished()), workerThread, SLOT(deleteLater()));
-                        
-                        _currentAssignment->moveToThread(workerThread);
-                        
-                        // move the NodeList to the thread used for the _current assignment
-                        nodeList->moveToThread(workerThread);
-                        
-                        // Starts an event loop, and emits workerThread->started()
-                        workerThread->start();
-                    } else {
-                        qDebug() << "Received an assignment that could not be unpacked. Re-requesting.";
-                    }
+                    // start the deployed assignment
+                    QThread* workerThread = new QThread(this);
+                    
+                    connect(workerThread, SIGNAL(started()), _currentAssignment, SLOT(run()));
+                    
+                    connect(_currentAssignment, SIGNAL(finished()), this, SLOT(assignmentCompleted()));
+                    connect(_currentAssignment, SIGNAL(finished()), workerThread, SLOT(quit()));
+                    connect(_currentAssignment, SIGNAL(finished()), _currentAssignment, SLOT(deleteLater()));
+                    connect(workerThread, SIGNAL(finished()), workerThread, SLOT(deleteLater()));
+                    
+                    _currentAssignment->moveToThread(workerThread);
+                    
+                    // move the NodeList to the thread used for the _current assignment
+                    nodeList->moveToThread(workerThread);
+                    
+                    // Starts an event loop, and emits workerThread->started()
+                    workerThread->start();
+                } else {
+                    qDebug() << "Received an assignment that could not be unpacked. Re-requesting.";
                 }
-            } else {
-                // have the NodeList attempt to handle it
-                nodeList->processNodeData(senderSockAddr, receivedPacket);
             }
+        } else {
+            // have the NodeList attempt to handle it
+            nodeList->processNodeData(senderSockAddr, receivedPacket);
         }
     }
 }
@@ -170,6 +242,10 @@ void AssignmentClient::assignmentCompleted() {
     
     qDebug("Assignment finished or never started - waiting for new assignment.");
     
+    if (!_traceFilename.isEmpty()) {
+        Trace::writeChromeTraceFile(_traceFilename);
+    }
+    
     _currentAssignment = NULL;
     
     NodeList* nodeList = NodeList::getInstance();
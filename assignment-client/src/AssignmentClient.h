@@ -13,17 +13,25 @@
 
 #include "ThreadedAssignment.h"
 
+class DatagramCaptureWriter;
+class DatagramReplayer;
+
 class AssignmentClient : public QCoreApplication {
     Q_OBJECT
 public:
     AssignmentClient(int &argc, char **argv);
+    ~AssignmentClient();
 private slots:
     void sendAssignmentRequest();
     void readPendingDatagrams();
+    void processDatagram(const QByteArray& receivedPacket, const HifiSockAddr& senderSockAddr);
     void assignmentCompleted();
 private:
     Assignment _requestAssignment;
     ThreadedAssignment* _currentAssignment;
+    DatagramCaptureWriter* _datagramCapture;
+    DatagramReplayer* _datagramReplayer;
+    QString _traceFilename;
 };
 
 #endif /* defined(__hifi__AssignmentClient__) */
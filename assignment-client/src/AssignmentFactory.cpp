@@ -9,6 +9,7 @@
 #include <PacketHeaders.h>
 
 #include "Agent.h"
+#include "AgentHost.h"
 #include "AssignmentFactory.h"
 #include "audio/AudioMixer.h"
 #include "avatars/AvatarMixer.h"
@@ -31,6 +32,10 @@ ThreadedAssignment* AssignmentFactory::unpackAssignment(const QByteArray& packet
         case Assignment::AvatarMixerType:
             return new AvatarMixer(packet);
         case Assignment::AgentType:
+            // agent assignments that ask for several instances per process get a host that runs them all
+            if (AgentHost::instancesPerProcessForPayload(Assignment(packet).getPayload()) > 1) {
+                return new AgentHost(packet);
+            }
             return new Agent(packet);
         case Assignment::VoxelServerType:
             return new VoxelServer(packet);
@@ -0,0 +1,107 @@
+//
+//  DatagramReplayer.cpp
+//  hifi
+//
+//  Created on 2/4/14.
+//  Copyright (c) 2014 HighFidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+
+#include <NodeList.h>
+#include <SharedUtil.h>
+
+#include "DatagramReplayer.h"
+
+// how many datagrams we'll push back to back before giving the event loop a turn when replaying flat out
+const int MAX_DATAGRAMS_PER_REPLAY_BATCH = 100;
+
+DatagramReplayer::DatagramReplayer(const QString& filename, float speed, QObject* parent) :
+    QObject(parent),
+    _reader(filename),
+    _speed(std::max(speed, 0.0f)),
+    _nextDatagram(),
+    _hasNextDatagram(false),
+    _replayStartUsecs(0),
+    _datagramsReplayed(0),
+    _bytesReplayed(0),
+    _serviceTimes(),
+    _replayTimer()
+{
+    _hasNextDatagram = _reader.readNext(_nextDatagram);
+
+    _replayTimer.setSingleShot(true);
+    connect(&_replayTimer, SIGNAL(timeout()), SLOT(replayDueDatagrams()));
+}
+
+void DatagramReplayer::start() {
+    qDebug() << "Replaying datagram capture at" << (_speed > 0.0f ? QString::number(_speed) + "x" : QString("full speed"));
+    _replayStartUsecs = usecTimestampNow();
+    replayDueDatagrams();
+}
+
+void DatagramReplayer::replayDueDatagrams() {
+    int datagramsThisBatch = 0;
+
+    while (_hasNextDatagram) {
+        quint64 replayElapsed = usecTimestampNow() - _replayStartUsecs;
+        quint64 nextDueElapsed = (_speed > 0.0f) ? _nextDatagram.usecsSinceStart / _speed : 0;
+
+        if (nextDueElapsed > replayElapsed) {
+            // not time for this one yet, come back when it is
+            _replayTimer.start((nextDueElapsed - replayElapsed) / USECS_PER_MSEC);
+            return;
+        }
+
+        if (datagramsThisBatch++ == MAX_DATAGRAMS_PER_REPLAY_BATCH) {
+            _replayTimer.start(0);
+            return;
+        }
+
+        quint64 dispatchStart = usecTimestampNow();
+        emit datagramReplayed(_nextDatagram.datagram, _nextDatagram.senderSockAddr);
+        _serviceTimes.append(usecTimestampNow() - dispatchStart);
+
+        _datagramsReplayed++;
+        _bytesReplayed += _nextDatagram.datagram.size();
+
+        _hasNextDatagram = _reader.readNext(_nextDatagram);
+    }
+
+    printReport();
+    emit finished();
+}
+
+void DatagramReplayer::printReport() {
+    quint64 replayUsecs = usecTimestampNow() - _replayStartUsecs;
+    float replaySeconds = (float) replayUsecs / USECS_PER_SECOND;
+
+    ImpairableUdpSocket& nodeSocket = NodeList::getInstance()->getNodeSocket();
+
+    qDebug() << "Datagram replay finished.";
+    qDebug("    replayed %llu datagrams (%llu bytes) in %.3f seconds",
+           _datagramsReplayed, _bytesReplayed, replaySeconds);
+    qDebug("    outbound %llu datagrams (%llu bytes), %.1f kbps",
+           nodeSocket.getDatagramsWritten(), nodeSocket.getBytesWritten(),
+           replaySeconds > 0.0f ? (nodeSocket.getBytesWritten() * 8 / 1000.0f) / replaySeconds : 0.0f);
+
+    if (_serviceTimes.isEmpty()) {
+        return;
+    }
+
+    // service time is how long the assignment took to get to and process each datagram, which for the looping
+    // assignments (mixers, octree servers) is dominated by how long their current frame runs
+    QVector<quint64> sortedServiceTimes = _serviceTimes;
+    std::sort(sortedServiceTimes.begin(), sortedServiceTimes.end());
+
+    quint64 totalServiceTime = 0;
+    foreach (quint64 serviceTime, sortedServiceTimes) {
+        totalServiceTime += serviceTime;
+    }
+
+    int lastIndex = sortedServiceTimes.size() - 1;
+    qDebug("    service time usecs - min %llu avg %llu p50 %llu p90 %llu p99 %llu max %llu",
+           sortedServiceTimes[0], totalServiceTime / sortedServiceTimes.size(),
+           sortedServiceTimes[lastIndex * 50 / 100], sortedServiceTimes[lastIndex * 90 / 100],
+           sortedServiceTimes[lastIndex * 99 / 100], sortedServiceTimes[lastIndex]);
+}
@@ -0,0 +1,51 @@
+//
+//  DatagramReplayer.h
+//  hifi
+//
+//  Created on 2/4/14.
+//  Copyright (c) 2014 HighFidelity, Inc. All rights reserved.
+//
+//  Feeds a datagram capture back into the assignment-client at recorded or accelerated speed.
+//
+
+#ifndef __hifi__DatagramReplayer__
+#define __hifi__DatagramReplayer__
+
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+
+#include <DatagramCapture.h>
+
+class DatagramReplayer : public QObject {
+    Q_OBJECT
+public:
+    /// \param speed 1.0 replays at the recorded pace, 4.0 four times faster, 0 as fast as the assignment can take it
+    DatagramReplayer(const QString& filename, float speed, QObject* parent = 0);
+
+    bool isValid() const { return _hasNextDatagram; }
+public slots:
+    void start();
+signals:
+    /// emitted for each captured datagram when its time comes, receiver should handle it as if it came off the socket.
+    /// The time spent in a direct connection to this signal is what the report calls service time, so the receiver
+    /// should block until the assignment has processed the datagram.
+    void datagramReplayed(const QByteArray& datagram, const HifiSockAddr& senderSockAddr);
+    void finished();
+private slots:
+    void replayDueDatagrams();
+private:
+    void printReport();
+
+    DatagramCaptureReader _reader;
+    float _speed;
+    CapturedDatagram _nextDatagram;
+    bool _hasNextDatagram;
+    quint64 _replayStartUsecs;
+    quint64 _datagramsReplayed;
+    quint64 _bytesReplayed;
+    QVector<quint64> _serviceTimes;
+    QTimer _replayTimer;
+};
+
+#endif /* defined(__hifi__DatagramReplayer__) */
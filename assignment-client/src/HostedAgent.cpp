@@ -0,0 +1,36 @@
+//
+//  HostedAgent.cpp
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 HighFidelity, Inc. All rights reserved.
+//
+
+#include <QtCore/QDebug>
+
+#include <ScriptEngine.h>
+
+#include "HostedAgent.h"
+
+HostedAgent::HostedAgent(ScriptEngine* scriptEngine) :
+    QObject(scriptEngine),
+    _scriptEngine(scriptEngine),
+    _scriptedAvatar()
+{
+    // a child too, so that it moves to the engine's thread
+    _scriptedAvatar.setParent(this);
+
+    _scriptEngine->setAvatarData(&_scriptedAvatar, "Avatar");
+    _scriptEngine->registerGlobalObject("Agent", this);
+}
+
+void HostedAgent::setIsAvatar(bool isAvatar) {
+    if (isAvatar) {
+        qDebug() << "Ignoring Agent.isAvatar, since the scripts of an agent host share one node. Run the script as an"
+            << "agent of its own to make it an avatar.";
+    }
+}
+
+bool HostedAgent::isAvatar() const {
+    return _scriptEngine->isAvatar();
+}
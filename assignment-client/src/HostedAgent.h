@@ -0,0 +1,43 @@
+//
+//  HostedAgent.h
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 HighFidelity, Inc. All rights reserved.
+//
+//  The Agent object of one of an AgentHost's script engines, so that scripts run the same whether an Agent or an
+//  AgentHost runs them.
+//
+
+#ifndef __hifi__HostedAgent__
+#define __hifi__HostedAgent__
+
+#include <QtCore/QObject>
+
+#include <AvatarData.h>
+
+class ScriptEngine;
+
+/// Gives a script engine its own Agent and Avatar objects, like an Agent gives its engine. The scripts of a host share one
+/// node, so they can't be avatars, and setting isAvatar is ignored. It's a child of the engine, so it moves to the
+/// engine's thread with it and is deleted with it.
+class HostedAgent : public QObject {
+    Q_OBJECT
+
+    Q_PROPERTY(bool isAvatar READ isAvatar WRITE setIsAvatar)
+public:
+    HostedAgent(ScriptEngine* scriptEngine);
+
+    void setIsAvatar(bool isAvatar);
+    bool isAvatar() const;
+
+signals:
+    void willSendAudioDataCallback();
+    void willSendVisualDataCallback();
+
+private:
+    ScriptEngine* _scriptEngine;
+    AvatarData _scriptedAvatar;
+};
+
+#endif /* defined(__hifi__HostedAgent__) */
@@ -34,12 +34,14 @@
 #include <QtCore/QCoreApplication>
 #include <QtCore/QTimer>
 
+#include <FrameScheduler.h>
 #include <Logging.h>
 #include <NodeList.h>
 #include <Node.h>
 #include <PacketHeaders.h>
 #include <SharedUtil.h>
 #include <StdDev.h>
+#include <Trace.h>
 #include <UUID.h>
 
 #include "AudioRingBuffer.h"
@@ -181,6 +183,7 @@ void AudioMixer::addBufferToMixForListeningNodeWithBuffer(PositionalAudioRingBuf
 }
 
 void AudioMixer::prepareMixForListeningNode(Node* node) {
+    TRACE_SCOPE("audio mix");
     AvatarAudioRingBuffer* nodeRingBuffer = ((AudioMixerClientData*) node->getLinkedData())->getAvatarAudioRingBuffer();
 
     // zero out the client mix for this node
@@ -245,10 +248,9 @@ void AudioMixer::run() {
 
     nodeList->linkedDataCreateCallback = attachNewBufferToNode;
 
-    int nextFrame = 0;
-    timeval startTime;
-
-    gettimeofday(&startTime, NULL);
+    // the mix has to keep up with the clients' sample rate, so frames missed by an overrun are caught up on
+    FrameScheduler frameScheduler("AudioMixer", BUFFER_SEND_INTERVAL_USECS, FrameScheduler::CatchUpOverruns);
+    frameScheduler.start();
 
     int numBytesPacketHeader = numBytesForPacketHeaderGivenPacketType(PacketTypeMixedAudio);
     // note: Visual Studio 2010 doesn't support variable sized local arrays
@@ -278,6 +280,7 @@ void AudioMixer::run() {
                 && ((AudioMixerClientData*) node->getLinkedData())->getAvatarAudioRingBuffer()) {
                 prepareMixForListeningNode(node.data());
 
+                TRACE_SCOPE("audio send");
                 memcpy(clientPacket + numBytesPacketHeader, _clientSamples, sizeof(_clientSamples));
                 nodeList->getNodeSocket().writeDatagram((char*) clientPacket, sizeof(clientPacket),
                                                         node->getActiveSocket()->getAddress(),
@@ -292,13 +295,8 @@ void AudioMixer::run() {
             }
         }
 
-        int usecToSleep = usecTimestamp(&startTime) + (++nextFrame * BUFFER_SEND_INTERVAL_USECS) - usecTimestampNow();
-
-        if (usecToSleep > 0) {
-            usleep(usecToSleep);
-        } else {
-            qDebug() << "AudioMixer loop took" << -usecToSleep << "of extra time. Not sleeping.";
-        }
-
+        frameScheduler.waitForNextFrame();
     }
+
+    frameScheduler.printStats();
 }
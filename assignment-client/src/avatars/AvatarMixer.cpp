@@ -13,10 +13,12 @@
 #include <QtCore/QCoreApplication>
 #include <QtCore/QTimer>
 
+#include <FrameScheduler.h>
 #include <Logging.h>
 #include <NodeList.h>
 #include <PacketHeaders.h>
 #include <SharedUtil.h>
+#include <Trace.h>
 #include <UUID.h>
 
 #include "AvatarData.h"
@@ -48,6 +50,7 @@ void attachAvatarDataToNode(Node* newNode) {
 //       determine which avatars are included in the packet stream
 //    4) we should optimize the avatar data format to be more compact (100 bytes is pretty wasteful).
 void broadcastAvatarData() {
+    TRACE_SCOPE("avatar broadcast");
     static QByteArray mixedAvatarByteArray;
     
     int numPacketHeaderBytes = populatePacketHeader(mixedAvatarByteArray, PacketTypeBulkAvatarData);
@@ -150,10 +153,8 @@ void AvatarMixer::run() {
     
     nodeList->linkedDataCreateCallback = attachAvatarDataToNode;
     
-    int nextFrame = 0;
-    timeval startTime;
-    
-    gettimeofday(&startTime, NULL);
+    FrameScheduler frameScheduler("AvatarMixer", AVATAR_DATA_SEND_INTERVAL_USECS, FrameScheduler::CatchUpOverruns);
+    frameScheduler.start();
     
     while (!_isFinished) {
         
@@ -165,12 +166,8 @@ void AvatarMixer::run() {
         
         broadcastAvatarData();
         
-        int usecToSleep = usecTimestamp(&startTime) + (++nextFrame * AVATAR_DATA_SEND_INTERVAL_USECS) - usecTimestampNow();
-        
-        if (usecToSleep > 0) {
-            usleep(usecToSleep);
-        } else {
-            qDebug() << "AvatarMixer loop took too" << -usecToSleep << "of extra time. Won't sleep.";
-        }
+        frameScheduler.waitForNextFrame();
     }
+    
+    frameScheduler.printStats();
 }
@@ -38,6 +38,14 @@ void OctreeInboundPacketProcessor::resetStats() {
     _singleSenderStats.clear();
 }
 
+bool OctreeInboundPacketProcessor::process() {
+    if (!_myServer->isInitialLoadComplete()) {
+        const quint64 LOAD_WAIT_SLEEP_INTERVAL = (1000 * 1000) / 60; // check at 60fps, like the queue itself
+        usleep(LOAD_WAIT_SLEEP_INTERVAL);
+        return isStillRunning();
+    }
+    return ReceivedPacketProcessor::process();
+}
 
 void OctreeInboundPacketProcessor::processPacket(const HifiSockAddr& senderSockAddr, const QByteArray& packet) {
 
@@ -57,6 +65,13 @@ void OctreeInboundPacketProcessor::processPacket(const HifiSockAddr& senderSockA
         _receivedPacketCount++;
 
         SharedNodePointer senderNode = NodeList::getInstance()->nodeWithAddress(senderSockAddr);
+        OctreeReplicator* replicator = _myServer->getReplicator();
+        if (!senderNode && replicator && replicator->isReplicaAddress(senderSockAddr)) {
+            // a replica passed on the edit of one of its viewers, which is who answers go to
+            QUuid viewerUUID;
+            deconstructPacketHeader(packet, viewerUUID);
+            senderNode = NodeList::getInstance()->nodeWithUUID(viewerUUID);
+        }
         
         const unsigned char* packetData = reinterpret_cast<const unsigned char*>(packet.data());
 
@@ -105,6 +120,11 @@ void OctreeInboundPacketProcessor::processPacket(const HifiSockAddr& senderSockA
             atByte += editDataBytesRead;
         }
 
+        // replicas apply what we applied, in the order we applied it
+        if (replicator) {
+            replicator->forwardEditPacket(packet);
+        }
+
         if (debugProcessPacket) {
             printf("OctreeInboundPacketProcessor::processPacket() DONE LOOPING FOR %c "
                    "packetData=%p packetLength=%d voxelData=%p atByte=%d\n",
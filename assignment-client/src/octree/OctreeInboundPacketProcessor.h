@@ -65,6 +65,10 @@ public:
 protected:
     virtual void processPacket(const HifiSockAddr& senderSockAddr, const QByteArray& packet);
 
+    /// Holds edits in the queue until the persist file has loaded, since the load would overwrite edits to the chunks it
+    /// hasn't read yet.
+    virtual bool process();
+
 private:
     void trackInboundPackets(const QUuid& nodeUUID, int sequence, quint64 transitTime, 
             int voxelsInPacket, quint64 processTime, quint64 lockWaitTime);
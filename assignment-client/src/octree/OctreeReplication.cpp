@@ -0,0 +1,319 @@
+//
+//  OctreeReplication.cpp
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <climits>
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDebug>
+#include <QtCore/QTimer>
+
+#include <OctalCode.h>
+#include <Octree.h>
+#include <PacketHeaders.h>
+#include <SharedUtil.h>
+
+#include "OctreeReplication.h"
+
+OctreeReplicator::OctreeReplicator(Octree* tree, const QString& replicaGroup, NodeType_t serverType) :
+    _tree(tree),
+    _replicaGroup(replicaGroup),
+    _serverType(serverType),
+    _syncSource(tree)
+{
+}
+
+void OctreeReplicator::setHandoffTarget(const QUuid& targetUUID, const QByteArray& rootOctalCode) {
+    if (targetUUID == _handoffTargetUUID && rootOctalCode == _handoffRootOctalCode) {
+        return;
+    }
+    if (targetUUID.isNull()) {
+        qDebug() << "Done handing subtree"
+            << octalCodeToHexString((const unsigned char*)_handoffRootOctalCode.constData())
+            << "to" << _handoffTargetUUID;
+    } else {
+        qDebug() << "Handing subtree" << octalCodeToHexString((const unsigned char*)rootOctalCode.constData())
+            << "to" << targetUUID;
+    }
+    _handoffTargetUUID = targetUUID;
+    _handoffRootOctalCode = rootOctalCode;
+}
+
+// whether a packet is from a server of a type at the address the domain-server knows it by
+static bool isFromServer(const QUuid& senderUUID, const HifiSockAddr& senderSockAddr, NodeType_t serverType) {
+    SharedNodePointer sender = NodeList::getInstance()->nodeWithUUID(senderUUID);
+    return sender && sender->getType() == serverType
+        && (senderSockAddr == sender->getPublicSocket() || senderSockAddr == sender->getLocalSocket());
+}
+
+void OctreeReplicator::processSyncRequest(const QByteArray& packet, const HifiSockAddr& senderSockAddr) {
+    QUuid replicaUUID;
+    deconstructPacketHeader(packet, replicaUUID);
+
+    QDataStream packetStream(packet);
+    packetStream.skipRawData(numBytesForPacketHeader(packet));
+    QString replicaGroup;
+    quint32 sequence;
+    QByteArray request;
+    QByteArray rootOctalCode;
+    packetStream >> replicaGroup >> sequence >> request >> rootOctalCode;
+    if (packetStream.status() != QDataStream::Ok || rootOctalCode.isEmpty()
+            || numberOfThreeBitSectionsInCode((const unsigned char*)rootOctalCode.constData(), rootOctalCode.size())
+                == OVERFLOWED_OCTCODE_BUFFER) {
+        return;
+    }
+    if (!isFromServer(replicaUUID, senderSockAddr, _serverType)) {
+        return;
+    }
+
+    // servers taking over a subtree don't name a group, and apply their own edits to everything but the subtree,
+    // whose edits come to us until it's theirs
+    if (replicaGroup.isEmpty()) {
+        if (replicaUUID != _handoffTargetUUID || rootOctalCode != _handoffRootOctalCode) {
+            return; // the domain-server isn't moving that subtree of ours to that server
+        }
+        _replicasMutex.lock();
+        if (!_handoffs.contains(replicaUUID)) {
+            qDebug() << "Server" << replicaUUID << "at" << senderSockAddr << "is taking over subtree"
+                << octalCodeToHexString((const unsigned char*)rootOctalCode.constData());
+        }
+        Replica& handoff = _handoffs[replicaUUID];
+        handoff.sockAddr = senderSockAddr;
+        handoff.rootOctalCode = rootOctalCode;
+        handoff.lastHeard = usecTimestampNow();
+        _replicasMutex.unlock();
+
+    } else {
+        if (replicaGroup != _replicaGroup) {
+            return; // a replica of another group, looking for its authority
+        }
+        _replicasMutex.lock();
+        if (!_replicas.contains(replicaUUID)) {
+            qDebug() << "Replica" << replicaUUID << "at" << senderSockAddr << "joined replica group" << _replicaGroup;
+        }
+        Replica& replica = _replicas[replicaUUID];
+        replica.sockAddr = senderSockAddr;
+        replica.lastHeard = usecTimestampNow();
+        _replicasMutex.unlock();
+    }
+
+    // replies to requests for layers of big elements can be more than a packet, and are fragmented on their way
+    QByteArray replyPacket = byteArrayWithPopluatedHeader(PacketTypeOctreeSyncReply);
+    QDataStream replyStream(&replyPacket, QIODevice::Append);
+    replyStream << sequence << _syncSource.handleRequest(request);
+    NodeList::getInstance()->getNodeSocket().writeDatagram(replyPacket, senderSockAddr.getAddress(),
+                                                           senderSockAddr.getPort());
+}
+
+void OctreeReplicator::forwardEditPacket(const QByteArray& packet) {
+    QMutexLocker locker(&_replicasMutex);
+    quint64 now = usecTimestampNow();
+    QHash<QUuid, Replica>::iterator replica = _replicas.begin();
+    while (replica != _replicas.end()) {
+        if (now - replica->lastHeard > REPLICA_SILENCE_THRESHOLD_USECS) {
+            qDebug() << "Replica" << replica.key() << "left replica group" << _replicaGroup;
+            replica = _replicas.erase(replica);
+            continue;
+        }
+        NodeList::getInstance()->getNodeSocket().writeDatagram(packet, replica->sockAddr.getAddress(),
+                                                               replica->sockAddr.getPort());
+        ++replica;
+    }
+
+    QHash<QUuid, Replica>::iterator handoff = _handoffs.begin();
+    while (handoff != _handoffs.end()) {
+        if (now - handoff->lastHeard > REPLICA_SILENCE_THRESHOLD_USECS) {
+            qDebug() << "Server" << handoff.key() << "is done taking over subtree"
+                << octalCodeToHexString((const unsigned char*)handoff->rootOctalCode.constData());
+            handoff = _handoffs.erase(handoff);
+            continue;
+        }
+        QByteArray insidePacket;
+        QByteArray outsidePacket;
+        if (_tree->splitEditPacket(packet, (const unsigned char*)handoff->rootOctalCode.constData(),
+                                   insidePacket, outsidePacket) && !insidePacket.isEmpty()) {
+            NodeList::getInstance()->getNodeSocket().writeDatagram(insidePacket, handoff->sockAddr.getAddress(),
+                                                                   handoff->sockAddr.getPort());
+        }
+        ++handoff;
+    }
+}
+
+bool OctreeReplicator::isReplicaAddress(const HifiSockAddr& sockAddr) {
+    QMutexLocker locker(&_replicasMutex);
+    foreach (const Replica& replica, _replicas) {
+        if (replica.sockAddr == sockAddr) {
+            return true;
+        }
+    }
+    foreach (const Replica& handoff, _handoffs) {
+        if (handoff.sockAddr == sockAddr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int OctreeReplicator::getReplicaCount() {
+    QMutexLocker locker(&_replicasMutex);
+    return _replicas.size();
+}
+
+OctreeReplica::OctreeReplica(Octree* tree, const QString& replicaGroup, NodeType_t serverType) :
+    _replicaGroup(replicaGroup),
+    _rootOctalCode(1, 0),
+    _serverType(serverType),
+    _syncTarget(tree, INT_MAX, REPLICA_SYNC_CODES_PER_REQUEST), // never whole subtrees, which may not fit a packet
+    _pendingSequence(0),
+    _pendingSentAt(0),
+    _syncFinishedAt(0),
+    _synced(false),
+    _syncsCompleted(0)
+{
+    init();
+}
+
+OctreeReplica::OctreeReplica(Octree* tree, const QUuid& handoffSourceUUID, const QByteArray& handoffRootOctalCode,
+                             NodeType_t serverType) :
+    _rootOctalCode(handoffRootOctalCode),
+    _serverType(serverType),
+    _syncTarget(tree, INT_MAX, REPLICA_SYNC_CODES_PER_REQUEST),
+    _authorityUUID(handoffSourceUUID),
+    _pendingSequence(0),
+    _pendingSentAt(0),
+    _syncFinishedAt(0),
+    _synced(false),
+    _syncsCompleted(0)
+{
+    _syncTarget.setRootOctalCode(_rootOctalCode);
+    init();
+}
+
+void OctreeReplica::init() {
+    connect(NodeList::getInstance(), SIGNAL(nodeKilled(SharedNodePointer)), this, SLOT(nodeKilled(SharedNodePointer)));
+
+    QTimer* syncTimer = new QTimer(this);
+    connect(syncTimer, SIGNAL(timeout()), this, SLOT(sendNextSyncRequest()));
+    syncTimer->start(REPLICA_SYNC_INTERVAL_MSECS);
+}
+
+void OctreeReplica::processSyncReply(const QByteArray& packet, const HifiSockAddr& senderSockAddr) {
+    QUuid senderUUID;
+    deconstructPacketHeader(packet, senderUUID);
+    if ((hasAuthority() && senderUUID != _authorityUUID) || !isFromServer(senderUUID, senderSockAddr, _serverType)) {
+        return;
+    }
+
+    QDataStream packetStream(packet);
+    packetStream.skipRawData(numBytesForPacketHeader(packet));
+    quint32 sequence;
+    QByteArray reply;
+    packetStream >> sequence >> reply;
+    if (packetStream.status() != QDataStream::Ok || _pendingRequest.isEmpty() || sequence != _pendingSequence) {
+        return; // the answer to a request we've since asked again, and had answered
+    }
+
+    if (!hasAuthority()) {
+        _authorityUUID = senderUUID;
+        qDebug() << "Replicating replica group" << _replicaGroup << "from" << senderUUID << "at" << senderSockAddr;
+    }
+    _pendingRequest.clear();
+
+    // a reply that can't be read is asked for again with the next request
+    if (_syncTarget.handleReply(reply) && _syncTarget.isFinished()) {
+        _syncFinishedAt = usecTimestampNow();
+        _syncsCompleted++;
+        if (!_synced) {
+            qDebug() << "Subtree" << octalCodeToHexString((const unsigned char*)_rootOctalCode.constData())
+                << "is in sync with" << _authorityUUID << "after" << _syncTarget.getElementsCompared()
+                << "elements compared and" << _syncTarget.getBytesReceived() << "bytes received.";
+            _synced = true;
+        }
+    }
+}
+
+bool OctreeReplica::isAuthorityAddress(const HifiSockAddr& sockAddr) const {
+    SharedNodePointer authority = getAuthority();
+    return authority && (sockAddr == authority->getPublicSocket() || sockAddr == authority->getLocalSocket());
+}
+
+bool OctreeReplica::forwardEditPacket(const QByteArray& packet) {
+    SharedNodePointer authority = getAuthority();
+    if (!authority || !authority->getActiveSocket()) {
+        return false;
+    }
+    const HifiSockAddr* socket = authority->getActiveSocket();
+    NodeList::getInstance()->getNodeSocket().writeDatagram(packet, socket->getAddress(), socket->getPort());
+    return true;
+}
+
+void OctreeReplica::nodeKilled(SharedNodePointer node) {
+    if (node->getUUID() != _authorityUUID) {
+        return;
+    }
+    _authorityUUID = QUuid();
+    _pendingRequest.clear();
+    if (_replicaGroup.isEmpty()) {
+        qDebug() << "The server a subtree was being taken over from went away.";
+        return;
+    }
+    // a new authority may have a different tree, so compare all of it again
+    qDebug() << "Replica lost its authority, looking for another.";
+    _syncTarget.restart();
+    _synced = false;
+}
+
+void OctreeReplica::sendNextSyncRequest() {
+    quint64 now = usecTimestampNow();
+    if (_pendingRequest.isEmpty()) {
+        if (_syncTarget.isFinished()) {
+            if (now - _syncFinishedAt < REPLICA_RESYNC_INTERVAL_USECS) {
+                return;
+            }
+            _syncTarget.restart();
+        }
+        _pendingRequest = _syncTarget.getNextRequest();
+        if (_pendingRequest.isEmpty()) {
+            return;
+        }
+        _pendingSequence++;
+
+    } else if (now - _pendingSentAt < REPLICA_SYNC_REPLY_TIMEOUT_USECS) {
+        return; // still waiting for the reply
+    }
+    _pendingSentAt = now;
+
+    SharedNodePointer authority = getAuthority();
+    if (authority) {
+        sendSyncRequest(authority);
+        return;
+    }
+    if (_replicaGroup.isEmpty()) {
+        return; // the source of a handoff isn't looked for
+    }
+    // ask every server of our type, the authority of our group is the one that answers
+    foreach (const SharedNodePointer& node, NodeList::getInstance()->getNodeHash()) {
+        if (node->getType() == _serverType) {
+            sendSyncRequest(node);
+        }
+    }
+}
+
+SharedNodePointer OctreeReplica::getAuthority() const {
+    return hasAuthority() ? NodeList::getInstance()->nodeWithUUID(_authorityUUID) : SharedNodePointer();
+}
+
+void OctreeReplica::sendSyncRequest(const SharedNodePointer& server) {
+    const HifiSockAddr* socket = server->getActiveSocket();
+    if (!socket) {
+        return; // we haven't reached it yet, the request is sent again when the reply times out
+    }
+    QByteArray packet = byteArrayWithPopluatedHeader(PacketTypeOctreeSyncRequest);
+    QDataStream packetStream(&packet, QIODevice::Append);
+    packetStream << _replicaGroup << _pendingSequence << _pendingRequest << _rootOctalCode;
+    NodeList::getInstance()->getNodeSocket().writeDatagram(packet, socket->getAddress(), socket->getPort());
+}
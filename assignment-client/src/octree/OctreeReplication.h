@@ -0,0 +1,149 @@
+//
+//  OctreeReplication.h
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Lets one octree server hand out its tree to read only replicas, so that viewers of a jurisdiction can be spread
+//  over several servers.
+//
+
+#ifndef __hifi__OctreeReplication__
+#define __hifi__OctreeReplication__
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QUuid>
+
+#include <HifiSockAddr.h>
+#include <NodeList.h>
+#include <OctreeSync.h>
+
+class Octree;
+
+/// how often a replica sends its authority the next sync request, or asks again for one that went unanswered
+const int REPLICA_SYNC_INTERVAL_MSECS = 10;
+
+/// how long a replica waits for the reply to a sync request before asking again
+const quint64 REPLICA_SYNC_REPLY_TIMEOUT_USECS = 500 * 1000;
+
+/// how long a replica waits after bringing its tree up to date before comparing it with its authority's again, which
+/// repairs the edits it missed
+const quint64 REPLICA_RESYNC_INTERVAL_USECS = 5 * 1000 * 1000;
+
+/// how long an authority keeps streaming edits to a replica that has stopped syncing with it
+const quint64 REPLICA_SILENCE_THRESHOLD_USECS = 15 * 1000 * 1000;
+
+/// Few enough codes that the hashes of their children fit in one packet. Replicas never ask for whole subtrees, which
+/// could be too big for a packet, only for the layers that differ.
+const int REPLICA_SYNC_CODES_PER_REQUEST = 8;
+
+/// Runs on every octree server. Answers the sync requests of servers taking over a subtree from it, and on the
+/// authoritative server of a replica group, those of its replicas, and streams both the edits it applies, the former
+/// only those to their subtree. Replicas and servers taking over are known by the sync requests they send, so one that
+/// stops syncing is dropped. Requests are only answered from servers of our type at the address the domain-server
+/// knows them by, and a subtree is only handed to the server the domain-server names as taking it over.
+class OctreeReplicator {
+public:
+    /// the replica group is empty on servers that aren't the authority of one
+    OctreeReplicator(Octree* tree, const QString& replicaGroup, NodeType_t serverType);
+
+    const QString& getReplicaGroup() const { return _replicaGroup; }
+
+    /// Names the server the domain-server is moving a subtree of our jurisdiction to, or none if the UUID is null.
+    void setHandoffTarget(const QUuid& targetUUID, const QByteArray& rootOctalCode);
+    const QUuid& getHandoffTarget() const { return _handoffTargetUUID; }
+
+    /// Answers a PacketTypeOctreeSyncRequest from a replica of the group, or from a server taking over a subtree.
+    void processSyncRequest(const QByteArray& packet, const HifiSockAddr& senderSockAddr);
+
+    /// Sends an edit packet that has been applied to the tree on to every replica, and the edits in it to a subtree
+    /// being taken over on to the server taking it over. Called on the thread that applies edits.
+    void forwardEditPacket(const QByteArray& packet);
+
+    /// whether a packet came from one of the replicas or servers taking over a subtree, which pass on the edits of the
+    /// viewers they serve
+    bool isReplicaAddress(const HifiSockAddr& sockAddr);
+
+    int getReplicaCount();
+
+private:
+    class Replica {
+    public:
+        HifiSockAddr sockAddr;
+        QByteArray rootOctalCode;
+        quint64 lastHeard;
+    };
+
+    Octree* _tree;
+    QString _replicaGroup;
+    NodeType_t _serverType;
+    OctreeSyncSource _syncSource;
+    QUuid _handoffTargetUUID;
+    QByteArray _handoffRootOctalCode;
+
+    QMutex _replicasMutex; // guards the replicas and handoffs, which edits are forwarded to on the inbound packet thread
+    QHash<QUuid, Replica> _replicas;
+    QHash<QUuid, Replica> _handoffs; // the servers taking over a subtree from us
+};
+
+/// Runs on a read only replica. Finds the authoritative server of its group among the servers of its type, keeps its
+/// tree up to date with the authority's by syncing with it, and passes the edits of its viewers on to it. Edits come
+/// back to it from the authority once they're applied, like they do to every other replica.
+///
+/// Also runs on a server taking over a subtree from another when jurisdictions are split or merged, in which case the
+/// other server is the authority, only the subtree is synced, and the server applies its own edits.
+class OctreeReplica : public QObject {
+    Q_OBJECT
+public:
+    OctreeReplica(Octree* tree, const QString& replicaGroup, NodeType_t serverType);
+
+    /// takes over the subtree under an element from a server, which isn't looked for again if it goes away
+    OctreeReplica(Octree* tree, const QUuid& handoffSourceUUID, const QByteArray& handoffRootOctalCode,
+                  NodeType_t serverType);
+
+    /// Applies a PacketTypeOctreeSyncReply from the authority.
+    void processSyncReply(const QByteArray& packet, const HifiSockAddr& senderSockAddr);
+
+    /// whether a packet came from the authority, in which case it's an edit the authority has applied
+    bool isAuthorityAddress(const HifiSockAddr& sockAddr) const;
+
+    /// Sends an edit from one of our viewers to the authority. Returns false if we haven't found the authority yet.
+    bool forwardEditPacket(const QByteArray& packet);
+
+    bool hasAuthority() const { return !_authorityUUID.isNull(); }
+    const QUuid& getAuthorityUUID() const { return _authorityUUID; }
+    const QByteArray& getRootOctalCode() const { return _rootOctalCode; }
+    bool isSynced() const { return _synced; }
+    int getSyncsCompleted() const { return _syncsCompleted; }
+    const OctreeSyncTarget& getSyncTarget() const { return _syncTarget; }
+
+public slots:
+    /// Called by NodeList to inform us that a node has been killed.
+    void nodeKilled(SharedNodePointer node);
+
+private slots:
+    void sendNextSyncRequest();
+
+private:
+    void init();
+    SharedNodePointer getAuthority() const;
+    void sendSyncRequest(const SharedNodePointer& server);
+
+    QString _replicaGroup; // empty for a handoff
+    QByteArray _rootOctalCode;
+    NodeType_t _serverType;
+    OctreeSyncTarget _syncTarget;
+
+    QUuid _authorityUUID;
+    QByteArray _pendingRequest;
+    quint32 _pendingSequence;
+    quint64 _pendingSentAt;
+    quint64 _syncFinishedAt;
+    bool _synced;
+    int _syncsCompleted;
+};
+
+#endif /* defined(__hifi__OctreeReplication__) */
@@ -9,6 +9,7 @@
 #include <PacketHeaders.h>
 #include <PerfStat.h>
 #include <SharedUtil.h>
+#include <Trace.h>
 
 #include "OctreeSendThread.h"
 #include "OctreeServer.h"
@@ -20,59 +21,52 @@ quint64 endSceneSleepTime = 0;
 OctreeSendThread::OctreeSendThread(const QUuid& nodeUUID, OctreeServer* myServer) :
     _nodeUUID(nodeUUID),
     _myServer(myServer),
-    _packetData()
+    _packetData(),
+    _sendScheduler("OctreeSendThread", OCTREE_SEND_INTERVAL_USECS)
 {
 }
 
 bool OctreeSendThread::process() {
-    quint64  start = usecTimestampNow();
     bool gotLock = false;
 
-    // don't do any send processing until the initial load of the octree is complete...
-    if (_myServer->isInitialLoadComplete()) {
-        SharedNodePointer node = NodeList::getInstance()->nodeWithUUID(_nodeUUID);
+    // the octree is sent while it's loading, the loader publishes it coarse levels first and then the parts near
+    // viewers first, so viewers see it fill in rather than wait for all of it
+    SharedNodePointer node = NodeList::getInstance()->nodeWithUUID(_nodeUUID);
 
-        if (node) {
-            // make sure the node list doesn't kill our node while we're using it
-            if (node->getMutex().tryLock()) {
-                gotLock = true;
-                OctreeQueryNode* nodeData = NULL;
+    if (node) {
+        // make sure the node list doesn't kill our node while we're using it
+        if (node->getMutex().tryLock()) {
+            gotLock = true;
+            OctreeQueryNode* nodeData = NULL;
 
-                nodeData = (OctreeQueryNode*) node->getLinkedData();
+            nodeData = (OctreeQueryNode*) node->getLinkedData();
 
-                int packetsSent = 0;
+            int packetsSent = 0;
 
-                // Sometimes the node data has not yet been linked, in which case we can't really do anything
-                if (nodeData) {
-                    bool viewFrustumChanged = nodeData->updateCurrentViewFrustum();
-                    if (_myServer->wantsDebugSending() && _myServer->wantsVerboseDebug()) {
-                        printf("nodeData->updateCurrentViewFrustum() changed=%s\n", debug::valueOf(viewFrustumChanged));
-                    }
-                    packetsSent = packetDistributor(node.data(), nodeData, viewFrustumChanged);
+            // Sometimes the node data has not yet been linked, in which case we can't really do anything
+            if (nodeData) {
+                bool viewFrustumChanged = nodeData->updateCurrentViewFrustum();
+                if (_myServer->wantsDebugSending() && _myServer->wantsVerboseDebug()) {
+                    printf("nodeData->updateCurrentViewFrustum() changed=%s\n", debug::valueOf(viewFrustumChanged));
                 }
-
-                node->getMutex().unlock(); // we're done with this node for now.
+                packetsSent = packetDistributor(node.data(), nodeData, viewFrustumChanged);
             }
-        }
-    } else {
-        if (_myServer->wantsDebugSending() && _myServer->wantsVerboseDebug()) {
-            qDebug("OctreeSendThread::process() waiting for isInitialLoadComplete()");
+
+            node->getMutex().unlock(); // we're done with this node for now.
         }
     }
 
     // Only sleep if we're still running and we got the lock last time we tried, otherwise try to get the lock asap
     if (isStillRunning() && gotLock) {
-        // dynamically sleep until we need to fire off the next set of octree elements
-        int elapsed = (usecTimestampNow() - start);
-        int usecToSleep =  OCTREE_SEND_INTERVAL_USECS - elapsed;
-
-        if (usecToSleep > 0) {
+        // sleep until we need to fire off the next set of octree elements
+        bool isOnSchedule;
+        {
             PerformanceWarning warn(false,"OctreeSendThread... usleep()",false,&_usleepTime,&_usleepCalls);
-            usleep(usecToSleep);
-        } else {
-            if (_myServer->wantsDebugSending() && _myServer->wantsVerboseDebug()) {
-                std::cout << "Last send took too much time, not sleeping!\n";
-            }
+            isOnSchedule = _sendScheduler.waitForNextFrame();
+        }
+
+        if (!isOnSchedule && _myServer->wantsDebugSending() && _myServer->wantsVerboseDebug()) {
+            std::cout << "Last send took too much time, not sleeping!\n";
         }
     }
 
@@ -85,8 +79,10 @@ quint64 OctreeSendThread::_usleepCalls = 0;
 quint64 OctreeSendThread::_totalBytes = 0;
 quint64 OctreeSendThread::_totalWastedBytes = 0;
 quint64 OctreeSendThread::_totalPackets = 0;
+quint64 OctreeSendThread::_totalEncodeTime = 0;
 
 int OctreeSendThread::handlePacketSend(Node* node, OctreeQueryNode* nodeData, int& trueBytesSent, int& truePacketsSent) {
+    TRACE_SCOPE("octree packet send");
     bool debug = _myServer->wantsDebugSending();
     quint64 now = usecTimestampNow();
 
@@ -219,6 +215,7 @@ int OctreeSendThread::handlePacketSend(Node* node, OctreeQueryNode* nodeData, in
 
 /// Version of voxel distributor that sends the deepest LOD level at once
 int OctreeSendThread::packetDistributor(Node* node, OctreeQueryNode* nodeData, bool viewFrustumChanged) {
+    TRACE_SCOPE("octree packet distributor");
     bool forceDebugging = false;
 
     int truePacketsSent = 0;
@@ -364,8 +361,27 @@ int OctreeSendThread::packetDistributor(Node* node, OctreeQueryNode* nodeData, b
                 << " Wasted:" << _totalWastedBytes;
         }
 
+        // the subtrees the client has cached are checked against the whole scene, so take them as the scene starts
+        _cachedSubtrees = nodeData->getCachedSubtrees();
+
         ::startSceneSleepTime = _usleepTime;
-        nodeData->stats.sceneStarted(isFullScene, viewFrustumChanged, _myServer->getOctree()->getRoot(), _myServer->getJurisdiction());
+
+        // the stats copy the jurisdiction's codes, which the server replaces with the tree locked for writing
+        _myServer->getOctree()->lockForRead();
+        nodeData->stats.sceneStarted(isFullScene, viewFrustumChanged, _myServer->getOctree()->getRoot(),
+                                     _myServer->getJurisdiction());
+        _myServer->getOctree()->unlock();
+
+        // while the octree is loading, load what's near this viewer first
+        if (!_myServer->isInitialLoadComplete()) {
+            _myServer->getOctree()->setLoadFocus(_nodeUUID, nodeData->getCurrentViewFrustum().getOffsetPosition());
+        }
+
+        // what this view reaches is paged in by the persist thread, so later scenes have it
+        OctreePager* pager = _myServer->getOctree()->getPager();
+        if (pager) {
+            pager->touchInView(nodeData->getCurrentViewFrustum());
+        }
 
         // This is the start of "resending" the scene.
         bool dontRestartSceneOnMove = false; // this is experimental
@@ -424,11 +440,21 @@ int OctreeSendThread::packetDistributor(Node* node, OctreeQueryNode* nodeData, b
                                              wantOcclusionCulling, coverageMap, boundaryLevelAdjust, voxelSizeScale,
                                              nodeData->getLastTimeBagEmpty(),
                                              isFullScene, &nodeData->stats, _myServer->getJurisdiction());
+                params.cachedSubtrees = &_cachedSubtrees;
 
 
-                _myServer->getOctree()->lockForRead();
+                {
+                    TRACE_SCOPE("octree lock wait");
+                    _myServer->getOctree()->lockForRead();
+                }
                 nodeData->stats.encodeStarted();
-                bytesWritten = _myServer->getOctree()->encodeTreeBitstream(subTree, &_packetData, nodeData->nodeBag, params);
+                {
+                    TRACE_SCOPE("octree encode");
+                    quint64 encodeStart = usecTimestampNow();
+                    bytesWritten = _myServer->getOctree()->encodeTreeBitstream(subTree, &_packetData, nodeData->nodeBag,
+                                                                               params);
+                    _totalEncodeTime += usecTimestampNow() - encodeStart;
+                }
 
                 // If after calling encodeTreeBitstream() there are no nodes left to send, then we know we've
                 // sent the entire scene. We want to know this below so we'll actually write this content into
@@ -10,6 +10,7 @@
 #ifndef __octree_server__OctreeSendThread__
 #define __octree_server__OctreeSendThread__
 
+#include <FrameScheduler.h>
 #include <GenericThread.h>
 #include <NetworkPacket.h>
 #include <OctreeElementBag.h>
@@ -24,6 +25,7 @@ public:
     static quint64 _totalBytes;
     static quint64 _totalWastedBytes;
     static quint64 _totalPackets;
+    static quint64 _totalEncodeTime; // usecs spent encoding, over all send threads
 
     static quint64 _usleepTime;
     static quint64 _usleepCalls;
@@ -40,6 +42,8 @@ private:
     int packetDistributor(Node* node, OctreeQueryNode* nodeData, bool viewFrustumChanged);
 
     OctreePacketData _packetData;
+    OctreeCachedSubtrees _cachedSubtrees; // what the client has cached as of the start of the scene being sent
+    FrameScheduler _sendScheduler;
 };
 
 #endif // __octree_server__OctreeSendThread__
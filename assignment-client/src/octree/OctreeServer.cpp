@@ -13,6 +13,9 @@
 #include <time.h>
 #include <HTTPConnection.h>
 #include <Logging.h>
+#include <OctalCode.h>
+#include <OctreeServerLoad.h>
+#include <Trace.h>
 #include <UUID.h>
 
 #include "OctreeServer.h"
@@ -44,6 +47,13 @@ OctreeServer::OctreeServer(const QByteArray& packet) :
     _jurisdictionSender(NULL),
     _octreeInboundPacketProcessor(NULL),
     _persistThread(NULL),
+    _pager(NULL),
+    _replicator(NULL),
+    _replica(NULL),
+    _handoff(NULL),
+    _lastLoadReportAt(0),
+    _lastLoadEncodeTime(0),
+    _lastLoadEditsProcessed(0),
     _started(time(0)),
     _startedUSecs(usecTimestampNow())
 {
@@ -73,6 +83,19 @@ OctreeServer::~OctreeServer() {
         _persistThread->deleteLater();
     }
 
+    delete _replicator;
+    _replicator = NULL;
+    delete _replica;
+    _replica = NULL;
+    delete _handoff;
+    _handoff = NULL;
+
+    if (_pager) {
+        _tree->setPager(NULL);
+        delete _pager;
+        _pager = NULL;
+    }
+
     delete _jurisdiction;
     _jurisdiction = NULL;
 
@@ -116,6 +139,20 @@ bool OctreeServer::handleHTTPRequest(HTTPConnection* connection, const QString&
         } else if (path == "/resetStats") {
             _octreeInboundPacketProcessor->resetStats();
             showStats = true;
+        } else if (path == "/trace/start") {
+            // start from an empty trace so the dump only covers what happened since
+            Trace::clear();
+            Trace::setEnabled(true);
+            connection->respond(HTTPConnection::StatusCode200, "Tracing started.\r\n", "text/plain");
+            return true;
+        } else if (path == "/trace/stop") {
+            Trace::setEnabled(false);
+            connection->respond(HTTPConnection::StatusCode200, "Tracing stopped.\r\n", "text/plain");
+            return true;
+        } else if (path == "/trace.json") {
+            // load this in chrome://tracing
+            connection->respond(HTTPConnection::StatusCode200, Trace::toChromeTraceJSON(), "application/json");
+            return true;
         }
     }
 
@@ -193,7 +230,28 @@ bool OctreeServer::handleHTTPRequest(HTTPConnection* connection, const QString&
             statsString += "\r\n";
 
         } else {
-            statsString += "Voxels not yet loaded...\r\n";
+            // the tree is sent as it loads, so say how far along it is
+            quint64 msecsElapsed = getLoadElapsedTime() / USECS_PER_MSEC;
+            statsString += QString().sprintf("%s File Loading... %d%% loaded after %.3f seconds\r\n",
+                                             getMyServerName(), getLoadProgress(), (float)msecsElapsed / MSECS_PER_SEC);
+        }
+
+        if (_replicator && !_replicator->getReplicaGroup().isEmpty()) {
+            statsString += QString("Authority of a replica group, streaming edits to %1 replicas\r\n")
+                .arg(_replicator->getReplicaCount());
+        } else if (_replica) {
+            const OctreeSyncTarget& sync = _replica->getSyncTarget();
+            statsString += QString("Replica %1, %2 syncs with the authority completed\r\n")
+                .arg(!_replica->hasAuthority() ? "looking for its authority"
+                     : _replica->isSynced() ? "in sync" : "catching up").arg(_replica->getSyncsCompleted());
+            statsString += QString("    current sync: %1 elements compared, %2 layers received, %3 bytes received\r\n")
+                .arg(sync.getElementsCompared()).arg(sync.getLayersReceived()).arg(sync.getBytesReceived());
+        }
+        if (_handoff) {
+            statsString += QString("Taking over subtree %1 from %2, %3\r\n")
+                .arg(octalCodeToHexString((const unsigned char*)_handoff->getRootOctalCode().constData()))
+                .arg(uuidStringWithoutCurlyBraces(_handoff->getAuthorityUUID()))
+                .arg(_handoff->isSynced() ? "in sync" : "catching up");
         }
 
         statsString += "\r\n\r\n";
@@ -224,6 +282,32 @@ bool OctreeServer::handleHTTPRequest(HTTPConnection* connection, const QString&
         statsString += "\r\n";
         statsString += "\r\n";
 
+        // display paging stats
+        if (_pager) {
+            const float BYTES_PER_MB = 1024.0f * 1024.0f;
+            quint64 pageIns = _pager->getPageIns();
+            quint64 pageOuts = _pager->getPageOuts();
+            statsString += "<b>Paging:</b>\r\n";
+            statsString += QString().sprintf("     Memory Budget: %8.2f MB\r\n", _pager->getMemoryBudget() / BYTES_PER_MB);
+            statsString += QString().sprintf("      Memory Usage: %8.2f MB\r\n",
+                                             OctreeElement::getTotalMemoryUsage() / BYTES_PER_MB);
+            statsString += QString("    Resident Pages: %1 of %2 pages\r\n")
+                .arg(locale.toString(_pager->getResidentPageCount()).rightJustified(16, ' '))
+                .arg(locale.toString(_pager->getPageCount()));
+            statsString += QString("          Page Ins: %1 pages\r\n")
+                .arg(locale.toString((uint)pageIns).rightJustified(16, ' '));
+            statsString += QString("         Page Outs: %1 pages\r\n")
+                .arg(locale.toString((uint)pageOuts).rightJustified(16, ' '));
+            statsString += QString("       Page Faults: %1 pages (page ins edits waited for)\r\n")
+                .arg(locale.toString((uint)_pager->getPageFaults()).rightJustified(16, ' '));
+            statsString += QString().sprintf("   Average Page In: %8.2f msecs\r\n",
+                                             pageIns ? (float)_pager->getPageInUsecs() / pageIns / USECS_PER_MSEC : 0.0f);
+            statsString += QString().sprintf("  Average Page Out: %8.2f msecs\r\n",
+                                             pageOuts ? (float)_pager->getPageOutUsecs() / pageOuts / USECS_PER_MSEC : 0.0f);
+            statsString += "\r\n";
+            statsString += "\r\n";
+        }
+
         // display outbound packet stats
         statsString += QString("<b>%1 Outbound Packet Statistics...</b>\r\n").arg(getMyServerName());
         quint64 totalOutboundPackets = OctreeSendThread::_totalPackets;
@@ -490,8 +574,44 @@ void OctreeServer::processDatagram(const QByteArray& dataByteArray, const HifiSo
         }
     } else if (packetType == PacketTypeJurisdictionRequest) {
         _jurisdictionSender->queueReceivedPacket(senderSockAddr, dataByteArray);
+    } else if (packetType == PacketTypeOctreeSyncRequest) {
+        if (_replicator) {
+            _replicator->processSyncRequest(dataByteArray, senderSockAddr);
+        }
+    } else if (packetType == PacketTypeOctreeSyncReply) {
+        if (_replica) {
+            _replica->processSyncReply(dataByteArray, senderSockAddr);
+        }
+        if (_handoff) {
+            _handoff->processSyncReply(dataByteArray, senderSockAddr);
+        }
+    } else if (packetType == PacketTypeJurisdictionUpdate) {
+        if (senderSockAddr.getAddress() == nodeList->getDomainIP()
+            && senderSockAddr.getPort() == nodeList->getDomainPort()) {
+            updateJurisdiction(dataByteArray);
+        }
     } else if (_octreeInboundPacketProcessor && getOctree()->handlesEditPacketType(packetType)) {
-       _octreeInboundPacketProcessor->queueReceivedPacket(senderSockAddr, dataByteArray);
+        QByteArray insidePacket;
+        QByteArray outsidePacket;
+        if (_replica && !_replica->isAuthorityAddress(senderSockAddr)) {
+            // replicas are read only, the authority applies the edit and streams it back to us
+            if (!_replica->forwardEditPacket(dataByteArray)) {
+                qDebug() << "Dropped an edit since the replica hasn't found its authority.";
+            }
+        } else if (_handoff && !_handoff->isAuthorityAddress(senderSockAddr)
+                   && getOctree()->splitEditPacket(dataByteArray,
+                        (const unsigned char*)_handoff->getRootOctalCode().constData(), insidePacket, outsidePacket)) {
+            // the server we're taking a subtree over from applies its edits until the handoff is over, and passes them
+            // back to us, so that neither of us misses the ones made while the subtree is synced
+            if (!insidePacket.isEmpty() && !_handoff->forwardEditPacket(insidePacket)) {
+                _octreeInboundPacketProcessor->queueReceivedPacket(senderSockAddr, insidePacket);
+            }
+            if (!outsidePacket.isEmpty()) {
+                _octreeInboundPacketProcessor->queueReceivedPacket(senderSockAddr, outsidePacket);
+            }
+        } else {
+            _octreeInboundPacketProcessor->queueReceivedPacket(senderSockAddr, dataByteArray);
+        }
    } else {
        // let processNodeData handle it.
        NodeList::getInstance()->processNodeData(senderSockAddr, dataByteArray);
@@ -551,9 +671,15 @@ void OctreeServer::run() {
     NodeList* nodeList = NodeList::getInstance();
     nodeList->setOwnerType(getMyNodeType());
 
+    // a server config from the domain-server can ask for an emulated WAN link (e.g. --netImpair latency=80,loss=0.01)
+    nodeList->getNodeSocket().parseImpairmentArguments(_argc, _argv);
+
     // we need to ask the DS about agents so we can ping/reply with them
     nodeList->addNodeTypeToInterestSet(NodeType::Agent);
 
+    // and about the other servers of our type, which are the only ones whose syncs we answer
+    nodeList->addNodeTypeToInterestSet(getMyNodeType());
+
     setvbuf(stdout, NULL, _IOLBF, 0);
 
     nodeList->linkedDataCreateCallback = &OctreeServer::attachQueryNodeToNode;
@@ -577,6 +703,24 @@ void OctreeServer::run() {
     if (cmdOptionExists(_argc, _argv, NO_PERSIST)) {
         _wantPersist = false;
     }
+
+    // servers of a replica group serve the same jurisdiction, one of them applies the edits and the replicas copy its
+    // tree, so that the domain-server can spread the group's viewers over all of them
+    const char* REPLICA_GROUP = "--replicaGroup";
+    const char* replicaGroup = getCmdOption(_argc, _argv, REPLICA_GROUP);
+    const char* REPLICA = "--replica";
+    if (replicaGroup && cmdOptionExists(_argc, _argv, REPLICA)) {
+        // the authority's tree is the one that's persisted, and its averages are the ones that are synced
+        _wantPersist = false;
+        _tree->setShouldReaverage(false);
+        _replica = new OctreeReplica(_tree, replicaGroup, getMyNodeType());
+        qDebug("replica of replicaGroup=%s", replicaGroup);
+    } else if (replicaGroup) {
+        qDebug("authority of replicaGroup=%s", replicaGroup);
+    }
+
+    // every server answers the syncs of servers taking over a subtree from it
+    _replicator = new OctreeReplicator(_tree, replicaGroup && !_replica ? replicaGroup : "", getMyNodeType());
     qDebug("wantPersist=%s", debug::valueOf(_wantPersist));
 
     // if we want Persistence, set up the local file and persist thread
@@ -593,8 +737,23 @@ void OctreeServer::run() {
 
         qDebug("persistFilename=%s", _persistFilename);
 
-        // now set up PersistThread
-        _persistThread = new OctreePersistThread(_tree, _persistFilename);
+        // a memory budget pages the tree in and out of the persist file, so it needs one, and a tree whose edits page in
+        const char* MEMORY_BUDGET_MB = "--memoryBudgetMB";
+        const char* memoryBudgetMB = getCmdOption(_argc, _argv, MEMORY_BUDGET_MB);
+        if (memoryBudgetMB && !_tree->canBePaged()) {
+            qDebug("memoryBudgetMB=%s ignored, since the %s's edits can't page in the tree", memoryBudgetMB,
+                   getMyServerName());
+        } else if (memoryBudgetMB) {
+            const quint64 BYTES_PER_MB = 1024 * 1024;
+            quint64 memoryBudget = atoi(memoryBudgetMB) * BYTES_PER_MB;
+            _pager = new OctreePager(_tree, QString(_persistFilename) + ".pages", memoryBudget);
+            _tree->setPager(_pager);
+            qDebug("memoryBudgetMB=%s", memoryBudgetMB);
+        }
+
+        // now set up PersistThread, a chunked persist file is only loaded where it reaches into our jurisdiction
+        _persistThread = new OctreePersistThread(_tree, _persistFilename, OctreePersistThread::DEFAULT_PERSIST_INTERVAL,
+                                                 _jurisdiction);
         if (_persistThread) {
             _persistThread->initialize(true);
         }
@@ -659,4 +818,229 @@ void OctreeServer::run() {
     QTimer* pingNodesTimer = new QTimer(this);
     connect(pingNodesTimer, SIGNAL(timeout()), nodeList, SLOT(pingInactiveNodes()));
     pingNodesTimer->start(PING_INACTIVE_NODE_INTERVAL_USECS / 1000);
+
+    // the domain-server splits and merges jurisdictions by the load we report
+    _lastLoadReportAt = usecTimestampNow();
+    QTimer* loadReportTimer = new QTimer(this);
+    connect(loadReportTimer, SIGNAL(timeout()), this, SLOT(sendLoadToDomainServer()));
+    loadReportTimer->start(OCTREE_SERVER_LOAD_INTERVAL_MSECS);
+
+    // a replica has no persist thread to update its tree, and the sync only carries the changes the authority's viewers
+    // make, not what its update (such as the particle simulation) does between them, so we update it ourselves
+    if (_replica) {
+        const int REPLICA_UPDATE_INTERVAL_MSECS = 10; // as often as the authority's persist thread updates
+        QTimer* updateTimer = new QTimer(this);
+        connect(updateTimer, SIGNAL(timeout()), this, SLOT(updateTree()));
+        updateTimer->start(REPLICA_UPDATE_INTERVAL_MSECS);
+    }
+}
+
+void OctreeServer::updateTree() {
+    _tree->lockForWrite();
+    _tree->update();
+    _tree->unlock();
+}
+
+// Cameras are in meters, and the tree is in units of TREE_SCALE. Called with the tree locked.
+static bool isCameraInCode(const glm::vec3& cameraPosition, const unsigned char* octalCode) {
+    VoxelPositionSize box;
+    voxelDetailsForCode(octalCode, box);
+    glm::vec3 position = cameraPosition / (float)TREE_SCALE;
+    return position.x >= box.x && position.x < box.x + box.s && position.y >= box.y && position.y < box.y + box.s
+        && position.z >= box.z && position.z < box.z + box.s;
+}
+
+void OctreeServer::sendLoadToDomainServer() {
+    NodeList* nodeList = NodeList::getInstance();
+    if (nodeList->getOwnerUUID().isNull()) {
+        return; // the domain-server doesn't know us yet
+    }
+    if (_handoff && !_handoff->hasAuthority()) {
+        // the server we were taking a subtree over from went away, the domain-server will tell us what to do
+        delete _handoff;
+        _handoff = NULL;
+    }
+    deleteGivenUpSubtrees();
+
+    quint64 now = usecTimestampNow();
+    float elapsedUsecs = qMax(now - _lastLoadReportAt, (quint64)1);
+    _lastLoadReportAt = now;
+
+    OctreeServerLoad load;
+    quint64 encodeTime = OctreeSendThread::_totalEncodeTime;
+    load.encodeLoad = (encodeTime - _lastLoadEncodeTime) / elapsedUsecs;
+    _lastLoadEncodeTime = encodeTime;
+
+    // the processor's stats can be reset from the stats page
+    quint64 editsProcessed = _octreeInboundPacketProcessor->getTotalElementsProcessed();
+    quint64 edits = (editsProcessed >= _lastLoadEditsProcessed) ? editsProcessed - _lastLoadEditsProcessed
+        : editsProcessed;
+    load.editsPerSecond = edits * USECS_PER_SECOND / elapsedUsecs;
+    _lastLoadEditsProcessed = editsProcessed;
+
+    if (_jurisdiction) {
+        load.jurisdictionRoot = _jurisdiction->getRootHexString();
+        load.jurisdictionEndNodes = _jurisdiction->getEndNodeHexStrings();
+    }
+
+    // every viewer is sent the tree, but the ones whose cameras are in our jurisdiction are sent the most of it
+    QVector<glm::vec3> cameraPositions;
+    foreach (const SharedNodePointer& node, nodeList->getNodeHash()) {
+        OctreeQueryNode* nodeData = (OctreeQueryNode*) node->getLinkedData();
+        if (node->getType() == NodeType::Agent && nodeData && nodeData->isOctreeSendThreadInitalized()) {
+            cameraPositions << nodeData->getCameraPosition();
+        }
+    }
+    _tree->lockForRead();
+    foreach (const glm::vec3& cameraPosition, cameraPositions) {
+        bool inJurisdiction = true;
+        if (_jurisdiction) {
+            inJurisdiction = isCameraInCode(cameraPosition, _jurisdiction->getRootOctalCode());
+            for (int i = 0; inJurisdiction && i < _jurisdiction->getEndNodeCount(); i++) {
+                inJurisdiction = !isCameraInCode(cameraPosition, _jurisdiction->getEndNodeOctalCode(i));
+            }
+        }
+        if (inJurisdiction) {
+            load.viewers++;
+        }
+    }
+    if (_jurisdiction) {
+        load.busiestChild = findBusiestChild(cameraPositions);
+    }
+    _tree->unlock();
+
+    if (_handoff) {
+        load.handoffSource = _handoff->getAuthorityUUID();
+        load.handoffSynced = _handoff->isSynced();
+    }
+    load.handoffTarget = _replicator->getHandoffTarget();
+
+    QByteArray packet = byteArrayWithPopluatedHeader(PacketTypeOctreeServerLoad);
+    QDataStream packetStream(&packet, QIODevice::Append);
+    packetStream << load;
+    nodeList->getNodeSocket().writeDatagram(packet, nodeList->getDomainIP(), nodeList->getDomainPort());
+}
+
+QString OctreeServer::findBusiestChild(const QVector<glm::vec3>& cameraPositions) {
+    QString busiestChild;
+    int busiestChildViewers = 0;
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        unsigned char* childCode = childOctalCode(_jurisdiction->getRootOctalCode(), i);
+
+        // only a child that's wholly ours can be handed to another server
+        if (_jurisdiction->isMyJurisdiction(childCode, CHECK_NODE_ONLY) == JurisdictionMap::WITHIN) {
+            int viewers = 0;
+            foreach (const glm::vec3& cameraPosition, cameraPositions) {
+                if (isCameraInCode(cameraPosition, childCode)) {
+                    viewers++;
+                }
+            }
+            if (viewers > busiestChildViewers) {
+                busiestChild = octalCodeToHexString(childCode);
+                busiestChildViewers = viewers;
+            }
+        }
+        delete[] childCode;
+    }
+    return busiestChild;
+}
+
+// an empty string, as the handoff root of an update without a handoff is, makes an empty code
+static QByteArray hexStringToOctalCodeBytes(const QString& hexString) {
+    if (hexString.isEmpty()) {
+        return QByteArray();
+    }
+    unsigned char* octalCode = hexStringToOctalCode(hexString);
+    QByteArray bytes((const char*)octalCode, bytesRequiredForCodeLength(numberOfThreeBitSectionsInCode(octalCode)));
+    delete[] octalCode;
+    return bytes;
+}
+
+void OctreeServer::updateJurisdiction(const QByteArray& packet) {
+    if (!_jurisdiction) {
+        return; // we have the whole tree, which the domain-server never moves
+    }
+    QDataStream packetStream(packet);
+    packetStream.skipRawData(numBytesForPacketHeader(packet));
+    JurisdictionUpdate update;
+    packetStream >> update;
+    if (packetStream.status() != QDataStream::Ok) {
+        return;
+    }
+
+    // the update is sent until our load reports show it, so most of the time there's nothing to change
+    OctreeServerLoad current;
+    current.jurisdictionRoot = _jurisdiction->getRootHexString();
+    current.jurisdictionEndNodes = _jurisdiction->getEndNodeHexStrings();
+    current.handoffSource = update.handoffSource;
+    current.handoffTarget = update.handoffTarget;
+    if (!update.isShownBy(current)) {
+        qDebug() << "Jurisdiction changed to root" << update.root << "end nodes" << update.endNodes;
+
+        std::vector<unsigned char*> endNodes;
+        foreach (const QString& endNode, update.endNodes) {
+            endNodes.push_back(hexStringToOctalCode(endNode));
+        }
+        JurisdictionMap jurisdiction(hexStringToOctalCode(update.root), endNodes);
+        jurisdiction.setNodeType(getMyNodeType());
+
+        // the send threads and the persist thread read the jurisdiction with the tree locked
+        _tree->lockForWrite();
+        *_jurisdiction = jurisdiction;
+        _tree->unlock();
+
+        // subtrees we've handed to another server are kept for a while, in case it's still syncing them from us
+        quint64 deleteAt = usecTimestampNow() + GIVEN_UP_SUBTREE_GRACE_USECS;
+        foreach (const QString& endNode, update.endNodes) {
+            if (!current.jurisdictionEndNodes.contains(endNode, Qt::CaseInsensitive)) {
+                _givenUpSubtrees << qMakePair(deleteAt, hexStringToOctalCodeBytes(endNode));
+            }
+        }
+    }
+
+    // the domain-server names the server it's moving a subtree of ours to, which we only let sync what we have
+    QByteArray handoffRootOctalCode = hexStringToOctalCodeBytes(update.handoffRoot);
+    if (!update.handoffTarget.isNull() && !handoffRootOctalCode.isEmpty()
+        && _jurisdiction->isMyJurisdiction((const unsigned char*)handoffRootOctalCode.constData(), CHECK_NODE_ONLY)
+            == JurisdictionMap::WITHIN) {
+        _replicator->setHandoffTarget(update.handoffTarget, handoffRootOctalCode);
+    } else {
+        _replicator->setHandoffTarget(QUuid(), QByteArray());
+    }
+
+    if (update.handoffSource.isNull()) {
+        if (_handoff) {
+            qDebug() << "Finished taking over subtree"
+                << octalCodeToHexString((const unsigned char*)_handoff->getRootOctalCode().constData());
+            delete _handoff;
+            _handoff = NULL;
+        }
+        return;
+    }
+    if (!_handoff || _handoff->getAuthorityUUID() != update.handoffSource
+        || _handoff->getRootOctalCode() != handoffRootOctalCode) {
+        qDebug() << "Taking over subtree" << update.handoffRoot << "from" << update.handoffSource;
+        delete _handoff;
+        _handoff = new OctreeReplica(_tree, update.handoffSource, handoffRootOctalCode, getMyNodeType());
+    }
+}
+
+void OctreeServer::deleteGivenUpSubtrees() {
+    quint64 now = usecTimestampNow();
+    QList<QPair<quint64, QByteArray> >::iterator subtree = _givenUpSubtrees.begin();
+    while (subtree != _givenUpSubtrees.end()) {
+        if (now < subtree->first) {
+            ++subtree;
+            continue;
+        }
+        const unsigned char* octalCode = (const unsigned char*)subtree->second.constData();
+        _tree->lockForWrite();
+        // unless the domain-server has since given it back to us
+        if (_jurisdiction && _jurisdiction->isMyJurisdiction(octalCode, CHECK_NODE_ONLY) == JurisdictionMap::BELOW) {
+            qDebug() << "Deleting given up subtree" << octalCodeToHexString(octalCode);
+            _tree->deleteOctalCodeFromTree(octalCode);
+        }
+        _tree->unlock();
+        subtree = _givenUpSubtrees.erase(subtree);
+    }
 }
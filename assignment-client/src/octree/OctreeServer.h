@@ -19,7 +19,9 @@
 #include <ThreadedAssignment.h>
 #include <EnvironmentData.h>
 
+#include "OctreePager.h"
 #include "OctreePersistThread.h"
+#include "OctreeReplication.h"
 #include "OctreeSendThread.h"
 #include "OctreeServerConsts.h"
 #include "OctreeInboundPacketProcessor.h"
@@ -46,6 +48,10 @@ public:
     bool isInitialLoadComplete() const { return (_persistThread) ? _persistThread->isInitialLoadComplete() : true; }
     bool isPersistEnabled() const { return (_persistThread) ? true : false; }
     quint64 getLoadElapsedTime() const { return (_persistThread) ? _persistThread->getLoadElapsedTime() : 0; }
+    int getLoadProgress() const { return (_persistThread) ? _persistThread->getLoadProgress() : 100; }
+
+    /// edits that are applied are streamed through this to the replicas, if we're the authority of a replica group
+    OctreeReplicator* getReplicator() { return _replicator; }
 
     // Subclasses must implement these methods
     virtual OctreeQueryNode* createOctreeQueryNode() = 0;
@@ -69,9 +75,16 @@ public slots:
     void run();
     void processDatagram(const QByteArray& dataByteArray, const HifiSockAddr& senderSockAddr);
 
+private slots:
+    void sendLoadToDomainServer();
+    void updateTree();
+
 protected:
     void parsePayload();
     void initHTTPManager(int port);
+    void updateJurisdiction(const QByteArray& packet);
+    QString findBusiestChild(const QVector<glm::vec3>& cameraPositions);
+    void deleteGivenUpSubtrees();
 
     int _argc;
     const char** _argv;
@@ -81,7 +94,7 @@ protected:
 
     char _persistFilename[MAX_FILENAME_LENGTH];
     int _packetsPerClientPerInterval;
-    Octree* _tree; // this IS a reaveraging tree
+    Octree* _tree; // this IS a reaveraging tree, unless we're a replica
     bool _wantPersist;
     bool _debugSending;
     bool _debugReceiving;
@@ -90,6 +103,15 @@ protected:
     JurisdictionSender* _jurisdictionSender;
     OctreeInboundPacketProcessor* _octreeInboundPacketProcessor;
     OctreePersistThread* _persistThread;
+    OctreePager* _pager;
+    OctreeReplicator* _replicator;
+    OctreeReplica* _replica;
+    OctreeReplica* _handoff; // takes over a subtree from another server when the domain-server moves it to us
+
+    quint64 _lastLoadReportAt;
+    quint64 _lastLoadEncodeTime;
+    quint64 _lastLoadEditsProcessed;
+    QList<QPair<quint64, QByteArray> > _givenUpSubtrees; // when to delete them, and their octal codes
 
     static OctreeServer* _instance;
 
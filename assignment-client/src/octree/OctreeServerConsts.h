@@ -17,5 +17,6 @@ const int MAX_FILENAME_LENGTH = 1024;
 const int INTERVALS_PER_SECOND = 60;
 const int OCTREE_SEND_INTERVAL_USECS = (1000 * 1000)/INTERVALS_PER_SECOND;
 const int SENDING_TIME_TO_SPARE = 5 * 1000; // usec of sending interval to spare for calculating voxels
+const quint64 GIVEN_UP_SUBTREE_GRACE_USECS = 10 * 1000 * 1000; // how long a subtree handed to another server is kept
 
 #endif // __octree_server__OctreeServerConsts__
@@ -18,15 +18,16 @@ class ParticleNodeData : public OctreeQueryNode {
 public:
     ParticleNodeData() :
         OctreeQueryNode(),
-        _lastDeletedParticlesSentAt(0) {  };
+        _nextDeletedParticleToSend(0) {  };
 
     virtual PacketType getMyPacketType() const { return PacketTypeParticleData; }
 
-    quint64 getLastDeletedParticlesSentAt() const { return _lastDeletedParticlesSentAt; }
-    void setLastDeletedParticlesSentAt(quint64 sentAt) { _lastDeletedParticlesSentAt = sentAt; }
+    /// the sequence number of the first deleted particle this node hasn't been told about
+    quint64 getNextDeletedParticleToSend() const { return _nextDeletedParticleToSend; }
+    void setNextDeletedParticleToSend(quint64 sequence) { _nextDeletedParticleToSend = sequence; }
 
 private:
-    quint64 _lastDeletedParticlesSentAt;
+    quint64 _nextDeletedParticleToSend;
 };
 
 #endif /* defined(__hifi__ParticleNodeData__) */
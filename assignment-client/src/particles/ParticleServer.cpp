@@ -6,6 +6,8 @@
 //  Copyright (c) 2013 HighFidelity, Inc. All rights reserved.
 //
 
+#include <limits>
+
 #include <QTimer>
 #include <ParticleTree.h>
 
@@ -44,6 +46,10 @@ void ParticleServer::beforeRun() {
 }
 
 void ParticleServer::particleCreated(const Particle& newParticle, Node* node) {
+    if (!node || !node->getActiveSocket()) {
+        return; // an edit passed on by a replica from a viewer we haven't reached
+    }
+
     unsigned char outputBuffer[MAX_PACKET_SIZE];
     unsigned char* copyAt = outputBuffer;
 
@@ -76,10 +82,8 @@ bool ParticleServer::hasSpecialPacketToSend(Node* node) {
     // check to see if any new particles have been added since we last sent to this node...
     ParticleNodeData* nodeData = static_cast<ParticleNodeData*>(node->getLinkedData());
     if (nodeData) {
-        quint64 deletedParticlesSentAt = nodeData->getLastDeletedParticlesSentAt();
-
         ParticleTree* tree = static_cast<ParticleTree*>(_tree);
-        shouldSendDeletedParticles = tree->hasParticlesDeletedSince(deletedParticlesSentAt);
+        shouldSendDeletedParticles = tree->hasParticlesDeletedSince(nodeData->getNextDeletedParticleToSend());
     }
 
     return shouldSendDeletedParticles;
@@ -91,15 +95,14 @@ int ParticleServer::sendSpecialPacket(Node* node) {
 
     ParticleNodeData* nodeData = static_cast<ParticleNodeData*>(node->getLinkedData());
     if (nodeData) {
-        quint64 deletedParticlesSentAt = nodeData->getLastDeletedParticlesSentAt();
-        quint64 deletePacketSentAt = usecTimestampNow();
+        quint64 nextDeletedParticleToSend = nodeData->getNextDeletedParticleToSend();
 
         ParticleTree* tree = static_cast<ParticleTree*>(_tree);
         bool hasMoreToSend = true;
 
         // TODO: is it possible to send too many of these packets? what if you deleted 1,000,000 particles?
         while (hasMoreToSend) {
-            hasMoreToSend = tree->encodeParticlesDeletedSince(deletedParticlesSentAt,
+            hasMoreToSend = tree->encodeParticlesDeletedSince(nextDeletedParticleToSend,
                                                 outputBuffer, MAX_PACKET_SIZE, packetLength);
 
             //qDebug() << "sending PacketType_PARTICLE_ERASE packetLength:" << packetLength;
@@ -109,7 +112,7 @@ int ParticleServer::sendSpecialPacket(Node* node) {
                                                                    node->getActiveSocket()->getPort());
         }
 
-        nodeData->setLastDeletedParticlesSentAt(deletePacketSentAt);
+        nodeData->setNextDeletedParticleToSend(nextDeletedParticleToSend);
     }
 
     // TODO: caller is expecting a packetLength, what if we send more than one packet??
@@ -120,19 +123,16 @@ void ParticleServer::pruneDeletedParticles() {
     ParticleTree* tree = static_cast<ParticleTree*>(_tree);
     if (tree->hasAnyDeletedParticles()) {
 
-        //qDebug() << "there are some deleted particles to consider...";
-        quint64 earliestLastDeletedParticlesSent = usecTimestampNow() + 1; // in the future
+        // with no nodes connected nobody needs any of them
+        quint64 earliestNextDeletedParticleToSend = std::numeric_limits<quint64>::max();
         foreach (const SharedNodePointer& otherNode, NodeList::getInstance()->getNodeHash()) {
             if (otherNode->getLinkedData()) {
                 ParticleNodeData* nodeData = static_cast<ParticleNodeData*>(otherNode->getLinkedData());
-                quint64 nodeLastDeletedParticlesSentAt = nodeData->getLastDeletedParticlesSentAt();
-                if (nodeLastDeletedParticlesSentAt < earliestLastDeletedParticlesSent) {
-                    earliestLastDeletedParticlesSent = nodeLastDeletedParticlesSentAt;
-                }
+                earliestNextDeletedParticleToSend = std::min(earliestNextDeletedParticleToSend,
+                                                             nodeData->getNextDeletedParticleToSend());
             }
         }
-        //qDebug() << "earliestLastDeletedParticlesSent=" << earliestLastDeletedParticlesSent;
-        tree->forgetParticlesDeletedBefore(earliestLastDeletedParticlesSent);
+        tree->forgetParticlesDeletedBefore(earliestNextDeletedParticleToSend);
     }
 }
 
@@ -25,6 +25,9 @@ $(document).ready(function(){
     if ($('#instance-field input').val()) {
       headers['ASSIGNMENT-INSTANCES'] = $('#instance-field input').val();
     }
+    if ($('#instances-per-process-field input').val()) {
+      headers['ASSIGNMENT-INSTANCES-PER-PROCESS'] = $('#instances-per-process-field input').val();
+    }
             
     // post form to assignment in order to create an assignment
     $.ajax({
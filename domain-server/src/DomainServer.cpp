@@ -17,6 +17,7 @@
 #include <QtCore/QTimer>
 
 #include <HTTPConnection.h>
+#include <OctalCode.h>
 #include <PacketHeaders.h>
 #include <SharedUtil.h>
 #include <UUID.h>
@@ -31,11 +32,26 @@ const char* METAVOXEL_SERVER_CONFIG = "metavoxelServerConfig";
 
 const quint16 DOMAIN_SERVER_HTTP_PORT = 8080;
 
+// an octree server over any of these limits for long enough has the busiest child of its jurisdiction split off to a
+// new server, and a server that was split off is merged back once both it and its parent are well under them
+const quint32 JURISDICTION_MAX_VIEWERS = 32;
+const float JURISDICTION_MAX_ENCODE_LOAD = 2.0f;
+const float JURISDICTION_MAX_EDITS_PER_SECOND = 1000.0f;
+const float JURISDICTION_MERGE_LOAD_FRACTION = 0.25f;
+const int JURISDICTION_SPLIT_OVERLOADED_REPORTS = 10;
+const int JURISDICTION_MERGE_UNDERLOADED_REPORTS = 60;
+const quint64 JURISDICTION_MOVE_COOLDOWN_USECS = 30 * 1000 * 1000;
+const quint64 JURISDICTION_MOVE_TIMEOUT_USECS = 5 * 60 * 1000 * 1000;
+
 DomainServer::DomainServer(int argc, char* argv[]) :
     QCoreApplication(argc, argv),
     _HTTPManager(DOMAIN_SERVER_HTTP_PORT, QString("%1/resources/web/").arg(QCoreApplication::applicationDirPath()), this),
     _staticAssignmentHash(),
     _assignmentQueue(),
+    _autoSplitJurisdictions(false),
+    _jurisdictionMoveStage(NoJurisdictionMove),
+    _jurisdictionMoveStartedAt(0),
+    _lastJurisdictionMoveAt(0),
     _hasCompletedRestartHold(false)
 {
     const char CUSTOM_PORT_OPTION[] = "-p";
@@ -55,8 +71,15 @@ DomainServer::DomainServer(int argc, char* argv[]) :
     }
     
     populateDefaultStaticAssignmentsExcludingTypes(parsedTypes);
+    
+    // octree servers with a jurisdiction report their load, and busy ones are split, idle ones merged
+    const QString AUTO_SPLIT_JURISDICTIONS_OPTION = "--autoSplitJurisdictions";
+    _autoSplitJurisdictions = argumentList.contains(AUTO_SPLIT_JURISDICTIONS_OPTION);
 
     NodeList* nodeList = NodeList::createInstance(NodeType::DomainServer, domainServerPort);
+    
+    // optionally emulate a WAN link on the domain-server socket
+    nodeList->getNodeSocket().parseImpairmentArguments(argc, (const char**) argv);
 
     connect(nodeList, SIGNAL(nodeKilled(SharedNodePointer)), this, SLOT(nodeKilled(SharedNodePointer)));
 
@@ -299,6 +322,14 @@ void DomainServer::readAvailableDatagrams() {
                             if (node->getUUID() != nodeUUID &&
                                 memchr(nodeTypesOfInterest, node->getType(), numInterestTypes)) {
                                 
+                                // agents are only told about the server of each replica group that they use
+                                QString replicaGroup;
+                                bool isReplica;
+                                if (nodeType == NodeType::Agent && replicaGroupForNode(node, replicaGroup, isReplica)
+                                    && replicaGroupMemberForAgent(nodeUUID, replicaGroup) != node->getUUID()) {
+                                    continue;
+                                }
+                                
                                 // don't send avatar nodes to other avatars, that will come from avatar mixer
                                 broadcastDataStream << *node.data();
                             }
@@ -313,6 +344,8 @@ void DomainServer::readAvailableDatagrams() {
                     nodeList->getNodeSocket().writeDatagram(broadcastPacket,
                                                             senderSockAddr.getAddress(), senderSockAddr.getPort());
                 }
+            } else if (requestType == PacketTypeOctreeServerLoad) {
+                processOctreeServerLoad(receivedPacket, senderSockAddr);
             } else if (requestType == PacketTypeRequestAssignment) {
                 
                 // construct the requested assignment from the packet data
@@ -475,6 +508,19 @@ bool DomainServer::handleHTTPRequest(HTTPConnection* connection, const QString&
                     scriptAssignment->setNumberOfInstances(numInstances);
                 }
             }
+
+            // check if the user wants each assignment-client to run several instances of the script, in which case
+            // ASSIGNMENT-INSTANCES is the number of assignment-clients
+            const QString ASSIGNMENT_INSTANCES_PER_PROCESS_HEADER = "ASSIGNMENT-INSTANCES-PER-PROCESS";
+
+            QByteArray instancesPerProcessValue =
+                connection->requestHeaders().value(ASSIGNMENT_INSTANCES_PER_PROCESS_HEADER.toLocal8Bit());
+            if (!instancesPerProcessValue.isEmpty()) {
+                int instancesPerProcess = instancesPerProcessValue.toInt();
+                if (instancesPerProcess > 1) {
+                    scriptAssignment->setPayload(QString("--instancesPerProcess %1").arg(instancesPerProcess).toUtf8());
+                }
+            }
             
             const char ASSIGNMENT_SCRIPT_HOST_LOCATION[] = "resources/web/assignment";
             
@@ -536,6 +582,11 @@ void DomainServer::refreshStaticAssignmentAndAddToQueue(SharedAssignmentPointer&
     qDebug() << "Reset UUID for assignment -" << *assignment.data() << "- and added to queue. Old UUID was"
         << uuidStringWithoutCurlyBraces(oldUUID);
     
+    // a server created by a split is still one when it's given out again
+    if (_splitAssignmentUUIDs.remove(oldUUID)) {
+        _splitAssignmentUUIDs.insert(assignment->getUUID());
+    }
+    
     // add the static assignment back under the right UUID, and to the queue
     _staticAssignmentHash.insert(assignment->getUUID(), assignment);
     
@@ -546,7 +597,373 @@ void DomainServer::refreshStaticAssignmentAndAddToQueue(SharedAssignmentPointer&
     _staticAssignmentHash.remove(oldUUID);
 }
 
+// finds the replica group of an octree server from its assignment's config, groups are told apart by server type
+bool DomainServer::replicaGroupForNode(const SharedNodePointer& node, QString& replicaGroup, bool& isReplica) {
+    SharedAssignmentPointer assignment = _staticAssignmentHash.value(node->getUUID());
+    if (!assignment) {
+        return false;
+    }
+    QString config(assignment->getPayload());
+    
+    const QString REPLICA_GROUP_REGEX = "--replicaGroup\\s+(\\S+)";
+    QRegExp replicaGroupRegex(REPLICA_GROUP_REGEX);
+    if (replicaGroupRegex.indexIn(config) == -1) {
+        return false;
+    }
+    replicaGroup = QString("%1 %2").arg(assignment->getType()).arg(replicaGroupRegex.cap(1));
+    
+    const QString REPLICA_REGEX = "--replica(\\s|$)";
+    isReplica = config.contains(QRegExp(REPLICA_REGEX));
+    return true;
+}
+
+// picks the server of a replica group an agent uses, sticking with it while it's up, and otherwise choosing the member
+// with the fewest agents, replicas before the authority, which has the group's edits to apply
+QUuid DomainServer::replicaGroupMemberForAgent(const QUuid& agentUUID, const QString& replicaGroup) {
+    QUuid& member = _agentReplicaGroupMembers[agentUUID][replicaGroup];
+    if (!member.isNull() && NodeList::getInstance()->nodeWithUUID(member)) {
+        return member;
+    }
+    
+    QUuid leastLoadedMember;
+    bool leastLoadedIsReplica = false;
+    int leastLoadedAgents = 0;
+    foreach (const SharedNodePointer& node, NodeList::getInstance()->getNodeHash()) {
+        QString nodeReplicaGroup;
+        bool isReplica;
+        if (!replicaGroupForNode(node, nodeReplicaGroup, isReplica) || nodeReplicaGroup != replicaGroup) {
+            continue;
+        }
+        int agents = _agentsPerReplicaGroupMember.value(node->getUUID());
+        if (leastLoadedMember.isNull() || (isReplica && !leastLoadedIsReplica)
+            || (isReplica == leastLoadedIsReplica && agents < leastLoadedAgents)) {
+            leastLoadedMember = node->getUUID();
+            leastLoadedIsReplica = isReplica;
+            leastLoadedAgents = agents;
+        }
+    }
+    
+    member = leastLoadedMember;
+    if (!member.isNull()) {
+        _agentsPerReplicaGroupMember[member]++;
+    }
+    return member;
+}
+
+// whether the element of one hex octal code is the element of another or one of its ancestors
+static bool isHexCodeAncestorOf(const QString& ancestorHexCode, const QString& descendantHexCode) {
+    unsigned char* ancestor = hexStringToOctalCode(ancestorHexCode);
+    unsigned char* descendant = hexStringToOctalCode(descendantHexCode);
+    bool isAncestor = ancestor && descendant && isAncestorOf(ancestor, descendant);
+    delete[] ancestor;
+    delete[] descendant;
+    return isAncestor;
+}
+
+static QString configWithoutOption(const QString& config, const QString& option) {
+    return QString(config).remove(QRegExp(QString("%1\\s+\\S+").arg(QRegExp::escape(option)))).simplified();
+}
+
+void DomainServer::processOctreeServerLoad(const QByteArray& packet, const HifiSockAddr& senderSockAddr) {
+    if (!_autoSplitJurisdictions) {
+        return;
+    }
+    QUuid serverUUID;
+    deconstructPacketHeader(packet, serverUUID);
+    SharedNodePointer server = NodeList::getInstance()->nodeWithUUID(serverUUID);
+    if (!server) {
+        return;
+    }
+    QDataStream packetStream(packet);
+    packetStream.skipRawData(numBytesForPacketHeader(packet));
+    OctreeServerLoad load;
+    packetStream >> load;
+    if (packetStream.status() != QDataStream::Ok) {
+        return;
+    }
+    
+    OctreeServerState& state = _octreeServerStates[serverUUID];
+    state.load = load;
+    state.sockAddr = senderSockAddr;
+    bool overloaded = load.viewers > JURISDICTION_MAX_VIEWERS || load.encodeLoad > JURISDICTION_MAX_ENCODE_LOAD
+        || load.editsPerSecond > JURISDICTION_MAX_EDITS_PER_SECOND;
+    bool underloaded = load.viewers < JURISDICTION_MAX_VIEWERS * JURISDICTION_MERGE_LOAD_FRACTION
+        && load.encodeLoad < JURISDICTION_MAX_ENCODE_LOAD * JURISDICTION_MERGE_LOAD_FRACTION
+        && load.editsPerSecond < JURISDICTION_MAX_EDITS_PER_SECOND * JURISDICTION_MERGE_LOAD_FRACTION;
+    state.overloadedReports = overloaded ? state.overloadedReports + 1 : 0;
+    state.underloadedReports = underloaded ? state.underloadedReports + 1 : 0;
+    
+    // the server is told what we want until it shows it, since the update can be lost
+    if (_desiredJurisdictions.contains(serverUUID) && !_desiredJurisdictions.value(serverUUID).isShownBy(load)) {
+        QByteArray updatePacket = byteArrayWithPopluatedHeader(PacketTypeJurisdictionUpdate);
+        QDataStream updateStream(&updatePacket, QIODevice::Append);
+        updateStream << _desiredJurisdictions.value(serverUUID);
+        NodeList::getInstance()->getNodeSocket().writeDatagram(updatePacket, senderSockAddr.getAddress(),
+                                                               senderSockAddr.getPort());
+        return;
+    }
+    
+    if (_jurisdictionMoveStage != NoJurisdictionMove) {
+        advanceJurisdictionMove();
+        return;
+    }
+    if (usecTimestampNow() - _lastJurisdictionMoveAt < JURISDICTION_MOVE_COOLDOWN_USECS) {
+        return;
+    }
+    
+    // servers of a replica group share their jurisdiction, and servers without one have the whole tree. Only voxel
+    // servers are balanced, since the edits to a moving subtree are passed between the two servers by octal code.
+    SharedAssignmentPointer assignment = _staticAssignmentHash.value(serverUUID);
+    QString replicaGroup;
+    bool isReplica;
+    if (!assignment || assignment->getType() != Assignment::VoxelServerType || load.jurisdictionRoot.isEmpty()
+        || replicaGroupForNode(server, replicaGroup, isReplica)) {
+        return;
+    }
+    if (state.overloadedReports >= JURISDICTION_SPLIT_OVERLOADED_REPORTS && !load.busiestChild.isEmpty()) {
+        startJurisdictionSplit(serverUUID, assignment);
+    } else if (state.underloadedReports >= JURISDICTION_MERGE_UNDERLOADED_REPORTS
+               && _splitAssignmentUUIDs.contains(serverUUID)) {
+        startJurisdictionMerge(serverUUID);
+    }
+}
+
+void DomainServer::startJurisdictionSplit(const QUuid& serverUUID, const SharedAssignmentPointer& assignment) {
+    const OctreeServerLoad& load = _octreeServerStates.value(serverUUID).load;
+    JurisdictionUpdate split;
+    split.root = load.busiestChild;
+    foreach (const QString& endNode, load.jurisdictionEndNodes) {
+        if (isHexCodeAncestorOf(split.root, endNode)) {
+            split.endNodes << endNode;
+        }
+    }
+    
+    // the new server runs with the config of the one it's split from, but has its own persist file
+    QString config(assignment->getPayload());
+    config = configWithoutOption(config, "--statusPort");
+    const QString PERSIST_FILENAME_REGEX = "--persistFilename\\s+(\\S+)";
+    QRegExp persistFilenameRegex(PERSIST_FILENAME_REGEX);
+    QString persistFilename = persistFilenameRegex.indexIn(config) != -1 ? persistFilenameRegex.cap(1)
+        : assignment->getType() == Assignment::VoxelServerType ? "resources/voxels.svo" : "resources/particles.svo";
+    const QString SVO_EXTENSION = ".svo";
+    persistFilename.insert(persistFilename.endsWith(SVO_EXTENSION) ? persistFilename.size() - SVO_EXTENSION.size()
+                           : persistFilename.size(), "." + split.root);
+    config = configWithoutOption(config, "--persistFilename") + " --persistFilename " + persistFilename;
+    
+    Assignment* splitAssignment = new Assignment(Assignment::CreateCommand, assignment->getType(),
+                                                 assignment->getPool());
+    splitAssignment->setPayload(config.toUtf8());
+    addStaticAssignmentToAssignmentHash(splitAssignment);
+    SharedAssignmentPointer sharedSplitAssignment = _staticAssignmentHash.value(splitAssignment->getUUID());
+    setAssignmentJurisdiction(sharedSplitAssignment, split);
+    _assignmentQueue.enqueue(sharedSplitAssignment);
+    _splitAssignmentUUIDs.insert(splitAssignment->getUUID());
+    
+    qDebug() << "Splitting subtree" << split.root << "of the jurisdiction of"
+        << uuidStringWithoutCurlyBraces(serverUUID) << "off to a new server -" << *splitAssignment;
+    
+    // the new server syncs the subtree from the old one, the old one keeps it until the new one has it
+    split.handoffSource = serverUUID;
+    split.handoffRoot = split.root;
+    _desiredJurisdictions.insert(splitAssignment->getUUID(), split);
+    
+    _jurisdictionMoveStage = SplitSyncing;
+    _jurisdictionMoveSource = serverUUID;
+    _jurisdictionMoveTarget = splitAssignment->getUUID();
+    _jurisdictionMoveRoot = split.root;
+    _jurisdictionMoveStartedAt = usecTimestampNow();
+    setJurisdictionMoveHandoffTarget(_jurisdictionMoveTarget);
+}
+
+void DomainServer::startJurisdictionMerge(const QUuid& serverUUID) {
+    const OctreeServerLoad& load = _octreeServerStates.value(serverUUID).load;
+    
+    // the server this one was split from has its root as an end node, and has to be idle too
+    QHash<QUuid, OctreeServerState>::const_iterator parent = _octreeServerStates.constBegin();
+    for (; parent != _octreeServerStates.constEnd(); ++parent) {
+        if (parent.key() != serverUUID && parent->underloadedReports >= JURISDICTION_MERGE_UNDERLOADED_REPORTS
+            && parent->load.jurisdictionEndNodes.contains(load.jurisdictionRoot, Qt::CaseInsensitive)) {
+            break;
+        }
+    }
+    if (parent == _octreeServerStates.constEnd() || !_staticAssignmentHash.contains(parent.key())
+        || _staticAssignmentHash.value(parent.key())->getType() != Assignment::VoxelServerType) {
+        return;
+    }
+    
+    JurisdictionUpdate before;
+    before.root = parent->load.jurisdictionRoot;
+    before.endNodes = parent->load.jurisdictionEndNodes;
+    JurisdictionUpdate merged;
+    merged.root = before.root;
+    foreach (const QString& endNode, before.endNodes) {
+        if (endNode.compare(load.jurisdictionRoot, Qt::CaseInsensitive) != 0) {
+            merged.endNodes << endNode;
+        }
+    }
+    merged.endNodes << load.jurisdictionEndNodes;
+    merged.handoffSource = serverUUID;
+    merged.handoffRoot = load.jurisdictionRoot;
+    
+    qDebug() << "Merging subtree" << load.jurisdictionRoot << "of" << uuidStringWithoutCurlyBraces(serverUUID)
+        << "back into the jurisdiction of" << uuidStringWithoutCurlyBraces(parent.key());
+    
+    _desiredJurisdictions.insert(parent.key(), merged);
+    _jurisdictionMoveTargetBefore = before;
+    
+    _jurisdictionMoveStage = MergeSyncing;
+    _jurisdictionMoveSource = serverUUID;
+    _jurisdictionMoveTarget = parent.key();
+    _jurisdictionMoveRoot = load.jurisdictionRoot;
+    _jurisdictionMoveStartedAt = usecTimestampNow();
+    setJurisdictionMoveHandoffTarget(_jurisdictionMoveTarget);
+}
+
+void DomainServer::advanceJurisdictionMove() {
+    quint64 now = usecTimestampNow();
+    if (now - _jurisdictionMoveStartedAt > JURISDICTION_MOVE_TIMEOUT_USECS) {
+        qDebug() << "Timed out moving subtree" << _jurisdictionMoveRoot;
+        abortJurisdictionMove();
+        return;
+    }
+    
+    // each stage waits for the target to show what it was told
+    const OctreeServerLoad& targetLoad = _octreeServerStates.value(_jurisdictionMoveTarget).load;
+    JurisdictionUpdate& target = _desiredJurisdictions[_jurisdictionMoveTarget];
+    if (!_octreeServerStates.contains(_jurisdictionMoveTarget) || !target.isShownBy(targetLoad)) {
+        return;
+    }
+    
+    switch (_jurisdictionMoveStage) {
+        case SplitSyncing:
+        case MergeSyncing:
+            if (targetLoad.handoffSynced) {
+                // the target stops syncing before the source gives the subtree up, so edits the target has taken
+                // since aren't undone by syncing with the source's copy
+                target.handoffSource = QUuid();
+                target.handoffRoot.clear();
+                setJurisdictionMoveHandoffTarget(QUuid());
+                _jurisdictionMoveStage = (_jurisdictionMoveStage == SplitSyncing) ? SplitFinishing : MergeFinishing;
+            }
+            return;
+            
+        case SplitFinishing: {
+            const OctreeServerLoad& sourceLoad = _octreeServerStates.value(_jurisdictionMoveSource).load;
+            JurisdictionUpdate remaining;
+            remaining.root = sourceLoad.jurisdictionRoot;
+            foreach (const QString& endNode, sourceLoad.jurisdictionEndNodes) {
+                if (!isHexCodeAncestorOf(_jurisdictionMoveRoot, endNode)) {
+                    remaining.endNodes << endNode;
+                }
+            }
+            remaining.endNodes << _jurisdictionMoveRoot;
+            _desiredJurisdictions.insert(_jurisdictionMoveSource, remaining);
+            setAssignmentJurisdiction(_staticAssignmentHash.value(_jurisdictionMoveSource), remaining);
+            qDebug() << "Split subtree" << _jurisdictionMoveRoot << "off to"
+                << uuidStringWithoutCurlyBraces(_jurisdictionMoveTarget);
+            break;
+        }
+        case MergeFinishing:
+            setAssignmentJurisdiction(_staticAssignmentHash.value(_jurisdictionMoveTarget), target);
+            qDebug() << "Merged subtree" << _jurisdictionMoveRoot << "back into"
+                << uuidStringWithoutCurlyBraces(_jurisdictionMoveTarget);
+            break;
+            
+        default:
+            return;
+    }
+    
+    JurisdictionMoveStage finishedStage = _jurisdictionMoveStage;
+    _jurisdictionMoveStage = NoJurisdictionMove;
+    _lastJurisdictionMoveAt = now;
+    _octreeServerStates[_jurisdictionMoveSource].overloadedReports = 0;
+    _octreeServerStates[_jurisdictionMoveTarget].overloadedReports = 0;
+    if (finishedStage == MergeFinishing) {
+        removeSplitAssignment(_jurisdictionMoveSource);
+    }
+}
+
+void DomainServer::abortJurisdictionMove() {
+    qDebug() << "Aborting the move of subtree" << _jurisdictionMoveRoot;
+    JurisdictionMoveStage abortedStage = _jurisdictionMoveStage;
+    _jurisdictionMoveStage = NoJurisdictionMove;
+    _lastJurisdictionMoveAt = usecTimestampNow();
+    if (_octreeServerStates.contains(_jurisdictionMoveSource)) {
+        setJurisdictionMoveHandoffTarget(QUuid());
+    }
+    
+    if (abortedStage == SplitSyncing || abortedStage == SplitFinishing) {
+        // the source hasn't given the subtree up, so the new server goes away again
+        removeSplitAssignment(_jurisdictionMoveTarget);
+    } else if (NodeList::getInstance()->nodeWithUUID(_jurisdictionMoveTarget)) {
+        // the source still has the subtree, and its assignment is unchanged, so the target gives it back
+        _desiredJurisdictions.insert(_jurisdictionMoveTarget, _jurisdictionMoveTargetBefore);
+    }
+}
+
+// the source of a move only answers the syncs of the subtree from the server we name, and only while we name it
+void DomainServer::setJurisdictionMoveHandoffTarget(const QUuid& targetUUID) {
+    if (!_desiredJurisdictions.contains(_jurisdictionMoveSource)) {
+        const OctreeServerLoad& sourceLoad = _octreeServerStates.value(_jurisdictionMoveSource).load;
+        JurisdictionUpdate current;
+        current.root = sourceLoad.jurisdictionRoot;
+        current.endNodes = sourceLoad.jurisdictionEndNodes;
+        _desiredJurisdictions.insert(_jurisdictionMoveSource, current);
+    }
+    JurisdictionUpdate& source = _desiredJurisdictions[_jurisdictionMoveSource];
+    source.handoffTarget = targetUUID;
+    source.handoffRoot = targetUUID.isNull() ? QString() : _jurisdictionMoveRoot;
+}
+
+void DomainServer::removeSplitAssignment(const QUuid& assignmentUUID) {
+    SharedAssignmentPointer assignment = _staticAssignmentHash.take(assignmentUUID);
+    if (assignment) {
+        removeMatchingAssignmentFromQueue(assignment);
+    }
+    _splitAssignmentUUIDs.remove(assignmentUUID);
+    _desiredJurisdictions.remove(assignmentUUID);
+    _octreeServerStates.remove(assignmentUUID);
+    
+    // with its assignment gone the server isn't answered when it checks in, and exits, killed later since we may be
+    // called while the node list is killing another node
+    QMetaObject::invokeMethod(NodeList::getInstance(), "killNodeWithUUID", Qt::QueuedConnection,
+                              Q_ARG(QUuid, assignmentUUID));
+}
+
+// the jurisdiction a server is given when its assignment is handed out again
+void DomainServer::setAssignmentJurisdiction(const SharedAssignmentPointer& assignment,
+                                             const JurisdictionUpdate& jurisdiction) {
+    if (!assignment) {
+        return;
+    }
+    QString config(assignment->getPayload());
+    config = configWithoutOption(config, "--jurisdictionFile");
+    config = configWithoutOption(config, "--jurisdictionRoot");
+    config = configWithoutOption(config, "--jurisdictionEndNodes");
+    config += " --jurisdictionRoot " + jurisdiction.root;
+    if (!jurisdiction.endNodes.isEmpty()) {
+        config += " --jurisdictionEndNodes " + jurisdiction.endNodes.join(",");
+    }
+    assignment->setPayload(config.simplified().toUtf8());
+}
+
 void DomainServer::nodeKilled(SharedNodePointer node) {
+    // forget which replica group members an agent used, and how many agents a dead member had
+    foreach (const QUuid& member, _agentReplicaGroupMembers.take(node->getUUID())) {
+        if (_agentsPerReplicaGroupMember.contains(member)) {
+            _agentsPerReplicaGroupMember[member]--;
+        }
+    }
+    _agentsPerReplicaGroupMember.remove(node->getUUID());
+    
+    // a jurisdiction move can't go on without both of its servers
+    if (_jurisdictionMoveStage != NoJurisdictionMove
+        && (node->getUUID() == _jurisdictionMoveSource || node->getUUID() == _jurisdictionMoveTarget)) {
+        abortJurisdictionMove();
+    }
+    _octreeServerStates.remove(node->getUUID());
+    _desiredJurisdictions.remove(node->getUUID());
+    
     // if this node's UUID matches a static assignment we need to throw it back in the assignment queue
     SharedAssignmentPointer matchedAssignment = _staticAssignmentHash.value(node->getUUID());
     
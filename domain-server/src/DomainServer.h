@@ -17,6 +17,7 @@
 #include <Assignment.h>
 #include <HTTPManager.h>
 #include <NodeList.h>
+#include <OctreeServerLoad.h>
 
 typedef QSharedPointer<Assignment> SharedAssignmentPointer;
 
@@ -46,11 +47,58 @@ private:
     void removeMatchingAssignmentFromQueue(const SharedAssignmentPointer& removableAssignment);
     void refreshStaticAssignmentAndAddToQueue(SharedAssignmentPointer& assignment);
     
+    bool replicaGroupForNode(const SharedNodePointer& node, QString& replicaGroup, bool& isReplica);
+    QUuid replicaGroupMemberForAgent(const QUuid& agentUUID, const QString& replicaGroup);
+    
+    void processOctreeServerLoad(const QByteArray& packet, const HifiSockAddr& senderSockAddr);
+    void advanceJurisdictionMove();
+    void startJurisdictionSplit(const QUuid& serverUUID, const SharedAssignmentPointer& assignment);
+    void startJurisdictionMerge(const QUuid& serverUUID);
+    void abortJurisdictionMove();
+    void setJurisdictionMoveHandoffTarget(const QUuid& targetUUID);
+    void removeSplitAssignment(const QUuid& assignmentUUID);
+    void setAssignmentJurisdiction(const SharedAssignmentPointer& assignment, const JurisdictionUpdate& jurisdiction);
+    
     HTTPManager _HTTPManager;
     
     QHash<QUuid, SharedAssignmentPointer> _staticAssignmentHash;
     QQueue<SharedAssignmentPointer> _assignmentQueue;
     
+    QHash<QUuid, QHash<QString, QUuid> > _agentReplicaGroupMembers; // the server of each replica group an agent uses
+    QHash<QUuid, int> _agentsPerReplicaGroupMember;
+    
+    /// the last load an octree server reported, and how many reports in a row it's been over or under its limits
+    class OctreeServerState {
+    public:
+        OctreeServerState() : overloadedReports(0), underloadedReports(0) { }
+        
+        OctreeServerLoad load;
+        HifiSockAddr sockAddr;
+        int overloadedReports;
+        int underloadedReports;
+    };
+    
+    /// the stages of moving a subtree from one octree server to another, one move runs at a time
+    enum JurisdictionMoveStage {
+        NoJurisdictionMove,
+        SplitSyncing, // a new server is taking over a busy child of a server's jurisdiction
+        SplitFinishing, // the new server has the child and has stopped syncing, the old server is told to give it up
+        MergeSyncing, // a server is taking back an idle subtree it split off
+        MergeFinishing // the server has the subtree back and has stopped syncing, the other server is removed
+    };
+    
+    bool _autoSplitJurisdictions;
+    QHash<QUuid, OctreeServerState> _octreeServerStates;
+    QHash<QUuid, JurisdictionUpdate> _desiredJurisdictions; // sent to a server until its load reports show it
+    QSet<QUuid> _splitAssignmentUUIDs; // the static assignments created by splits, which merges remove again
+    JurisdictionMoveStage _jurisdictionMoveStage;
+    QUuid _jurisdictionMoveSource;
+    QUuid _jurisdictionMoveTarget;
+    QString _jurisdictionMoveRoot;
+    JurisdictionUpdate _jurisdictionMoveTargetBefore; // what a merge's target goes back to if it's aborted
+    quint64 _jurisdictionMoveStartedAt;
+    quint64 _lastJurisdictionMoveAt;
+    
     bool _hasCompletedRestartHold;
 private slots:
     void readAvailableDatagrams();
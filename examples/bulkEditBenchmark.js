@@ -0,0 +1,123 @@
+//
+//  bulkEditBenchmark.js
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 HighFidelity, Inc. All rights reserved.
+//
+//  This is an example script that builds the same block of voxels with Voxels.setVoxel(), Voxels.setVoxels() and
+//  Voxels.setVoxelGrid(), and a cloud of particles with Particles.addParticle() and Particles.addParticles(), and prints
+//  how many edits per second each way queues.
+//
+
+var VOXELS_EACH_DIMENSION = 32;
+var VOXEL_SCALE = 0.25;
+var NUMBER_OF_PARTICLES = 2000;
+var PARTICLE_RADIUS = 0.1;
+
+var origin = { x: 10, y: 0, z: 10 };
+
+function report(name, edits, startTime) {
+    var seconds = (new Date().getTime() - startTime) / 1000;
+    print(name + ": " + edits + " edits in " + seconds + " seconds, "
+          + Math.round(edits / Math.max(seconds, 0.001)) + " edits/second\n");
+}
+
+function colorFor(i, j, k) {
+    return [Math.floor(255 * i / VOXELS_EACH_DIMENSION), Math.floor(255 * j / VOXELS_EACH_DIMENSION),
+            Math.floor(255 * k / VOXELS_EACH_DIMENSION)];
+}
+
+function benchmarkSetVoxel() {
+    var startTime = new Date().getTime();
+    var edits = 0;
+    for (var k = 0; k < VOXELS_EACH_DIMENSION; k++) {
+        for (var j = 0; j < VOXELS_EACH_DIMENSION; j++) {
+            for (var i = 0; i < VOXELS_EACH_DIMENSION; i++) {
+                var color = colorFor(i, j, k);
+                Voxels.setVoxel(origin.x + i * VOXEL_SCALE, origin.y + j * VOXEL_SCALE, origin.z + k * VOXEL_SCALE,
+                                VOXEL_SCALE, color[0], color[1], color[2]);
+                edits++;
+            }
+        }
+    }
+    report("Voxels.setVoxel", edits, startTime);
+}
+
+function benchmarkSetVoxels() {
+    var startTime = new Date().getTime();
+    var positions = [];
+    var colors = [];
+    for (var k = 0; k < VOXELS_EACH_DIMENSION; k++) {
+        for (var j = 0; j < VOXELS_EACH_DIMENSION; j++) {
+            for (var i = 0; i < VOXELS_EACH_DIMENSION; i++) {
+                positions.push(origin.x + i * VOXEL_SCALE, origin.y + j * VOXEL_SCALE, origin.z + k * VOXEL_SCALE);
+                var color = colorFor(i, j, k);
+                colors.push(color[0], color[1], color[2]);
+            }
+        }
+    }
+    var edits = Voxels.setVoxels(positions, [VOXEL_SCALE], colors);
+    report("Voxels.setVoxels", edits, startTime);
+}
+
+function benchmarkSetVoxelGrid() {
+    var startTime = new Date().getTime();
+    var colors = [];
+    for (var k = 0; k < VOXELS_EACH_DIMENSION; k++) {
+        for (var j = 0; j < VOXELS_EACH_DIMENSION; j++) {
+            for (var i = 0; i < VOXELS_EACH_DIMENSION; i++) {
+                var color = colorFor(i, j, k);
+                colors.push(color[0], color[1], color[2]);
+            }
+        }
+    }
+    var edits = Voxels.setVoxelGrid(origin.x, origin.y, origin.z, VOXEL_SCALE,
+                                    VOXELS_EACH_DIMENSION, VOXELS_EACH_DIMENSION, VOXELS_EACH_DIMENSION, colors);
+    report("Voxels.setVoxelGrid", edits, startTime);
+}
+
+function randomPosition() {
+    return { x: origin.x + Math.random() * 8, y: 4 + Math.random() * 4, z: origin.z + Math.random() * 8 };
+}
+
+function benchmarkAddParticle() {
+    var startTime = new Date().getTime();
+    for (var i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        Particles.addParticle({ position: randomPosition(), radius: PARTICLE_RADIUS,
+                                color: { red: 255, green: 128, blue: 0 }, lifetime: 10 });
+    }
+    report("Particles.addParticle", NUMBER_OF_PARTICLES, startTime);
+}
+
+function benchmarkAddParticles() {
+    var startTime = new Date().getTime();
+    var positions = [];
+    for (var i = 0; i < NUMBER_OF_PARTICLES; i++) {
+        var position = randomPosition();
+        positions.push(position.x, position.y, position.z);
+    }
+    var ids = Particles.addParticles(positions, [PARTICLE_RADIUS], [0, 128, 255], []);
+    report("Particles.addParticles", ids.length, startTime);
+}
+
+// give the queued edits a few frames to go out before stopping
+var FRAMES_TO_SEND_EDITS = 60;
+var frames = 0;
+
+function runBenchmarks() {
+    if (frames == 0) {
+        benchmarkSetVoxel();
+        benchmarkSetVoxels();
+        benchmarkSetVoxelGrid();
+        benchmarkAddParticle();
+        benchmarkAddParticles();
+    }
+    frames++;
+    if (frames > FRAMES_TO_SEND_EDITS) {
+        Script.stop();
+    }
+}
+
+// register the call back so it fires before each data send
+Script.willSendVisualDataCallback.connect(runBenchmarks);
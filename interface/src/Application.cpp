@@ -37,6 +37,7 @@
 #include <QNetworkDiskCache>
 #include <QOpenGLFramebufferObject>
 #include <QObject>
+#include <QRegExp>
 #include <QWheelEvent>
 #include <QSettings>
 #include <QShortcut>
@@ -119,6 +120,7 @@ Application::Application(int& argc, char** argv, timeval &startup_time) :
     _frameCount(0),
     _fps(120.0f),
     _justStarted(true),
+    _voxelCache(NULL),
     _voxelImporter(NULL),
     _wantToKillLocalVoxels(false),
     _audioScope(256, 200, true),
@@ -186,6 +188,9 @@ Application::Application(int& argc, char** argv, timeval &startup_time) :
     // put the NodeList and datagram processing on the node thread
     NodeList* nodeList = NodeList::createInstance(NodeType::Agent, listenPort);
     
+    // optionally emulate a WAN link on our node socket
+    nodeList->getNodeSocket().parseImpairmentArguments(argc, constArgv);
+    
     nodeList->moveToThread(_nodeThread);
     _datagramProcessor.moveToThread(_nodeThread);
     
@@ -324,6 +329,10 @@ Application::~Application() {
     _sharedVoxelSystem.changeTree(new VoxelTree);
 
     VoxelTreeElement::removeDeleteHook(&_voxels); // we don't need to do this processing on shutdown
+    if (_voxelCache) {
+        _voxelCache->save();
+        delete _voxelCache;
+    }
     _menu->deleteLater();
 
     _myAvatar = NULL;
@@ -1870,6 +1879,9 @@ void Application::init() {
     _voxels.setDisableFastVoxelPipeline(false);
     _voxels.init();
 
+    _voxelCache = new OctreeClientCache(_voxels.getTree());
+    loadVoxelCache(NodeList::getInstance()->getDomainHostname());
+
     _particles.init();
     _particles.setViewFrustum(getViewFrustum());
 
@@ -2348,6 +2360,9 @@ void Application::updateMyAvatar(float deltaTime) {
     // actually need to calculate the view frustum planes to send these details
     // to the server.
     loadViewFrustum(_myCamera, _viewFrustum);
+    _queriedViewFrustumMutex.lock();
+    _queriedViewFrustum = _viewFrustum;
+    _queriedViewFrustumMutex.unlock();
 
     // Update my voxel servers with my current voxel query...
     queryOctree(NodeType::VoxelServer, PacketTypeVoxelQuery, _voxelServerJurisdictions);
@@ -2379,6 +2394,7 @@ void Application::queryOctree(NodeType_t serverType, PacketType packetType, Node
     _voxelQuery.setCameraEyeOffsetPosition(_viewFrustum.getEyeOffsetPosition());
     _voxelQuery.setOctreeSizeScale(_menu->getVoxelSizeScale());
     _voxelQuery.setBoundaryLevelAdjust(_menu->getBoundaryLevelAdjust());
+    _voxelCache->setLevelOfDetail(_menu->getVoxelSizeScale(), _menu->getBoundaryLevelAdjust());
 
     unsigned char voxelQueryPacket[MAX_PACKET_SIZE];
 
@@ -2519,6 +2535,14 @@ void Application::queryOctree(NodeType_t serverType, PacketType packetType, Node
             } else {
                 _voxelQuery.setMaxOctreePacketsPerSecond(0);
             }
+
+            // tell voxel servers what we have cached of what they're sending us, so they can skip what hasn't changed
+            if (inView && serverType == NodeType::VoxelServer) {
+                _voxelQuery.setCachedSubtrees(_voxelCache->takeSubtreesToAdvertise(nodeUUID, jurisdictions[nodeUUID],
+                                                                                   _viewFrustum));
+            } else {
+                _voxelQuery.setCachedSubtrees(OctreeCachedSubtrees());
+            }
             // set up the packet for sending...
             unsigned char* endOfVoxelQueryPacket = voxelQueryPacket;
 
@@ -3863,6 +3887,24 @@ void Application::domainChanged(const QString& domainHostname) {
     
     // reset the particle renderer
     _particles.clear();
+
+    // put away the old domain's voxels, and bring out what we have of the new one's
+    if (_voxelCache) {
+        _voxelCache->save();
+        _voxels.killLocalVoxels();
+        loadVoxelCache(domainHostname);
+    }
+}
+
+void Application::loadVoxelCache(const QString& domainHostname) {
+    if (domainHostname.isEmpty()) {
+        return;
+    }
+    QString cacheName = domainHostname;
+    cacheName.replace(QRegExp("[^A-Za-z0-9.-]"), "_");
+    if (_voxelCache->load(QStandardPaths::writableLocation(QStandardPaths::DataLocation) + "/voxelCache/" + cacheName)) {
+        _voxels.forceRedrawEntireTree();
+    }
 }
 
 void Application::nodeKilled(SharedNodePointer node) {
@@ -3890,11 +3932,17 @@ void Application::nodeKilled(SharedNodePointer node) {
 	    _voxelServerJurisdictions.erase(nodeUUID);
 	}
 
+	// forget what we told it about our voxel cache
+	if (_voxelCache) {
+	    _voxelCache->forgetServer(nodeUUID);
+	}
+
 	// also clean up scene stats for that server
 	_voxelSceneStatsLock.lockForWrite();
 	if (_octreeServerSceneStats.find(nodeUUID) != _octreeServerSceneStats.end()) {
 	    _octreeServerSceneStats.erase(nodeUUID);
 	}
+	_octreeServerPacketsMissedAtLastScene.erase(nodeUUID);
 	_voxelSceneStatsLock.unlock();
 
     } else if (node->getType() == NodeType::ParticleServer) {
@@ -3966,10 +4014,18 @@ int Application::parseOctreeStats(const QByteArray& packet, const HifiSockAddr&
         QUuid nodeUUID = server->getUUID();
 
         // now that we know the node ID, let's add these stats to the stats for that node...
+        // the scene was received whole if no packets of it were missed since the server's last scene completed
+        bool sceneReceivedWhole = false;
         _voxelSceneStatsLock.lockForWrite();
         if (_octreeServerSceneStats.find(nodeUUID) != _octreeServerSceneStats.end()) {
-            _octreeServerSceneStats[nodeUUID].unpackFromMessage(reinterpret_cast<const unsigned char*>(packet.data()),
-                                                                packet.size());
+            VoxelSceneStats& stats = _octreeServerSceneStats[nodeUUID];
+            stats.unpackFromMessage(reinterpret_cast<const unsigned char*>(packet.data()), packet.size());
+
+            unsigned int packetsMissed = stats.getIncomingLikelyLost() + stats.getIncomingOutOfOrder();
+            std::map<QUuid, unsigned int>::iterator lastScene = _octreeServerPacketsMissedAtLastScene.find(nodeUUID);
+            sceneReceivedWhole = lastScene != _octreeServerPacketsMissedAtLastScene.end()
+                && lastScene->second == packetsMissed;
+            _octreeServerPacketsMissedAtLastScene[nodeUUID] = packetsMissed;
         } else {
             _octreeServerSceneStats[nodeUUID] = temp;
         }
@@ -4007,6 +4063,16 @@ int Application::parseOctreeStats(const QByteArray& packet, const HifiSockAddr&
 	JurisdictionMap jurisdictionMap;
 	jurisdictionMap.copyContents(temp.getJurisdictionRoot(), temp.getJurisdictionEndNodes());
 	(*jurisdiction)[nodeUUID] = jurisdictionMap;
+
+        // a scene sent while we held still has everything in view we need, unless occlusion culling left some out or
+        // some of its packets never arrived
+        if (_voxelCache && server->getType() == NodeType::VoxelServer && !temp.isMoving() && sceneReceivedWhole
+                && !_menu->isOptionChecked(MenuOption::EnableOcclusionCulling)) {
+            _queriedViewFrustumMutex.lock();
+            ViewFrustum viewFrustum = _queriedViewFrustum;
+            _queriedViewFrustumMutex.unlock();
+            _voxelCache->sceneCompleted(jurisdictionMap, temp.getStart(), viewFrustum);
+        }
     }
     return statsMessageLength;
 }
@@ -4082,6 +4148,7 @@ void Application::loadScript(const QString& fileNameString) {
     scriptEngine->getVoxelsScriptingInterface()->setPacketSender(&_voxelEditSender);
     scriptEngine->getParticlesScriptingInterface()->setPacketSender(&_particleEditSender);
     scriptEngine->getParticlesScriptingInterface()->setParticleTree(_particles.getTree());
+    scriptEngine->getVoxelsScriptingInterface()->setVoxelTree(_voxels.getTree());
     
     // hook our avatar object into this script engine
     scriptEngine->setAvatarData( static_cast<Avatar*>(_myAvatar), "MyAvatar");
@@ -19,6 +19,7 @@
 #include <QList>
 #include <QStringList>
 #include <QPointer>
+#include <QMutex>
 
 #include <NetworkPacket.h>
 #include <NodeList.h>
@@ -26,6 +27,7 @@
 #include <ParticleCollisionSystem.h>
 #include <ParticleEditPacketSender.h>
 #include <ScriptEngine.h>
+#include <OctreeClientCache.h>
 #include <VoxelQuery.h>
 
 #include "Audio.h"
@@ -149,6 +151,8 @@ public:
     ViewFrustum* getViewFrustum() { return &_viewFrustum; }
     VoxelSystem* getVoxels() { return &_voxels; }
     ParticleTreeRenderer* getParticles() { return &_particles; }
+    VoxelEditPacketSender* getVoxelEditSender() { return &_voxelEditSender; }
+    ParticleEditPacketSender* getParticleEditSender() { return &_particleEditSender; }
     MetavoxelSystem* getMetavoxels() { return &_metavoxels; }
     VoxelSystem* getSharedVoxelSystem() { return &_sharedVoxelSystem; }
     VoxelTree* getClipboard() { return &_clipboard; }
@@ -301,6 +305,7 @@ private:
 
     void updateMyAvatar(float deltaTime);
     void queryOctree(NodeType_t serverType, PacketType packetType, NodeToJurisdictionMap& jurisdictions);
+    void loadVoxelCache(const QString& domainHostname);
     void loadViewFrustum(Camera& camera, ViewFrustum& viewFrustum);
 
     glm::vec3 getSunDirection();
@@ -356,6 +361,7 @@ private:
     Cloud _cloud;
 
     VoxelSystem _voxels;
+    OctreeClientCache* _voxelCache; // what we've received of each domain's voxels, kept on disk
     VoxelTree _clipboard; // if I copy/paste
     VoxelImporter* _voxelImporter;
     VoxelSystem _sharedVoxelSystem;
@@ -370,6 +376,8 @@ private:
     MetavoxelSystem _metavoxels;
 
     ViewFrustum _viewFrustum; // current state of view frustum, perspective, orientation, etc.
+    ViewFrustum _queriedViewFrustum; // the view last sent to the servers, read when their scenes complete
+    QMutex _queriedViewFrustumMutex; // scene stats are parsed on the voxel packet processor's thread
 
     Oscilloscope _audioScope;
 
@@ -481,6 +489,7 @@ private:
     NodeToJurisdictionMap _voxelServerJurisdictions;
     NodeToJurisdictionMap _particleServerJurisdictions;
     NodeToVoxelSceneStats _octreeServerSceneStats;
+    std::map<QUuid, unsigned int> _octreeServerPacketsMissedAtLastScene; // likely lost plus out of order, under the lock
     QReadWriteLock _voxelSceneStatsLock;
 
     std::vector<VoxelFade> _voxelFades;
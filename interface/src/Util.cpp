@@ -16,6 +16,7 @@
 #include <glm/gtx/quaternion.hpp>
 
 #include <AvatarData.h>
+#include <ParticleBroadphase.h>
 #include <SharedUtil.h>
 
 #include "InterfaceConfig.h"
@@ -655,6 +656,64 @@ void runTimingTests() {
     gettimeofday(&endTime, NULL);
     elapsedMsecs = diffclock(&startTime, &endTime);
     qDebug("vec3 assign and dot() usecs: %f", 1000.0f * elapsedMsecs / (float) numTests);
+
+    runParticleBroadphaseTimingTests();
+}
+
+//  Time the particle collision broadphase against checking every pair, for a few crowd sizes
+void runParticleBroadphaseTimingTests() {
+    const int NUM_CROWD_SIZES = 3;
+    const int CROWD_SIZES[NUM_CROWD_SIZES] = { 1000, 10000, 100000 };
+    const int BRUTE_FORCE_MAX_PARTICLES = 10000;
+    const int NUM_STEPS = 10;
+    const float PARTICLES_PER_CUBIC_METER = 0.5f;
+    const float PARTICLE_RADIUS = 0.1f / TREE_SCALE;
+
+    ParticleBroadphase broadphase;
+    QVector<glm::vec3> centers;
+    timeval startTime, endTime;
+
+    for (int crowd = 0; crowd < NUM_CROWD_SIZES; crowd++) {
+        int numParticles = CROWD_SIZES[crowd];
+
+        // keep the density the same as the crowd grows, so that the number of collisions grows with it
+        float side = powf(numParticles / PARTICLES_PER_CUBIC_METER, 1.0f / 3.0f) / TREE_SCALE;
+        centers.resize(numParticles);
+        for (int i = 0; i < numParticles; i++) {
+            centers[i] = glm::vec3(randFloat(), randFloat(), randFloat()) * side;
+        }
+
+        gettimeofday(&startTime, NULL);
+        int pairs = 0;
+        for (int step = 0; step < NUM_STEPS; step++) {
+            broadphase.clear();
+            for (int i = 0; i < numParticles; i++) {
+                broadphase.addParticle(centers[i], PARTICLE_RADIUS);
+            }
+            broadphase.findPairs();
+            pairs = broadphase.getParticlePairs().size();
+        }
+        gettimeofday(&endTime, NULL);
+        qDebug("particle broadphase, %d particles: %f msecs per step, %d pairs",
+               numParticles, diffclock(&startTime, &endTime) / NUM_STEPS, pairs);
+
+        if (numParticles <= BRUTE_FORCE_MAX_PARTICLES) {
+            const float OVERLAP_DISTANCE_SQUARED = (2.0f * PARTICLE_RADIUS) * (2.0f * PARTICLE_RADIUS);
+            gettimeofday(&startTime, NULL);
+            pairs = 0;
+            for (int i = 0; i < numParticles; i++) {
+                for (int j = i + 1; j < numParticles; j++) {
+                    glm::vec3 offset = centers[i] - centers[j];
+                    if (glm::dot(offset, offset) <= OVERLAP_DISTANCE_SQUARED) {
+                        pairs++;
+                    }
+                }
+            }
+            gettimeofday(&endTime, NULL);
+            qDebug("every pair, %d particles: %f msecs per step, %d pairs",
+                   numParticles, diffclock(&startTime, &endTime), pairs);
+        }
+    }
 }
 
 float loadSetting(QSettings* settings, const char* name, float defaultValue) {
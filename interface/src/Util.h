@@ -84,6 +84,7 @@ void renderSphereOutline(glm::vec3 position, float radius, int numSides, glm::ve
 void renderCircle(glm::vec3 position, float radius, glm::vec3 surfaceNormal, int numSides );
 
 void runTimingTests();
+void runParticleBroadphaseTimingTests();
 
 float loadSetting(QSettings* settings, const char* name, float defaultValue);
 
@@ -16,16 +16,17 @@
 #include "Application.h"
 #include "VoxelHideShowThread.h"
 
+const quint64 MSECS_TO_USECS = 1000;
+const quint64 SECS_TO_USECS = 1000 * MSECS_TO_USECS;
+const quint64 FRAME_RATE = 60;
+const quint64 USECS_PER_FRAME = SECS_TO_USECS / FRAME_RATE; // every 60fps
+
 VoxelHideShowThread::VoxelHideShowThread(VoxelSystem* theSystem) :
-    _theSystem(theSystem) {
+    _theSystem(theSystem),
+    _cullingScheduler("VoxelHideShowThread", USECS_PER_FRAME) {
 }
 
 bool VoxelHideShowThread::process() {
-    const quint64 MSECS_TO_USECS = 1000;
-    const quint64 SECS_TO_USECS = 1000 * MSECS_TO_USECS;
-    const quint64 FRAME_RATE = 60;
-    const quint64 USECS_PER_FRAME = SECS_TO_USECS / FRAME_RATE; // every 60fps
-
     quint64 start = usecTimestampNow();
     if (_theSystem) {
       _theSystem->checkForCulling();
@@ -39,10 +40,7 @@ bool VoxelHideShowThread::process() {
     }
 
     if (isStillRunning()) {
-        if (elapsed < USECS_PER_FRAME) {
-            quint64 sleepFor = USECS_PER_FRAME - elapsed;
-            usleep(sleepFor);
-        }
+        _cullingScheduler.waitForNextFrame();
     }
     return isStillRunning();  // keep running till they terminate us
 }
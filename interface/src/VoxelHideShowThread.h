@@ -11,6 +11,7 @@
 #ifndef __interface__VoxelHideShowThread__
 #define __interface__VoxelHideShowThread__
 
+#include <FrameScheduler.h>
 #include <GenericThread.h>
 #include "VoxelSystem.h"
 
@@ -26,6 +27,7 @@ protected:
 
 private:
     VoxelSystem* _theSystem;
+    FrameScheduler _cullingScheduler;
 };
 
 #endif // __interface__VoxelHideShowThread__
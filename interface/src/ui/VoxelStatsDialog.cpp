@@ -48,6 +48,7 @@ VoxelStatsDialog::VoxelStatsDialog(QWidget* parent, NodeToVoxelSceneStats* model
     _localVoxelsMemory = AddStatItem("Elements Memory");
     _voxelsRendered = AddStatItem("Voxels Rendered");
     _sendingMode = AddStatItem("Sending Mode");
+    _editsSent = AddStatItem("Edits Sent");
     
     layout()->setSizeConstraint(QLayout::SetFixedSize); 
 }
@@ -217,6 +218,22 @@ void VoxelStatsDialog::paintEvent(QPaintEvent* event) {
         "Leaves: " << serversLeavesString.toLocal8Bit().constData() << "";
     label->setText(statsValue.str().c_str());
 
+    // Edits Sent, and how many were dropped because a later edit of the same thing replaced them before they were sent
+    VoxelEditPacketSender* voxelEditSender = Application::getInstance()->getVoxelEditSender();
+    ParticleEditPacketSender* particleEditSender = Application::getInstance()->getParticleEditSender();
+    QString voxelEditsSentString = locale.toString((uint)voxelEditSender->getEditsSent());
+    QString voxelEditsCoalescedString = locale.toString((uint)voxelEditSender->getEditsCoalesced());
+    QString particleEditsSentString = locale.toString((uint)particleEditSender->getEditsSent());
+    QString particleEditsCoalescedString = locale.toString((uint)particleEditSender->getEditsCoalesced());
+    label = _labels[_editsSent];
+    statsValue.str("");
+    statsValue <<
+        "Voxels: " << voxelEditsSentString.toLocal8Bit().constData() << " / " <<
+        "Coalesced: " << voxelEditsCoalescedString.toLocal8Bit().constData() << " / " <<
+        "Particles: " << particleEditsSentString.toLocal8Bit().constData() << " / " <<
+        "Coalesced: " << particleEditsCoalescedString.toLocal8Bit().constData() << "";
+    label->setText(statsValue.str().c_str());
+
     showAllOctreeServers();
 
     this->QDialog::paintEvent(event);
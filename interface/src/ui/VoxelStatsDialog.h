@@ -61,6 +61,7 @@ private:
     int _localVoxels;
     int _localVoxelsMemory;
     int _voxelsRendered;
+    int _editsSent;
     int _voxelServerLables[MAX_VOXEL_SERVERS];
     int _voxelServerLabelsCount;
     details _extraServerDetails[MAX_VOXEL_SERVERS];
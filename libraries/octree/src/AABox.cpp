@@ -255,6 +255,11 @@ bool AABox::findCapsulePenetration(const glm::vec3& start, const glm::vec3& end,
     return true;
 }
 
+float AABox::distanceToPoint(const glm::vec3& point) const {
+    glm::vec3 closestPoint = glm::clamp(point, _corner, _corner + glm::vec3(_scale, _scale, _scale));
+    return glm::distance(point, closestPoint);
+}
+
 glm::vec3 AABox::getClosestPointOnFace(const glm::vec3& point, BoxFace face) const {
     switch (face) {
         case MIN_X_FACE:
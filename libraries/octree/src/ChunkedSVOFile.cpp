@@ -0,0 +1,255 @@
+//
+//  ChunkedSVOFile.cpp
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <zlib.h>
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDebug>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+
+#include <OctalCode.h>
+
+#include "ChunkedSVOFile.h"
+
+bool ChunkedSVOFile::isChunkedSVOData(const unsigned char* data, quint64 length) {
+    if (length < sizeof(CHUNKED_SVO_MAGIC)) {
+        return false;
+    }
+    quint32 magic = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+    return magic == CHUNKED_SVO_MAGIC;
+}
+
+bool ChunkedSVOFile::readIndex(const unsigned char* data, quint64 length, ChunkedSVOHeader& header,
+                               QVector<SVOChunk>& chunks) {
+    return readHeader(data, length, header) && header.chunkTableOffset <= length
+        && readChunkTable(data + header.chunkTableOffset, length - header.chunkTableOffset, header, chunks);
+}
+
+bool ChunkedSVOFile::readHeader(const unsigned char* data, quint64 length, ChunkedSVOHeader& header) {
+    if (length < (quint64)HEADER_SIZE) {
+        return false;
+    }
+    QByteArray headerBytes = QByteArray::fromRawData((const char*)data, HEADER_SIZE);
+    QDataStream headerStream(headerBytes);
+
+    quint32 magic;
+    quint8 formatVersion;
+    quint8 dataType;
+    quint8 dataVersion;
+    headerStream >> magic >> formatVersion >> dataType >> dataVersion >> header.chunkLevel >> header.chunkCount
+        >> header.chunkTableOffset;
+    if (magic != CHUNKED_SVO_MAGIC || formatVersion != CHUNKED_SVO_FORMAT_VERSION) {
+        return false;
+    }
+    header.dataType = (PacketType)dataType;
+    header.dataVersion = (PacketVersion)dataVersion;
+    return true;
+}
+
+bool ChunkedSVOFile::readChunkTable(const unsigned char* table, quint64 length, const ChunkedSVOHeader& header,
+                                    QVector<SVOChunk>& chunks) {
+    // a damaged count could ask for more chunks than there's memory for, each takes at least the smallest entry
+    const quint64 MIN_CHUNK_TABLE_ENTRY_SIZE = sizeof(quint8) + sizeof(quint64) + 3 * sizeof(quint32) + sizeof(quint8);
+    if (header.chunkCount > length / MIN_CHUNK_TABLE_ENTRY_SIZE) {
+        return false;
+    }
+    QByteArray tableBytes = QByteArray::fromRawData((const char*)table, length);
+    QDataStream tableStream(tableBytes);
+
+    chunks.resize(header.chunkCount);
+    for (quint32 i = 0; i < header.chunkCount; i++) {
+        SVOChunk& chunk = chunks[i];
+        quint8 sectionCount;
+        tableStream >> sectionCount;
+        int codeLength = bytesRequiredForCodeLength(sectionCount);
+        chunk.octalCode.resize(codeLength);
+        chunk.octalCode[0] = sectionCount;
+        tableStream.readRawData(chunk.octalCode.data() + 1, codeLength - 1);
+        tableStream >> chunk.offset >> chunk.storedSize >> chunk.size >> chunk.checksum >> chunk.flags;
+
+        if (tableStream.status() != QDataStream::Ok || chunk.offset > header.chunkTableOffset
+                || chunk.storedSize > header.chunkTableOffset - chunk.offset) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ChunkedSVOFile::writeHeader(QIODevice& device, const ChunkedSVOHeader& header) {
+    QDataStream stream(&device);
+    stream << CHUNKED_SVO_MAGIC << CHUNKED_SVO_FORMAT_VERSION << (quint8)header.dataType << (quint8)header.dataVersion
+        << header.chunkLevel << header.chunkCount << header.chunkTableOffset;
+}
+
+void ChunkedSVOFile::writeChunkTable(QIODevice& device, const QVector<SVOChunk>& chunks) {
+    QDataStream stream(&device);
+    foreach (const SVOChunk& chunk, chunks) {
+        stream.writeRawData(chunk.octalCode.constData(), chunk.octalCode.size());
+        stream << chunk.offset << chunk.storedSize << chunk.size << chunk.checksum << chunk.flags;
+    }
+}
+
+void ChunkedSVOFile::prepareChunk(SVOChunk& chunk, const QByteArray& bitstream, bool wantCompression) {
+    chunk.size = bitstream.size();
+    chunk.flags = 0;
+    chunk.bitstream = bitstream;
+
+    if (wantCompression) {
+        QByteArray compressed = qCompress(bitstream);
+        if (compressed.size() < bitstream.size()) {
+            chunk.flags |= SVO_CHUNK_COMPRESSED;
+            chunk.bitstream = compressed;
+        }
+    }
+    chunk.storedSize = chunk.bitstream.size();
+    chunk.checksum = checksum(chunk.bitstream.constData(), chunk.storedSize);
+    chunk.isValid = true;
+}
+
+quint32 ChunkedSVOFile::checksum(const char* data, quint32 length) {
+    return crc32(crc32(0L, Z_NULL, 0), (const Bytef*)data, length);
+}
+
+class SVOChunkDecoder : public QRunnable {
+public:
+    SVOChunkDecoder(const unsigned char* data, SVOChunk& chunk) : _data(data), _chunk(chunk) { }
+
+    virtual void run() {
+        const char* stored = (const char*)_data + _chunk.offset;
+        if (ChunkedSVOFile::checksum(stored, _chunk.storedSize) != _chunk.checksum) {
+            return;
+        }
+        if (_chunk.flags & SVO_CHUNK_COMPRESSED) {
+            _chunk.bitstream = qUncompress((const uchar*)stored, _chunk.storedSize);
+        } else {
+            _chunk.bitstream = QByteArray::fromRawData(stored, _chunk.storedSize);
+        }
+        _chunk.isValid = ((quint32)_chunk.bitstream.size() == _chunk.size);
+    }
+
+private:
+    const unsigned char* _data;
+    SVOChunk& _chunk;
+};
+
+void ChunkedSVOFile::decodeChunks(const unsigned char* data, QVector<SVOChunk>& chunks) {
+    // detach before handing out references to the chunks
+    SVOChunk* chunkData = chunks.data();
+
+    QThreadPool decoders;
+    for (int i = 0; i < chunks.size(); i++) {
+        chunkData[i].isValid = false;
+        if (chunkData[i].isWanted) {
+            decoders.start(new SVOChunkDecoder(data, chunkData[i]));
+        }
+    }
+    decoders.waitForDone();
+}
+
+ChunkedSVOReader::ChunkedSVOReader(const QString& fileName) :
+    _file(fileName),
+    _data(NULL),
+    _isChunked(false)
+{
+    if (!_file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    _data = _file.map(0, _file.size());
+    if (_data) {
+        _isChunked = ChunkedSVOFile::isChunkedSVOData(_data, _file.size())
+            && ChunkedSVOFile::readIndex(_data, _file.size(), _header, _chunks) && !_chunks.isEmpty();
+        return;
+    }
+
+    // without a mapping, the header and the chunk table are all we read up front
+    QByteArray headerBytes = _file.read(ChunkedSVOFile::HEADER_SIZE);
+    if (!ChunkedSVOFile::readHeader((const unsigned char*)headerBytes.constData(), headerBytes.size(), _header)
+            || _header.chunkTableOffset > (quint64)_file.size() || !_file.seek(_header.chunkTableOffset)) {
+        return;
+    }
+    QByteArray tableBytes = _file.readAll();
+    _isChunked = ChunkedSVOFile::readChunkTable((const unsigned char*)tableBytes.constData(), tableBytes.size(), _header,
+                                                _chunks) && !_chunks.isEmpty();
+}
+
+bool ChunkedSVOReader::readStoredBytes(int chunkIndex, QByteArray& storedBytes) {
+    const SVOChunk& chunk = _chunks.at(chunkIndex);
+    if (_data) {
+        storedBytes = QByteArray::fromRawData((const char*)_data + chunk.offset, chunk.storedSize);
+        return true;
+    }
+    QMutexLocker locker(&_fileMutex);
+    if (!_file.seek(chunk.offset)) {
+        return false;
+    }
+    storedBytes = _file.read(chunk.storedSize);
+    return (quint32)storedBytes.size() == chunk.storedSize;
+}
+
+bool ChunkedSVOReader::readChunk(int chunkIndex, QByteArray& bitstream) {
+    const SVOChunk& chunk = _chunks.at(chunkIndex);
+    QByteArray storedBytes;
+    if (!readStoredBytes(chunkIndex, storedBytes)
+            || ChunkedSVOFile::checksum(storedBytes.constData(), storedBytes.size()) != chunk.checksum) {
+        return false;
+    }
+    bitstream = (chunk.flags & SVO_CHUNK_COMPRESSED) ? qUncompress(storedBytes) : storedBytes;
+    return (quint32)bitstream.size() == chunk.size;
+}
+
+QByteArray ChunkedSVOReader::getMappedData() const {
+    return _data ? QByteArray::fromRawData((const char*)_data, _file.size()) : QByteArray();
+}
+
+ChunkedSVOWriter::ChunkedSVOWriter(const QString& fileName, PacketType dataType, PacketVersion dataVersion,
+                                   int chunkLevel) :
+    _file(fileName),
+    _chunks(1),
+    _hasTopChunk(false)
+{
+    _header.dataType = dataType;
+    _header.dataVersion = dataVersion;
+    _header.chunkLevel = chunkLevel;
+
+    // leave room for the header, it's written once the chunk table's offset is known
+    if (_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        _file.write(QByteArray(ChunkedSVOFile::HEADER_SIZE, 0));
+    }
+}
+
+void ChunkedSVOWriter::writeChunk(const SVOChunk& chunk, const QByteArray& storedBytes, bool isTopChunk) {
+    SVOChunk written = chunk;
+    written.offset = _file.pos();
+    written.bitstream.clear();
+    _file.write(storedBytes);
+
+    if (isTopChunk) {
+        _chunks[0] = written;
+        _hasTopChunk = true;
+    } else {
+        _chunks.append(written);
+    }
+}
+
+bool ChunkedSVOWriter::finish() {
+    if (!_hasTopChunk) {
+        qDebug() << "Chunked SVO file" << _file.fileName() << "has no top chunk.";
+        _file.close();
+        return false;
+    }
+    _header.chunkCount = _chunks.size();
+    _header.chunkTableOffset = _file.pos();
+    ChunkedSVOFile::writeChunkTable(_file, _chunks);
+    _file.seek(0);
+    ChunkedSVOFile::writeHeader(_file, _header);
+
+    bool fileOk = (_file.error() == QFile::NoError);
+    _file.close();
+    return fileOk;
+}
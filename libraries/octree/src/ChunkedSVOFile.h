@@ -0,0 +1,152 @@
+//
+//  ChunkedSVOFile.h
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  The layout of version 2 (chunked) SVO files.
+//
+//  A version 1 SVO file is the bitstream of the whole tree, optionally after the data packet type and version. A
+//  version 2 file splits the tree into chunks that can be checked, decompressed and loaded independently:
+//
+//      header       magic "SVO2", format version, data packet type and version, chunk level, chunk count and the
+//                   offset of the chunk table
+//      chunks       the bitstream of each chunk, compressed or not
+//      chunk table  for each chunk the octal code of its root, its offset and size in the file, its decoded size, the
+//                   CRC32 of its stored bytes and its flags
+//
+//  The first chunk is the top of the tree, the root down to the chunk level, and each of the others is the whole
+//  subtree under one element at the chunk level. A chunk's bitstream starts with its root's octal code, as the
+//  packets of a version 1 file do, so chunks can be read into the tree in any order once the top has been.
+//
+
+#ifndef __hifi__ChunkedSVOFile__
+#define __hifi__ChunkedSVOFile__
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QIODevice>
+#include <QtCore/QMutex>
+#include <QtCore/QVector>
+
+#include <PacketHeaders.h>
+
+const quint32 CHUNKED_SVO_MAGIC = 0x53564f32; // "SVO2"
+const quint8 CHUNKED_SVO_FORMAT_VERSION = 2;
+
+/// the depth of the roots of the chunks below the top chunk, 3 gives up to 512 of them
+const int DEFAULT_SVO_CHUNK_LEVEL = 3;
+
+const quint8 SVO_CHUNK_COMPRESSED = 1;
+
+class SVOChunk {
+public:
+    SVOChunk() : offset(0), storedSize(0), size(0), checksum(0), flags(0), isWanted(true), isValid(false) { }
+
+    QByteArray octalCode;
+    quint64 offset;
+    quint32 storedSize;
+    quint32 size;
+    quint32 checksum;
+    quint8 flags;
+
+    bool isWanted; // read the chunk into the tree
+    bool isValid; // the checksum matched and the chunk decompressed to its size
+    QByteArray bitstream; // the decoded chunk, pointing into the file's data when it isn't compressed
+};
+
+class ChunkedSVOHeader {
+public:
+    ChunkedSVOHeader() : dataType(PacketTypeUnknown), dataVersion(0), chunkLevel(DEFAULT_SVO_CHUNK_LEVEL), chunkCount(0),
+        chunkTableOffset(0) { }
+
+    PacketType dataType;
+    PacketVersion dataVersion;
+    quint8 chunkLevel;
+    quint32 chunkCount;
+    quint64 chunkTableOffset;
+};
+
+class ChunkedSVOFile {
+public:
+    static const int HEADER_SIZE = sizeof(quint32) + 4 * sizeof(quint8) + sizeof(quint32) + sizeof(quint64);
+
+    /// does the file's data start like a version 2 file
+    static bool isChunkedSVOData(const unsigned char* data, quint64 length);
+
+    /// reads the header and chunk table of a version 2 file, false if they're damaged
+    static bool readIndex(const unsigned char* data, quint64 length, ChunkedSVOHeader& header, QVector<SVOChunk>& chunks);
+
+    /// the two halves of readIndex(), for files that are read rather than mapped
+    static bool readHeader(const unsigned char* data, quint64 length, ChunkedSVOHeader& header);
+    static bool readChunkTable(const unsigned char* table, quint64 length, const ChunkedSVOHeader& header,
+                               QVector<SVOChunk>& chunks);
+
+    static void writeHeader(QIODevice& device, const ChunkedSVOHeader& header);
+    static void writeChunkTable(QIODevice& device, const QVector<SVOChunk>& chunks);
+
+    /// sets up a chunk for a bitstream to be written, compressing it if that makes it smaller
+    static void prepareChunk(SVOChunk& chunk, const QByteArray& bitstream, bool wantCompression);
+
+    /// Checks and decompresses the wanted chunks of a file's data on all cores. Chunks that aren't compressed are
+    /// decoded in place, so the data must outlive their bitstreams.
+    static void decodeChunks(const unsigned char* data, QVector<SVOChunk>& chunks);
+
+    static quint32 checksum(const char* data, quint32 length);
+};
+
+/// Reads a chunked SVO file a chunk at a time, for tools that work through files bigger than memory. The file is memory
+/// mapped when it can be, and read a chunk at a time when it can't.
+class ChunkedSVOReader {
+public:
+    ChunkedSVOReader(const QString& fileName);
+
+    bool isOpen() const { return _file.isOpen(); }
+    bool isChunked() const { return _isChunked; } // false for version 1 files and damaged version 2 ones
+    const ChunkedSVOHeader& getHeader() const { return _header; }
+    const QVector<SVOChunk>& getChunks() const { return _chunks; }
+
+    /// the chunk's bytes as they're stored in the file, without checking them. Safe to call from many threads at once.
+    bool readStoredBytes(int chunkIndex, QByteArray& storedBytes);
+
+    /// Checks and decompresses a chunk, false if it's damaged. Safe to call from many threads at once.
+    bool readChunk(int chunkIndex, QByteArray& bitstream);
+
+    /// the whole file, for version 1 files, empty if it can't be mapped
+    QByteArray getMappedData() const;
+
+private:
+    QFile _file;
+    QMutex _fileMutex;
+    const unsigned char* _data;
+    bool _isChunked;
+    ChunkedSVOHeader _header;
+    QVector<SVOChunk> _chunks;
+};
+
+/// Writes a chunked SVO file a chunk at a time, so that the whole tree never has to be in memory. The top chunk comes
+/// first in the chunk table wherever it is in the file, so it can be written last.
+class ChunkedSVOWriter {
+public:
+    ChunkedSVOWriter(const QString& fileName, PacketType dataType, PacketVersion dataVersion,
+                     int chunkLevel = DEFAULT_SVO_CHUNK_LEVEL);
+
+    bool isOpen() const { return _file.isOpen(); }
+    int getChunkCount() const { return _chunks.size() - (_hasTopChunk ? 0 : 1); }
+    quint64 getBytesWritten() const { return _file.pos(); }
+
+    /// writes the stored bytes of a chunk, either prepared by ChunkedSVOFile::prepareChunk() or copied from another file
+    void writeChunk(const SVOChunk& chunk, const QByteArray& storedBytes, bool isTopChunk = false);
+
+    /// writes the chunk table and header and closes the file, false if any of it couldn't be written
+    bool finish();
+
+private:
+    QFile _file;
+    ChunkedSVOHeader _header;
+    QVector<SVOChunk> _chunks;
+    bool _hasTopChunk;
+};
+
+#endif /* defined(__hifi__ChunkedSVOFile__) */
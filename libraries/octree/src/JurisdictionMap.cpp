@@ -20,7 +20,10 @@
 // standard assignment
 // copy assignment 
 JurisdictionMap& JurisdictionMap::operator=(const JurisdictionMap& other) {
-    copyContents(other);
+    if (this != &other) {
+        QMutexLocker locker(&_mutex);
+        copyContents(other);
+    }
     return *this;
 }
 
@@ -70,6 +73,7 @@ void JurisdictionMap::copyContents(unsigned char* rootCodeIn, const std::vector<
 }
 
 void JurisdictionMap::copyContents(const JurisdictionMap& other) {
+    QMutexLocker locker(&other._mutex);
     _nodeType = other._nodeType;
     copyContents(other._rootOctalCode, other._endNodes);
 }
@@ -79,6 +83,7 @@ JurisdictionMap::~JurisdictionMap() {
 }
 
 void JurisdictionMap::clear() {
+    _trie.clear();
     if (_rootOctalCode) {
         delete[] _rootOctalCode;
         _rootOctalCode = NULL;
@@ -172,6 +177,7 @@ JurisdictionMap::JurisdictionMap(const char* rootHexCode, const char* endNodesHe
         myDebugPrintOctalCode(endNodeOctcode, true);
 
     }    
+    buildTrie();
 }
 
 
@@ -179,9 +185,80 @@ void JurisdictionMap::init(unsigned char* rootOctalCode, const std::vector<unsig
     clear(); // clean up our own memory
     _rootOctalCode = rootOctalCode;
     _endNodes = endNodes;
+    buildTrie();
+}
+
+const int NO_TRIE_NODE = -1;
+
+JurisdictionMap::TrieNode::TrieNode() :
+    flags(0)
+{
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        children[i] = NO_TRIE_NODE;
+    }
+}
+
+void JurisdictionMap::buildTrie() {
+    _trie.clear();
+    _trie.push_back(TrieNode());
+    if (_rootOctalCode) {
+        _trie[addTriePath(_rootOctalCode, TRIE_ROOT_PATH)].flags |= TRIE_ROOT;
+    }
+    for (size_t i = 0; i < _endNodes.size(); i++) {
+        if (_endNodes[i]) {
+            _trie[addTriePath(_endNodes[i], 0)].flags |= TRIE_END_NODE;
+        }
+    }
+}
+
+// adds the sections of an octal code that aren't in the trie yet, and returns the index of its last one
+int JurisdictionMap::addTriePath(const unsigned char* octalCode, quint8 pathFlags) {
+    int trieNode = 0;
+    _trie[trieNode].flags |= pathFlags;
+    int sections = numberOfThreeBitSectionsInCode(octalCode);
+    for (int section = 0; section < sections; section++) {
+        int branch = getOctalCodeSectionValue(octalCode, section);
+        if (_trie[trieNode].children[branch] == NO_TRIE_NODE) {
+            _trie[trieNode].children[branch] = _trie.size();
+            _trie.push_back(TrieNode());
+        }
+        trieNode = _trie[trieNode].children[branch];
+        _trie[trieNode].flags |= pathFlags;
+    }
+    return trieNode;
 }
 
 JurisdictionMap::Area JurisdictionMap::isMyJurisdiction(const unsigned char* nodeOctalCode, int childIndex) const {
+    if (_trie.empty()) {
+        return BELOW; // no root, like a map that's being unpacked
+    }
+
+    // walk down the node's octal code for as long as the trie has it, noting the root and end nodes we pass
+    bool isUnderRoot = false;
+    bool isUnderEndNode = false;
+    int sections = numberOfThreeBitSectionsInCode(nodeOctalCode);
+    int trieNode = 0;
+    for (int section = 0; ; section++) {
+        quint8 flags = _trie[trieNode].flags;
+        isUnderRoot = isUnderRoot || (flags & TRIE_ROOT);
+        isUnderEndNode = isUnderEndNode || (flags & TRIE_END_NODE);
+        if (section == sections) {
+            // the whole code is in the trie, so the node is the root or an ancestor of it if it's on the root's path
+            if (flags & TRIE_ROOT_PATH) {
+                return ABOVE;
+            }
+            break;
+        }
+        trieNode = _trie[trieNode].children[getOctalCodeSectionValue(nodeOctalCode, section)];
+        if (trieNode == NO_TRIE_NODE) {
+            break;
+        }
+    }
+    return (isUnderRoot && !isUnderEndNode) ? WITHIN : BELOW;
+}
+
+JurisdictionMap::Area JurisdictionMap::isMyJurisdictionByScan(const unsigned char* nodeOctalCode,
+                                                              int childIndex) const {
     // to be in our jurisdiction, we must be under the root...
 
     // if the node is an ancestor of my root, then we return ABOVE
@@ -228,6 +305,7 @@ bool JurisdictionMap::readFromFile(const char* filename) {
         _endNodes.push_back(octcode);
     }
     settings.endGroup();
+    buildTrie();
     return true;
 }
 
@@ -280,7 +358,24 @@ int JurisdictionMap::packEmptyJurisdictionIntoMessage(NodeType_t type, unsigned
     return destinationBuffer - bufferStart; // includes header!
 }
 
+QString JurisdictionMap::getRootHexString() const {
+    QMutexLocker locker(&_mutex);
+    return octalCodeToHexString(_rootOctalCode);
+}
+
+QStringList JurisdictionMap::getEndNodeHexStrings() const {
+    QMutexLocker locker(&_mutex);
+    QStringList endNodes;
+    for (size_t i = 0; i < _endNodes.size(); i++) {
+        if (_endNodes[i]) {
+            endNodes << octalCodeToHexString(_endNodes[i]);
+        }
+    }
+    return endNodes;
+}
+
 int JurisdictionMap::packIntoMessage(unsigned char* destinationBuffer, int availableBytes) {
+    QMutexLocker locker(&_mutex);
     unsigned char* bufferStart = destinationBuffer;
     
     int headerLength = populatePacketHeader(reinterpret_cast<char*>(destinationBuffer), PacketTypeJurisdiction);
@@ -368,6 +463,7 @@ int JurisdictionMap::unpackFromMessage(const unsigned char* sourceBuffer, int av
             }
         }
     }
+    buildTrie();
     
     return sourceBuffer - startPosition; // includes header!
 }
@@ -13,11 +13,15 @@
 #include <stdint.h>
 #include <vector>
 
+#include <QtCore/QMutex>
 #include <QtCore/QString>
+#include <QtCore/QStringList>
 #include <QtCore/QUuid>
 
 #include <Node.h>
 
+#include "OctreeConstants.h"
+
 class JurisdictionMap {
 public:
     enum Area {
@@ -45,8 +49,15 @@ public:
     JurisdictionMap(const char* rootHextString, const char* endNodesHextString);
     ~JurisdictionMap();
 
+    /// Whether an element is above, within or below the jurisdiction, found by walking a trie of the root and end nodes
+    /// along its octal code, so it takes time in the depth of the element rather than in the number of end nodes. The
+    /// child index doesn't change the answer: an element whose child could be the root is itself above the root.
     Area isMyJurisdiction(const unsigned char* nodeOctalCode, int childIndex) const;
 
+    /// The same answer as isMyJurisdiction(), found by checking the element against the root and each end node in turn.
+    /// Kept to check and benchmark the trie against.
+    Area isMyJurisdictionByScan(const unsigned char* nodeOctalCode, int childIndex) const;
+
     bool writeToFile(const char* filename);
     bool readFromFile(const char* filename);
 
@@ -54,6 +65,10 @@ public:
     unsigned char* getEndNodeOctalCode(int index) const { return _endNodes[index]; }
     int getEndNodeCount() const { return _endNodes.size(); }
 
+    /// the root and end nodes as hex strings, as they're given in server configs
+    QString getRootHexString() const;
+    QStringList getEndNodeHexStrings() const;
+
     void copyContents(unsigned char* rootCodeIn, const std::vector<unsigned char*>& endNodesIn);
 
     int unpackFromMessage(const unsigned char* sourceBuffer, int availableBytes);
@@ -71,10 +86,34 @@ private:
     void copyContents(const JurisdictionMap& other); // use assignment instead
     void clear();
     void init(unsigned char* rootOctalCode, const std::vector<unsigned char*>& endNodes);
+    void buildTrie();
+    int addTriePath(const unsigned char* octalCode, quint8 pathFlags);
 
     unsigned char* _rootOctalCode;
     std::vector<unsigned char*> _endNodes;
     NodeType_t _nodeType;
+
+    enum TrieFlags {
+        TRIE_ROOT_PATH = 1, // the root, or one of its ancestors
+        TRIE_ROOT = 2,
+        TRIE_END_NODE = 4
+    };
+
+    /// one section of the octal code of the root or of an end node, with the indexes of its children in the trie
+    class TrieNode {
+    public:
+        TrieNode();
+
+        int children[NUMBER_OF_CHILDREN];
+        quint8 flags;
+    };
+
+    /// rebuilt whenever the root or end nodes change, its first node is the root of the tree
+    std::vector<TrieNode> _trie;
+
+    /// Guards assigning a new jurisdiction to a server's map against packing or copying it on other threads. Servers
+    /// assign it with their tree locked for writing, so checking elements against it with the tree locked is safe.
+    mutable QMutex _mutex;
 };
 
 /// Map between node IDs and their reported JurisdictionMap. Typically used by classes that need to know which nodes are 
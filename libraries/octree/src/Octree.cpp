@@ -10,6 +10,7 @@
 #define _USE_MATH_DEFINES
 #endif
 
+#include <cfloat>
 #include <cstring>
 #include <cstdio>
 #include <cmath>
@@ -18,6 +19,8 @@
 #include <glm/gtc/noise.hpp>
 
 #include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
 #include <QImage>
 #include <QRgb>
 
@@ -33,6 +36,7 @@
 #include "OctreeConstants.h"
 #include "OctreeElementBag.h"
 #include "Octree.h"
+#include "OctreePager.h"
 
 float boundaryDistanceForRenderLevel(unsigned int renderLevel, float voxelSizeScale) {
     return voxelSizeScale / powf(2, renderLevel);
@@ -44,6 +48,7 @@ Octree::Octree(bool shouldReaverage) :
     _stopImport(false) {
     _rootNode = NULL;
     _isViewing = false;
+    _pager = NULL;
 }
 
 Octree::~Octree() {
@@ -182,6 +187,9 @@ OctreeElement* Octree::createMissingNode(OctreeElement* lastParentNode, const un
 
 int Octree::readNodeData(OctreeElement* destinationNode, const unsigned char* nodeData, int bytesLeftToRead,
                             ReadBitstreamToTreeParams& args) {
+    // whatever's read under this node changes its hash
+    destinationNode->markDescendantsHashDirty();
+
     // give this destination node the child mask from the packet
     const unsigned char ALL_CHILDREN_ASSUMED_TO_EXIST = 0xFF;
     unsigned char colorInPacketMask = *nodeData;
@@ -295,6 +303,7 @@ void Octree::readBitstreamToTree(const unsigned char * bitstream, unsigned long
 
         theseBytesRead += readNodeData(bitstreamRootNode, bitstreamAt + octalCodeBytes,
                                        bufferSizeBytes - (bytesRead + octalCodeBytes), args);
+        markPathHashesDirty(bitstreamRootNode->getOctalCode());
 
         // skip bitstream to new startPoint
         bitstreamAt += theseBytesRead;
@@ -463,6 +472,9 @@ void Octree::processRemoveOctreeElementsBitstream(const unsigned char* bitstream
         int voxelDataSize = bytesRequiredForCodeLength(codeLength) + SIZE_OF_COLOR_DATA;
 
         if (atByte + voxelDataSize <= bufferSizeBytes) {
+            if (_pager) {
+                _pager->willEditOctalCode(voxelCode, true);
+            }
             deleteOctalCodeFromTree(voxelCode, COLLAPSE_EMPTY_TREE);
             voxelCode += voxelDataSize;
             atByte += voxelDataSize;
@@ -860,6 +872,22 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
             return bytesAtThisLevel;
         }
 
+        // If the client has this subtree cached from an earlier visit, at at least the detail it needs from here, and it
+        // hasn't changed since then, then we can skip it too
+        if (params.cachedSubtrees && !params.cachedSubtrees->isEmpty()
+                && numberOfThreeBitSectionsInCode(node->getOctalCode()) == CLIENT_CACHE_SUBTREE_LEVEL) {
+            OctreeCachedSubtrees::const_iterator cached = params.cachedSubtrees->constFind(QByteArray::fromRawData(
+                (const char*)node->getOctalCode(), bytesRequiredForCodeLength(CLIENT_CACHE_SUBTREE_LEVEL)));
+            if (cached != params.cachedSubtrees->constEnd() && !node->hasChangedSince(cached->version - CHANGE_FUDGE)
+                    && node->distanceToCamera(*params.viewFrustum) >= cached->viewDistance) {
+                if (params.stats) {
+                    params.stats->skippedNoChange(node);
+                }
+                params.stopReason = EncodeBitstreamParams::NO_CHANGE;
+                return bytesAtThisLevel;
+            }
+        }
+
         // If the user also asked for occlusion culling, check if this node is occluded, but only if it's not a leaf.
         // leaf occlusion is handled down below when we check child nodes
         if (params.wantOcclusionCulling && !node->isLeaf()) {
@@ -1299,25 +1327,44 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
     return bytesAtThisLevel;
 }
 
-bool Octree::readFromSVOFile(const char* fileName) {
+bool Octree::readFromSVOFile(const char* fileName, const JurisdictionMap* jurisdictionMap, bool isProgressive) {
     bool fileOk = false;
-    std::ifstream file(fileName, std::ios::in|std::ios::binary|std::ios::ate);
-    if(file.is_open()) {
+    QFile file(fileName);
+    if (file.open(QIODevice::ReadOnly)) {
         emit importSize(1.0f, 1.0f, 1.0f);
         emit importProgress(0);
 
         qDebug("Loading file %s...", fileName);
 
-        // get file length....
-        unsigned long fileLength = file.tellg();
-        file.seekg( 0, std::ios::beg );
+        unsigned long fileLength = file.size();
+
+        // map the file rather than reading it into a buffer, and only read it if it can't be mapped
+        QByteArray entireFile;
+        const unsigned char* fileData = file.map(0, fileLength);
+        if (!fileData) {
+            entireFile = file.readAll();
+            fileData = (const unsigned char*)entireFile.constData();
+        }
+
+        if (ChunkedSVOFile::isChunkedSVOData(fileData, fileLength)) {
+            fileOk = readFromChunkedSVOData(fileName, fileData, fileLength, jurisdictionMap, isProgressive);
+            if (_pager) {
+                if (isProgressive) {
+                    lockForWrite();
+                }
+                _pager->addResidentPages();
+                if (isProgressive) {
+                    unlock();
+                }
+            }
+            emit importProgress(100);
+            file.close();
+            return fileOk;
+        }
 
-        // read the entire file into a buffer, WHAT!? Why not.
-        unsigned char* entireFile = new unsigned char[fileLength];
-        file.read((char*)entireFile, fileLength);
         bool wantImportProgress = true;
 
-        unsigned char* dataAt = entireFile;
+        const unsigned char* dataAt = fileData;
         unsigned long  dataLength = fileLength;
 
         // before reading the file, check to see if this version of the Octree supports file versions
@@ -1347,10 +1394,21 @@ bool Octree::readFromSVOFile(const char* fileName) {
             fileOk = true; // assume the file is ok
         }
         if (fileOk) {
+            // a version 1 file is one bitstream, so it's read in one piece even when the read is progressive
+            if (isProgressive) {
+                lockForWrite();
+            }
+            bool wasDirty = _isDirty;
             ReadBitstreamToTreeParams args(WANT_COLOR, NO_EXISTS_BITS, NULL, 0, NULL, wantImportProgress);
             readBitstreamToTree(dataAt, dataLength, args);
+            if (_pager) {
+                _pager->addResidentPages();
+            }
+            if (isProgressive) {
+                _isDirty = wasDirty;
+                unlock();
+            }
         }
-        delete[] entireFile;
 
         emit importProgress(100);
 
@@ -1359,6 +1417,200 @@ bool Octree::readFromSVOFile(const char* fileName) {
     return fileOk;
 }
 
+bool Octree::readFromChunkedSVOData(const char* fileName, const unsigned char* data, quint64 length,
+                                    const JurisdictionMap* jurisdictionMap, bool isProgressive) {
+    ChunkedSVOHeader header;
+    QVector<SVOChunk> chunks;
+    if (!ChunkedSVOFile::readIndex(data, length, header, chunks) || chunks.isEmpty()) {
+        qDebug("Chunked SVO file has a damaged header or chunk table.");
+        return false;
+    }
+
+    if (getWantSVOfileVersions()) {
+        PacketType expectedType = expectedDataPacketType();
+        PacketVersion expectedVersion = versionForPacketType(expectedType);
+        if (header.dataType != expectedType) {
+            qDebug("SVO file type mismatch. Expected: %c Got: %c", expectedType, header.dataType);
+            return false;
+        }
+        if (header.dataVersion != expectedVersion) {
+            qDebug("SVO file version mismatch. Expected: %d Got: %d", expectedVersion, header.dataVersion);
+            return false;
+        }
+    }
+
+    // the top chunk is always read, the others only if they reach into our jurisdiction, which is copied since a server
+    // can be given a new one while it loads
+    JurisdictionMap jurisdiction;
+    if (jurisdictionMap) {
+        jurisdiction = *jurisdictionMap;
+        jurisdictionMap = &jurisdiction;
+    }
+    int wantedChunks = 0;
+    for (int i = 0; i < chunks.size(); i++) {
+        SVOChunk& chunk = chunks[i];
+        chunk.isWanted = (i == 0 || !jurisdictionMap || jurisdictionMap->isMyJurisdiction(
+            (const unsigned char*)chunk.octalCode.constData(), CHECK_NODE_ONLY) != JurisdictionMap::BELOW);
+        if (chunk.isWanted) {
+            wantedChunks++;
+        }
+    }
+
+    // with a pager whose pages are these chunks, only the top is read now, and the others are paged in when they're needed
+    if (_pager && header.chunkLevel == _pager->getChunkLevel()) {
+        if (isProgressive) {
+            lockForWrite();
+        }
+        for (int i = 1; i < chunks.size(); i++) {
+            SVOChunk& chunk = chunks[i];
+            if (chunk.isWanted) {
+                _pager->addStoredPage(fileName, chunk);
+                chunk.isWanted = false;
+                wantedChunks--;
+            }
+        }
+        if (isProgressive) {
+            unlock();
+        }
+    }
+    qDebug("Reading %d of %d chunks...", wantedChunks, chunks.size());
+
+    // the top chunk is decoded and read before the others, so that a progressive read has the coarse levels of the whole
+    // tree in it as soon as possible
+    QVector<SVOChunk> topChunk(1, chunks.at(0));
+    ChunkedSVOFile::decodeChunks(data, topChunk);
+    readChunkToTree(topChunk.at(0), isProgressive);
+    emit importProgress(100 / wantedChunks);
+
+    chunks[0].isWanted = false;
+    ChunkedSVOFile::decodeChunks(data, chunks);
+
+    // the chunks are decoded on many threads, but read into the tree on this one, since a tree isn't safe to build on
+    // many at once
+    QVector<int> chunksToRead;
+    for (int i = 1; i < chunks.size(); i++) {
+        if (chunks.at(i).isWanted) {
+            chunksToRead.append(i);
+        }
+    }
+    int chunksRead = 1;
+    while (!chunksToRead.isEmpty() && !_stopImport) {
+        int next = isProgressive ? nearestChunkToLoadFocus(chunks, chunksToRead) : 0;
+        readChunkToTree(chunks.at(chunksToRead.at(next)), isProgressive);
+        chunksToRead.remove(next);
+
+        emit importProgress((100 * ++chunksRead) / wantedChunks);
+    }
+
+    if (isProgressive) {
+        QMutexLocker locker(&_loadFocusLock);
+        _loadFocus.clear();
+    }
+    return true;
+}
+
+void Octree::readChunkToTree(const SVOChunk& chunk, bool isProgressive) {
+    if (!chunk.isValid) {
+        qDebug() << "Skipping damaged SVO chunk rooted at"
+            << octalCodeToHexString((const unsigned char*)chunk.octalCode.constData());
+        return;
+    }
+    if (isProgressive) {
+        lockForWrite();
+    }
+    bool wasDirty = _isDirty;
+    ReadBitstreamToTreeParams args(WANT_COLOR, NO_EXISTS_BITS, NULL, 0, NULL, false);
+    readBitstreamToTree((const unsigned char*)chunk.bitstream.constData(), chunk.bitstream.size(), args);
+    if (isProgressive) {
+        // reading isn't an edit that needs saving, but it is a change that readers need to send
+        _isDirty = wasDirty;
+        markPathAsChanged((const unsigned char*)chunk.octalCode.constData());
+        unlock();
+    }
+}
+
+void Octree::setLoadFocus(const QUuid& viewerID, const glm::vec3& position) {
+    QMutexLocker locker(&_loadFocusLock);
+    _loadFocus.insert(viewerID, position);
+}
+
+int Octree::nearestChunkToLoadFocus(const QVector<SVOChunk>& chunks, const QVector<int>& chunkIndexes) {
+    QMutexLocker locker(&_loadFocusLock);
+    if (_loadFocus.isEmpty()) {
+        return 0;
+    }
+    int nearest = 0;
+    float nearestDistance = FLT_MAX;
+    for (int i = 0; i < chunkIndexes.size(); i++) {
+        VoxelPositionSize details;
+        voxelDetailsForCode((const unsigned char*)chunks.at(chunkIndexes.at(i)).octalCode.constData(), details);
+        AABox box(glm::vec3(details.x, details.y, details.z), details.s);
+        box.scale(TREE_SCALE);
+        foreach (const glm::vec3& focus, _loadFocus) {
+            float distance = box.distanceToPoint(focus);
+            if (distance < nearestDistance) {
+                nearest = i;
+                nearestDistance = distance;
+            }
+        }
+    }
+    return nearest;
+}
+
+void Octree::markPathAsChanged(const unsigned char* octalCode) {
+    int sections = numberOfThreeBitSectionsInCode(octalCode);
+    OctreeElement* element = _rootNode;
+    element->markWithChangedTime();
+    for (int section = 0; element && section < sections; section++) {
+        element = element->getChildAtIndex(getOctalCodeSectionValue(octalCode, section));
+        if (element) {
+            element->markWithChangedTime();
+        }
+    }
+}
+
+void Octree::markPathHashesDirty(const unsigned char* octalCode) {
+    int sections = numberOfThreeBitSectionsInCode(octalCode);
+    OctreeElement* element = _rootNode;
+    element->markDescendantsHashDirty();
+    for (int section = 0; element && section < sections; section++) {
+        element = element->getChildAtIndex(getOctalCodeSectionValue(octalCode, section));
+        if (element) {
+            element->markDescendantsHashDirty();
+        }
+    }
+}
+
+quint64 Octree::getSubtreeHash(OctreeElement* element) {
+    return OctreeElement::combineHashes(element->hashElementData(), getDescendantsHash(element));
+}
+
+quint64 Octree::getDescendantsHash(OctreeElement* element) {
+    QMutexLocker locker(&_subtreeHashLock);
+    return descendantsHashRecursion(element);
+}
+
+quint64 Octree::descendantsHashRecursion(OctreeElement* element) {
+    if (!element->isDescendantsHashDirty()) {
+        return element->getDescendantsHash();
+    }
+    quint64 hash = 0;
+
+    // a page that's paged out is a leaf in the tree, but hashes as the subtree it stands for
+    if (!(element->isLeaf() && _pager && _pager->getPagedOutHash(element->getOctalCode(), hash))) {
+        for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+            OctreeElement* child = element->getChildAtIndex(i);
+            if (child) {
+                hash = OctreeElement::combineHashes(hash, i + 1);
+                hash = OctreeElement::combineHashes(hash, child->hashElementData());
+                hash = OctreeElement::combineHashes(hash, descendantsHashRecursion(child));
+            }
+        }
+    }
+    element->setDescendantsHash(hash);
+    return hash;
+}
+
 void Octree::writeToSVOFile(const char* fileName, OctreeElement* node) {
 
     std::ofstream file(fileName, std::ios::out|std::ios::binary);
@@ -1416,6 +1668,230 @@ void Octree::writeToSVOFile(const char* fileName, OctreeElement* node) {
     file.close();
 }
 
+void Octree::encodeSubTreeToBuffer(OctreeElement* subTree, int stopLevel, QByteArray& buffer) {
+    OctreeElementBag nodeBag;
+    nodeBag.insert(subTree);
+
+    OctreePacketData packetData;
+    bool lastPacketWritten = false;
+
+    while (!nodeBag.isEmpty()) {
+        OctreeElement* node = nodeBag.extract();
+
+        // the encode level counts from the node being encoded, so elements at the stop level are encoded by their parent
+        // but nothing below them is
+        int maxEncodeLevel = INT_MAX;
+        if (stopLevel != INT_MAX) {
+            maxEncodeLevel = stopLevel - numberOfThreeBitSectionsInCode(node->getOctalCode()) + 1;
+        }
+        EncodeBitstreamParams params(maxEncodeLevel, IGNORE_VIEW_FRUSTUM, WANT_COLOR, NO_EXISTS_BITS);
+        int bytesWritten = encodeTreeBitstream(node, &packetData, nodeBag, params);
+
+        // if the subTree couldn't fit, and so we should reset the packet and reinsert the node in our bag and try again...
+        if (bytesWritten == 0 && (params.stopReason == EncodeBitstreamParams::DIDNT_FIT)) {
+            if (packetData.hasContent()) {
+                buffer.append((const char*)packetData.getFinalizedData(), packetData.getFinalizedSize());
+                lastPacketWritten = true;
+            }
+            packetData.reset();
+            nodeBag.insert(node);
+        } else {
+            lastPacketWritten = false;
+        }
+    }
+
+    if (!lastPacketWritten && packetData.hasContent()) {
+        buffer.append((const char*)packetData.getFinalizedData(), packetData.getFinalizedSize());
+    }
+}
+
+class CollectChunkRootsArgs {
+public:
+    int chunkLevel;
+    QVector<QByteArray>* octalCodes;
+};
+
+static bool collectChunkRootsOperation(OctreeElement* element, void* extraData) {
+    CollectChunkRootsArgs* args = static_cast<CollectChunkRootsArgs*>(extraData);
+    int level = numberOfThreeBitSectionsInCode(element->getOctalCode());
+    if (level < args->chunkLevel) {
+        return true; // keep going
+    }
+    // a leaf at the chunk level is written with the top chunk
+    if (!element->isLeaf()) {
+        args->octalCodes->append(QByteArray((const char*)element->getOctalCode(),
+                                            bytesRequiredForCodeLength(*element->getOctalCode())));
+    }
+    return false; // the chunk root's subtree is the chunk's
+}
+
+QVector<QByteArray> Octree::getChunkRootOctalCodes(int chunkLevel) {
+    QVector<QByteArray> octalCodes;
+    CollectChunkRootsArgs args = { chunkLevel, &octalCodes };
+    recurseTreeWithOperation(collectChunkRootsOperation, &args);
+    return octalCodes;
+}
+
+bool Octree::writeToChunkedSVOFile(const char* fileName, const JurisdictionMap* jurisdictionMap, bool wantCompression,
+                                   int chunkLevel) {
+    quint64 savedAt = usecTimestampNow();
+
+    // a copy, since a server can be given a new jurisdiction while it saves
+    JurisdictionMap jurisdiction;
+    if (jurisdictionMap) {
+        jurisdiction = *jurisdictionMap;
+        jurisdictionMap = &jurisdiction;
+    }
+
+    // the chunks outside of our jurisdiction come from the file we're replacing, since we may not have read them
+    QFile oldFile(fileName);
+    const unsigned char* oldFileData = NULL;
+    QByteArray oldFileContents;
+    ChunkedSVOHeader oldHeader;
+    QVector<SVOChunk> oldChunks;
+    QHash<QByteArray, int> oldChunkIndexes;
+    if (jurisdictionMap && oldFile.open(QIODevice::ReadOnly)) {
+        oldFileData = oldFile.map(0, oldFile.size());
+        if (!oldFileData) {
+            oldFileContents = oldFile.readAll();
+            oldFileData = (const unsigned char*)oldFileContents.constData();
+        }
+        if (ChunkedSVOFile::readIndex(oldFileData, oldFile.size(), oldHeader, oldChunks)) {
+            for (int i = 1; i < oldChunks.size(); i++) {
+                const QByteArray& octalCode = oldChunks.at(i).octalCode;
+                if (jurisdictionMap->isMyJurisdiction((const unsigned char*)octalCode.constData(), CHECK_NODE_ONLY)
+                        == JurisdictionMap::BELOW) {
+                    oldChunkIndexes.insert(octalCode, i);
+                }
+            }
+            // the other jurisdictions' chunks are copied as they are, so the file keeps the chunk level they were
+            // written at
+            if (!oldChunkIndexes.isEmpty() && oldHeader.chunkLevel != chunkLevel) {
+                qDebug("Keeping chunk level %d of %s rather than %d, since it has chunks of other jurisdictions.",
+                       oldHeader.chunkLevel, fileName, chunkLevel);
+                chunkLevel = oldHeader.chunkLevel;
+            }
+        }
+    }
+
+    // write to a new file and replace the old one once it's complete, so a failed save doesn't lose the old one
+    QString newFileName = QString(fileName) + ".new";
+    QFile file(newFileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug("Couldn't open %s for writing.", qPrintable(newFileName));
+        return false;
+    }
+    qDebug("Saving to chunked file %s...", fileName);
+
+    ChunkedSVOHeader header;
+    header.dataType = expectedDataPacketType();
+    header.dataVersion = versionForPacketType(header.dataType);
+    header.chunkLevel = chunkLevel;
+
+    // leave room for the header, it's written once the chunk table's offset is known
+    QVector<SVOChunk> chunks;
+    file.write(QByteArray(ChunkedSVOFile::HEADER_SIZE, 0));
+
+    QVector<QByteArray> chunkRoots;
+    chunkRoots.append(QByteArray((const char*)_rootNode->getOctalCode(), bytesRequiredForCodeLength(0)));
+
+    lockForRead();
+    chunkRoots += getChunkRootOctalCodes(chunkLevel);
+    unlock();
+
+    // chunks that are paged out, and so are leaves in the tree
+    OctreePager* pager = (_pager && _pager->getChunkLevel() == chunkLevel) ? _pager : NULL;
+    if (pager) {
+        foreach (const QByteArray& octalCode, pager->getPagedOutOctalCodes()) {
+            if (!chunkRoots.contains(octalCode)) {
+                chunkRoots.append(octalCode);
+            }
+        }
+    }
+
+    // chunks we don't have because we didn't read them
+    foreach (int oldChunkIndex, oldChunkIndexes) {
+        const QByteArray& octalCode = oldChunks.at(oldChunkIndex).octalCode;
+        if (jurisdictionMap->isMyJurisdiction((const unsigned char*)octalCode.constData(), CHECK_NODE_ONLY)
+                == JurisdictionMap::BELOW && !chunkRoots.contains(octalCode)) {
+            chunkRoots.append(octalCode);
+        }
+    }
+
+    for (int i = 0; i < chunkRoots.size(); i++) {
+        const QByteArray& octalCode = chunkRoots.at(i);
+        SVOChunk chunk;
+        chunk.octalCode = octalCode;
+        chunk.offset = file.pos();
+
+        QHash<QByteArray, int>::const_iterator oldChunk = oldChunkIndexes.constFind(octalCode);
+        if (i > 0 && oldChunk != oldChunkIndexes.constEnd() && jurisdictionMap->isMyJurisdiction(
+                (const unsigned char*)octalCode.constData(), CHECK_NODE_ONLY) == JurisdictionMap::BELOW) {
+            // copied as it was, without decoding it
+            const SVOChunk& old = oldChunks.at(*oldChunk);
+            chunk.storedSize = old.storedSize;
+            chunk.size = old.size;
+            chunk.checksum = old.checksum;
+            chunk.flags = old.flags;
+            file.write((const char*)oldFileData + old.offset, old.storedSize);
+        } else {
+            // do tree locking per chunk so that we have shorter slices and less thread contention
+            QByteArray bitstream;
+            QByteArray storedBytes;
+            lockForRead();
+            if (i > 0 && pager && pager->getPagedOutChunk(octalCode, chunk, storedBytes)) {
+                // paged out, copied from where the pager keeps it
+                chunk.offset = file.pos();
+            } else {
+                OctreeElement* chunkRoot = (i == 0) ? _rootNode
+                    : nodeForOctalCode(_rootNode, (const unsigned char*)octalCode.constData(), NULL);
+                if (*chunkRoot->getOctalCode() == (unsigned char)octalCode.at(0)) {
+                    encodeSubTreeToBuffer(chunkRoot, (i == 0) ? chunkLevel : INT_MAX, bitstream);
+                }
+            }
+            unlock();
+
+            if (!storedBytes.isEmpty()) {
+                file.write(storedBytes);
+                chunks.append(chunk);
+                continue;
+            }
+            if (bitstream.isEmpty() && i > 0) {
+                continue; // the subtree went away since we collected it
+            }
+            ChunkedSVOFile::prepareChunk(chunk, bitstream, wantCompression);
+            file.write(chunk.bitstream);
+            chunk.bitstream.clear();
+        }
+        chunks.append(chunk);
+    }
+
+    header.chunkCount = chunks.size();
+    header.chunkTableOffset = file.pos();
+    ChunkedSVOFile::writeChunkTable(file, chunks);
+    file.seek(0);
+    ChunkedSVOFile::writeHeader(file, header);
+
+    bool fileOk = (file.error() == QFile::NoError);
+    file.close();
+    oldFile.close();
+
+    if (fileOk) {
+        if (pager) {
+            pager->willReplaceSVOFile();
+        }
+        QFile::remove(fileName);
+        fileOk = QFile::rename(newFileName, fileName);
+        if (pager) {
+            pager->didReplaceSVOFile(fileOk ? QString(fileName) : newFileName, chunks, savedAt);
+        }
+    }
+    if (!fileOk) {
+        qDebug("Saving to chunked file %s failed.", fileName);
+    }
+    return fileOk;
+}
+
 unsigned long Octree::getOctreeElementsCount() {
     unsigned long nodeCount = 0;
     recurseTreeWithOperation(countOctreeElementsOperation, &nodeCount);
@@ -1466,7 +1942,7 @@ void Octree::copySubTreeIntoNewTree(OctreeElement* startNode, Octree* destinatio
     //destinationStartNode->setColor(startNode->getColor());
 }
 
-void Octree::copyFromTreeIntoSubTree(Octree* sourceTree, OctreeElement* destinationNode) {
+void Octree::copyFromTreeIntoSubTree(Octree* sourceTree, OctreeElement* destinationNode, bool wantImportProgress) {
     OctreeElementBag nodeBag;
     // If we were given a specific node, start from there, otherwise start from root
     nodeBag.insert(sourceTree->_rootNode);
@@ -1484,7 +1960,6 @@ void Octree::copyFromTreeIntoSubTree(Octree* sourceTree, OctreeElement* destinat
         bytesWritten = sourceTree->encodeTreeBitstream(subTree, &packetData, nodeBag, params);
 
         // ask destination tree to read the bitstream
-        bool wantImportProgress = true;
         ReadBitstreamToTreeParams args(WANT_COLOR, NO_EXISTS_BITS, destinationNode, 0, NULL, wantImportProgress);
         readBitstreamToTree(packetData.getUncompressedData(), packetData.getUncompressedSize(), args);
     }
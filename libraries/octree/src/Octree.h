@@ -19,17 +19,22 @@ class Octree;
 class OctreeElement;
 class OctreeElementBag;
 class OctreePacketData;
+class OctreePager;
 
 
+#include "ChunkedSVOFile.h"
 #include "JurisdictionMap.h"
 #include "ViewFrustum.h"
+#include "OctreeClientCache.h"
 #include "OctreeElement.h"
 #include "OctreeElementBag.h"
 #include "OctreePacketData.h"
 #include "OctreeSceneStats.h"
 
+#include <QHash>
 #include <QObject>
 #include <QReadWriteLock>
+#include <QUuid>
 
 // Callback function, for recuseTreeWithOperation
 typedef bool (*RecurseOctreeOperation)(OctreeElement* node, void* extraData);
@@ -72,6 +77,7 @@ public:
     OctreeSceneStats* stats;
     CoverageMap* map;
     JurisdictionMap* jurisdictionMap;
+    const OctreeCachedSubtrees* cachedSubtrees; // subtrees the client has, skipped unless changed
 
     // output hints from the encode process
     typedef enum {
@@ -120,6 +126,7 @@ public:
             stats(stats),
             map(map),
             jurisdictionMap(jurisdictionMap),
+            cachedSubtrees(NULL),
             stopReason(UNKNOWN)
     {}
 
@@ -192,6 +199,11 @@ public:
     virtual int processEditPacketData(PacketType packetType, const unsigned char* packetData, int packetLength,
                     const unsigned char* editData, int maxLength, Node* senderNode) { return 0; }
 
+    /// Splits an edit packet into the edits that land under an element and the ones that don't, each in a packet with
+    /// the same header, or left empty if there are none. Returns false if the tree's edits can't be placed that way.
+    virtual bool splitEditPacket(const QByteArray& packet, const unsigned char* rootOctalCode,
+                                 QByteArray& insidePacket, QByteArray& outsidePacket) const { return false; }
+
 
     virtual void update() { }; // nothing to do by default
 
@@ -233,7 +245,28 @@ public:
 
     // these will read/write files that match the wireformat, excluding the 'V' leading
     void writeToSVOFile(const char* filename, OctreeElement* node = NULL);
-    bool readFromSVOFile(const char* filename);
+
+    /// Writes a chunked (version 2) SVO file, see ChunkedSVOFile.h. If a jurisdiction is given the chunks outside of it
+    /// are copied from the file being replaced when it has them, since a tree read with the same jurisdiction won't.
+    /// They're copied as they are, so a file that has them keeps its chunk level.
+    bool writeToChunkedSVOFile(const char* filename, const JurisdictionMap* jurisdictionMap = NULL,
+                               bool wantCompression = true, int chunkLevel = DEFAULT_SVO_CHUNK_LEVEL);
+
+    /// Appends the bitstreams of a subtree, as an SVO file holds them, down to the stop level (counted in sections of the
+    /// elements' octal codes, so the elements at it are encoded but not their children) or all of it for INT_MAX.
+    void encodeSubTreeToBuffer(OctreeElement* subTree, int stopLevel, QByteArray& buffer);
+
+    /// Reads an SVO file of either version. Chunked files are memory mapped and their chunks are checked and decompressed
+    /// on all cores, and if a jurisdiction is given only the chunks that reach into it are read.
+    ///
+    /// A progressive read locks the tree itself, for each chunk rather than for the whole file, so that readers can use
+    /// the tree while it's read: the top chunk is read first, giving the coarse levels of the whole tree, then the other
+    /// chunks nearest the load focus first. Reading doesn't dirty the tree, only edits made during the read do.
+    bool readFromSVOFile(const char* filename, const JurisdictionMap* jurisdictionMap = NULL, bool isProgressive = false);
+
+    /// Where a viewer is, in meters, for a progressive read to read the chunks near it first.
+    void setLoadFocus(const QUuid& viewerID, const glm::vec3& position);
+
     // reads voxels from square image with alpha as a Y-axis
     bool readFromSquareARGB32Pixels(const char *filename);
     bool readFromSchematicFile(const char* filename);
@@ -248,9 +281,10 @@ public:
     unsigned long getOctreeElementsCount();
 
     void copySubTreeIntoNewTree(OctreeElement* startNode, Octree* destinationTree, bool rebaseToRoot);
-    void copyFromTreeIntoSubTree(Octree* sourceTree, OctreeElement* destinationNode);
+    void copyFromTreeIntoSubTree(Octree* sourceTree, OctreeElement* destinationNode, bool wantImportProgress = true);
 
     bool getShouldReaverage() const { return _shouldReaverage; }
+    void setShouldReaverage(bool shouldReaverage) { _shouldReaverage = shouldReaverage; }
 
     void recurseNodeWithOperation(OctreeElement* node, RecurseOctreeOperation operation,
                 void* extraData, int recursionCount = 0);
@@ -261,6 +295,24 @@ public:
     bool getIsViewing() const { return _isViewing; }
     void setIsViewing(bool isViewing) { _isViewing = isViewing; }
 
+    /// The pager keeping the tree within a memory budget, if it has one. Set it before the tree is read, so that a chunked
+    /// SVO file is read lazily and its subtrees are only paged in once they're needed.
+    OctreePager* getPager() const { return _pager; }
+    void setPager(OctreePager* pager) { _pager = pager; }
+
+    /// whether the tree's edits page in the subtrees they change, which a pager needs so that paged out subtrees aren't
+    /// edited while they're missing
+    virtual bool canBePaged() const { return false; }
+
+    /// the octal codes of the elements at the chunk level that have children, the roots of a chunked SVO file's chunks
+    QVector<QByteArray> getChunkRootOctalCodes(int chunkLevel);
+
+    /// Content hashes of an element with everything under it, and of everything under it without its own data, for
+    /// comparing trees without encoding them (see OctreeSync.h). The hashes are kept on the elements and recomputed only
+    /// along the paths that changed since they were last asked for. Called with the tree locked.
+    quint64 getSubtreeHash(OctreeElement* element);
+    quint64 getDescendantsHash(OctreeElement* element);
+
 signals:
     void importSize(float x, float y, float z);
     void importProgress(int progress);
@@ -283,6 +335,18 @@ protected:
     int readNodeData(OctreeElement *destinationNode, const unsigned char* nodeData,
                 int bufferSizeBytes, ReadBitstreamToTreeParams& args);
 
+    bool readFromChunkedSVOData(const char* fileName, const unsigned char* data, quint64 length,
+                                const JurisdictionMap* jurisdictionMap, bool isProgressive);
+    void readChunkToTree(const SVOChunk& chunk, bool isProgressive);
+    int nearestChunkToLoadFocus(const QVector<SVOChunk>& chunks, const QVector<int>& chunkIndexes);
+
+    /// marks the element with this octal code and its ancestors as changed, so that senders resend a subtree read under it
+    void markPathAsChanged(const unsigned char* octalCode);
+
+    /// marks the hashes of the element with this octal code and its ancestors as needing recomputing
+    void markPathHashesDirty(const unsigned char* octalCode);
+    quint64 descendantsHashRecursion(OctreeElement* element);
+
     OctreeElement* _rootNode;
 
     bool _isDirty;
@@ -327,6 +391,17 @@ protected:
     
     /// This tree is receiving inbound viewer datagrams.
     bool _isViewing;
+
+    OctreePager* _pager;
+
+    QHash<QUuid, glm::vec3> _loadFocus;
+    QMutex _loadFocusLock;
+
+    QMutex _subtreeHashLock; // hashes are cached on the elements by readers of the tree, which this serializes
+
+    friend class OctreePager;
+    friend class OctreeSyncSource;
+    friend class OctreeSyncTarget;
 };
 
 float boundaryDistanceForRenderLevel(unsigned int renderLevel, float voxelSizeScale);
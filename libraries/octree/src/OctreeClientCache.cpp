@@ -0,0 +1,240 @@
+//
+//  OctreeClientCache.cpp
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMap>
+
+#include <OctalCode.h>
+
+#include "Octree.h"
+#include "OctreeClientCache.h"
+
+const quint32 CLIENT_CACHE_VERSIONS_MAGIC = 0x4f434331; // "OCC1"
+
+// the octal code of an element's ancestor at a depth
+QByteArray ancestorOctalCode(const unsigned char* octalCode, int sections) {
+    QByteArray ancestor((const char*)octalCode, bytesRequiredForCodeLength(sections));
+    ancestor[0] = sections;
+    int unusedBits = (ancestor.size() - 1) * BITS_IN_BYTE - sections * BITS_IN_OCTAL;
+    if (unusedBits > 0) {
+        ancestor[ancestor.size() - 1] = ancestor.at(ancestor.size() - 1) & (0xff << unusedBits);
+    }
+    return ancestor;
+}
+
+OctreeClientCache::OctreeClientCache(Octree* tree) :
+    _tree(tree),
+    _octreeSizeScale(DEFAULT_OCTREE_SIZE_SCALE),
+    _boundaryLevelAdjust(0)
+{
+    OctreeElement::addDeleteHook(this);
+}
+
+OctreeClientCache::~OctreeClientCache() {
+    OctreeElement::removeDeleteHook(this);
+}
+
+bool OctreeClientCache::load(const QString& fileNameBase) {
+    QMutexLocker locker(&_mutex);
+    _fileNameBase = fileNameBase;
+    _subtrees.clear();
+    _advertisedVersions.clear();
+    QDir().mkpath(QFileInfo(fileNameBase).path());
+
+    QFile versionsFile(getVersionsFileName());
+    if (!QFile::exists(getTreeFileName()) || !versionsFile.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream versions(&versionsFile);
+    quint32 magic;
+    versions >> magic;
+    if (magic != CLIENT_CACHE_VERSIONS_MAGIC) {
+        qDebug() << "Ignoring the octree cache" << fileNameBase << "since its versions are damaged.";
+        return false;
+    }
+    versions >> _octreeSizeScale >> _boundaryLevelAdjust;
+    OctreeCachedSubtrees subtrees;
+    versions >> subtrees;
+    if (versions.status() != QDataStream::Ok) {
+        qDebug() << "Ignoring the octree cache" << fileNameBase << "since its versions are damaged.";
+        return false;
+    }
+
+    // the tree is read a chunk at a time with its lock held for each, so that it can be drawn while it's read
+    locker.unlock();
+    if (!_tree->readFromSVOFile(qPrintable(getTreeFileName()), NULL, true)) {
+        return false;
+    }
+    locker.relock();
+    _subtrees = subtrees;
+    qDebug() << "Loaded" << _subtrees.size() << "cached subtrees from" << fileNameBase;
+    return true;
+}
+
+void OctreeClientCache::save() {
+    if (_fileNameBase.isEmpty()) {
+        return;
+    }
+    if (!_tree->writeToChunkedSVOFile(qPrintable(getTreeFileName()))) {
+        return;
+    }
+
+    QMutexLocker locker(&_mutex);
+    QFile versionsFile(getVersionsFileName());
+    if (!versionsFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "Couldn't save the versions of the octree cache" << _fileNameBase;
+        return;
+    }
+    QDataStream versions(&versionsFile);
+    versions << CLIENT_CACHE_VERSIONS_MAGIC << _octreeSizeScale << _boundaryLevelAdjust << _subtrees;
+    qDebug() << "Saved" << _subtrees.size() << "cached subtrees to" << _fileNameBase;
+}
+
+void OctreeClientCache::setLevelOfDetail(float octreeSizeScale, int boundaryLevelAdjust) {
+    QMutexLocker locker(&_mutex);
+    if (octreeSizeScale != _octreeSizeScale || boundaryLevelAdjust != _boundaryLevelAdjust) {
+        _octreeSizeScale = octreeSizeScale;
+        _boundaryLevelAdjust = boundaryLevelAdjust;
+        _subtrees.clear();
+    }
+}
+
+// finds the elements at the cache level that are wholly in the view and in the jurisdiction, and how far away they are
+void findSubtreesInView(OctreeElement* element, const JurisdictionMap& jurisdiction, const ViewFrustum& viewFrustum,
+                        OctreeCachedSubtrees& found, quint64 version) {
+    ViewFrustum::location location = element->inFrustum(viewFrustum);
+    if (location == ViewFrustum::OUTSIDE) {
+        return;
+    }
+    const unsigned char* octalCode = element->getOctalCode();
+    int sections = numberOfThreeBitSectionsInCode(octalCode);
+    if (sections == CLIENT_CACHE_SUBTREE_LEVEL) {
+        if (location == ViewFrustum::INSIDE
+                && jurisdiction.isMyJurisdiction(octalCode, CHECK_NODE_ONLY) == JurisdictionMap::WITHIN) {
+            found.insert(QByteArray((const char*)octalCode, bytesRequiredForCodeLength(sections)),
+                         OctreeCachedSubtree(version, element->distanceToCamera(viewFrustum)));
+        }
+        return;
+    }
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        OctreeElement* child = element->getChildAtIndex(i);
+        if (child) {
+            findSubtreesInView(child, jurisdiction, viewFrustum, found, version);
+        }
+    }
+}
+
+void OctreeClientCache::sceneCompleted(const JurisdictionMap& jurisdiction, quint64 sceneStartedAt,
+                                       const ViewFrustum& viewFrustum) {
+    OctreeCachedSubtrees found;
+    _tree->lockForRead();
+    findSubtreesInView(_tree->getRoot(), jurisdiction, viewFrustum, found, sceneStartedAt);
+    _tree->unlock();
+
+    QMutexLocker locker(&_mutex);
+    for (OctreeCachedSubtrees::const_iterator subtree = found.constBegin(); subtree != found.constEnd(); ++subtree) {
+        // a stamp from a later scene on the same server supersedes this one
+        OctreeCachedSubtree& stamp = _subtrees[subtree.key()];
+        if (subtree->version >= stamp.version) {
+            stamp = subtree.value();
+        }
+    }
+}
+
+// whether a subtree is in a server's jurisdiction and in the view, and how far away it is
+static bool subtreeDistanceInView(const QByteArray& subtree, const JurisdictionMap& jurisdiction,
+                                  const ViewFrustum& viewFrustum, float& distance) {
+    const unsigned char* octalCode = (const unsigned char*)subtree.constData();
+    if (jurisdiction.isMyJurisdiction(octalCode, CHECK_NODE_ONLY) != JurisdictionMap::WITHIN) {
+        return false;
+    }
+    VoxelPositionSize details;
+    voxelDetailsForCode(octalCode, details);
+    AABox box(glm::vec3(details.x, details.y, details.z), details.s);
+    box.scale(TREE_SCALE);
+    if (viewFrustum.boxInFrustum(box) == ViewFrustum::OUTSIDE) {
+        return false;
+    }
+    distance = glm::distance(box.calcCenter(), viewFrustum.getPosition());
+    return true;
+}
+
+OctreeCachedSubtrees OctreeClientCache::takeSubtreesToAdvertise(const QUuid& serverUUID,
+                                                                 const JurisdictionMap& jurisdiction,
+                                                                 const ViewFrustum& viewFrustum) {
+    QMutexLocker locker(&_mutex);
+    QHash<QByteArray, quint64>& advertisedVersions = _advertisedVersions[serverUUID];
+
+    // The subtrees the server was told of that the client no longer has are told again with every query while they're
+    // in view, since a lost query would leave the server skipping them, until they're stamped again, which only
+    // happens once the server has sent them. Out of view the server wouldn't send them anyway.
+    QMultiMap<float, QByteArray> nearestForgotten;
+    QMultiMap<float, QByteArray> nearest;
+    float distance;
+    for (QHash<QByteArray, quint64>::iterator subtree = advertisedVersions.begin(); subtree != advertisedVersions.end();
+            ++subtree) {
+        if (!_subtrees.contains(subtree.key())) {
+            subtree.value() = 0;
+            if (subtreeDistanceInView(subtree.key(), jurisdiction, viewFrustum, distance)) {
+                nearestForgotten.insert(distance, subtree.key());
+            }
+        }
+    }
+    for (OctreeCachedSubtrees::const_iterator subtree = _subtrees.constBegin(); subtree != _subtrees.constEnd();
+            ++subtree) {
+        if (advertisedVersions.value(subtree.key()) != subtree->version
+                && subtreeDistanceInView(subtree.key(), jurisdiction, viewFrustum, distance)) {
+            nearest.insert(distance, subtree.key());
+        }
+    }
+
+    OctreeCachedSubtrees advertised;
+    for (QMultiMap<float, QByteArray>::const_iterator subtree = nearestForgotten.constBegin();
+            subtree != nearestForgotten.constEnd() && advertised.size() < MAX_CACHED_SUBTREES_PER_QUERY; ++subtree) {
+        advertised.insert(subtree.value(), OctreeCachedSubtree());
+    }
+    for (QMultiMap<float, QByteArray>::const_iterator subtree = nearest.constBegin();
+            subtree != nearest.constEnd() && advertised.size() < MAX_CACHED_SUBTREES_PER_QUERY; ++subtree) {
+        const OctreeCachedSubtree& stamp = _subtrees[subtree.value()];
+        advertised.insert(subtree.value(), stamp);
+        advertisedVersions.insert(subtree.value(), stamp.version);
+    }
+    return advertised;
+}
+
+void OctreeClientCache::forgetServer(const QUuid& serverUUID) {
+    QMutexLocker locker(&_mutex);
+    _advertisedVersions.remove(serverUUID);
+}
+
+int OctreeClientCache::getCachedSubtreeCount() {
+    QMutexLocker locker(&_mutex);
+    return _subtrees.size();
+}
+
+void OctreeClientCache::elementDeleted(OctreeElement* element) {
+    const unsigned char* octalCode = element->getOctalCode();
+    if (numberOfThreeBitSectionsInCode(octalCode) < CLIENT_CACHE_SUBTREE_LEVEL) {
+        return; // the subtrees below it are deleted too, and forget themselves
+    }
+    QByteArray subtree = ancestorOctalCode(octalCode, CLIENT_CACHE_SUBTREE_LEVEL);
+    QMutexLocker locker(&_mutex);
+    _subtrees.remove(subtree);
+}
+
+QDataStream& operator<<(QDataStream& out, const OctreeCachedSubtree& subtree) {
+    return out << subtree.version << subtree.viewDistance;
+}
+
+QDataStream& operator>>(QDataStream& in, OctreeCachedSubtree& subtree) {
+    return in >> subtree.version >> subtree.viewDistance;
+}
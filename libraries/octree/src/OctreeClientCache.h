@@ -0,0 +1,107 @@
+//
+//  OctreeClientCache.h
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Keeps what a client has received of a domain's octree on disk, so that rejoining the domain doesn't need the servers
+//  to send it all again.
+//
+
+#ifndef __hifi__OctreeClientCache__
+#define __hifi__OctreeClientCache__
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDataStream>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QUuid>
+
+#include "JurisdictionMap.h"
+#include "OctreeElement.h"
+#include "ViewFrustum.h"
+
+class Octree;
+
+/// the depth, in sections of their octal codes, of the subtrees the client cache keeps versions of
+const int CLIENT_CACHE_SUBTREE_LEVEL = 5;
+
+/// the most cached subtrees a client tells a server about in one query packet
+const int MAX_CACHED_SUBTREES_PER_QUERY = 64;
+
+/// the most cached subtrees a server keeps for a client, the rest are sent to it as if it had none of them
+const int MAX_CACHED_SUBTREES_PER_CLIENT = 4096;
+
+/// what a client has of a subtree, as of a time on the clock of the server that sent it
+class OctreeCachedSubtree {
+public:
+    OctreeCachedSubtree(quint64 version = 0, float viewDistance = 0.0f) : version(version), viewDistance(viewDistance) { }
+
+    quint64 version; // the start of a scene the whole subtree was in view for, on the server's clock
+    float viewDistance; // how far from the camera the subtree was, the client has as much detail as that distance needs
+};
+
+QDataStream& operator<<(QDataStream& out, const OctreeCachedSubtree& subtree);
+QDataStream& operator>>(QDataStream& in, OctreeCachedSubtree& subtree);
+
+/// cached subtrees by the octal codes of their roots
+typedef QHash<QByteArray, OctreeCachedSubtree> OctreeCachedSubtrees;
+
+/// Stamps the subtrees of a client's tree with the times a server has finished sending them, saves the tree and the
+/// stamps for each domain, and picks the stamps to tell the servers about so that they can skip what hasn't changed.
+///
+/// A subtree at CLIENT_CACHE_SUBTREE_LEVEL is stamped when a server finishes a scene that it was wholly inside the view
+/// of, with the scene's start. A server changes an element's changed time whenever anything under it changes, so a
+/// subtree whose root hasn't changed since its stamp is what the client has, down to the detail the view it was stamped
+/// from needed. Like delta sending, this trusts that the scene's packets all arrived. Subtrees that lose elements on the
+/// client are forgotten, since they may not be whole any more. Delete hooks don't say which tree an element was in, so
+/// deletions in other trees forget the same subtrees too, which only costs sending them again.
+class OctreeClientCache : public OctreeElementDeleteHook {
+public:
+    OctreeClientCache(Octree* tree);
+    ~OctreeClientCache();
+
+    /// Reads the cache saved under a file name base into the tree, and keeps saving to it from then on. The tree
+    /// should be empty.
+    bool load(const QString& fileNameBase);
+
+    /// saves the tree and its stamps under the file name base they were loaded from
+    void save();
+
+    /// Forgets every stamp if the level of detail the client wants has changed, since they were made for the old one.
+    void setLevelOfDetail(float octreeSizeScale, int boundaryLevelAdjust);
+
+    /// A server has finished sending a scene it started at sceneStartedAt on its clock, stamp the subtrees of its
+    /// jurisdiction that are wholly inside the view.
+    void sceneCompleted(const JurisdictionMap& jurisdiction, quint64 sceneStartedAt, const ViewFrustum& viewFrustum);
+
+    /// The stamps of a server's jurisdiction in the view that haven't been sent to it since they changed, nearest
+    /// first, up to MAX_CACHED_SUBTREES_PER_QUERY of them. They're taken as sent. Subtrees in the view the server was
+    /// told of that have since been forgotten come first, with empty stamps, and come again until they're stamped again.
+    OctreeCachedSubtrees takeSubtreesToAdvertise(const QUuid& serverUUID, const JurisdictionMap& jurisdiction,
+                                                const ViewFrustum& viewFrustum);
+
+    /// the server went away, and a new one needs to be told about every stamp
+    void forgetServer(const QUuid& serverUUID);
+
+    int getCachedSubtreeCount();
+
+    virtual void elementDeleted(OctreeElement* element);
+
+private:
+    QString getTreeFileName() const { return _fileNameBase + ".svo"; }
+    QString getVersionsFileName() const { return _fileNameBase + ".versions"; }
+
+    Octree* _tree;
+    QString _fileNameBase;
+    float _octreeSizeScale;
+    int _boundaryLevelAdjust;
+
+    QMutex _mutex; // guards the stamps, which deletions of elements change on whichever thread deletes them
+    OctreeCachedSubtrees _subtrees;
+    QHash<QUuid, QHash<QByteArray, quint64> > _advertisedVersions;
+};
+
+#endif /* defined(__hifi__OctreeClientCache__) */
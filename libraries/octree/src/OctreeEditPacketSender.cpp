@@ -8,6 +8,7 @@
 //  Threaded or non-threaded packet Sender for the Application
 //
 
+#include <algorithm>
 #include <assert.h>
 
 #include <PerfStat.h>
@@ -26,6 +27,9 @@ EditPacketBuffer::EditPacketBuffer(PacketType type, unsigned char* buffer, ssize
 
 const int OctreeEditPacketSender::DEFAULT_MAX_PENDING_MESSAGES = PacketSender::DEFAULT_PACKETS_PER_SECOND;
 
+// queued edits for a server are packed once they'd fill this many packets, even if the caller hasn't released them
+const int MAX_QUEUED_EDIT_PACKETS = 4;
+
 
 OctreeEditPacketSender::OctreeEditPacketSender() :
     PacketSender(),
@@ -34,7 +38,11 @@ OctreeEditPacketSender::OctreeEditPacketSender() :
     _releaseQueuedMessagesPending(false),
     _serverJurisdictions(NULL),
     _sequenceNumber(0),
-    _maxPacketSize(MAX_PACKET_SIZE) {
+    _maxPacketSize(MAX_PACKET_SIZE),
+    _editRouteSections(-1),
+    _editsCoalesced(0),
+    _editsSent(0),
+    _editMessagesMutex(QMutex::Recursive) {
     //printf("OctreeEditPacketSender::OctreeEditPacketSender() [%p] created... \n", this);
 }
 
@@ -142,6 +150,8 @@ void OctreeEditPacketSender::processPreServerExistsPackets() {
 }
 
 void OctreeEditPacketSender::queuePendingPacketToNodes(PacketType type, unsigned char* buffer, ssize_t length) {
+    QMutexLocker locker(&_editMessagesMutex);
+
     // If we're asked to save messages while waiting for voxel servers to arrive, then do so...
     if (_maxPendingMessages > 0) {
         EditPacketBuffer* packet = new EditPacketBuffer(type, buffer, length);
@@ -195,6 +205,8 @@ void OctreeEditPacketSender::queueOctreeEditMessage(PacketType type, unsigned ch
         return; // bail early
     }
 
+    QMutexLocker locker(&_editMessagesMutex);
+
     // If we don't have jurisdictions, then we will simply queue up all of these packets and wait till we have
     // jurisdictions for processing
     if (!serversExist()) {
@@ -213,13 +225,85 @@ void OctreeEditPacketSender::queueOctreeEditMessage(PacketType type, unsigned ch
         return; // bail early
     }
 
-    //qDebug() << "queueOctreeEditMessage() line:" << __LINE__;
+    QByteArray key = getEditMessageKey(type, codeColorBuffer, length);
 
     // We want to filter out edit messages for servers based on the server's Jurisdiction
     // But we can't really do that with a packed message, since each edit message could be destined
-    // for a different server... So we need to actually manage multiple queued packets... one
-    // for each server
+    // for a different server... So we need to actually manage multiple queues... one for each server
+    foreach (const QUuid& nodeUUID, routeEditMessage(codeColorBuffer, length)) {
+        EditMessageQueue& queue = _queuedEditMessages[nodeUUID];
+
+        // last write wins, drop the queued edit of the same thing
+        if (!key.isEmpty()) {
+            QHash<QByteArray, int>::iterator latest = queue._latestMessageWithKey.find(key);
+            if (latest != queue._latestMessageWithKey.end()) {
+                QueuedEditMessage& earlier = queue._messages[latest.value()];
+                if (earlier._type == type && canReplaceEditMessage(type, earlier._message, codeColorBuffer, length)) {
+                    earlier._isReplaced = true;
+                    queue._bytes -= earlier._message.size();
+                    _editsCoalesced++;
+                }
+            }
+            queue._latestMessageWithKey.insert(key, queue._messages.size());
+        }
+
+        QueuedEditMessage message;
+        message._type = type;
+        message._key = key;
+        message._message = QByteArray(reinterpret_cast<char*>(codeColorBuffer), length);
+        message._isReplaced = false;
+        queue._messages.append(message);
+        queue._bytes += length;
+
+        if (queue._bytes >= _maxPacketSize * MAX_QUEUED_EDIT_PACKETS) {
+            packQueuedEditMessages(nodeUUID, queue);
+        }
+    }
+}
+
+QByteArray OctreeEditPacketSender::octalCodeSections(const unsigned char* octalCode, ssize_t length, int maxSections) {
+    int sections = numberOfThreeBitSectionsInCode(octalCode, length);
+    if (sections < 0 || bytesRequiredForCodeLength(sections) > length) {
+        return QByteArray();
+    }
+    sections = std::min(sections, maxSections);
+
+    // the root has no sections, but still needs a key
+    QByteArray octalCodeSections(sections + 1, 0);
+    octalCodeSections[0] = 'S';
+    for (int section = 0; section < sections; section++) {
+        octalCodeSections[section + 1] = getOctalCodeSectionValue(octalCode, section);
+    }
+    return octalCodeSections;
+}
+
+const QVector<QUuid>& OctreeEditPacketSender::routeEditMessage(const unsigned char* octalCode, ssize_t length) {
+    if (_editRouteSections < 0) {
+        _editRouteSections = 0;
+        if (_serverJurisdictions) {
+            for (NodeToJurisdictionMap::const_iterator i = _serverJurisdictions->begin();
+                    i != _serverJurisdictions->end(); i++) {
+                const JurisdictionMap& map = i->second;
+                if (map.getRootOctalCode()) {
+                    _editRouteSections = std::max(_editRouteSections,
+                                                  numberOfThreeBitSectionsInCode(map.getRootOctalCode()) + 1);
+                }
+                for (int endNode = 0; endNode < map.getEndNodeCount(); endNode++) {
+                    _editRouteSections = std::max(_editRouteSections,
+                                                  numberOfThreeBitSectionsInCode(map.getEndNodeOctalCode(endNode)) + 1);
+                }
+            }
+        }
+    }
+
+    // without jurisdictions every server gets every edit, so they all share one route
+    QByteArray routeKey = _serverJurisdictions ? octalCodeSections(octalCode, length, _editRouteSections) : QByteArray();
+    QHash<QByteArray, QVector<QUuid> >::iterator route = _editRoutes.find(routeKey);
+    if (route != _editRoutes.end()) {
+        return route.value();
+    }
 
+    QVector<QUuid> nodeUUIDs;
     foreach (const SharedNodePointer& node, NodeList::getInstance()->getNodeHash()) {
         // only send to the NodeTypes that are getMyNodeType()
         if (node->getActiveSocket() != NULL && node->getType() == getMyNodeType()) {
@@ -231,60 +315,119 @@ void OctreeEditPacketSender::queueOctreeEditMessage(PacketType type, unsigned ch
                 // here we need to get the "pending packet" for this server
                 if ((*_serverJurisdictions).find(nodeUUID) != (*_serverJurisdictions).end()) {
                     const JurisdictionMap& map = (*_serverJurisdictions)[nodeUUID];
-                    isMyJurisdiction = (map.isMyJurisdiction(codeColorBuffer, CHECK_NODE_ONLY) == JurisdictionMap::WITHIN);
-                    //qDebug() << "queueOctreeEditMessage() line:" << __LINE__ << " isMyJurisdiction=" << isMyJurisdiction;
+                    isMyJurisdiction = (map.isMyJurisdiction(octalCode, CHECK_NODE_ONLY) == JurisdictionMap::WITHIN);
                 } else {
                     isMyJurisdiction = false;
-                    //qDebug() << "queueOctreeEditMessage() line:" << __LINE__;
                 }
             }
             if (isMyJurisdiction) {
-                EditPacketBuffer& packetBuffer = _pendingEditPackets[nodeUUID];
-                packetBuffer._nodeUUID = nodeUUID;
+                nodeUUIDs.append(nodeUUID);
+            }
+        }
+    }
+    return _editRoutes.insert(routeKey, nodeUUIDs).value();
+}
 
-                //qDebug() << "queueOctreeEditMessage() line:" << __LINE__;
+static bool lessThanEditKey(const QueuedEditMessage* a, const QueuedEditMessage* b) {
+    return a->_key < b->_key;
+}
 
-                // If we're switching type, then we send the last one and start over
-                if ((type != packetBuffer._currentType && packetBuffer._currentSize > 0) ||
-                    (packetBuffer._currentSize + length >= _maxPacketSize)) {
-                    releaseQueuedPacket(packetBuffer);
-                    initializePacket(packetBuffer, type);
+void OctreeEditPacketSender::packQueuedEditMessages(const QUuid& nodeUUID, EditMessageQueue& queue) {
+    SharedNodePointer node = NodeList::getInstance()->nodeWithUUID(nodeUUID);
+    if (node) {
+        EditPacketBuffer& packetBuffer = _pendingEditPackets[nodeUUID];
+        packetBuffer._nodeUUID = nodeUUID;
+
+        QVector<const QueuedEditMessage*> run;
+        int message = 0;
+        while (message < queue._messages.size()) {
+            // gather the next run of edits of the same type
+            PacketType type = queue._messages[message]._type;
+            bool canSort = true;
+            run.resize(0);
+            for (; message < queue._messages.size() && queue._messages[message]._type == type; message++) {
+                const QueuedEditMessage& queuedMessage = queue._messages[message];
+                if (!queuedMessage._isReplaced) {
+                    run.append(&queuedMessage);
+                    canSort = canSort && !queuedMessage._key.isEmpty();
                 }
+            }
 
-                // If the buffer is empty and not correctly initialized for our type...
-                if (type != packetBuffer._currentType && packetBuffer._currentSize == 0) {
-                    initializePacket(packetBuffer, type);
+            // edits packed in key order keep edits of nearby voxels, or of the same particle, together
+            if (canSort) {
+                std::stable_sort(run.begin(), run.end(), lessThanEditKey);
+                for (int i = 1; i < run.size() && canSort; i++) {
+                    const QByteArray& previousKey = run[i - 1]->_key;
+                    canSort = previousKey == run[i]->_key || !run[i]->_key.startsWith(previousKey);
                 }
-
-                // This is really the first time we know which server/node this particular edit message
-                // is going to, so we couldn't adjust for clock skew till now. But here's our chance.
-                // We call this virtual function that allows our specific type of EditPacketSender to
-                // fixup the buffer for any clock skew
-                if (node->getClockSkewUsec() != 0) {
-                    adjustEditPacketForClockSkew(codeColorBuffer, length, node->getClockSkewUsec());
-                    //qDebug() << "queueOctreeEditMessage() line:" << __LINE__;
+                if (!canSort) {
+                    // an edit would move past an edit of one of its ancestors, keep the order they were queued in
+                    std::sort(run.begin(), run.end());
                 }
+            }
 
-                //qDebug() << "queueOctreeEditMessage() line:" << __LINE__;
-
-                memcpy(&packetBuffer._currentBuffer[packetBuffer._currentSize], codeColorBuffer, length);
-                packetBuffer._currentSize += length;
+            foreach (const QueuedEditMessage* runMessage, run) {
+                packEditMessage(node, packetBuffer, *runMessage);
             }
         }
     }
+
+    queue._messages.resize(0);
+    queue._latestMessageWithKey.clear();
+    queue._bytes = 0;
+}
+
+void OctreeEditPacketSender::packEditMessage(const SharedNodePointer& node, EditPacketBuffer& packetBuffer,
+                                             const QueuedEditMessage& message) {
+    ssize_t length = message._message.size();
+
+    // If we're switching type, then we send the last one and start over
+    if ((message._type != packetBuffer._currentType && packetBuffer._currentSize > 0) ||
+        (packetBuffer._currentSize + length >= _maxPacketSize)) {
+        releaseQueuedPacket(packetBuffer);
+        initializePacket(packetBuffer, message._type);
+    }
+
+    // If the buffer is empty and not correctly initialized for our type...
+    if (message._type != packetBuffer._currentType && packetBuffer._currentSize == 0) {
+        initializePacket(packetBuffer, message._type);
+    }
+
+    unsigned char* editMessage = &packetBuffer._currentBuffer[packetBuffer._currentSize];
+    memcpy(editMessage, message._message.constData(), length);
+
+    // This is really the first time we know which server/node this particular edit message
+    // is going to, so we couldn't adjust for clock skew till now. But here's our chance.
+    // We call this virtual function that allows our specific type of EditPacketSender to
+    // fixup the buffer for any clock skew
+    if (node->getClockSkewUsec() != 0) {
+        adjustEditPacketForClockSkew(editMessage, length, node->getClockSkewUsec());
+    }
+
+    packetBuffer._currentSize += length;
+    _editsSent++;
 }
 
 void OctreeEditPacketSender::releaseQueuedMessages() {
+    QMutexLocker locker(&_editMessagesMutex);
+
     // if we don't yet have jurisdictions then we can't actually release messages yet because we don't
     // know where to send them to. Instead, just remember this request and when we eventually get jurisdictions
     // call release again at that time.
     if (!serversExist()) {
         _releaseQueuedMessagesPending = true;
     } else {
+        for (std::map<QUuid, EditMessageQueue>::iterator i = _queuedEditMessages.begin(); i != _queuedEditMessages.end(); i++) {
+            packQueuedEditMessages(i->first, i->second);
+        }
         for (std::map<QUuid, EditPacketBuffer>::iterator i = _pendingEditPackets.begin(); i != _pendingEditPackets.end(); i++) {
             releaseQueuedPacket(i->second);
             //qDebug() << "releaseQueuedMessages() line:" << __LINE__;
         }
+
+        // servers and jurisdictions may have changed since the routes were worked out
+        _editRoutes.clear();
+        _editRouteSections = -1;
     }
 }
 
@@ -318,8 +461,11 @@ void OctreeEditPacketSender::initializePacket(EditPacketBuffer& packetBuffer, Pa
 bool OctreeEditPacketSender::process() {
     // if we have server jurisdiction details, and we have pending pre-jurisdiction packets, then process those
     // before doing our normal process step. This processPreJurisdictionPackets()
-    if (serversExist() && (!_preServerPackets.empty() || !_preServerSingleMessagePackets.empty() )) {
-        processPreServerExistsPackets();
+    {
+        QMutexLocker locker(&_editMessagesMutex);
+        if (serversExist() && (!_preServerPackets.empty() || !_preServerSingleMessagePackets.empty() )) {
+            processPreServerExistsPackets();
+        }
     }
 
     // base class does most of the work.
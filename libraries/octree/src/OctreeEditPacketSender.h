@@ -11,6 +11,11 @@
 #ifndef __shared__OctreeEditPacketSender__
 #define __shared__OctreeEditPacketSender__
 
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QVector>
+
 #include <PacketSender.h>
 #include <PacketHeaders.h>
 #include "JurisdictionMap.h"
@@ -26,6 +31,24 @@ public:
     ssize_t _currentSize;
 };
 
+/// An edit message held until its queue is packed, so that a later edit of the same thing can replace it
+class QueuedEditMessage {
+public:
+    PacketType _type;
+    QByteArray _key;
+    QByteArray _message;
+    bool _isReplaced;
+};
+
+/// The edit messages headed for one server since its queue was last packed
+class EditMessageQueue {
+public:
+    EditMessageQueue() : _bytes(0) { }
+    QVector<QueuedEditMessage> _messages;
+    QHash<QByteArray, int> _latestMessageWithKey;
+    int _bytes;
+};
+
 /// Utility for processing, packing, queueing and sending of outbound edit messages.
 class OctreeEditPacketSender :  public PacketSender {
     Q_OBJECT
@@ -85,11 +108,33 @@ public:
     /// returns the current desired max packet size in bytes that the OctreeEditPacketSender will create
     int getMaxPacketSize() const { return _maxPacketSize; }
 
+    /// the number of queued edit messages dropped because a later edit replaced them before they were sent
+    quint64 getEditsCoalesced() { QMutexLocker locker(&_editMessagesMutex); return _editsCoalesced; }
+
+    /// the number of edit messages packed into packets
+    quint64 getEditsSent() { QMutexLocker locker(&_editMessagesMutex); return _editsSent; }
+
     // you must override these...
     virtual unsigned char getMyNodeType() const = 0;
     virtual void adjustEditPacketForClockSkew(unsigned char* codeColorBuffer, ssize_t length, int clockSkew) { };
-    
+
+    /// Override to let queued edits be coalesced and sorted. Returns what the edit message edits, or an empty key if it
+    /// can't be coalesced or moved. A queued edit is replaced by a later edit of the same type with the same key, and
+    /// edits of the same type are packed in key order, except that an edit whose key is a prefix of another's is never
+    /// moved past it.
+    virtual QByteArray getEditMessageKey(PacketType type, const unsigned char* editMessage, ssize_t length) const {
+        return QByteArray();
+    }
+
+    /// Override if a later edit with the same key doesn't always carry everything the earlier one did
+    virtual bool canReplaceEditMessage(PacketType type, const QByteArray& earlierMessage,
+                                       const unsigned char* laterMessage, ssize_t laterLength) const { return true; }
+
 protected:
+    /// the child indexes of the first maxSections sections of the octal code, one per byte, so that the sections of an
+    /// ancestor are a prefix of those of its descendants. Empty if the code runs past length.
+    static QByteArray octalCodeSections(const unsigned char* octalCode, ssize_t length, int maxSections);
+
     bool _shouldSend;
     void queuePacketToNode(const QUuid& nodeID, unsigned char* buffer, ssize_t length);
     void queuePendingPacketToNodes(PacketType type, unsigned char* buffer, ssize_t length);
@@ -99,6 +144,13 @@ protected:
     
     void processPreServerExistsPackets();
 
+    /// the servers whose jurisdiction the octal code is in
+    const QVector<QUuid>& routeEditMessage(const unsigned char* octalCode, ssize_t length);
+
+    /// moves the queued edit messages for a server into its pending packet, releasing full packets as it goes
+    void packQueuedEditMessages(const QUuid& nodeUUID, EditMessageQueue& queue);
+    void packEditMessage(const SharedNodePointer& node, EditPacketBuffer& packetBuffer, const QueuedEditMessage& message);
+
     // These are packets which are destined from know servers but haven't been released because they're still too small
     std::map<QUuid, EditPacketBuffer> _pendingEditPackets;
     
@@ -109,6 +161,23 @@ protected:
     std::vector<EditPacketBuffer*> _preServerSingleMessagePackets; // these will go out as is
 
     NodeToJurisdictionMap* _serverJurisdictions;
+
+    // Edit messages waiting to be packed, per server. They're held until the caller releases them, or until there are
+    // enough of them to fill several packets.
+    std::map<QUuid, EditMessageQueue> _queuedEditMessages;
+
+    // The servers each octal code was routed to since the last release. Codes are cut down to one level below the
+    // deepest root or end node of any jurisdiction, since every code under that cut is routed the same way.
+    QHash<QByteArray, QVector<QUuid> > _editRoutes;
+    int _editRouteSections;
+
+    quint64 _editsCoalesced;
+    quint64 _editsSent;
+
+    // Guards the queued and pending edits, so that several scripts can share one sender. It's recursive because
+    // processing the packets queued before servers existed queues them again, and it's separate from the thread's lock,
+    // which queuePacketForSending() takes.
+    QMutex _editMessagesMutex;
     
     unsigned short int _sequenceNumber;
     int _maxPacketSize;
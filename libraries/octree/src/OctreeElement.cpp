@@ -11,6 +11,8 @@
 #include <stdio.h>
 
 #include <QtCore/QDebug>
+#include <QtCore/QMutex>
+#include <QtCore/QThreadStorage>
 
 #include <NodeList.h>
 #include <PerfStat.h>
@@ -23,11 +25,68 @@
 #include "OctreeElement.h"
 #include "Octree.h"
 
-quint64 OctreeElement::_voxelMemoryUsage = 0;
-quint64 OctreeElement::_octcodeMemoryUsage = 0;
-quint64 OctreeElement::_externalChildrenMemoryUsage = 0;
-quint64 OctreeElement::_voxelNodeCount = 0;
-quint64 OctreeElement::_voxelNodeLeafCount = 0;
+const int MAX_OCTREE_ELEMENT_STATISTICS = 32;
+
+// one thread's share of every statistic, folded into the retired tallies when the thread exits
+class OctreeElementThreadTallies {
+public:
+    OctreeElementThreadTallies();
+    ~OctreeElementThreadTallies();
+
+    quint64 values[MAX_OCTREE_ELEMENT_STATISTICS];
+};
+
+// these are allocated once and never freed, since a thread can exit after the statics have been destroyed
+static QMutex* talliesMutex = new QMutex();
+static QList<OctreeElementThreadTallies*>* liveTallies = new QList<OctreeElementThreadTallies*>();
+static QThreadStorage<OctreeElementThreadTallies*>* threadTalliesStorage =
+    new QThreadStorage<OctreeElementThreadTallies*>();
+static quint64 retiredTallies[MAX_OCTREE_ELEMENT_STATISTICS];
+static int statisticCount = 0;
+
+OctreeElementThreadTallies::OctreeElementThreadTallies() {
+    memset(values, 0, sizeof(values));
+    QMutexLocker locker(talliesMutex);
+    liveTallies->append(this);
+}
+
+OctreeElementThreadTallies::~OctreeElementThreadTallies() {
+    QMutexLocker locker(talliesMutex);
+    for (int i = 0; i < MAX_OCTREE_ELEMENT_STATISTICS; i++) {
+        retiredTallies[i] += values[i];
+    }
+    liveTallies->removeOne(this);
+}
+
+OctreeElementStatistic::OctreeElementStatistic() : _index(statisticCount++) {
+    // the statistics are all defined in this file, so they're numbered during its static initialization
+    assert(_index < MAX_OCTREE_ELEMENT_STATISTICS);
+}
+
+OctreeElementStatistic::operator quint64() const {
+    // other threads keep tallying while we add up, so this is a snapshot, like the counters it replaced
+    QMutexLocker locker(talliesMutex);
+    quint64 total = retiredTallies[_index];
+    foreach (OctreeElementThreadTallies* tallies, *liveTallies) {
+        total += tallies->values[_index];
+    }
+    return total;
+}
+
+quint64* OctreeElementStatistic::threadTallies() {
+    OctreeElementThreadTallies* tallies = threadTalliesStorage->localData();
+    if (!tallies) {
+        tallies = new OctreeElementThreadTallies();
+        threadTalliesStorage->setLocalData(tallies);
+    }
+    return tallies->values;
+}
+
+OctreeElementStatistic OctreeElement::_voxelMemoryUsage;
+OctreeElementStatistic OctreeElement::_octcodeMemoryUsage;
+OctreeElementStatistic OctreeElement::_externalChildrenMemoryUsage;
+OctreeElementStatistic OctreeElement::_voxelNodeCount;
+OctreeElementStatistic OctreeElement::_voxelNodeLeafCount;
 
 OctreeElement::OctreeElement() {
     // Note: you must call init() from your subclass, otherwise the OctreeElement will not be properly
@@ -85,6 +144,8 @@ void OctreeElement::init(unsigned char * octalCode) {
     _isDirty = true;
     _shouldRender = false;
     _sourceUUIDKey = 0;
+    _descendantsHash = 0;
+    _descendantsHashDirty = true;
     calculateAABox();
     markWithChangedTime();
 }
@@ -107,6 +168,7 @@ OctreeElement::~OctreeElement() {
 
 void OctreeElement::markWithChangedTime() {
     _lastChanged = usecTimestampNow();
+    _descendantsHashDirty = true;
     notifyUpdateHooks(); // if the node has changed, notify our hooks
 }
 
@@ -125,6 +187,18 @@ void OctreeElement::handleSubtreeChanged(Octree* myTree) {
     markWithChangedTime();
 }
 
+quint64 OctreeElement::combineHashes(quint64 seed, quint64 value) {
+    quint64 hash = seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+
+    // finish with the splitmix64 mixer, so that nearby values spread over the whole hash
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
 const uint16_t KEY_FOR_NULL = 0;
 uint16_t OctreeElement::_nextUUIDKey = KEY_FOR_NULL + 1; // start at 1, 0 is reserved for NULL
 std::map<QString, uint16_t> OctreeElement::_mapSourceUUIDsToKeys;
@@ -276,17 +350,17 @@ quint64 OctreeElement::_setChildAtIndexTime = 0;
 quint64 OctreeElement::_setChildAtIndexCalls = 0;
 
 #ifdef BLENDED_UNION_CHILDREN
-quint64 OctreeElement::_singleChildrenCount = 0;
-quint64 OctreeElement::_twoChildrenOffsetCount = 0;
-quint64 OctreeElement::_twoChildrenExternalCount = 0;
-quint64 OctreeElement::_threeChildrenOffsetCount = 0;
-quint64 OctreeElement::_threeChildrenExternalCount = 0;
-quint64 OctreeElement::_couldStoreFourChildrenInternally = 0;
-quint64 OctreeElement::_couldNotStoreFourChildrenInternally = 0;
+OctreeElementStatistic OctreeElement::_singleChildrenCount;
+OctreeElementStatistic OctreeElement::_twoChildrenOffsetCount;
+OctreeElementStatistic OctreeElement::_twoChildrenExternalCount;
+OctreeElementStatistic OctreeElement::_threeChildrenOffsetCount;
+OctreeElementStatistic OctreeElement::_threeChildrenExternalCount;
+OctreeElementStatistic OctreeElement::_couldStoreFourChildrenInternally;
+OctreeElementStatistic OctreeElement::_couldNotStoreFourChildrenInternally;
 #endif
 
-quint64 OctreeElement::_externalChildrenCount = 0;
-quint64 OctreeElement::_childrenCount[NUMBER_OF_CHILDREN + 1] = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+OctreeElementStatistic OctreeElement::_externalChildrenCount;
+OctreeElementStatistic OctreeElement::_childrenCount[NUMBER_OF_CHILDREN + 1];
 
 OctreeElement* OctreeElement::getChildAtIndex(int childIndex) const {
 #ifdef SIMPLE_CHILD_ARRAY
@@ -630,6 +704,24 @@ void OctreeElement::checkStoreFourChildren(OctreeElement* childOne, OctreeElemen
 }
 #endif
 
+void OctreeElement::deleteChildrenQuietly() {
+    bool hadChildren = false;
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        OctreeElement* childAt = getChildAtIndex(i);
+        if (childAt) {
+            delete childAt;
+            setChildAtIndex(i, NULL);
+            hadChildren = true;
+        }
+    }
+    if (hadChildren && isLeaf()) {
+        _voxelNodeLeafCount++;
+    }
+#ifdef HAS_AUDIT_CHILDREN
+    auditChildren("deleteChildrenQuietly()");
+#endif // def HAS_AUDIT_CHILDREN
+}
+
 void OctreeElement::deleteAllChildren() {
     // first delete all the OctreeElement objects...
     for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
@@ -1301,6 +1393,12 @@ bool OctreeElement::findSpherePenetration(const glm::vec3& center, float radius,
     return _box.findSpherePenetration(center, radius, penetration);
 }
 
+bool OctreeElement::findSpatialItemRayIntersection(int index, const glm::vec3& origin, const glm::vec3& direction,
+                                                   float& distance) const {
+    BoxFace face;
+    return _box.findRayIntersection(origin, direction, distance, face);
+}
+
 
 OctreeElement* OctreeElement::getOrCreateChildElementAt(float x, float y, float z, float s) {
     OctreeElement* child = NULL;
@@ -34,6 +34,25 @@ public:
     virtual void elementDeleted(OctreeElement* element) = 0;
 };
 
+/// A statistic of every element in every tree. Separate trees are built on many threads at once by the importers and
+/// the streaming SVO tools, so each thread tallies its changes on its own without locking, and the tallies of all the
+/// threads (plus those of threads that have exited) are added up when the statistic is read.
+class OctreeElementStatistic {
+public:
+    OctreeElementStatistic();
+
+    operator quint64() const;
+    void operator+=(quint64 amount) { threadTallies()[_index] += amount; }
+    void operator-=(quint64 amount) { threadTallies()[_index] -= amount; }
+    void operator++(int) { *this += 1; }
+    void operator--(int) { *this -= 1; }
+
+private:
+    static quint64* threadTallies();
+
+    int _index;
+};
+
 // Callers who want update hook callbacks should implement this class
 class OctreeElementUpdateHook {
 public:
@@ -92,14 +111,44 @@ public:
     
     virtual bool deleteApproved() const { return true; }
 
+    /// A hash of this element's own data, for comparing trees by content. Subclasses with data override it, mixing their
+    /// fields in with combineHashes().
+    virtual quint64 hashElementData() const { return 0; }
+
 
     virtual bool findSpherePenetration(const glm::vec3& center, float radius, 
                         glm::vec3& penetration, void** penetratedObject) const;
 
+    /// Spatial queries (see OctreeSpatialQuery) see each element as holding a number of items. By default a leaf with
+    /// content is one item that fills the element's box. Override these in elements that hold other things, like particles.
+    virtual int getSpatialItemCount() const { return (isLeaf() && hasContent()) ? 1 : 0; }
+
+    /// Override if items can reach outside of the element's box. This must also cover the items of every descendant, so
+    /// that queries can skip a whole subtree by testing the element's box grown by the margin.
+    virtual float getSpatialItemMargin() const { return 0.0f; }
+
+    /// the distance from the point to the item, zero if the item contains the point. Points are in tree units.
+    virtual float getSpatialItemDistance(int index, const glm::vec3& point) const { return _box.distanceToPoint(point); }
+
+    /// does the item touch the box, in tree units
+    virtual bool spatialItemTouches(int index, const AABox& box) const { return _box.touches(box); }
+
+    /// finds where a ray first hits the item, in tree units
+    virtual bool findSpatialItemRayIntersection(int index, const glm::vec3& origin, const glm::vec3& direction,
+                                                float& distance) const;
+
+    /// where the item is relative to the view frustum, which is in meters like the frustum methods below
+    virtual ViewFrustum::location spatialItemInFrustum(int index, const ViewFrustum& viewFrustum) const
+                    { return inFrustum(viewFrustum); }
+
     // Base class methods you don't need to implement
     const unsigned char* getOctalCode() const { return (_octcodePointer) ? _octalCode.pointer : &_octalCode.buffer[0]; }
     OctreeElement* getChildAtIndex(int childIndex) const;
     void deleteChildAtIndex(int childIndex);
+
+    /// Deletes every child without marking this element as changed, for dropping a subtree that can be read back (see
+    /// OctreePager), so that viewers aren't sent this element as if it had really lost its children.
+    void deleteChildrenQuietly();
     OctreeElement* removeChildAtIndex(int childIndex);
 
     /// handles deletion of all descendants, returns false if delete not approved
@@ -136,6 +185,13 @@ public:
     void markWithChangedTime();
     quint64 getLastChanged() const { return _lastChanged; }
     void handleSubtreeChanged(Octree* myTree);
+
+    // Used by Octree to keep the hashes of its subtrees, see Octree::getSubtreeHash()
+    bool isDescendantsHashDirty() const { return _descendantsHashDirty; }
+    void markDescendantsHashDirty() { _descendantsHashDirty = true; }
+    quint64 getDescendantsHash() const { return _descendantsHash; }
+    void setDescendantsHash(quint64 hash) { _descendantsHash = hash; _descendantsHashDirty = false; }
+    static quint64 combineHashes(quint64 seed, quint64 value);
     
     // Used by VoxelSystem for rendering in/out of view and LOD
     void setShouldRender(bool shouldRender);
@@ -228,6 +284,7 @@ protected:
     } _octalCode;  
 
     quint64 _lastChanged; /// Client and server, timestamp this node was last changed, 8 bytes
+    quint64 _descendantsHash; /// Client and server, hash of everything under this node, 8 bytes
 
     /// Client and server, pointers to child nodes, various encodings
 #ifdef SIMPLE_CHILD_ARRAY
@@ -265,6 +322,10 @@ protected:
 
     unsigned char _childBitmask;     // 1 byte 
 
+    /// Client and server, the descendants hash needs recomputing, 1 byte. Not one of the bits below, since those are
+    /// written by readers that the hash computation runs alongside.
+    bool _descendantsHashDirty;
+
     bool _falseColored : 1, /// Client only, is this voxel false colored, 1 bit
          _isDirty : 1, /// Client only, has this voxel changed since being rendered, 1 bit
          _shouldRender : 1, /// Client only, should this voxel render at this time, 1 bit
@@ -278,12 +339,12 @@ protected:
     //static QReadWriteLock _updateHooksLock;
     static std::vector<OctreeElementUpdateHook*> _updateHooks;
 
-    static quint64 _voxelNodeCount;
-    static quint64 _voxelNodeLeafCount;
+    static OctreeElementStatistic _voxelNodeCount;
+    static OctreeElementStatistic _voxelNodeLeafCount;
 
-    static quint64 _voxelMemoryUsage;
-    static quint64 _octcodeMemoryUsage;
-    static quint64 _externalChildrenMemoryUsage;
+    static OctreeElementStatistic _voxelMemoryUsage;
+    static OctreeElementStatistic _octcodeMemoryUsage;
+    static OctreeElementStatistic _externalChildrenMemoryUsage;
 
     static quint64 _getChildAtIndexTime;
     static quint64 _getChildAtIndexCalls;
@@ -291,16 +352,16 @@ protected:
     static quint64 _setChildAtIndexCalls;
 
 #ifdef BLENDED_UNION_CHILDREN
-    static quint64 _singleChildrenCount;
-    static quint64 _twoChildrenOffsetCount;
-    static quint64 _twoChildrenExternalCount;
-    static quint64 _threeChildrenOffsetCount;
-    static quint64 _threeChildrenExternalCount;
-    static quint64 _couldStoreFourChildrenInternally;
-    static quint64 _couldNotStoreFourChildrenInternally;
+    static OctreeElementStatistic _singleChildrenCount;
+    static OctreeElementStatistic _twoChildrenOffsetCount;
+    static OctreeElementStatistic _twoChildrenExternalCount;
+    static OctreeElementStatistic _threeChildrenOffsetCount;
+    static OctreeElementStatistic _threeChildrenExternalCount;
+    static OctreeElementStatistic _couldStoreFourChildrenInternally;
+    static OctreeElementStatistic _couldNotStoreFourChildrenInternally;
 #endif
-    static quint64 _externalChildrenCount;
-    static quint64 _childrenCount[NUMBER_OF_CHILDREN + 1];
+    static OctreeElementStatistic _externalChildrenCount;
+    static OctreeElementStatistic _childrenCount[NUMBER_OF_CHILDREN + 1];
 };
 
 #endif /* defined(__hifi__OctreeElement__) */
\ No newline at end of file
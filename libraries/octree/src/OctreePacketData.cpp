@@ -7,6 +7,7 @@
 //
 
 #include <PerfStat.h>
+#include <Trace.h>
 #include "OctreePacketData.h"
 
 bool OctreePacketData::_debug = false;
@@ -357,6 +358,7 @@ bool OctreePacketData::compressContent() {
     if (!_enableCompression) {
         return true;
     }
+    TRACE_SCOPE("octree compress");
 
     _bytesInUseLastCheck = _bytesInUse;
 
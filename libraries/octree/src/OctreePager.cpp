@@ -0,0 +1,405 @@
+//
+//  OctreePager.cpp
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <QtCore/QDebug>
+
+#include <OctalCode.h>
+#include <SharedUtil.h>
+
+#include "Octree.h"
+#include "OctreeConstants.h"
+#include "OctreePager.h"
+
+// a page that was just used is left in even if the tree is over budget, so that pages don't thrash
+const quint64 MIN_RESIDENT_USECS = 2 * USECS_PER_SECOND;
+
+// once over budget, page out down to a little under it
+const float PAGE_OUT_TARGET = 0.9f;
+
+// keeps each call to process() short, the rest is paged out on the next call
+const int MAX_PAGE_OUTS_PER_PROCESS = 16;
+
+OctreePager::OctreePager(Octree* tree, const QString& pageFileName, quint64 memoryBudgetBytes, int chunkLevel) :
+    _tree(tree),
+    _chunkLevel(chunkLevel),
+    _memoryBudgetBytes(memoryBudgetBytes),
+    _pageFile(pageFileName),
+    _pageIns(0),
+    _pageOuts(0),
+    _pageFaults(0),
+    _pageInUsecs(0),
+    _pageOutUsecs(0)
+{
+    // whatever was in the page file belonged to the pages of an earlier run
+    if (!_pageFile.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+        qDebug() << "OctreePager couldn't open its page file" << pageFileName << ", pages can only be paged out if they "
+            "haven't been edited";
+    }
+}
+
+OctreePager::~OctreePager() {
+    _pageFile.close();
+    _pageFile.remove();
+}
+
+QByteArray OctreePager::pageOctalCode(const unsigned char* octalCode) const {
+    if (numberOfThreeBitSectionsInCode(octalCode) < _chunkLevel) {
+        return QByteArray();
+    }
+    // the ancestor of the code at the chunk level
+    unsigned char* pageCode = NULL;
+    for (int section = 0; section < _chunkLevel; section++) {
+        unsigned char* childCode = childOctalCode(pageCode, getOctalCodeSectionValue(octalCode, section));
+        delete[] pageCode;
+        pageCode = childCode;
+    }
+    QByteArray result((const char*)pageCode, bytesRequiredForCodeLength(_chunkLevel));
+    delete[] pageCode;
+    return result;
+}
+
+static AABox pageBox(const QByteArray& octalCode) {
+    VoxelPositionSize details;
+    voxelDetailsForCode((const unsigned char*)octalCode.constData(), details);
+    AABox box(glm::vec3(details.x, details.y, details.z), details.s);
+    box.scale(TREE_SCALE);
+    return box;
+}
+
+void OctreePager::addStoredPage(const QString& svoFileName, const SVOChunk& chunk) {
+    QMutexLocker locker(&_pagesMutex);
+    if (_svoFile.fileName() != svoFileName || !_svoFile.isOpen()) {
+        _svoFile.close();
+        _svoFile.setFileName(svoFileName);
+        _svoFile.open(QIODevice::ReadOnly);
+    }
+
+    OctreePage page;
+    page.stored = chunk;
+    page.stored.bitstream.clear();
+    page.isResident = false;
+    page.isDirty = false;
+    page.hasStoredCopy = true;
+    _pages.insert(chunk.octalCode, page);
+}
+
+void OctreePager::addResidentPages() {
+    QVector<QByteArray> octalCodes = _tree->getChunkRootOctalCodes(_chunkLevel);
+
+    QMutexLocker locker(&_pagesMutex);
+    quint64 now = usecTimestampNow();
+    foreach (const QByteArray& octalCode, octalCodes) {
+        if (!_pages.contains(octalCode)) {
+            OctreePage page;
+            page.lastTouched = now;
+            _pages.insert(octalCode, page);
+        }
+    }
+}
+
+void OctreePager::touchInView(const ViewFrustum& viewFrustum) {
+    QMutexLocker locker(&_pagesMutex);
+    quint64 now = usecTimestampNow();
+    for (QHash<QByteArray, OctreePage>::iterator page = _pages.begin(); page != _pages.end(); ++page) {
+        if (viewFrustum.boxInFrustum(pageBox(page.key())) != ViewFrustum::OUTSIDE) {
+            page->lastTouched = now;
+            if (!page->isResident && !_pageInQueue.contains(page.key())) {
+                _pageInQueue.append(page.key());
+            }
+        }
+    }
+}
+
+void OctreePager::willEditOctalCode(const unsigned char* octalCode, bool willDelete) {
+    QMutexLocker locker(&_pagesMutex);
+    quint64 now = usecTimestampNow();
+
+    // an edit above the chunk level reaches every page under it
+    if (numberOfThreeBitSectionsInCode(octalCode) <= _chunkLevel) {
+        QHash<QByteArray, OctreePage>::iterator page = _pages.begin();
+        while (page != _pages.end()) {
+            if (!isAncestorOf(octalCode, (const unsigned char*)page.key().constData())) {
+                ++page;
+            } else if (willDelete) {
+                // the subtree is going away, there's nothing to keep
+                page = _pages.erase(page);
+            } else {
+                if (!page->isResident) {
+                    pageIn(page.key(), *page);
+                    _pageFaults++;
+                }
+                page->isDirty = true;
+                page->lastEdited = now;
+                page->lastTouched = now;
+                ++page;
+            }
+        }
+        return;
+    }
+
+    QByteArray pageCode = pageOctalCode(octalCode);
+    QHash<QByteArray, OctreePage>::iterator page = _pages.find(pageCode);
+    if (page == _pages.end()) {
+        // an edit that starts a new page
+        page = _pages.insert(pageCode, OctreePage());
+    } else if (!page->isResident) {
+        pageIn(page.key(), *page);
+        _pageFaults++;
+    }
+    page->isDirty = true;
+    page->lastEdited = now;
+    page->lastTouched = now;
+}
+
+bool OctreePager::readStoredBytes(const OctreePage& page, QByteArray& storedBytes) {
+    QFile& file = page.inPageFile ? _pageFile : _svoFile;
+    if (!page.hasStoredCopy || !file.isOpen() || !file.seek(page.stored.offset)) {
+        return false;
+    }
+    storedBytes = file.read(page.stored.storedSize);
+    return (quint32)storedBytes.size() == page.stored.storedSize;
+}
+
+void OctreePager::pageIn(const QByteArray& octalCode, OctreePage& page) {
+    quint64 start = usecTimestampNow();
+
+    QByteArray storedBytes;
+    QByteArray bitstream;
+    if (readStoredBytes(page, storedBytes)
+            && ChunkedSVOFile::checksum(storedBytes.constData(), storedBytes.size()) == page.stored.checksum) {
+        bitstream = (page.stored.flags & SVO_CHUNK_COMPRESSED) ? qUncompress(storedBytes) : storedBytes;
+    }
+    if ((quint32)bitstream.size() != page.stored.size) {
+        qDebug() << "OctreePager couldn't read the page rooted at"
+            << octalCodeToHexString((const unsigned char*)octalCode.constData()) << ", leaving it paged out";
+        return;
+    }
+
+    // reading the page back isn't a change that needs saving
+    bool wasDirty = _tree->isDirty();
+    ReadBitstreamToTreeParams args(WANT_COLOR, NO_EXISTS_BITS);
+    _tree->readBitstreamToTree((const unsigned char*)bitstream.constData(), bitstream.size(), args);
+    _tree->markPathAsChanged((const unsigned char*)octalCode.constData());
+    if (!wasDirty) {
+        _tree->clearDirtyBit();
+    }
+
+    page.isResident = true;
+    page.lastTouched = usecTimestampNow();
+    _pageIns++;
+    _pageInUsecs += page.lastTouched - start;
+}
+
+bool OctreePager::pageOut(const QByteArray& octalCode) {
+    quint64 start = usecTimestampNow();
+
+    _tree->lockForWrite();
+    QMutexLocker locker(&_pagesMutex);
+
+    QHash<QByteArray, OctreePage>::iterator page = _pages.find(octalCode);
+    if (page == _pages.end() || !page->isResident) {
+        locker.unlock();
+        _tree->unlock();
+        return false;
+    }
+
+    const unsigned char* code = (const unsigned char*)octalCode.constData();
+    OctreeElement* element = _tree->nodeForOctalCode(_tree->getRoot(), code, NULL);
+    if (compareOctalCodes(element->getOctalCode(), code) != EXACT_MATCH || element->isLeaf()) {
+        // the subtree is gone, or never had anything under its root
+        _pages.erase(page);
+        locker.unlock();
+        _tree->unlock();
+        return true;
+    }
+
+    if (page->isDirty || !page->hasStoredCopy) {
+        if (!_pageFile.isOpen()) {
+            locker.unlock();
+            _tree->unlock();
+            return false;
+        }
+        QByteArray bitstream;
+        _tree->encodeSubTreeToBuffer(element, INT_MAX, bitstream);
+
+        SVOChunk chunk;
+        chunk.octalCode = octalCode;
+        ChunkedSVOFile::prepareChunk(chunk, bitstream, true);
+        chunk.offset = _pageFile.size();
+        _pageFile.seek(chunk.offset);
+        if (_pageFile.write(chunk.bitstream) != chunk.bitstream.size()) {
+            qDebug() << "OctreePager couldn't write to its page file, leaving the page in";
+            locker.unlock();
+            _tree->unlock();
+            return false;
+        }
+        chunk.bitstream.clear();
+
+        page->stored = chunk;
+        page->hasStoredCopy = true;
+        page->inPageFile = true;
+        page->isDirty = false;
+    }
+
+    // remember what the subtree hashes as, for comparing trees while it's out. No reader is hashing the tree, since
+    // it's locked for writing.
+    page->descendantsHash = _tree->getDescendantsHash(element);
+    page->hasDescendantsHash = true;
+
+    element->deleteChildrenQuietly();
+    page->isResident = false;
+    _pageOuts++;
+    _pageOutUsecs += usecTimestampNow() - start;
+
+    locker.unlock();
+    _tree->unlock();
+    return true;
+}
+
+void OctreePager::process() {
+    QVector<QByteArray> pageInQueue;
+    {
+        QMutexLocker locker(&_pagesMutex);
+        pageInQueue.swap(_pageInQueue);
+    }
+    foreach (const QByteArray& octalCode, pageInQueue) {
+        _tree->lockForWrite();
+        {
+            QMutexLocker locker(&_pagesMutex);
+            QHash<QByteArray, OctreePage>::iterator page = _pages.find(octalCode);
+            if (page != _pages.end() && !page->isResident) {
+                pageIn(octalCode, *page);
+            }
+        }
+        _tree->unlock();
+    }
+
+    if (OctreeElement::getTotalMemoryUsage() <= _memoryBudgetBytes) {
+        return;
+    }
+    quint64 targetBytes = _memoryBudgetBytes * PAGE_OUT_TARGET;
+    for (int i = 0; i < MAX_PAGE_OUTS_PER_PROCESS && OctreeElement::getTotalMemoryUsage() > targetBytes; i++) {
+        // the least recently used page that hasn't been used too recently
+        QByteArray coldest;
+        {
+            QMutexLocker locker(&_pagesMutex);
+            quint64 touchedBefore = usecTimestampNow() - MIN_RESIDENT_USECS;
+            quint64 coldestTouched = touchedBefore;
+            for (QHash<QByteArray, OctreePage>::const_iterator page = _pages.constBegin(); page != _pages.constEnd();
+                    ++page) {
+                if (page->isResident && page->lastTouched < coldestTouched) {
+                    coldest = page.key();
+                    coldestTouched = page->lastTouched;
+                }
+            }
+        }
+        if (coldest.isEmpty() || !pageOut(coldest)) {
+            break;
+        }
+    }
+}
+
+bool OctreePager::getPagedOutHash(const unsigned char* octalCode, quint64& descendantsHash) {
+    if (numberOfThreeBitSectionsInCode(octalCode) != _chunkLevel) {
+        return false;
+    }
+    QMutexLocker locker(&_pagesMutex);
+    QHash<QByteArray, OctreePage>::const_iterator page = _pages.constFind(pageOctalCode(octalCode));
+    if (page == _pages.constEnd() || page->isResident || !page->hasDescendantsHash) {
+        return false;
+    }
+    descendantsHash = page->descendantsHash;
+    return true;
+}
+
+void OctreePager::pageInToRead(const unsigned char* octalCode, bool wholeSubtree) {
+    QMutexLocker locker(&_pagesMutex);
+    for (QHash<QByteArray, OctreePage>::iterator page = _pages.begin(); page != _pages.end(); ++page) {
+        const unsigned char* pageCode = (const unsigned char*)page.key().constData();
+        if (!page->isResident && (isAncestorOf(pageCode, octalCode)
+                || (isAncestorOf(octalCode, pageCode) && (wholeSubtree || !page->hasDescendantsHash)))) {
+            pageIn(page.key(), *page);
+        }
+    }
+}
+
+bool OctreePager::getPagedOutChunk(const QByteArray& octalCode, SVOChunk& chunk, QByteArray& storedBytes) {
+    QMutexLocker locker(&_pagesMutex);
+    QHash<QByteArray, OctreePage>::const_iterator page = _pages.constFind(octalCode);
+    if (page == _pages.constEnd() || page->isResident) {
+        return false;
+    }
+    chunk = page->stored;
+    return readStoredBytes(*page, storedBytes);
+}
+
+QVector<QByteArray> OctreePager::getPagedOutOctalCodes() {
+    QMutexLocker locker(&_pagesMutex);
+    QVector<QByteArray> octalCodes;
+    for (QHash<QByteArray, OctreePage>::const_iterator page = _pages.constBegin(); page != _pages.constEnd(); ++page) {
+        if (!page->isResident) {
+            octalCodes.append(page.key());
+        }
+    }
+    return octalCodes;
+}
+
+void OctreePager::willReplaceSVOFile() {
+    QMutexLocker locker(&_pagesMutex);
+    _svoFile.close();
+}
+
+void OctreePager::didReplaceSVOFile(const QString& svoFileName, const QVector<SVOChunk>& chunks, quint64 savedAt) {
+    QMutexLocker locker(&_pagesMutex);
+    _svoFile.setFileName(svoFileName);
+    _svoFile.open(QIODevice::ReadOnly);
+
+    QHash<QByteArray, const SVOChunk*> savedChunks;
+    for (int i = 1; i < chunks.size(); i++) {
+        savedChunks.insert(chunks.at(i).octalCode, &chunks.at(i));
+    }
+
+    bool isPageFileInUse = false;
+    for (QHash<QByteArray, OctreePage>::iterator page = _pages.begin(); page != _pages.end(); ++page) {
+        const SVOChunk* saved = savedChunks.value(page.key());
+        if (saved) {
+            page->stored = *saved;
+            page->stored.bitstream.clear();
+            page->hasStoredCopy = true;
+            page->inPageFile = false;
+            if (!page->isResident || page->lastEdited < savedAt) {
+                page->isDirty = false;
+            }
+        } else if (!page->inPageFile) {
+            // its chunk in the old file is gone
+            page->hasStoredCopy = false;
+        }
+        isPageFileInUse = isPageFileInUse || (page->hasStoredCopy && page->inPageFile);
+    }
+
+    // every page that was in the page file is in the SVO file now
+    if (!isPageFileInUse && _pageFile.isOpen()) {
+        _pageFile.resize(0);
+    }
+}
+
+int OctreePager::getPageCount() {
+    QMutexLocker locker(&_pagesMutex);
+    return _pages.size();
+}
+
+int OctreePager::getResidentPageCount() {
+    QMutexLocker locker(&_pagesMutex);
+    int residentPages = 0;
+    foreach (const OctreePage& page, _pages) {
+        if (page.isResident) {
+            residentPages++;
+        }
+    }
+    return residentPages;
+}
@@ -0,0 +1,136 @@
+//
+//  OctreePager.h
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Keeps a tree within a memory budget by paging its subtrees out to storage and back in.
+//
+
+#ifndef __hifi__OctreePager__
+#define __hifi__OctreePager__
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+#include "ChunkedSVOFile.h"
+#include "ViewFrustum.h"
+
+class Octree;
+
+/// one of the subtrees the pager moves in and out of memory, rooted at an element at the chunk level
+class OctreePage {
+public:
+    OctreePage() : isResident(true), isDirty(true), hasStoredCopy(false), inPageFile(false), lastTouched(0),
+        lastEdited(0), hasDescendantsHash(false), descendantsHash(0) { }
+
+    SVOChunk stored; // where the stored copy of the subtree is, in the SVO file or the page file
+    bool isResident; // the subtree is in the tree
+    bool isDirty; // the subtree has been edited since its stored copy was written
+    bool hasStoredCopy;
+    bool inPageFile;
+    quint64 lastTouched;
+    quint64 lastEdited;
+    bool hasDescendantsHash; // the subtree was hashed when it was paged out
+    quint64 descendantsHash;
+};
+
+/// Pages the subtrees of a tree in and out of memory, so that a server can hold a world that's bigger than its memory.
+/// Each page is the subtree under one element at the chunk level of a chunked SVO file. A page that's paged out leaves
+/// its root element in the tree as a leaf, so viewers still see the page's average until it's paged back in.
+///
+/// Pages come from the chunked SVO file the tree was read from until they're edited, and after that from a page file
+/// of the pager's own, until the SVO file is saved again. Pages are paged in when a viewer's frustum reaches them (see
+/// touchInView()) or when an edit does (see the tree's edit handling), and the least recently used pages are paged out
+/// while the tree's elements use more memory than the budget.
+class OctreePager {
+public:
+    static const quint64 DEFAULT_MEMORY_BUDGET_BYTES = 1024ULL * 1024ULL * 1024ULL;
+
+    OctreePager(Octree* tree, const QString& pageFileName, quint64 memoryBudgetBytes = DEFAULT_MEMORY_BUDGET_BYTES,
+                int chunkLevel = DEFAULT_SVO_CHUNK_LEVEL);
+    ~OctreePager();
+
+    int getChunkLevel() const { return _chunkLevel; }
+
+    quint64 getMemoryBudget() const { return _memoryBudgetBytes; }
+    void setMemoryBudget(quint64 memoryBudgetBytes) { _memoryBudgetBytes = memoryBudgetBytes; }
+
+    /// Adds a page that's left in the SVO file rather than read, for trees reading a chunked file lazily. Called with the
+    /// tree's write lock held.
+    void addStoredPage(const QString& svoFileName, const SVOChunk& chunk);
+
+    /// Adds pages for every subtree of the tree at the chunk level that isn't a page yet, for trees that were read
+    /// entirely. Called with the tree's write lock held.
+    void addResidentPages();
+
+    /// Marks the pages the view frustum reaches as used, and queues the paged out ones to be paged in by process().
+    void touchInView(const ViewFrustum& viewFrustum);
+
+    /// Pages in whatever an edit of the element with this octal code reaches and marks it edited, or forgets the pages
+    /// under it if the edit deletes it. Called by the tree with its write lock held.
+    void willEditOctalCode(const unsigned char* octalCode, bool willDelete);
+
+    /// If the page rooted at the octal code is paged out and was hashed when it was, the hash of what's under its root.
+    /// Called with the tree locked.
+    bool getPagedOutHash(const unsigned char* octalCode, quint64& descendantsHash);
+
+    /// Pages in what reading under the element with this octal code needs: the page holding its children, and either
+    /// every page under it, or only those that weren't hashed when they were paged out, so that it can be hashed. Called
+    /// with the tree's write lock held.
+    void pageInToRead(const unsigned char* octalCode, bool wholeSubtree);
+
+    /// Pages in the queued pages, then pages out the least recently used ones while the tree is over the memory budget.
+    /// Called without the tree's lock, which is locked for each page.
+    void process();
+
+    /// If the page rooted at the octal code is paged out, its stored chunk and bytes, for saving. Called with the tree
+    /// locked.
+    bool getPagedOutChunk(const QByteArray& octalCode, SVOChunk& chunk, QByteArray& storedBytes);
+    QVector<QByteArray> getPagedOutOctalCodes();
+
+    /// The SVO file is about to be replaced by a newly saved one, the pager lets go of it.
+    void willReplaceSVOFile();
+
+    /// The SVO file has been replaced, and the pages' stored copies are now the chunks of the new file, which was
+    /// started at savedAt so that pages edited since are still dirty.
+    void didReplaceSVOFile(const QString& svoFileName, const QVector<SVOChunk>& chunks, quint64 savedAt);
+
+    quint64 getPageIns() const { return _pageIns; }
+    quint64 getPageOuts() const { return _pageOuts; }
+    quint64 getPageFaults() const { return _pageFaults; }
+    quint64 getPageInUsecs() const { return _pageInUsecs; }
+    quint64 getPageOutUsecs() const { return _pageOutUsecs; }
+    int getPageCount();
+    int getResidentPageCount();
+
+private:
+    QByteArray pageOctalCode(const unsigned char* octalCode) const;
+    bool readStoredBytes(const OctreePage& page, QByteArray& storedBytes);
+    void pageIn(const QByteArray& octalCode, OctreePage& page);
+    bool pageOut(const QByteArray& octalCode);
+
+    Octree* _tree;
+    int _chunkLevel;
+    quint64 _memoryBudgetBytes;
+
+    QMutex _pagesMutex; // guards the pages, the queue and the files, and is only ever locked after the tree's lock
+    QHash<QByteArray, OctreePage> _pages;
+    QVector<QByteArray> _pageInQueue;
+
+    QFile _svoFile;
+    QFile _pageFile;
+
+    quint64 _pageIns;
+    quint64 _pageOuts;
+    quint64 _pageFaults; // page ins an edit had to wait for
+    quint64 _pageInUsecs;
+    quint64 _pageOutUsecs;
+};
+
+#endif /* defined(__hifi__OctreePager__) */
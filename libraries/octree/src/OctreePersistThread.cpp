@@ -12,35 +12,50 @@
 #include <PerfStat.h>
 #include <SharedUtil.h>
 
+#include "OctreePager.h"
 #include "OctreePersistThread.h"
 
-OctreePersistThread::OctreePersistThread(Octree* tree, const QString& filename, int persistInterval) :
+const quint64 OCTREE_UPDATE_INTERVAL_USECS = 10 * USECS_PER_MSEC; // every 10ms
+
+OctreePersistThread::OctreePersistThread(Octree* tree, const QString& filename, int persistInterval,
+                                         const JurisdictionMap* jurisdictionMap) :
     _tree(tree),
     _filename(filename),
     _persistInterval(persistInterval),
+    _jurisdictionMap(jurisdictionMap),
     _initialLoadComplete(false),
-    _loadTimeUSecs(0) {
+    _loadStarted(0),
+    _loadTimeUSecs(0),
+    _loadProgress(0),
+    _updateScheduler("OctreePersistThread", OCTREE_UPDATE_INTERVAL_USECS) {
+    connect(_tree, SIGNAL(importProgress(int)), this, SLOT(setLoadProgress(int)), Qt::DirectConnection);
+}
+
+quint64 OctreePersistThread::getLoadElapsedTime() const {
+    return _initialLoadComplete ? _loadTimeUSecs : (_loadStarted ? usecTimestampNow() - _loadStarted : 0);
 }
 
 bool OctreePersistThread::process() {
 
     if (!_initialLoadComplete) {
-        quint64 loadStarted = usecTimestampNow();
+        _loadStarted = usecTimestampNow();
         qDebug() << "loading Octrees from file: " << _filename << "...";
 
         bool persistantFileRead;
 
+        // the tree is clean since we're loading it, edits are held back by the server until the load is complete
         _tree->lockForWrite();
+        _tree->clearDirtyBit();
+        _tree->unlock();
+
+        // the load locks the tree for each chunk, so that it can be sent while it's loading
         {
             PerformanceWarning warn(true, "Loading Octree File", true);
-            persistantFileRead = _tree->readFromSVOFile(_filename.toLocal8Bit().constData());
+            persistantFileRead = _tree->readFromSVOFile(_filename.toLocal8Bit().constData(), _jurisdictionMap, true);
         }
-        _tree->unlock();
 
         quint64 loadDone = usecTimestampNow();
-        _loadTimeUSecs = loadDone - loadStarted;
-
-        _tree->clearDirtyBit(); // the tree is clean since we just loaded it
+        _loadTimeUSecs = loadDone - _loadStarted;
         qDebug("DONE loading Octrees from file... fileRead=%s", debug::valueOf(persistantFileRead));
 
         unsigned long nodeCount = OctreeElement::getNodeCount();
@@ -64,14 +79,18 @@ bool OctreePersistThread::process() {
 
     if (isStillRunning()) {
         quint64 MSECS_TO_USECS = 1000;
-        quint64 USECS_TO_SLEEP = 10 * MSECS_TO_USECS; // every 10ms
-        usleep(USECS_TO_SLEEP);
+        _updateScheduler.waitForNextFrame();
 
         // do our updates then check to save...
         _tree->lockForWrite();
         _tree->update();
         _tree->unlock();
 
+        // page in what viewers have reached, and page out what they haven't for a while if we're over budget
+        if (_tree->getPager()) {
+            _tree->getPager()->process();
+        }
+
         quint64 now = usecTimestampNow();
         quint64 sinceLastSave = now - _lastCheck;
         quint64 intervalToCheck = _persistInterval * MSECS_TO_USECS;
@@ -81,7 +100,7 @@ bool OctreePersistThread::process() {
             _lastCheck = usecTimestampNow();
             if (_tree->isDirty()) {
                 qDebug() << "saving Octrees to file " << _filename << "...";
-                _tree->writeToSVOFile(_filename.toLocal8Bit().constData());
+                _tree->writeToChunkedSVOFile(_filename.toLocal8Bit().constData(), _jurisdictionMap);
                 _tree->clearDirtyBit(); // tree is clean after saving
                 qDebug("DONE saving Octrees to file...");
             }
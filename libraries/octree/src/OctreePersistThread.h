@@ -12,6 +12,7 @@
 #define __Octree_server__OctreePersistThread__
 
 #include <QString>
+#include <FrameScheduler.h>
 #include <GenericThread.h>
 #include "Octree.h"
 
@@ -21,14 +22,25 @@ class OctreePersistThread : public GenericThread {
 public:
     static const int DEFAULT_PERSIST_INTERVAL = 1000 * 30; // every 30 seconds
 
-    OctreePersistThread(Octree* tree, const QString& filename, int persistInterval = DEFAULT_PERSIST_INTERVAL);
+    /// If a jurisdiction is given only the parts of a chunked file that reach into it are loaded, and the rest of the file
+    /// is kept as it was when the tree is saved.
+    OctreePersistThread(Octree* tree, const QString& filename, int persistInterval = DEFAULT_PERSIST_INTERVAL,
+                        const JurisdictionMap* jurisdictionMap = NULL);
 
     bool isInitialLoadComplete() const { return _initialLoadComplete; }
-    quint64 getLoadElapsedTime() const { return _loadTimeUSecs; }
+
+    /// how long the initial load took, or has taken so far
+    quint64 getLoadElapsedTime() const;
+
+    /// how much of the initial load is done, in percent
+    int getLoadProgress() const { return _loadProgress; }
 
 signals:
     void loadCompleted();
 
+private slots:
+    void setLoadProgress(int progress) { _loadProgress = progress; }
+
 protected:
     /// Implements generic processing behavior for this thread.
     virtual bool process();
@@ -36,10 +48,14 @@ private:
     Octree* _tree;
     QString _filename;
     int _persistInterval;
+    const JurisdictionMap* _jurisdictionMap;
     bool _initialLoadComplete;
 
+    quint64 _loadStarted;
     quint64 _loadTimeUSecs;
+    int _loadProgress;
     quint64 _lastCheck;
+    FrameScheduler _updateScheduler;
 };
 
 #endif // __Octree_server__OctreePersistThread__
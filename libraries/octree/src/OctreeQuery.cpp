@@ -14,6 +14,7 @@
 #include <PacketHeaders.h>
 #include <SharedUtil.h>
 #include <UUID.h>
+#include <OctalCode.h>
 #include "OctreeConstants.h"
 
 #include "OctreeQuery.h"
@@ -84,7 +85,21 @@ int OctreeQuery::getBroadcastData(unsigned char* destinationBuffer) {
     // desired boundaryLevelAdjust
     memcpy(destinationBuffer, &_boundaryLevelAdjust, sizeof(_boundaryLevelAdjust));
     destinationBuffer += sizeof(_boundaryLevelAdjust);
-    
+
+    // cached subtrees the server hasn't been told about
+    quint16 cachedSubtreeCount = _cachedSubtrees.size();
+    memcpy(destinationBuffer, &cachedSubtreeCount, sizeof(cachedSubtreeCount));
+    destinationBuffer += sizeof(cachedSubtreeCount);
+    for (OctreeCachedSubtrees::const_iterator subtree = _cachedSubtrees.constBegin();
+            subtree != _cachedSubtrees.constEnd(); ++subtree) {
+        memcpy(destinationBuffer, subtree.key().constData(), subtree.key().size());
+        destinationBuffer += subtree.key().size();
+        memcpy(destinationBuffer, &subtree->version, sizeof(subtree->version));
+        destinationBuffer += sizeof(subtree->version);
+        memcpy(destinationBuffer, &subtree->viewDistance, sizeof(subtree->viewDistance));
+        destinationBuffer += sizeof(subtree->viewDistance);
+    }
+
     return destinationBuffer - bufferStart;
 }
 
@@ -129,9 +144,54 @@ int OctreeQuery::parseData(const QByteArray& packet) {
     memcpy(&_boundaryLevelAdjust, sourceBuffer, sizeof(_boundaryLevelAdjust));
     sourceBuffer += sizeof(_boundaryLevelAdjust);
 
+    // cached subtrees, which clients that don't cache leave off
+    const unsigned char* endPosition = startPosition + packet.size();
+    quint16 cachedSubtreeCount = 0;
+    if (endPosition - sourceBuffer >= (int)sizeof(cachedSubtreeCount)) {
+        memcpy(&cachedSubtreeCount, sourceBuffer, sizeof(cachedSubtreeCount));
+        sourceBuffer += sizeof(cachedSubtreeCount);
+    }
+    if (cachedSubtreeCount > 0) {
+        QMutexLocker locker(&_cachedSubtreesMutex);
+        for (int i = 0; i < cachedSubtreeCount && sourceBuffer < endPosition; i++) {
+            int codeLength = bytesRequiredForCodeLength(*sourceBuffer);
+            OctreeCachedSubtree subtree;
+            if (endPosition - sourceBuffer < codeLength + (int)(sizeof(subtree.version) + sizeof(subtree.viewDistance))) {
+                break;
+            }
+            bool isCacheLevel = numberOfThreeBitSectionsInCode(sourceBuffer, codeLength) == CLIENT_CACHE_SUBTREE_LEVEL;
+            QByteArray octalCode((const char*)sourceBuffer, codeLength);
+            sourceBuffer += codeLength;
+            memcpy(&subtree.version, sourceBuffer, sizeof(subtree.version));
+            sourceBuffer += sizeof(subtree.version);
+            memcpy(&subtree.viewDistance, sourceBuffer, sizeof(subtree.viewDistance));
+            sourceBuffer += sizeof(subtree.viewDistance);
+
+            // the client only caches subtrees at one level, and a stamp that doesn't fit is as good as none
+            if (!isCacheLevel) {
+                continue;
+            }
+            if (subtree.version == 0) {
+                _cachedSubtrees.remove(octalCode);
+            } else if (_cachedSubtrees.size() < MAX_CACHED_SUBTREES_PER_CLIENT || _cachedSubtrees.contains(octalCode)) {
+                _cachedSubtrees.insert(octalCode, subtree);
+            }
+        }
+    }
+
     return sourceBuffer - startPosition;
 }
 
+void OctreeQuery::setCachedSubtrees(const OctreeCachedSubtrees& cachedSubtrees) {
+    QMutexLocker locker(&_cachedSubtreesMutex);
+    _cachedSubtrees = cachedSubtrees;
+}
+
+OctreeCachedSubtrees OctreeQuery::getCachedSubtrees() {
+    QMutexLocker locker(&_cachedSubtreesMutex);
+    return _cachedSubtrees;
+}
+
 glm::vec3 OctreeQuery::calculateCameraDirection() const {
     glm::vec3 direction = glm::vec3(_cameraOrientation * glm::vec4(IDENTITY_FRONT, 0.0f));
     return direction;
@@ -32,6 +32,7 @@ typedef unsigned long long quint64;
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
 #include <QtCore/QUuid>
 #include <QtCore/QVariantMap>
@@ -40,6 +41,8 @@ typedef unsigned long long quint64;
 
 #include <NodeData.h>
 
+#include "OctreeClientCache.h"
+
 // First bitset
 const int WANT_LOW_RES_MOVING_BIT = 0;
 const int WANT_COLOR_AT_BIT = 1;
@@ -97,6 +100,13 @@ public slots:
     void setOctreeSizeScale(float octreeSizeScale) { _octreeElementSizeScale = octreeSizeScale; }
     void setBoundaryLevelAdjust(int boundaryLevelAdjust) { _boundaryLevelAdjust = boundaryLevelAdjust; }
 
+    /// The subtrees the client has cached that it hasn't told this server about yet, sent with the next query. Stamps
+    /// with a version of zero tell the server the client no longer has those subtrees.
+    void setCachedSubtrees(const OctreeCachedSubtrees& cachedSubtrees);
+
+    /// every subtree the client has told this server it has cached
+    OctreeCachedSubtrees getCachedSubtrees();
+
 protected:
     // camera details for the avatar
     glm::vec3 _cameraPosition;
@@ -117,6 +127,9 @@ protected:
     float _octreeElementSizeScale; /// used for LOD calculations
     int _boundaryLevelAdjust; /// used for LOD calculations
 
+    QMutex _cachedSubtreesMutex; // queries are parsed on the node list's thread, and read on the send thread
+    OctreeCachedSubtrees _cachedSubtrees;
+
 private:
     // privatize the copy constructor and assignment operator so they cannot be called
     OctreeQuery(const OctreeQuery&);
@@ -143,6 +143,7 @@ public:
     const std::vector<unsigned char*>& getJurisdictionEndNodes() const { return _jurisdictionEndNodes; }
     
     bool isMoving() const { return _isMoving; };
+    quint64 getStart() const { return _start; } // when the scene started, on the server's clock
     unsigned long getTotalElements() const { return _totalElements; }
     unsigned long getTotalInternal() const { return _totalInternal; }
     unsigned long getTotalLeaves() const { return _totalLeaves; }
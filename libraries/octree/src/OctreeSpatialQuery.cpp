@@ -0,0 +1,234 @@
+//
+//  OctreeSpatialQuery.cpp
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+
+#include "Octree.h"
+#include "OctreeConstants.h"
+#include "OctreeElement.h"
+#include "OctreeSpatialQuery.h"
+
+// the element's box grown by how far its items may reach outside of it
+static AABox expandedBox(const OctreeElement* element) {
+    float margin = element->getSpatialItemMargin();
+    if (margin == 0.0f) {
+        return element->getAABox();
+    }
+    return AABox(element->getCorner() - glm::vec3(margin, margin, margin), element->getScale() + 2.0f * margin);
+}
+
+// no item of the element or its descendants can be closer to the point than this
+static float closestPossibleDistance(const OctreeElement* element, const glm::vec3& point) {
+    return std::max(0.0f, element->getAABox().distanceToPoint(point) - element->getSpatialItemMargin());
+}
+
+// orders the candidate heap so that the closest candidate is on top
+class FartherCandidate {
+public:
+    bool operator()(const SpatialQueryCandidate& a, const SpatialQueryCandidate& b) const {
+        return a.distance > b.distance;
+    }
+};
+
+OctreeSpatialQuery::OctreeSpatialQuery(Octree* tree) :
+    _tree(tree),
+    _elementsVisited(0)
+{
+}
+
+void OctreeSpatialQuery::pushCandidate(float distance, OctreeElement* element, int item) {
+    SpatialQueryCandidate candidate;
+    candidate.distance = distance;
+    candidate.element = element;
+    candidate.item = item;
+    candidate.isInside = false;
+    _candidates.append(candidate);
+}
+
+const QVector<SpatialQueryResult>& OctreeSpatialQuery::findNearest(const glm::vec3& point, int count, float maxDistance) {
+    _results.resize(0);
+    _candidates.resize(0);
+    _elementsVisited = 0;
+
+    OctreeElement* root = _tree->getRoot();
+    if (!root || count <= 0) {
+        return _results;
+    }
+
+    // best first: elements and items come off the heap closest first, an element by the closest any of its items could
+    // be, so once an item comes off nothing left on the heap can be closer than it
+    pushCandidate(closestPossibleDistance(root, point), root, -1);
+    while (!_candidates.isEmpty() && _results.size() < count) {
+        std::pop_heap(_candidates.begin(), _candidates.end(), FartherCandidate());
+        SpatialQueryCandidate candidate = _candidates.last();
+        _candidates.pop_back();
+
+        if (candidate.distance > maxDistance) {
+            break;
+        }
+        if (candidate.item >= 0) {
+            _results.append(SpatialQueryResult(candidate.element, candidate.item, candidate.distance));
+            continue;
+        }
+
+        OctreeElement* element = candidate.element;
+        _elementsVisited++;
+
+        int itemCount = element->getSpatialItemCount();
+        for (int i = 0; i < itemCount; i++) {
+            float distance = element->getSpatialItemDistance(i, point);
+            if (distance <= maxDistance) {
+                pushCandidate(distance, element, i);
+                std::push_heap(_candidates.begin(), _candidates.end(), FartherCandidate());
+            }
+        }
+        for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+            OctreeElement* child = element->getChildAtIndex(i);
+            if (child) {
+                float distance = closestPossibleDistance(child, point);
+                if (distance <= maxDistance) {
+                    pushCandidate(distance, child, -1);
+                    std::push_heap(_candidates.begin(), _candidates.end(), FartherCandidate());
+                }
+            }
+        }
+    }
+    return _results;
+}
+
+const QVector<SpatialQueryResult>& OctreeSpatialQuery::findInBox(const AABox& box) {
+    _results.resize(0);
+    _candidates.resize(0);
+    _elementsVisited = 0;
+
+    OctreeElement* root = _tree->getRoot();
+    if (root) {
+        pushCandidate(0.0f, root, -1);
+    }
+    while (!_candidates.isEmpty()) {
+        OctreeElement* element = _candidates.last().element;
+        _candidates.pop_back();
+
+        if (!expandedBox(element).touches(box)) {
+            continue;
+        }
+        _elementsVisited++;
+
+        int itemCount = element->getSpatialItemCount();
+        for (int i = 0; i < itemCount; i++) {
+            if (element->spatialItemTouches(i, box)) {
+                _results.append(SpatialQueryResult(element, i, 0.0f));
+            }
+        }
+        for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+            OctreeElement* child = element->getChildAtIndex(i);
+            if (child) {
+                pushCandidate(0.0f, child, -1);
+            }
+        }
+    }
+    return _results;
+}
+
+const QVector<SpatialQueryResult>& OctreeSpatialQuery::findInView(const ViewFrustum& viewFrustum) {
+    _results.resize(0);
+    _candidates.resize(0);
+    _elementsVisited = 0;
+
+    OctreeElement* root = _tree->getRoot();
+    if (root) {
+        pushCandidate(0.0f, root, -1);
+    }
+    while (!_candidates.isEmpty()) {
+        SpatialQueryCandidate candidate = _candidates.last();
+        _candidates.pop_back();
+        OctreeElement* element = candidate.element;
+
+        // once an element is entirely in view, so is everything under it, and nothing under it needs testing
+        if (!candidate.isInside) {
+            AABox box = expandedBox(element);
+            box.scale(TREE_SCALE);
+            ViewFrustum::location location = viewFrustum.boxInFrustum(box);
+            if (location == ViewFrustum::OUTSIDE) {
+                continue;
+            }
+            candidate.isInside = (location == ViewFrustum::INSIDE);
+        }
+        _elementsVisited++;
+
+        int itemCount = element->getSpatialItemCount();
+        for (int i = 0; i < itemCount; i++) {
+            if (candidate.isInside || element->spatialItemInFrustum(i, viewFrustum) != ViewFrustum::OUTSIDE) {
+                _results.append(SpatialQueryResult(element, i, 0.0f));
+            }
+        }
+        for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+            OctreeElement* child = element->getChildAtIndex(i);
+            if (child) {
+                pushCandidate(0.0f, child, -1);
+                _candidates.last().isInside = candidate.isInside;
+            }
+        }
+    }
+    return _results;
+}
+
+const QVector<SpatialQueryResult>& OctreeSpatialQuery::findRayIntersections(const QVector<glm::vec3>& origins,
+                                                                            const QVector<glm::vec3>& directions) {
+    int rayCount = std::min(origins.size(), directions.size());
+    _results.resize(rayCount);
+    _elementsVisited = 0;
+
+    for (int i = 0; i < rayCount; i++) {
+        _results[i] = SpatialQueryResult();
+        findRayIntersection(origins[i], directions[i], _results[i]);
+    }
+    return _results;
+}
+
+void OctreeSpatialQuery::findRayIntersection(const glm::vec3& origin, const glm::vec3& direction,
+                                             SpatialQueryResult& hit) {
+    _candidates.resize(0);
+
+    OctreeElement* root = _tree->getRoot();
+    float distance;
+    BoxFace face;
+    if (root && expandedBox(root).findRayIntersection(origin, direction, distance, face)) {
+        pushCandidate(distance, root, -1);
+    }
+    while (!_candidates.isEmpty()) {
+        SpatialQueryCandidate candidate = _candidates.last();
+        _candidates.pop_back();
+
+        // a closer hit has been found since this element was pushed
+        if (candidate.distance >= hit.distance) {
+            continue;
+        }
+        OctreeElement* element = candidate.element;
+        _elementsVisited++;
+
+        int itemCount = element->getSpatialItemCount();
+        for (int i = 0; i < itemCount; i++) {
+            if (element->findSpatialItemRayIntersection(i, origin, direction, distance) && distance < hit.distance) {
+                hit = SpatialQueryResult(element, i, distance);
+            }
+        }
+
+        // push the children the ray enters farthest first, so that the nearest one is searched first and its hits can
+        // rule out the others
+        int firstChild = _candidates.size();
+        for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+            OctreeElement* child = element->getChildAtIndex(i);
+            if (child && expandedBox(child).findRayIntersection(origin, direction, distance, face)
+                    && distance < hit.distance) {
+                pushCandidate(distance, child, -1);
+            }
+        }
+        std::sort(_candidates.begin() + firstChild, _candidates.end(), FartherCandidate());
+    }
+}
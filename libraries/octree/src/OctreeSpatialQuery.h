@@ -0,0 +1,84 @@
+//
+//  OctreeSpatialQuery.h
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Nearest neighbour, box, view frustum and ray queries over the items held by the elements of an octree.
+//
+
+#ifndef __hifi__OctreeSpatialQuery__
+#define __hifi__OctreeSpatialQuery__
+
+#include <cfloat>
+
+#include <glm/glm.hpp>
+
+#include <QtCore/QVector>
+
+#include "AABox.h"
+#include "ViewFrustum.h"
+
+class Octree;
+class OctreeElement;
+
+/// an item a query found, the index of the item is the element's own (see OctreeElement::getSpatialItemCount())
+class SpatialQueryResult {
+public:
+    SpatialQueryResult() : element(NULL), item(-1), distance(FLT_MAX) { }
+    SpatialQueryResult(OctreeElement* element, int item, float distance) :
+        element(element), item(item), distance(distance) { }
+
+    OctreeElement* element;
+    int item;
+    float distance;
+};
+
+/// an element or an item waiting to be searched, ordered by how close it could be
+class SpatialQueryCandidate {
+public:
+    float distance;
+    OctreeElement* element;
+    int item; // -1 for the element itself
+    bool isInside; // for view frustum queries, the element is known to be entirely in view
+};
+
+/// Runs spatial queries over a tree without recursion or callbacks. The traversal stack, the candidate heap and the
+/// results are kept from one query to the next, so a query object that is reused doesn't allocate once it has grown
+/// to the size of its queries. Each query's results are valid until the next query. Positions and distances are in
+/// tree units, except for view frustums which are in meters. The caller must hold the tree's lock.
+class OctreeSpatialQuery {
+public:
+    OctreeSpatialQuery(Octree* tree);
+
+    /// the count items closest to the point, closest first, no farther than maxDistance
+    const QVector<SpatialQueryResult>& findNearest(const glm::vec3& point, int count, float maxDistance = FLT_MAX);
+
+    /// every item that touches the box
+    const QVector<SpatialQueryResult>& findInBox(const AABox& box);
+
+    /// every item that is at least partly in the view frustum
+    const QVector<SpatialQueryResult>& findInView(const ViewFrustum& viewFrustum);
+
+    /// The first item each ray hits, one result per ray in the order of the rays. A ray that hits nothing gets a result
+    /// with a NULL element. Directions should be normalized so that the distances are in tree units.
+    const QVector<SpatialQueryResult>& findRayIntersections(const QVector<glm::vec3>& origins,
+                                                            const QVector<glm::vec3>& directions);
+
+    const QVector<SpatialQueryResult>& getResults() const { return _results; }
+
+    /// the number of elements the last query looked at, for measuring how well it pruned
+    int getElementsVisited() const { return _elementsVisited; }
+
+private:
+    void findRayIntersection(const glm::vec3& origin, const glm::vec3& direction, SpatialQueryResult& hit);
+    void pushCandidate(float distance, OctreeElement* element, int item);
+
+    Octree* _tree;
+    QVector<SpatialQueryCandidate> _candidates;
+    QVector<SpatialQueryResult> _results;
+    int _elementsVisited;
+};
+
+#endif /* defined(__hifi__OctreeSpatialQuery__) */
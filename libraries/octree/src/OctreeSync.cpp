@@ -0,0 +1,335 @@
+//
+//  OctreeSync.cpp
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <cstring>
+
+#include <OctalCode.h>
+#include <SharedUtil.h>
+
+#include "Octree.h"
+#include "OctreePager.h"
+#include "OctreeSync.h"
+
+/// what a source said about the children of one element
+class OctreeSyncChildHashes {
+public:
+    unsigned char childMask;
+    quint64 dataHashes[NUMBER_OF_CHILDREN];
+    quint64 descendantsHashes[NUMBER_OF_CHILDREN];
+};
+
+static QByteArray octalCodeBytes(const unsigned char* octalCode) {
+    return QByteArray((const char*)octalCode, bytesRequiredForCodeLength(numberOfThreeBitSectionsInCode(octalCode)));
+}
+
+template<typename T> static bool readValue(const unsigned char*& at, const unsigned char* end, T& value) {
+    if (end - at < (int)sizeof(value)) {
+        return false;
+    }
+    memcpy(&value, at, sizeof(value));
+    at += sizeof(value);
+    return true;
+}
+
+template<typename T> static void appendValue(QByteArray& buffer, const T& value) {
+    buffer.append((const char*)&value, sizeof(value));
+}
+
+OctreeSyncSource::OctreeSyncSource(Octree* tree) :
+    _tree(tree)
+{
+}
+
+QByteArray OctreeSyncSource::handleRequest(const QByteArray& request) {
+    const unsigned char* requestAt = (const unsigned char*)request.constData();
+    const unsigned char* requestEnd = requestAt + request.size();
+
+    quint8 type;
+    quint16 count;
+    if (!readValue(requestAt, requestEnd, type) || !readValue(requestAt, requestEnd, count)
+            || type > OCTREE_SYNC_SUBTREES) {
+        return QByteArray();
+    }
+    QVector<QByteArray> octalCodes;
+    for (int i = 0; i < count; i++) {
+        if (requestAt >= requestEnd || requestEnd - requestAt < bytesRequiredForCodeLength(*requestAt)) {
+            return QByteArray();
+        }
+        octalCodes.append(octalCodeBytes(requestAt));
+        requestAt += octalCodes.last().size();
+    }
+
+    // reading what's under a paged out element means paging it in, which writes to the tree
+    OctreePager* pager = _tree->getPager();
+    if (pager) {
+        _tree->lockForWrite();
+        foreach (const QByteArray& octalCode, octalCodes) {
+            pager->pageInToRead((const unsigned char*)octalCode.constData(), type == OCTREE_SYNC_SUBTREES);
+        }
+    } else {
+        _tree->lockForRead();
+    }
+
+    QByteArray reply;
+    foreach (const QByteArray& octalCode, octalCodes) {
+        const unsigned char* code = (const unsigned char*)octalCode.constData();
+        OctreeElement* element = _tree->nodeForOctalCode(_tree->getRoot(), code, NULL);
+        if (compareOctalCodes(element->getOctalCode(), code) != EXACT_MATCH) {
+            element = NULL;
+        }
+
+        if (type == OCTREE_SYNC_HASHES) {
+            unsigned char childMask = 0;
+            for (int i = 0; element && i < NUMBER_OF_CHILDREN; i++) {
+                if (element->getChildAtIndex(i)) {
+                    setAtBit(childMask, i);
+                }
+            }
+            appendValue(reply, childMask);
+            for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+                if (oneAtBit(childMask, i)) {
+                    OctreeElement* child = element->getChildAtIndex(i);
+                    appendValue(reply, child->hashElementData());
+                    appendValue(reply, _tree->getDescendantsHash(child));
+                }
+            }
+        } else {
+            QByteArray bitstream;
+            if (element) {
+                int stopLevel = (type == OCTREE_SYNC_LAYERS) ? numberOfThreeBitSectionsInCode(code) + 1 : INT_MAX;
+                _tree->encodeSubTreeToBuffer(element, stopLevel, bitstream);
+            }
+            appendValue(reply, (quint32)bitstream.size());
+            reply.append(bitstream);
+        }
+    }
+    _tree->unlock();
+    return reply;
+}
+
+OctreeSyncTarget::OctreeSyncTarget(Octree* tree, int subtreeLevel, int codesPerRequest) :
+    _tree(tree),
+    _rootOctalCode(1, 0), // the root of the tree has no sections
+    _subtreeLevel(subtreeLevel),
+    _codesPerRequest(codesPerRequest)
+{
+    restart();
+}
+
+void OctreeSyncTarget::restart() {
+    _hashesQueue.clear();
+    _layersQueue.clear();
+    _subtreesQueue.clear();
+    _pendingType = OCTREE_SYNC_HASHES;
+    _pendingCodes.clear();
+
+    _hashesQueue.append(_rootOctalCode);
+
+    _elementsCompared = 0;
+    _layersReceived = 0;
+    _subtreesReceived = 0;
+    _subtreesDeleted = 0;
+    _bytesRequested = 0;
+    _bytesReceived = 0;
+}
+
+void OctreeSyncTarget::setRootOctalCode(const QByteArray& rootOctalCode) {
+    _rootOctalCode = rootOctalCode;
+    restart();
+}
+
+QByteArray OctreeSyncTarget::getNextRequest() {
+    if (!_pendingCodes.isEmpty()) {
+        return QByteArray();
+    }
+
+    // data first, so that what's been compared arrives before the walk goes further
+    QVector<QByteArray>* queue;
+    if (!_layersQueue.isEmpty()) {
+        _pendingType = OCTREE_SYNC_LAYERS;
+        queue = &_layersQueue;
+    } else if (!_subtreesQueue.isEmpty()) {
+        _pendingType = OCTREE_SYNC_SUBTREES;
+        queue = &_subtreesQueue;
+    } else if (!_hashesQueue.isEmpty()) {
+        _pendingType = OCTREE_SYNC_HASHES;
+        queue = &_hashesQueue;
+    } else {
+        return QByteArray();
+    }
+    int count = qMin(queue->size(), _codesPerRequest);
+    _pendingCodes = queue->mid(0, count);
+    queue->remove(0, count);
+
+    QByteArray request;
+    appendValue(request, (quint8)_pendingType);
+    appendValue(request, (quint16)count);
+    foreach (const QByteArray& octalCode, _pendingCodes) {
+        request.append(octalCode);
+    }
+    _bytesRequested += request.size();
+    return request;
+}
+
+bool OctreeSyncTarget::handleReply(const QByteArray& reply) {
+    if (_pendingCodes.isEmpty()) {
+        return false;
+    }
+    const unsigned char* replyAt = (const unsigned char*)reply.constData();
+    const unsigned char* replyEnd = replyAt + reply.size();
+
+    // read the whole reply before changing anything, so that a bad one changes nothing
+    QVector<OctreeSyncChildHashes> childHashes;
+    QVector<QByteArray> bitstreams;
+    for (int i = 0; i < _pendingCodes.size(); i++) {
+        if (_pendingType == OCTREE_SYNC_HASHES) {
+            OctreeSyncChildHashes hashes;
+            if (!readValue(replyAt, replyEnd, hashes.childMask)) {
+                requeuePendingCodes();
+                return false;
+            }
+            for (int j = 0; j < NUMBER_OF_CHILDREN; j++) {
+                if (oneAtBit(hashes.childMask, j) && !(readValue(replyAt, replyEnd, hashes.dataHashes[j])
+                        && readValue(replyAt, replyEnd, hashes.descendantsHashes[j]))) {
+                    requeuePendingCodes();
+                    return false;
+                }
+            }
+            childHashes.append(hashes);
+        } else {
+            quint32 length;
+            if (!readValue(replyAt, replyEnd, length) || (quint32)(replyEnd - replyAt) < length) {
+                requeuePendingCodes();
+                return false;
+            }
+            bitstreams.append(QByteArray((const char*)replyAt, length));
+            replyAt += length;
+        }
+    }
+    _bytesReceived += reply.size();
+
+    _tree->lockForWrite();
+    for (int i = 0; i < _pendingCodes.size(); i++) {
+        const unsigned char* octalCode = (const unsigned char*)_pendingCodes.at(i).constData();
+        if (_pendingType == OCTREE_SYNC_HASHES) {
+            compareChildren(octalCode, childHashes.at(i));
+            continue;
+        }
+        if (_pendingType == OCTREE_SYNC_SUBTREES) {
+            // the source's subtree replaces ours, apart from the data of its root, which is its parent's
+            deleteChildren(octalCode);
+            _subtreesReceived++;
+        } else {
+            _layersReceived++;
+        }
+        const QByteArray& bitstream = bitstreams.at(i);
+        if (!bitstream.isEmpty()) {
+            ReadBitstreamToTreeParams args(WANT_COLOR, NO_EXISTS_BITS);
+            _tree->readBitstreamToTree((const unsigned char*)bitstream.constData(), bitstream.size(), args);
+        }
+    }
+    _tree->unlock();
+
+    _pendingCodes.clear();
+    return true;
+}
+
+void OctreeSyncTarget::requeuePendingCodes() {
+    QVector<QByteArray>& queue = (_pendingType == OCTREE_SYNC_HASHES) ? _hashesQueue
+        : (_pendingType == OCTREE_SYNC_LAYERS) ? _layersQueue : _subtreesQueue;
+    queue = _pendingCodes + queue;
+    _pendingCodes.clear();
+}
+
+bool OctreeSyncTarget::isFinished() const {
+    return _pendingCodes.isEmpty() && _hashesQueue.isEmpty() && _layersQueue.isEmpty() && _subtreesQueue.isEmpty();
+}
+
+void OctreeSyncTarget::compareChildren(const unsigned char* octalCode, const OctreeSyncChildHashes& hashes) {
+    _elementsCompared++;
+    OctreeElement* element = _tree->nodeForOctalCode(_tree->getRoot(), octalCode, NULL);
+    if (compareOctalCodes(element->getOctalCode(), octalCode) != EXACT_MATCH) {
+        element = NULL; // we don't have it yet, so every child the source has is new
+    }
+
+    bool needsLayer = false;
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        OctreeElement* child = element ? element->getChildAtIndex(i) : NULL;
+        unsigned char* childCode = childOctalCode(octalCode, i);
+
+        if (!oneAtBit(hashes.childMask, i)) {
+            if (child) {
+                _tree->deleteOctalCodeFromTree(childCode);
+                _subtreesDeleted++;
+            }
+        } else {
+            if (!child || child->hashElementData() != hashes.dataHashes[i]) {
+                needsLayer = true;
+            }
+            quint64 descendantsHash = child ? _tree->getDescendantsHash(child) : 0;
+            if (descendantsHash != hashes.descendantsHashes[i]) {
+                // only leaves hash to nothing
+                if (hashes.descendantsHashes[i] == 0) {
+                    deleteChildren(childCode);
+                } else if (numberOfThreeBitSectionsInCode(childCode) >= _subtreeLevel) {
+                    _subtreesQueue.append(octalCodeBytes(childCode));
+                } else {
+                    _hashesQueue.append(octalCodeBytes(childCode));
+                }
+            }
+        }
+        delete[] childCode;
+    }
+    if (needsLayer) {
+        _layersQueue.append(octalCodeBytes(octalCode));
+    }
+}
+
+void OctreeSyncTarget::deleteChildren(const unsigned char* octalCode) {
+    OctreeElement* element = _tree->nodeForOctalCode(_tree->getRoot(), octalCode, NULL);
+    if (compareOctalCodes(element->getOctalCode(), octalCode) != EXACT_MATCH) {
+        return;
+    }
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        if (element->getChildAtIndex(i)) {
+            unsigned char* childCode = childOctalCode(octalCode, i);
+            _tree->deleteOctalCodeFromTree(childCode);
+            delete[] childCode;
+            _subtreesDeleted++;
+        }
+    }
+}
+
+static void findOctreeDifferencesRecursion(Octree* tree, OctreeElement* element, Octree* otherTree,
+                                           OctreeElement* otherElement, int maxLevel, QVector<QByteArray>& differences) {
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        OctreeElement* child = element->getChildAtIndex(i);
+        OctreeElement* otherChild = otherElement->getChildAtIndex(i);
+        if (!child && !otherChild) {
+            continue;
+        }
+        if (!child || !otherChild || child->hashElementData() != otherChild->hashElementData()) {
+            differences.append(octalCodeBytes((child ? child : otherChild)->getOctalCode()));
+
+        } else if (tree->getDescendantsHash(child) != otherTree->getDescendantsHash(otherChild)) {
+            if (numberOfThreeBitSectionsInCode(child->getOctalCode()) >= maxLevel) {
+                differences.append(octalCodeBytes(child->getOctalCode()));
+            } else {
+                findOctreeDifferencesRecursion(tree, child, otherTree, otherChild, maxLevel, differences);
+            }
+        }
+    }
+}
+
+QVector<QByteArray> findOctreeDifferences(Octree* tree, Octree* otherTree, int maxLevel) {
+    QVector<QByteArray> differences;
+    if (tree->getDescendantsHash(tree->getRoot()) != otherTree->getDescendantsHash(otherTree->getRoot())) {
+        findOctreeDifferencesRecursion(tree, tree->getRoot(), otherTree, otherTree->getRoot(), maxLevel, differences);
+    }
+    return differences;
+}
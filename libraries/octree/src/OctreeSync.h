@@ -0,0 +1,117 @@
+//
+//  OctreeSync.h
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Brings one octree up to date with another by comparing the hashes of their subtrees, and sending only the subtrees
+//  that differ.
+//
+
+#ifndef __hifi__OctreeSync__
+#define __hifi__OctreeSync__
+
+#include <QtCore/QByteArray>
+#include <QtCore/QVector>
+
+class Octree;
+class OctreeElement;
+class OctreeSyncChildHashes;
+
+/// the kinds of requests a sync target sends its source
+enum OctreeSyncRequestType {
+    OCTREE_SYNC_HASHES = 0, // the hashes of the children of each element
+    OCTREE_SYNC_LAYERS, // the data of the children of each element, and nothing below them
+    OCTREE_SYNC_SUBTREES // everything under each element
+};
+
+/// the depth, in sections of their octal codes, at which a sync sends whole subtrees rather than comparing further down
+const int DEFAULT_OCTREE_SYNC_SUBTREE_LEVEL = 8;
+
+/// the most elements a sync asks about in one request
+const int DEFAULT_OCTREE_SYNC_CODES_PER_REQUEST = 64;
+
+/// Answers a sync target's requests from the tree it's syncing with. Requests and replies are byte arrays, so that they
+/// can be carried by whatever connects the two trees, in this process or between them.
+///
+/// A request is its type, a 16 bit count, and that many octal codes. A reply to OCTREE_SYNC_HASHES has, for each code,
+/// the child mask of its element followed by the data hash and descendants hash of each child (see
+/// Octree::getSubtreeHash()), or an empty mask if there's no element. A reply to OCTREE_SYNC_LAYERS or
+/// OCTREE_SYNC_SUBTREES has, for each code, a 32 bit length and an encoded bitstream of that length.
+class OctreeSyncSource {
+public:
+    OctreeSyncSource(Octree* tree);
+
+    /// Answers a request, locking the tree while it does. Returns an empty reply to a request it can't read.
+    QByteArray handleRequest(const QByteArray& request);
+
+private:
+    Octree* _tree;
+};
+
+/// Walks a tree down from its root alongside a sync source's, comparing the hashes of their children and asking for the
+/// data of those that differ, until the tree has the same content as the source's. Subtrees at the subtree level are
+/// sent whole, and children that the source doesn't have are deleted. The target's tree shouldn't have a pager, or
+/// reaverage, since it takes the source's averages as they are.
+///
+/// The walk is a snapshot: edits to either tree while it runs may or may not be carried over. Edits made to the source
+/// after the sync are found by syncing again, which only walks the paths that changed.
+class OctreeSyncTarget {
+public:
+    OctreeSyncTarget(Octree* tree, int subtreeLevel = DEFAULT_OCTREE_SYNC_SUBTREE_LEVEL,
+                     int codesPerRequest = DEFAULT_OCTREE_SYNC_CODES_PER_REQUEST);
+
+    /// Starts comparing from the root again.
+    void restart();
+
+    /// Limits the sync to the subtree under an element, whose own data is left alone, and starts it again.
+    void setRootOctalCode(const QByteArray& rootOctalCode);
+
+    /// The next request to send to the source, or an empty one if the sync is finished or waiting for a reply.
+    QByteArray getNextRequest();
+
+    /// Applies the source's reply to the last request, locking the tree while it does. Returns false if the reply
+    /// couldn't be read, in which case the next request asks again.
+    bool handleReply(const QByteArray& reply);
+
+    bool isFinished() const;
+
+    int getElementsCompared() const { return _elementsCompared; }
+    int getLayersReceived() const { return _layersReceived; }
+    int getSubtreesReceived() const { return _subtreesReceived; }
+    int getSubtreesDeleted() const { return _subtreesDeleted; }
+    quint64 getBytesRequested() const { return _bytesRequested; }
+    quint64 getBytesReceived() const { return _bytesReceived; }
+
+private:
+    void compareChildren(const unsigned char* octalCode, const OctreeSyncChildHashes& hashes);
+    void deleteChildren(const unsigned char* octalCode);
+    void requeuePendingCodes();
+
+    Octree* _tree;
+    QByteArray _rootOctalCode;
+    int _subtreeLevel;
+    int _codesPerRequest;
+
+    QVector<QByteArray> _hashesQueue;
+    QVector<QByteArray> _layersQueue;
+    QVector<QByteArray> _subtreesQueue;
+
+    OctreeSyncRequestType _pendingType;
+    QVector<QByteArray> _pendingCodes;
+
+    int _elementsCompared;
+    int _layersReceived;
+    int _subtreesReceived;
+    int _subtreesDeleted;
+    quint64 _bytesRequested;
+    quint64 _bytesReceived;
+};
+
+/// The octal codes of the shallowest elements where two trees in this process differ: elements only one of them has or
+/// whose data differs, and elements at maxLevel with anything under them that differs. Called with both trees locked.
+QVector<QByteArray> findOctreeDifferences(Octree* tree, Octree* otherTree,
+                                          int maxLevel = DEFAULT_OCTREE_SYNC_SUBTREE_LEVEL);
+
+#endif /* defined(__hifi__OctreeSync__) */
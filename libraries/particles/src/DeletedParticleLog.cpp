@@ -0,0 +1,201 @@
+//
+//  DeletedParticleLog.cpp
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Erase packets hold the deleted IDs sorted and grouped into runs of consecutive IDs. Each run is written as the gap
+//  from the end of the previous run and the run's length less one, both as 7 bit variable length integers, after a
+//  uint16 count of runs. Particles are created with consecutive IDs, so whole bursts of them usually die as one run.
+//
+
+#include <algorithm>
+#include <cstring>
+
+#include "DeletedParticleLog.h"
+
+const int MAX_ENCODED_RANGES = 0xFFFF;
+const int MAX_ENCODED_RANGE_LENGTH = 0xFFFF; // keeps a bad packet from making the reader expand billions of IDs
+const int FIRST_ENCODE_ATTEMPT_DELETIONS = 64;
+
+DeletedParticleLog::DeletedParticleLog(int capacity) :
+    _particleIDs(capacity),
+    _firstSequence(0),
+    _nextSequence(0)
+{
+}
+
+quint64 DeletedParticleLog::append(uint32_t particleID) {
+    if (size() == _particleIDs.size()) {
+        grow();
+    }
+    quint64 sequence = _nextSequence++;
+    _particleIDs[sequence & (_particleIDs.size() - 1)] = particleID;
+    return sequence;
+}
+
+void DeletedParticleLog::forgetBefore(quint64 sequence) {
+    _firstSequence = std::max(_firstSequence, std::min(sequence, _nextSequence));
+}
+
+void DeletedParticleLog::grow() {
+    QVector<uint32_t> particleIDs(_particleIDs.size() * 2);
+    for (quint64 sequence = _firstSequence; sequence != _nextSequence; sequence++) {
+        particleIDs[sequence & (particleIDs.size() - 1)] = getParticleID(sequence);
+    }
+    _particleIDs = particleIDs;
+}
+
+static int variableLengthSize(uint32_t value) {
+    int bytes = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        bytes++;
+    }
+    return bytes;
+}
+
+static int writeVariableLength(uint32_t value, unsigned char* buffer) {
+    int bytes = 0;
+    while (value >= 0x80) {
+        buffer[bytes++] = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+    buffer[bytes++] = (unsigned char) value;
+    return bytes;
+}
+
+// returns the number of bytes read, or zero if the value runs past the end of the buffer
+static int readVariableLength(const unsigned char* buffer, int length, uint32_t& value) {
+    const int MAX_VARIABLE_LENGTH_BYTES = 5;
+    value = 0;
+    for (int bytes = 0; bytes < length && bytes < MAX_VARIABLE_LENGTH_BYTES; bytes++) {
+        value |= (uint32_t) (buffer[bytes] & 0x7F) << (7 * bytes);
+        if (!(buffer[bytes] & 0x80)) {
+            return bytes + 1;
+        }
+    }
+    return 0;
+}
+
+// the sorted, distinct IDs of count deletions starting at sequence
+static void sortedParticleIDs(const DeletedParticleLog& log, quint64 sequence, int count,
+                              QVector<uint32_t>& particleIDs) {
+    particleIDs.resize(count);
+    for (int i = 0; i < count; i++) {
+        particleIDs[i] = log.getParticleID(sequence + i);
+    }
+    std::sort(particleIDs.begin(), particleIDs.end());
+    particleIDs.erase(std::unique(particleIDs.begin(), particleIDs.end()), particleIDs.end());
+}
+
+// calls rangeOperation(gap, length) for each run of consecutive IDs
+template<typename RangeOperation>
+static void forEachRange(const QVector<uint32_t>& sortedIDs, RangeOperation& rangeOperation) {
+    uint32_t previousEnd = 0;
+    int i = 0;
+    while (i < sortedIDs.size()) {
+        int rangeEnd = i + 1;
+        while (rangeEnd < sortedIDs.size() && sortedIDs[rangeEnd] == sortedIDs[rangeEnd - 1] + 1
+               && rangeEnd - i < MAX_ENCODED_RANGE_LENGTH) {
+            rangeEnd++;
+        }
+        rangeOperation(sortedIDs[i] - previousEnd, (uint32_t) (rangeEnd - i));
+        previousEnd = sortedIDs[rangeEnd - 1];
+        i = rangeEnd;
+    }
+}
+
+class RangeSizer {
+public:
+    RangeSizer() : ranges(0), bytes(sizeof(uint16_t)) { }
+    void operator()(uint32_t gap, uint32_t length) {
+        ranges++;
+        bytes += variableLengthSize(gap) + variableLengthSize(length - 1);
+    }
+    int ranges;
+    int bytes;
+};
+
+class RangeWriter {
+public:
+    RangeWriter(unsigned char* buffer) : ranges(0), writeAt(buffer + sizeof(uint16_t)) { }
+    void operator()(uint32_t gap, uint32_t length) {
+        ranges++;
+        writeAt += writeVariableLength(gap, writeAt);
+        writeAt += writeVariableLength(length - 1, writeAt);
+    }
+    uint16_t ranges;
+    unsigned char* writeAt;
+};
+
+static bool rangesFit(const QVector<uint32_t>& sortedIDs, int maxLength) {
+    RangeSizer sizer;
+    forEachRange(sortedIDs, sizer);
+    return sizer.bytes <= maxLength && sizer.ranges <= MAX_ENCODED_RANGES;
+}
+
+int DeletedParticleLog::encodeRanges(quint64& sequence, unsigned char* buffer, int maxLength) const {
+    if (maxLength < (int) sizeof(uint16_t)) {
+        return 0;
+    }
+    sequence = std::max(sequence, _firstSequence);
+    int remaining = (int) (_nextSequence - std::min(sequence, _nextSequence));
+
+    // try larger and larger batches until one doesn't fit, then narrow down to the largest one that does, so that the
+    // work done stays proportional to what ends up in the packet
+    QVector<uint32_t> particleIDs;
+    int fits = 0;
+    int doesNotFit = remaining + 1;
+    int count = std::min(remaining, FIRST_ENCODE_ATTEMPT_DELETIONS);
+    while (count > fits && count < doesNotFit) {
+        sortedParticleIDs(*this, sequence, count, particleIDs);
+        if (rangesFit(particleIDs, maxLength)) {
+            fits = count;
+            count = (doesNotFit > remaining) ? std::min(count * 2, remaining) : (fits + doesNotFit) / 2;
+        } else {
+            doesNotFit = count;
+            count = (fits + doesNotFit) / 2;
+        }
+    }
+
+    sortedParticleIDs(*this, sequence, fits, particleIDs);
+    RangeWriter writer(buffer);
+    forEachRange(particleIDs, writer);
+    memcpy(buffer, &writer.ranges, sizeof(writer.ranges));
+
+    sequence += fits;
+    return writer.writeAt - buffer;
+}
+
+int DeletedParticleLog::decodeRanges(const unsigned char* buffer, int length, QVector<uint32_t>& particleIDs) {
+    if (length < (int) sizeof(uint16_t)) {
+        return 0;
+    }
+    uint16_t ranges = 0;
+    memcpy(&ranges, buffer, sizeof(ranges));
+    int bytesRead = sizeof(ranges);
+
+    uint32_t previousEnd = 0;
+    for (int range = 0; range < ranges; range++) {
+        uint32_t gap = 0;
+        uint32_t lengthLessOne = 0;
+        int gapBytes = readVariableLength(buffer + bytesRead, length - bytesRead, gap);
+        if (gapBytes == 0) {
+            break; // bail to prevent buffer overflow
+        }
+        int lengthBytes = readVariableLength(buffer + bytesRead + gapBytes, length - bytesRead - gapBytes, lengthLessOne);
+        if (lengthBytes == 0 || lengthLessOne >= (uint32_t) MAX_ENCODED_RANGE_LENGTH) {
+            break; // bail to prevent buffer overflow
+        }
+        bytesRead += gapBytes + lengthBytes;
+
+        uint32_t firstID = previousEnd + gap;
+        for (uint32_t i = 0; i <= lengthLessOne; i++) {
+            particleIDs.append(firstID + i);
+        }
+        previousEnd = firstID + lengthLessOne;
+    }
+    return bytesRead;
+}
@@ -0,0 +1,64 @@
+//
+//  DeletedParticleLog.h
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Log of the particles the server has deleted, so it can tell each client about them exactly once.
+//
+
+#ifndef __hifi__DeletedParticleLog__
+#define __hifi__DeletedParticleLog__
+
+#include <stdint.h>
+
+#include <QtCore/QVector>
+
+const int DEFAULT_DELETED_PARTICLE_LOG_CAPACITY = 256; // must be a power of two
+
+/// Ring buffer of deleted particle IDs. Each deletion gets the next sequence number, so a client's place in the log is
+/// just the sequence of the first deletion it hasn't been sent yet. Deletions are forgotten once every client is past
+/// them, and the buffer grows when a slow client holds on to more deletions than it has room for.
+class DeletedParticleLog {
+public:
+    DeletedParticleLog(int capacity = DEFAULT_DELETED_PARTICLE_LOG_CAPACITY);
+
+    /// \return the sequence number of the deletion
+    quint64 append(uint32_t particleID);
+
+    /// the sequence of the oldest deletion still in the log
+    quint64 getFirstSequence() const { return _firstSequence; }
+
+    /// the sequence the next deletion will get
+    quint64 getNextSequence() const { return _nextSequence; }
+
+    bool isEmpty() const { return _firstSequence == _nextSequence; }
+    int size() const { return (int) (_nextSequence - _firstSequence); }
+
+    /// true if there are deletions at or after this sequence
+    bool hasDeletionsSince(quint64 sequence) const { return sequence < _nextSequence; }
+
+    uint32_t getParticleID(quint64 sequence) const { return _particleIDs[sequence & (_particleIDs.size() - 1)]; }
+
+    /// forgets the deletions before the sequence
+    void forgetBefore(quint64 sequence);
+
+    /// Writes as many deletions from sequence on as fit in the buffer, as ranges of particle IDs.
+    /// \param sequence[in/out] the first deletion to write, set to the first deletion that wasn't written
+    /// \return the number of bytes written
+    int encodeRanges(quint64& sequence, unsigned char* buffer, int maxLength) const;
+
+    /// reads particle IDs written by encodeRanges()
+    /// \return the number of bytes read
+    static int decodeRanges(const unsigned char* buffer, int length, QVector<uint32_t>& particleIDs);
+
+private:
+    void grow();
+
+    QVector<uint32_t> _particleIDs;
+    quint64 _firstSequence;
+    quint64 _nextSequence;
+};
+
+#endif /* defined(__hifi__DeletedParticleLog__) */
@@ -24,6 +24,7 @@
 
 #include "ParticlesScriptingInterface.h"
 #include "Particle.h"
+#include "ParticleScriptPool.h"
 #include "ParticleTree.h"
 
 uint32_t Particle::_nextID = 0;
@@ -31,10 +32,12 @@ VoxelEditPacketSender* Particle::_voxelEditSender = NULL;
 ParticleEditPacketSender* Particle::_particleEditSender = NULL;
 
 // for locally created particles
+QMutex Particle::_creatorTokenIDsMutex;
 std::map<uint32_t,uint32_t> Particle::_tokenIDsToIDs;
 uint32_t Particle::_nextCreatorTokenID = 0;
 
 uint32_t Particle::getIDfromCreatorTokenID(uint32_t creatorTokenID) {
+    QMutexLocker locker(&_creatorTokenIDsMutex);
     if (_tokenIDsToIDs.find(creatorTokenID) != _tokenIDsToIDs.end()) {
         return _tokenIDsToIDs[creatorTokenID];
     }
@@ -42,6 +45,7 @@ uint32_t Particle::getIDfromCreatorTokenID(uint32_t creatorTokenID) {
 }
 
 uint32_t Particle::getNextCreatorTokenID() {
+    QMutexLocker locker(&_creatorTokenIDsMutex);
     uint32_t creatorTokenID = _nextCreatorTokenID;
     _nextCreatorTokenID++;
     return creatorTokenID;
@@ -61,6 +65,7 @@ void Particle::handleAddParticleResponse(const QByteArray& packet) {
     dataAt += sizeof(particleID);
 
     // add our token to id mapping
+    QMutexLocker locker(&_creatorTokenIDsMutex);
     _tokenIDsToIDs[creatorTokenID] = particleID;
 }
 
@@ -773,6 +778,37 @@ void Particle::adjustEditPacketForClockSkew(unsigned char* codeColorBuffer, ssiz
     }
 }
 
+uint32_t Particle::particleIDFromEditMessage(const unsigned char* editMessage, ssize_t length) {
+    int octets = numberOfThreeBitSectionsInCode(editMessage, length);
+    if (octets < 0) {
+        return UNKNOWN_PARTICLE_ID;
+    }
+    int lengthOfOctcode = bytesRequiredForCodeLength(octets);
+    if (lengthOfOctcode + (ssize_t) sizeof(uint32_t) > length) {
+        return UNKNOWN_PARTICLE_ID;
+    }
+
+    uint32_t id;
+    memcpy(&id, editMessage + lengthOfOctcode, sizeof(id));
+    return id;
+}
+
+bool Particle::changedBitsFromEditMessage(const unsigned char* editMessage, ssize_t length, uint16_t& changedBits) {
+    uint32_t id = particleIDFromEditMessage(editMessage, length);
+    if (id == NEW_PARTICLE || id == UNKNOWN_PARTICLE_ID) {
+        return false;
+    }
+
+    // octcode, id, lastEdited, then the changed bits
+    int changedBitsAt = bytesRequiredForCodeLength(numberOfThreeBitSectionsInCode(editMessage, length))
+        + sizeof(uint32_t) + sizeof(quint64);
+    if (changedBitsAt + (ssize_t) sizeof(changedBits) > length) {
+        return false;
+    }
+    memcpy(&changedBits, editMessage + changedBitsAt, sizeof(changedBits));
+    return true;
+}
+
 // HALTING_* params are determined using expected acceleration of gravity over some timescale.  
 // This is a HACK for particles that bounce in a 1.0 gravitational field and should eventually be made more universal.
 const float HALTING_PARTICLE_PERIOD = 0.0167f;  // ~1/60th of a second
@@ -820,19 +856,17 @@ void Particle::applyHardCollision(const CollisionInfo& collisionInfo) {
 const float MIN_EXPECTED_FRAME_PERIOD = 0.005f;  // 1/200th of a second
 const float MIN_VALID_SPEED = 9.8 * MIN_EXPECTED_FRAME_PERIOD / (float)(TREE_SCALE);
 
-void Particle::update(const quint64& now) {
+void Particle::update(const quint64& now, bool runScripts) {
     float timeElapsed = (float)(now - _lastUpdated) / (float)(USECS_PER_SECOND);
     _lastUpdated = now;
 
-    // calculate our default shouldDie state... then allow script to change it if it wants...
-    bool isInHand = getInHand();
-    bool shouldDie = (getAge() > getLifetime()) || getShouldDie();
-    setShouldDie(shouldDie);
-
-    executeUpdateScripts(); // allow the javascript to alter our state
+    // otherwise runUpdateScripts() has already aged us and let the javascript alter our state
+    if (runScripts) {
+        runUpdateScripts();
+    }
 
     // If the ball is in hand, it doesn't move or have gravity effect it
-    if (!isInHand) {
+    if (!getInHand()) {
         _position += _velocity * timeElapsed;
 
         // handle bounces off the ground...
@@ -851,59 +885,65 @@ void Particle::update(const quint64& now) {
     }
 }
 
-void Particle::startParticleScriptContext(ScriptEngine& engine, ParticleScriptObject& particleScriptable) {
+void Particle::runUpdateScripts() {
+    // calculate our default shouldDie state... then allow script to change it if it wants...
+    bool shouldDie = (getAge() > getLifetime()) || getShouldDie();
+    setShouldDie(shouldDie);
+
+    executeUpdateScripts();
+}
+
+ParticleScriptContext* Particle::startParticleScriptContext() {
     if (_voxelEditSender) {
-        engine.getVoxelsScriptingInterface()->setPacketSender(_voxelEditSender);
+        ScriptEngine::getVoxelsScriptingInterface()->setPacketSender(_voxelEditSender);
     }
     if (_particleEditSender) {
-        engine.getParticlesScriptingInterface()->setPacketSender(_particleEditSender);
+        ScriptEngine::getParticlesScriptingInterface()->setPacketSender(_particleEditSender);
     }
 
-    // Add the "this" Particle object
-    engine.registerGlobalObject("Particle", &particleScriptable);
-    engine.evaluate();
+    // the script is only compiled the first time it's seen, after that "Particle" is just pointed at us
+    return ParticleScriptPool::getInstance()->contextForParticle(_script, this);
 }
 
-void Particle::endParticleScriptContext(ScriptEngine& engine, ParticleScriptObject& particleScriptable) {
+void Particle::endParticleScriptContext(ParticleScriptContext* context, quint64 startedUsecs) {
     if (_voxelEditSender) {
         _voxelEditSender->releaseQueuedMessages();
     }
     if (_particleEditSender) {
         _particleEditSender->releaseQueuedMessages();
     }
+    context->endCall();
+    ParticleScriptPool::getInstance()->recordCall(context, usecTimestampNow() - startedUsecs);
 }
 
 void Particle::executeUpdateScripts() {
     // Only run this particle script if there's a script attached directly to the particle.
     if (!_script.isEmpty()) {
-        ScriptEngine engine(_script);
-        ParticleScriptObject particleScriptable(this);
-        startParticleScriptContext(engine, particleScriptable);
-        particleScriptable.emitUpdate();
-        endParticleScriptContext(engine, particleScriptable);
+        ParticleScriptContext* context = startParticleScriptContext();
+        quint64 startedUsecs = usecTimestampNow();
+        context->getParticleScriptable()->emitUpdate();
+        endParticleScriptContext(context, startedUsecs);
     }
 }
 
 void Particle::collisionWithParticle(Particle* other) {
     // Only run this particle script if there's a script attached directly to the particle.
     if (!_script.isEmpty()) {
-        ScriptEngine engine(_script);
-        ParticleScriptObject particleScriptable(this);
-        startParticleScriptContext(engine, particleScriptable);
+        ParticleScriptContext* context = startParticleScriptContext();
+        quint64 startedUsecs = usecTimestampNow();
         ParticleScriptObject otherParticleScriptable(other);
-        particleScriptable.emitCollisionWithParticle(&otherParticleScriptable);
-        endParticleScriptContext(engine, particleScriptable);
+        context->getParticleScriptable()->emitCollisionWithParticle(&otherParticleScriptable);
+        endParticleScriptContext(context, startedUsecs);
     }
 }
 
 void Particle::collisionWithVoxel(VoxelDetail* voxelDetails) {
     // Only run this particle script if there's a script attached directly to the particle.
     if (!_script.isEmpty()) {
-        ScriptEngine engine(_script);
-        ParticleScriptObject particleScriptable(this);
-        startParticleScriptContext(engine, particleScriptable);
-        particleScriptable.emitCollisionWithVoxel(*voxelDetails);
-        endParticleScriptContext(engine, particleScriptable);
+        ParticleScriptContext* context = startParticleScriptContext();
+        quint64 startedUsecs = usecTimestampNow();
+        context->getParticleScriptable()->emitCollisionWithVoxel(*voxelDetails);
+        endParticleScriptContext(context, startedUsecs);
     }
 }
 
@@ -14,6 +14,7 @@
 #include <stdint.h>
 
 #include <QtScript/QScriptEngine>
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
 
 #include <CollisionInfo.h>
@@ -24,6 +25,7 @@ class Particle;
 class ParticleEditPacketSender;
 class ParticleProperties;
 class ParticlesScriptingInterface;
+class ParticleScriptContext;
 class ParticleScriptObject;
 class ParticleTree;
 class ScriptEngine;
@@ -291,10 +293,22 @@ public:
                         unsigned char* bufferOut, int sizeIn, int& sizeOut);
 
     static void adjustEditPacketForClockSkew(unsigned char* codeColorBuffer, ssize_t length, int clockSkew);
+
+    /// the ID an edit message is for, NEW_PARTICLE for a new particle, or UNKNOWN_PARTICLE_ID if the message is too short
+    static uint32_t particleIDFromEditMessage(const unsigned char* editMessage, ssize_t length);
+
+    /// the properties an edit of an existing particle changes, false for new particles or messages that are too short
+    static bool changedBitsFromEditMessage(const unsigned char* editMessage, ssize_t length, uint16_t& changedBits);
     
     void applyHardCollision(const CollisionInfo& collisionInfo);
 
-    void update(const quint64& now);
+    /// ages, scripts and moves the particle
+    /// \param runScripts false if runUpdateScripts() has already been called for this step
+    void update(const quint64& now, bool runScripts = true);
+
+    /// the part of update() that has to run on the thread that owns the particle script engines: decides whether the
+    /// particle dies of age, then lets its script, if it has one, change that and anything else
+    void runUpdateScripts();
     void collisionWithParticle(Particle* other);
     void collisionWithVoxel(VoxelDetail* voxel);
 
@@ -322,8 +336,8 @@ protected:
     static VoxelEditPacketSender* _voxelEditSender;
     static ParticleEditPacketSender* _particleEditSender;
 
-    void startParticleScriptContext(ScriptEngine& engine, ParticleScriptObject& particleScriptable);
-    void endParticleScriptContext(ScriptEngine& engine, ParticleScriptObject& particleScriptable);
+    ParticleScriptContext* startParticleScriptContext();
+    void endParticleScriptContext(ParticleScriptContext* context, quint64 startedUsecs);
     void executeUpdateScripts();
 
     void setAge(float age);
@@ -357,17 +371,20 @@ protected:
     // this doesn't go on the wire, we send it as lifetime
     quint64 _created;
 
-    // used by the static interfaces for creator token ids
+    // used by the static interfaces for creator token ids, guarded by the mutex since scripts on several threads may be
+    // creating particles at once
+    static QMutex _creatorTokenIDsMutex;
     static uint32_t _nextCreatorTokenID;
     static std::map<uint32_t,uint32_t> _tokenIDsToIDs;
 };
 
 /// Scriptable interface to a single Particle object. Used exclusively in the JavaScript API for interacting with single
-/// Particles.
+/// Particles. Between calls no particle is bound, and the accessors read defaults and change nothing.
 class ParticleScriptObject  : public QObject {
     Q_OBJECT
 public:
     ParticleScriptObject(Particle* particle) { _particle = particle; }
+    void setParticle(Particle* particle) { _particle = particle; }
     //~ParticleScriptObject() { qDebug() << "~ParticleScriptObject() this=" << this; }
 
     void emitUpdate() { emit update(); }
@@ -375,45 +392,49 @@ public:
     void emitCollisionWithVoxel(const VoxelDetail& voxel) { emit collisionWithVoxel(voxel); }
 
 public slots:
-    unsigned int getID() const { return _particle->getID(); }
+    unsigned int getID() const { return _particle ? _particle->getID() : 0; }
     
     /// get position in meter units
-    glm::vec3 getPosition() const { return _particle->getPosition() * (float)TREE_SCALE; }
+    glm::vec3 getPosition() const { return _particle ? _particle->getPosition() * (float)TREE_SCALE : glm::vec3(); }
 
     /// get velocity in meter units
-    glm::vec3 getVelocity() const { return _particle->getVelocity() * (float)TREE_SCALE; }
-    xColor getColor() const { return _particle->getXColor(); }
+    glm::vec3 getVelocity() const { return _particle ? _particle->getVelocity() * (float)TREE_SCALE : glm::vec3(); }
+    xColor getColor() const { return _particle ? _particle->getXColor() : xColor(); }
 
     /// get gravity in meter units
-    glm::vec3 getGravity() const { return _particle->getGravity() * (float)TREE_SCALE; }
+    glm::vec3 getGravity() const { return _particle ? _particle->getGravity() * (float)TREE_SCALE : glm::vec3(); }
 
-    float getDamping() const { return _particle->getDamping(); }
+    float getDamping() const { return _particle ? _particle->getDamping() : 0.0f; }
 
     /// get radius in meter units
-    float getRadius() const { return _particle->getRadius() * (float)TREE_SCALE; }
-    bool getShouldDie() { return _particle->getShouldDie(); }
-    float getAge() const { return _particle->getAge(); }
-    float getLifetime() const { return _particle->getLifetime(); }
-    ParticleProperties getProperties() const { return _particle->getProperties(); }
+    float getRadius() const { return _particle ? _particle->getRadius() * (float)TREE_SCALE : 0.0f; }
+    bool getShouldDie() { return _particle ? _particle->getShouldDie() : false; }
+    float getAge() const { return _particle ? _particle->getAge() : 0.0f; }
+    float getLifetime() const { return _particle ? _particle->getLifetime() : 0.0f; }
+    ParticleProperties getProperties() const { return _particle ? _particle->getProperties() : ParticleProperties(); }
 
     /// set position in meter units
-    void setPosition(glm::vec3 value) { _particle->setPosition(value / (float)TREE_SCALE); }
+    void setPosition(glm::vec3 value) { if (_particle) { _particle->setPosition(value / (float)TREE_SCALE); } }
 
     /// set velocity in meter units
-    void setVelocity(glm::vec3 value) { _particle->setVelocity(value / (float)TREE_SCALE); }
+    void setVelocity(glm::vec3 value) { if (_particle) { _particle->setVelocity(value / (float)TREE_SCALE); } }
 
     /// set gravity in meter units
-    void setGravity(glm::vec3 value) { _particle->setGravity(value / (float)TREE_SCALE); }
+    void setGravity(glm::vec3 value) { if (_particle) { _particle->setGravity(value / (float)TREE_SCALE); } }
     
-    void setDamping(float value) { _particle->setDamping(value); }
-    void setColor(xColor value) { _particle->setColor(value); }
+    void setDamping(float value) { if (_particle) { _particle->setDamping(value); } }
+    void setColor(xColor value) { if (_particle) { _particle->setColor(value); } }
 
     /// set radius in meter units
-    void setRadius(float value) { _particle->setRadius(value / (float)TREE_SCALE); }
-    void setShouldDie(bool value) { _particle->setShouldDie(value); }
-    void setScript(const QString& script) { _particle->setScript(script); }
-    void setLifetime(float value) const { return _particle->setLifetime(value); }
-    void setProperties(const ParticleProperties& properties) { return _particle->setProperties(properties); }
+    void setRadius(float value) { if (_particle) { _particle->setRadius(value / (float)TREE_SCALE); } }
+    void setShouldDie(bool value) { if (_particle) { _particle->setShouldDie(value); } }
+    void setScript(const QString& script) { if (_particle) { _particle->setScript(script); } }
+    void setLifetime(float value) const { if (_particle) { _particle->setLifetime(value); } }
+    void setProperties(const ParticleProperties& properties) {
+        if (_particle) {
+            _particle->setProperties(properties);
+        }
+    }
 
 signals:
     void update();
@@ -0,0 +1,226 @@
+//
+//  ParticleBroadphase.cpp
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <cmath>
+
+#include "ParticleBroadphase.h"
+
+// cell coordinates are offset so that they pack into a key as unsigned 21 bit values
+const int CELL_KEY_BITS = 21;
+const int CELL_KEY_OFFSET = 1 << (CELL_KEY_BITS - 1);
+const quint64 CELL_KEY_MASK = (1 << CELL_KEY_BITS) - 1;
+
+ParticleBroadphase::ParticleBroadphase(float cellSize) :
+    _cellSize(cellSize)
+{
+}
+
+void ParticleBroadphase::setCellSize(float cellSize) {
+    if (cellSize != _cellSize) {
+        // every proxy would land in different cells
+        _cellSize = cellSize;
+        _cells.clear();
+        _cellIndices.clear();
+    }
+}
+
+void ParticleBroadphase::clear() {
+    _particles.resize(0);
+    _avatars.resize(0);
+    _oversizedParticles.resize(0);
+    _oversizedAvatars.resize(0);
+    _particlePairs.resize(0);
+    _avatarPairs.resize(0);
+
+    // keep the cells that were in use last step, they're likely to be used again this step
+    int cellsKept = 0;
+    for (int i = 0; i < _cells.size(); i++) {
+        BroadphaseCell& cell = _cells[i];
+        if (cell.particles.isEmpty() && cell.avatars.isEmpty()) {
+            continue;
+        }
+        cell.particles.resize(0);
+        cell.avatars.resize(0);
+        cell.homeParticles.resize(0);
+        cell.maxHomeParticleRadius = 0.0f;
+        if (cellsKept != i) {
+            _cells[cellsKept] = cell;
+        }
+        cellsKept++;
+    }
+    _cells.resize(cellsKept);
+
+    _cellIndices.clear();
+    for (int i = 0; i < _cells.size(); i++) {
+        const BroadphaseCell& cell = _cells[i];
+        _cellIndices.insert(cellKey(cell.cell[0], cell.cell[1], cell.cell[2]), i);
+    }
+}
+
+int ParticleBroadphase::addParticle(const glm::vec3& center, float radius) {
+    int index = _particles.size();
+    BroadphaseProxy proxy;
+    proxy.center = center;
+    proxy.radius = radius;
+
+    if (!computeCellRange(proxy)) {
+        _oversizedParticles.append(index);
+    } else {
+        for (int x = proxy.minCell[0]; x <= proxy.maxCell[0]; x++) {
+            for (int y = proxy.minCell[1]; y <= proxy.maxCell[1]; y++) {
+                for (int z = proxy.minCell[2]; z <= proxy.maxCell[2]; z++) {
+                    cellAt(x, y, z).particles.append(index);
+                }
+            }
+        }
+
+        BroadphaseCell& homeCell = cellAt((int) floorf(center.x / _cellSize), (int) floorf(center.y / _cellSize),
+                                          (int) floorf(center.z / _cellSize));
+        homeCell.homeParticles.append(index);
+        homeCell.maxHomeParticleRadius = std::max(homeCell.maxHomeParticleRadius, radius);
+    }
+
+    _particles.append(proxy);
+    return index;
+}
+
+int ParticleBroadphase::addAvatar(const glm::vec3& center, float radius) {
+    int index = _avatars.size();
+    BroadphaseProxy proxy;
+    proxy.center = center;
+    proxy.radius = radius;
+
+    if (!computeCellRange(proxy)) {
+        _oversizedAvatars.append(index);
+    } else {
+        for (int x = proxy.minCell[0]; x <= proxy.maxCell[0]; x++) {
+            for (int y = proxy.minCell[1]; y <= proxy.maxCell[1]; y++) {
+                for (int z = proxy.minCell[2]; z <= proxy.maxCell[2]; z++) {
+                    cellAt(x, y, z).avatars.append(index);
+                }
+            }
+        }
+    }
+
+    _avatars.append(proxy);
+    return index;
+}
+
+void ParticleBroadphase::findPairs() {
+    _particlePairs.resize(0);
+    _avatarPairs.resize(0);
+
+    foreach (const BroadphaseCell& cell, _cells) {
+        int numParticles = cell.particles.size();
+        for (int i = 0; i < numParticles; i++) {
+            int indexA = cell.particles[i];
+            const BroadphaseProxy& particleA = _particles[indexA];
+
+            for (int j = i + 1; j < numParticles; j++) {
+                int indexB = cell.particles[j];
+                const BroadphaseProxy& particleB = _particles[indexB];
+                if (isFirstSharedCell(cell, particleA, particleB) && spheresOverlap(particleA, particleB)) {
+                    _particlePairs.append(BroadphasePair(std::min(indexA, indexB), std::max(indexA, indexB)));
+                }
+            }
+
+            foreach (int avatarIndex, cell.avatars) {
+                const BroadphaseProxy& avatar = _avatars[avatarIndex];
+                if (isFirstSharedCell(cell, particleA, avatar) && spheresOverlap(particleA, avatar)) {
+                    _avatarPairs.append(BroadphasePair(indexA, avatarIndex));
+                }
+            }
+        }
+    }
+
+    // oversized proxies aren't in any cell, so they're checked against everything
+    foreach (int oversizedIndex, _oversizedParticles) {
+        const BroadphaseProxy& oversized = _particles[oversizedIndex];
+        for (int i = 0; i < _particles.size(); i++) {
+            // pairs of oversized particles are found from the one with the lower index
+            if (i == oversizedIndex || (_particles[i].isOversized && i < oversizedIndex)) {
+                continue;
+            }
+            if (spheresOverlap(oversized, _particles[i])) {
+                _particlePairs.append(BroadphasePair(std::min(i, oversizedIndex), std::max(i, oversizedIndex)));
+            }
+        }
+        for (int i = 0; i < _avatars.size(); i++) {
+            if (spheresOverlap(oversized, _avatars[i])) {
+                _avatarPairs.append(BroadphasePair(oversizedIndex, i));
+            }
+        }
+    }
+
+    foreach (int oversizedIndex, _oversizedAvatars) {
+        const BroadphaseProxy& oversized = _avatars[oversizedIndex];
+        for (int i = 0; i < _particles.size(); i++) {
+            // oversized particles have already been checked against every avatar
+            if (!_particles[i].isOversized && spheresOverlap(_particles[i], oversized)) {
+                _avatarPairs.append(BroadphasePair(i, oversizedIndex));
+            }
+        }
+    }
+}
+
+void ParticleBroadphase::getCellBounds(const BroadphaseCell& cell, glm::vec3& center, float& radius) const {
+    const float HALF_CELL_DIAGONAL = sqrtf(3.0f) * 0.5f;
+    center = (glm::vec3(cell.cell[0], cell.cell[1], cell.cell[2]) + glm::vec3(0.5f)) * _cellSize;
+    radius = HALF_CELL_DIAGONAL * _cellSize + cell.maxHomeParticleRadius;
+}
+
+bool ParticleBroadphase::computeCellRange(BroadphaseProxy& proxy) const {
+    proxy.isOversized = false;
+    for (int axis = 0; axis < 3; axis++) {
+        proxy.minCell[axis] = (int) floorf((proxy.center[axis] - proxy.radius) / _cellSize);
+        proxy.maxCell[axis] = (int) floorf((proxy.center[axis] + proxy.radius) / _cellSize);
+        if (proxy.maxCell[axis] - proxy.minCell[axis] >= MAX_BROADPHASE_CELLS_PER_AXIS) {
+            proxy.isOversized = true;
+        }
+    }
+    return !proxy.isOversized;
+}
+
+BroadphaseCell& ParticleBroadphase::cellAt(int x, int y, int z) {
+    quint64 key = cellKey(x, y, z);
+    QHash<quint64, int>::const_iterator existing = _cellIndices.constFind(key);
+    if (existing != _cellIndices.constEnd()) {
+        return _cells[existing.value()];
+    }
+
+    BroadphaseCell cell;
+    cell.cell[0] = x;
+    cell.cell[1] = y;
+    cell.cell[2] = z;
+    cell.maxHomeParticleRadius = 0.0f;
+    _cellIndices.insert(key, _cells.size());
+    _cells.append(cell);
+    return _cells.last();
+}
+
+quint64 ParticleBroadphase::cellKey(int x, int y, int z) {
+    return (((quint64) (x + CELL_KEY_OFFSET) & CELL_KEY_MASK) << (2 * CELL_KEY_BITS))
+        | (((quint64) (y + CELL_KEY_OFFSET) & CELL_KEY_MASK) << CELL_KEY_BITS)
+        | ((quint64) (z + CELL_KEY_OFFSET) & CELL_KEY_MASK);
+}
+
+bool ParticleBroadphase::spheresOverlap(const BroadphaseProxy& a, const BroadphaseProxy& b) {
+    glm::vec3 offset = a.center - b.center;
+    float radii = a.radius + b.radius;
+    return glm::dot(offset, offset) <= radii * radii;
+}
+
+bool ParticleBroadphase::isFirstSharedCell(const BroadphaseCell& cell, const BroadphaseProxy& a, const BroadphaseProxy& b) {
+    for (int axis = 0; axis < 3; axis++) {
+        if (cell.cell[axis] != std::max(a.minCell[axis], b.minCell[axis])) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,112 @@
+//
+//  ParticleBroadphase.h
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Uniform hash grid that finds which particles and avatars are close enough to collide, once per collision step.
+//
+
+#ifndef __hifi__ParticleBroadphase__
+#define __hifi__ParticleBroadphase__
+
+#include <glm/glm.hpp>
+
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+#include <QtCore/QVector>
+
+#include <OctreeConstants.h>
+
+const float DEFAULT_BROADPHASE_CELL_SIZE = 1.0f / TREE_SCALE; // one meter
+
+/// spheres that would cover more cells than this along any axis are tested against everything instead of being gridded
+const int MAX_BROADPHASE_CELLS_PER_AXIS = 8;
+
+/// a particle or avatar bounding sphere in tree units
+struct BroadphaseProxy {
+    glm::vec3 center;
+    float radius;
+    bool isOversized;
+    int minCell[3];
+    int maxCell[3];
+};
+
+/// Grid cell, remembers the particles and avatars overlapping it, and the particles whose centers are in it.
+struct BroadphaseCell {
+    int cell[3];
+    QVector<int> particles;
+    QVector<int> avatars;
+    QVector<int> homeParticles;
+    float maxHomeParticleRadius;
+};
+
+typedef QPair<int, int> BroadphasePair;
+
+/// Each step the caller clears the grid, adds every particle and avatar, and calls findPairs() to get the pairs whose
+/// bounding spheres overlap. Cells are kept from step to step, so a scene that doesn't move much doesn't reallocate.
+class ParticleBroadphase {
+public:
+    ParticleBroadphase(float cellSize = DEFAULT_BROADPHASE_CELL_SIZE);
+
+    void setCellSize(float cellSize);
+    float getCellSize() const { return _cellSize; }
+
+    /// starts a new step, forgets the proxies but keeps the storage of the cells that were in use
+    void clear();
+
+    /// \return the index of the particle, which identifies it in the pairs
+    int addParticle(const glm::vec3& center, float radius);
+
+    /// \return the index of the avatar, which identifies it in the pairs
+    int addAvatar(const glm::vec3& center, float radius);
+
+    /// finds every pair of particles, and of particle and avatar, whose bounding spheres overlap
+    void findPairs();
+
+    /// particle index pairs, each pair appears once
+    const QVector<BroadphasePair>& getParticlePairs() const { return _particlePairs; }
+
+    /// (particle index, avatar index) pairs
+    const QVector<BroadphasePair>& getAvatarPairs() const { return _avatarPairs; }
+
+    /// the cells in use, so that queries against other trees can be batched per cell. Cells that emptied out this step
+    /// are only dropped by the next clear(), so skip the ones without home particles.
+    int getCellCount() const { return _cells.size(); }
+    const BroadphaseCell& getCell(int index) const { return _cells[index]; }
+
+    /// particles too big to grid, they are not the home particle of any cell
+    const QVector<int>& getOversizedParticles() const { return _oversizedParticles; }
+
+    /// the center and the radius of a sphere that holds the cell and every home particle in it
+    void getCellBounds(const BroadphaseCell& cell, glm::vec3& center, float& radius) const;
+
+    int getParticleCount() const { return _particles.size(); }
+    const BroadphaseProxy& getParticle(int index) const { return _particles[index]; }
+    const BroadphaseProxy& getAvatar(int index) const { return _avatars[index]; }
+
+private:
+    bool computeCellRange(BroadphaseProxy& proxy) const;
+    BroadphaseCell& cellAt(int x, int y, int z);
+    static quint64 cellKey(int x, int y, int z);
+    static bool spheresOverlap(const BroadphaseProxy& a, const BroadphaseProxy& b);
+
+    /// true if this cell is the first one the two proxies share, so that a pair is reported in just one cell
+    static bool isFirstSharedCell(const BroadphaseCell& cell, const BroadphaseProxy& a, const BroadphaseProxy& b);
+
+    float _cellSize;
+
+    QVector<BroadphaseProxy> _particles;
+    QVector<BroadphaseProxy> _avatars;
+    QVector<int> _oversizedParticles;
+    QVector<int> _oversizedAvatars;
+
+    QVector<BroadphaseCell> _cells;
+    QHash<quint64, int> _cellIndices;
+
+    QVector<BroadphasePair> _particlePairs;
+    QVector<BroadphasePair> _avatarPairs;
+};
+
+#endif /* defined(__hifi__ParticleBroadphase__) */
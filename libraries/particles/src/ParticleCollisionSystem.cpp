@@ -13,6 +13,7 @@
 #include <AvatarData.h>
 #include <HeadData.h>
 #include <HandData.h>
+#include <GeometryUtil.h>
 
 #include "Particle.h"
 #include "ParticleCollisionSystem.h"
@@ -42,12 +43,13 @@ bool ParticleCollisionSystem::updateOperation(OctreeElement* element, void* extr
     ParticleCollisionSystem* system = static_cast<ParticleCollisionSystem*>(extraData);
     ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
 
-    // iterate the particles...
+    // gather the particles into the broadphase...
     QList<Particle>& particles = particleTreeElement->getParticles();
     uint16_t numberOfParticles = particles.size();
     for (uint16_t i = 0; i < numberOfParticles; i++) {
         Particle* particle = &particles[i];
-        system->checkParticle(particle);
+        system->_broadphase.addParticle(particle->getPosition(), particle->getRadius());
+        system->_stepParticles.append(particle);
     }
 
     return true;
@@ -57,11 +59,86 @@ bool ParticleCollisionSystem::updateOperation(OctreeElement* element, void* extr
 void ParticleCollisionSystem::update() {
     // update all particles
     if (_particles->tryLockForWrite()) {
+        _broadphase.clear();
+        _stepParticles.resize(0);
+        _stepAvatars.resize(0);
+
         _particles->recurseTreeWithOperation(updateOperation, this);
+
+        if (_avatars) {
+            foreach (const AvatarSharedPointer& avatarPointer, _avatars->getAvatarHash()) {
+                _broadphase.addAvatar(avatarPointer->getPosition() / (float)(TREE_SCALE),
+                                      AVATAR_BROADPHASE_RADIUS * avatarPointer->getTargetScale() / (float)(TREE_SCALE));
+                _stepAvatars.append(avatarPointer);
+            }
+        }
+
+        // the grid gives us every pair that might touch, so no particle has to search the trees on its own
+        _broadphase.findPairs();
+
+        updateCollisionsWithVoxels();
+        updateCollisionsBetweenParticles();
+        updateCollisionsWithAvatars();
+
+        _stepAvatars.resize(0);
         _particles->unlock();
     }
 }
 
+void ParticleCollisionSystem::updateCollisionsWithVoxels() {
+    // one voxel query per grid cell tells us whether any particle in it can be touching a voxel at all
+    for (int i = 0; i < _broadphase.getCellCount(); i++) {
+        const BroadphaseCell& cell = _broadphase.getCell(i);
+        if (cell.homeParticles.isEmpty()) {
+            continue;
+        }
+
+        glm::vec3 cellCenter;
+        float cellRadius;
+        _broadphase.getCellBounds(cell, cellCenter, cellRadius);
+
+        glm::vec3 penetration;
+        VoxelDetail* voxelDetails = NULL;
+        bool nearVoxels = _voxels->findSpherePenetration(cellCenter * (float)(TREE_SCALE), cellRadius * (float)(TREE_SCALE),
+                                                         penetration, (void**)&voxelDetails);
+        delete voxelDetails;
+
+        if (nearVoxels) {
+            foreach (int particleIndex, cell.homeParticles) {
+                updateCollisionWithVoxels(_stepParticles[particleIndex]);
+            }
+        }
+    }
+
+    foreach (int particleIndex, _broadphase.getOversizedParticles()) {
+        updateCollisionWithVoxels(_stepParticles[particleIndex]);
+    }
+}
+
+void ParticleCollisionSystem::updateCollisionsBetweenParticles() {
+    foreach (const BroadphasePair& pair, _broadphase.getParticlePairs()) {
+        Particle* particleA = _stepParticles[pair.first];
+        Particle* particleB = _stepParticles[pair.second];
+
+        // voxel collisions may have moved the particles since they were added to the broadphase
+        glm::vec3 penetration;
+        if (findSphereSpherePenetration(particleA->getPosition(), particleA->getRadius(),
+                                        particleB->getPosition(), particleB->getRadius(), penetration)) {
+            collideParticles(particleA, particleB, penetration * (float)(TREE_SCALE));
+        }
+    }
+}
+
+void ParticleCollisionSystem::updateCollisionsWithAvatars() {
+    foreach (const BroadphasePair& pair, _broadphase.getAvatarPairs()) {
+        Particle* particle = _stepParticles[pair.first];
+
+        // particles that are in hand, don't collide with avatars
+        if (!particle->getInHand()) {
+            collideWithAvatar(particle, _stepAvatars[pair.second].data());
+        }
+    }
+}
 
 void ParticleCollisionSystem::checkParticle(Particle* particle) {
     updateCollisionWithVoxels(particle);
@@ -110,53 +187,58 @@ void ParticleCollisionSystem::updateCollisionWithVoxels(Particle* particle) {
 void ParticleCollisionSystem::updateCollisionWithParticles(Particle* particleA) {
     glm::vec3 center = particleA->getPosition() * (float)(TREE_SCALE);
     float radius = particleA->getRadius() * (float)(TREE_SCALE);
-    //const float ELASTICITY = 0.4f;
-    //const float DAMPING = 0.0f;
-    const float COLLISION_FREQUENCY = 0.5f;
     glm::vec3 penetration;
     Particle* particleB;
     if (_particles->findSpherePenetration(center, radius, penetration, (void**)&particleB)) {
-        // NOTE: 'penetration' is the depth that 'particleA' overlaps 'particleB'.
-        // That is, it points from A into B.
-
-        // Even if the particles overlap... when the particles are already moving appart
-        // we don't want to count this as a collision.
-        glm::vec3 relativeVelocity = particleA->getVelocity() - particleB->getVelocity();
-        if (glm::dot(relativeVelocity, penetration) > 0.0f) {
-            particleA->collisionWithParticle(particleB);
-            particleB->collisionWithParticle(particleA);
-            emitGlobalParticleCollisionWithParticle(particleA, particleB);
-
-            glm::vec3 axis = glm::normalize(penetration);
-            glm::vec3 axialVelocity = glm::dot(relativeVelocity, axis) * axis;
-
-            // particles that are in hand are assigned an ureasonably large mass for collisions
-            // which effectively makes them immovable but allows the other ball to reflect correctly.
-            const float MAX_MASS = 1.0e6f;
-            float massA = (particleA->getInHand()) ? MAX_MASS : particleA->getMass();
-            float massB = (particleB->getInHand()) ? MAX_MASS : particleB->getMass();
-            float totalMass = massA + massB;
-
-            // handle A particle
-            particleA->setVelocity(particleA->getVelocity() - axialVelocity * (2.0f * massB / totalMass));
-            ParticleProperties propertiesA;
-            ParticleID particleAid(particleA->getID());
-            propertiesA.copyFromParticle(*particleA);
-            propertiesA.setVelocity(particleA->getVelocity() * (float)TREE_SCALE);
-            _packetSender->queueParticleEditMessage(PacketTypeParticleAddOrEdit, particleAid, propertiesA);
-
-            // handle B particle
-            particleB->setVelocity(particleB->getVelocity() + axialVelocity * (2.0f * massA / totalMass));
-            ParticleProperties propertiesB;
-            ParticleID particleBid(particleB->getID());
-            propertiesB.copyFromParticle(*particleB);
-            propertiesB.setVelocity(particleB->getVelocity() * (float)TREE_SCALE);
-            _packetSender->queueParticleEditMessage(PacketTypeParticleAddOrEdit, particleBid, propertiesB);
-
-            _packetSender->releaseQueuedMessages();
-
-            updateCollisionSound(particleA, penetration, COLLISION_FREQUENCY);
-        }
+        collideParticles(particleA, particleB, penetration);
+    }
+}
+
+void ParticleCollisionSystem::collideParticles(Particle* particleA, Particle* particleB, const glm::vec3& penetration) {
+    //const float ELASTICITY = 0.4f;
+    //const float DAMPING = 0.0f;
+    const float COLLISION_FREQUENCY = 0.5f;
+
+    // NOTE: 'penetration' is the depth that 'particleA' overlaps 'particleB'.
+    // That is, it points from A into B.
+
+    // Even if the particles overlap... when the particles are already moving appart
+    // we don't want to count this as a collision.
+    glm::vec3 relativeVelocity = particleA->getVelocity() - particleB->getVelocity();
+    if (glm::dot(relativeVelocity, penetration) > 0.0f) {
+        particleA->collisionWithParticle(particleB);
+        particleB->collisionWithParticle(particleA);
+        emitGlobalParticleCollisionWithParticle(particleA, particleB);
+
+        glm::vec3 axis = glm::normalize(penetration);
+        glm::vec3 axialVelocity = glm::dot(relativeVelocity, axis) * axis;
+
+        // particles that are in hand are assigned an ureasonably large mass for collisions
+        // which effectively makes them immovable but allows the other ball to reflect correctly.
+        const float MAX_MASS = 1.0e6f;
+        float massA = (particleA->getInHand()) ? MAX_MASS : particleA->getMass();
+        float massB = (particleB->getInHand()) ? MAX_MASS : particleB->getMass();
+        float totalMass = massA + massB;
+
+        // handle A particle
+        particleA->setVelocity(particleA->getVelocity() - axialVelocity * (2.0f * massB / totalMass));
+        ParticleProperties propertiesA;
+        ParticleID particleAid(particleA->getID());
+        propertiesA.copyFromParticle(*particleA);
+        propertiesA.setVelocity(particleA->getVelocity() * (float)TREE_SCALE);
+        _packetSender->queueParticleEditMessage(PacketTypeParticleAddOrEdit, particleAid, propertiesA);
+
+        // handle B particle
+        particleB->setVelocity(particleB->getVelocity() + axialVelocity * (2.0f * massA / totalMass));
+        ParticleProperties propertiesB;
+        ParticleID particleBid(particleB->getID());
+        propertiesB.copyFromParticle(*particleB);
+        propertiesB.setVelocity(particleB->getVelocity() * (float)TREE_SCALE);
+        _packetSender->queueParticleEditMessage(PacketTypeParticleAddOrEdit, particleBid, propertiesB);
+
+        _packetSender->releaseQueuedMessages();
+
+        updateCollisionSound(particleA, penetration, COLLISION_FREQUENCY);
     }
 }
 
@@ -170,45 +252,47 @@ void ParticleCollisionSystem::updateCollisionWithAvatars(Particle* particle) {
         return;
     }
 
+    foreach (const AvatarSharedPointer& avatarPointer, _avatars->getAvatarHash()) {
+        collideWithAvatar(particle, avatarPointer.data());
+    }
+}
+
+void ParticleCollisionSystem::collideWithAvatar(Particle* particle, AvatarData* avatar) {
     glm::vec3 center = particle->getPosition() * (float)(TREE_SCALE);
     float radius = particle->getRadius() * (float)(TREE_SCALE);
     const float ELASTICITY = 0.9f;
     const float DAMPING = 0.1f;
     const float COLLISION_FREQUENCY = 0.5f;
-    glm::vec3 penetration;
 
-    foreach (const AvatarSharedPointer& avatarPointer, _avatars->getAvatarHash()) {
-        AvatarData* avatar = avatarPointer.data();
-        CollisionInfo collisionInfo;
-        collisionInfo._damping = DAMPING;
-        collisionInfo._elasticity = ELASTICITY;
-        if (avatar->findSphereCollision(center, radius, collisionInfo)) {
-            collisionInfo._addedVelocity /= (float)(TREE_SCALE);
-            glm::vec3 relativeVelocity = collisionInfo._addedVelocity - particle->getVelocity();
-            if (glm::dot(relativeVelocity, collisionInfo._penetration) < 0.f) {
-                // only collide when particle and collision point are moving toward each other
-                // (doing this prevents some "collision snagging" when particle penetrates the object)
-
-                // HACK BEGIN: to allow paddle hands to "hold" particles we attenuate soft collisions against the avatar.
-                // NOTE: the physics are wrong (particles cannot roll) but it IS possible to catch a slow moving particle.
-                // TODO: make this less hacky when we have more per-collision details
-                float elasticity = ELASTICITY;
-                float attenuationFactor = glm::length(collisionInfo._addedVelocity) / HALTING_SPEED;
-                float damping = DAMPING;
-                if (attenuationFactor < 1.f) {
-                    collisionInfo._addedVelocity *= attenuationFactor;
-                    elasticity *= attenuationFactor;
-                    // NOTE: the math below keeps the damping piecewise continuous,
-                    // while ramping it up to 1.0 when attenuationFactor = 0
-                    damping = DAMPING + (1.f - attenuationFactor) * (1.f - DAMPING);
-                }
-                // HACK END
-
-                updateCollisionSound(particle, collisionInfo._penetration, COLLISION_FREQUENCY);
-                collisionInfo._penetration /= (float)(TREE_SCALE);
-                particle->applyHardCollision(collisionInfo);
-                queueParticlePropertiesUpdate(particle);
+    CollisionInfo collisionInfo;
+    collisionInfo._damping = DAMPING;
+    collisionInfo._elasticity = ELASTICITY;
+    if (avatar->findSphereCollision(center, radius, collisionInfo)) {
+        collisionInfo._addedVelocity /= (float)(TREE_SCALE);
+        glm::vec3 relativeVelocity = collisionInfo._addedVelocity - particle->getVelocity();
+        if (glm::dot(relativeVelocity, collisionInfo._penetration) < 0.f) {
+            // only collide when particle and collision point are moving toward each other
+            // (doing this prevents some "collision snagging" when particle penetrates the object)
+
+            // HACK BEGIN: to allow paddle hands to "hold" particles we attenuate soft collisions against the avatar.
+            // NOTE: the physics are wrong (particles cannot roll) but it IS possible to catch a slow moving particle.
+            // TODO: make this less hacky when we have more per-collision details
+            float elasticity = ELASTICITY;
+            float attenuationFactor = glm::length(collisionInfo._addedVelocity) / HALTING_SPEED;
+            float damping = DAMPING;
+            if (attenuationFactor < 1.f) {
+                collisionInfo._addedVelocity *= attenuationFactor;
+                elasticity *= attenuationFactor;
+                // NOTE: the math below keeps the damping piecewise continuous,
+                // while ramping it up to 1.0 when attenuationFactor = 0
+                damping = DAMPING + (1.f - attenuationFactor) * (1.f - DAMPING);
             }
+            // HACK END
+
+            updateCollisionSound(particle, collisionInfo._penetration, COLLISION_FREQUENCY);
+            collisionInfo._penetration /= (float)(TREE_SCALE);
+            particle->applyHardCollision(collisionInfo);
+            queueParticlePropertiesUpdate(particle);
         }
     }
 }
@@ -22,6 +22,7 @@
 #include <OctreePacketData.h>
 
 #include "Particle.h"
+#include "ParticleBroadphase.h"
 
 class AbstractAudioInterface;
 class AvatarData;
@@ -31,6 +32,9 @@ class VoxelTree;
 
 const glm::vec3 NO_ADDED_VELOCITY = glm::vec3(0);
 
+/// radius in meters, at an avatar scale of one, of a sphere that holds an avatar's body and paddle hands
+const float AVATAR_BROADPHASE_RADIUS = 2.0f;
+
 class ParticleCollisionSystem : public QObject {
 Q_OBJECT
 public:
@@ -58,6 +62,11 @@ signals:
 
 private:
     static bool updateOperation(OctreeElement* element, void* extraData);
+    void updateCollisionsWithVoxels();
+    void updateCollisionsBetweenParticles();
+    void updateCollisionsWithAvatars();
+    void collideParticles(Particle* particleA, Particle* particleB, const glm::vec3& penetration);
+    void collideWithAvatar(Particle* particle, AvatarData* avatar);
     void emitGlobalParticleCollisionWithVoxel(Particle* particle, VoxelDetail* voxelDetails);
     void emitGlobalParticleCollisionWithParticle(Particle* particleA, Particle* particleB);
 
@@ -66,6 +75,11 @@ private:
     VoxelTree* _voxels;
     AbstractAudioInterface* _audio;
     AvatarHashMap* _avatars;
+
+    // the particles and avatars in the broadphase this step, by their broadphase index
+    ParticleBroadphase _broadphase;
+    QVector<Particle*> _stepParticles;
+    QVector<AvatarSharedPointer> _stepAvatars;
 };
 
 #endif /* defined(__hifi__ParticleCollisionSystem__) */
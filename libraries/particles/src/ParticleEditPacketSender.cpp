@@ -22,7 +22,7 @@ void ParticleEditPacketSender::sendEditParticleMessage(PacketType type, Particle
         return; // bail early
     }
 
-    static unsigned char bufferOut[MAX_PACKET_SIZE];
+    unsigned char bufferOut[MAX_PACKET_SIZE];
     int sizeOut = 0;
 
     // This encodes the voxel edit message into a buffer...
@@ -48,8 +48,9 @@ void ParticleEditPacketSender::queueParticleEditMessage(PacketType type, Particl
         return; // bail early
     }
 
-    // use MAX_PACKET_SIZE since it's static and guaranteed to be larger than _maxPacketSize
-    static unsigned char bufferOut[MAX_PACKET_SIZE];
+    // use MAX_PACKET_SIZE since it's guaranteed to be larger than _maxPacketSize, on the stack since several scripts
+    // may be queueing edits at once
+    unsigned char bufferOut[MAX_PACKET_SIZE];
     int sizeOut = 0;
 
     if (Particle::encodeParticleEditMessageDetails(type, particleID, properties, &bufferOut[0], _maxPacketSize, sizeOut)) {
@@ -57,3 +58,22 @@ void ParticleEditPacketSender::queueParticleEditMessage(PacketType type, Particl
     }
 }
 
+
+QByteArray ParticleEditPacketSender::getEditMessageKey(PacketType type, const unsigned char* editMessage,
+                                                      ssize_t length) const {
+    uint32_t particleID = Particle::particleIDFromEditMessage(editMessage, length);
+    if (type != PacketTypeParticleAddOrEdit || particleID == NEW_PARTICLE || particleID == UNKNOWN_PARTICLE_ID) {
+        return QByteArray();
+    }
+    return QByteArray(reinterpret_cast<const char*>(&particleID), sizeof(particleID));
+}
+
+bool ParticleEditPacketSender::canReplaceEditMessage(PacketType type, const QByteArray& earlierMessage,
+                                                     const unsigned char* laterMessage, ssize_t laterLength) const {
+    uint16_t earlierChangedBits = 0;
+    uint16_t laterChangedBits = 0;
+    return Particle::changedBitsFromEditMessage(reinterpret_cast<const unsigned char*>(earlierMessage.constData()),
+                                                earlierMessage.size(), earlierChangedBits)
+        && Particle::changedBitsFromEditMessage(laterMessage, laterLength, laterChangedBits)
+        && (earlierChangedBits & laterChangedBits) == earlierChangedBits;
+}
@@ -31,5 +31,12 @@ public:
     // My server type is the particle server
     virtual unsigned char getMyNodeType() const { return NodeType::ParticleServer; }
     virtual void adjustEditPacketForClockSkew(unsigned char* codeColorBuffer, ssize_t length, int clockSkew);
+
+    /// particle edits are keyed by particle ID, new particles aren't coalesced
+    virtual QByteArray getEditMessageKey(PacketType type, const unsigned char* editMessage, ssize_t length) const;
+
+    /// a later edit only replaces an earlier one if it changes every property the earlier one did
+    virtual bool canReplaceEditMessage(PacketType type, const QByteArray& earlierMessage,
+                                       const unsigned char* laterMessage, ssize_t laterLength) const;
 };
 #endif // __shared__ParticleEditPacketSender__
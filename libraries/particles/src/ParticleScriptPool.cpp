@@ -0,0 +1,156 @@
+//
+//  ParticleScriptPool.cpp
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+
+#include <QtCore/QDebug>
+#include <QtCore/QPair>
+#include <QtCore/QThreadStorage>
+#include <QtCore/QVector>
+
+#include <SharedUtil.h>
+
+// see the note in Particle.cpp about why we include this header directly
+#include "../../script-engine/src/ScriptEngine.h"
+
+#include "Particle.h"
+#include "ParticleScriptPool.h"
+
+// how often each pool reports which scripts the time went to
+const quint64 SCRIPT_STATS_REPORT_INTERVAL_USECS = 30 * USECS_PER_SECOND;
+const int SCRIPT_STATS_REPORT_TOP_SCRIPTS = 5;
+const int SCRIPT_STATS_NAME_LENGTH = 40;
+
+ParticleScriptContext::ParticleScriptContext(const QString& script, Particle* particle) :
+    _engine(new ScriptEngine(script)),
+    _particleScriptable(new ParticleScriptObject(particle)),
+    _lastUsed(usecTimestampNow()),
+    _calls(0),
+    _totalUsecs(0),
+    _compileUsecs(0)
+{
+    // the "Particle" global has to be in place before the script's top level code runs and connects its handlers
+    _engine->registerGlobalObject("Particle", _particleScriptable);
+    _engine->evaluate();
+    _compileUsecs = usecTimestampNow() - _lastUsed;
+}
+
+ParticleScriptContext::~ParticleScriptContext() {
+    delete _engine;
+    delete _particleScriptable;
+}
+
+void ParticleScriptContext::bindParticle(Particle* particle) {
+    _particleScriptable->setParticle(particle);
+}
+
+void ParticleScriptContext::endCall() {
+    bindParticle(NULL);
+    _engine->stopAllTimers();
+}
+
+static QThreadStorage<ParticleScriptPool*> threadParticleScriptPools;
+
+ParticleScriptPool* ParticleScriptPool::getInstance() {
+    if (!threadParticleScriptPools.hasLocalData()) {
+        threadParticleScriptPools.setLocalData(new ParticleScriptPool());
+    }
+    return threadParticleScriptPools.localData();
+}
+
+ParticleScriptPool::ParticleScriptPool() :
+    _contexts(),
+    _maxContexts(DEFAULT_MAX_PARTICLE_SCRIPT_CONTEXTS),
+    _compiles(0),
+    _evictions(0),
+    _lastStatsReport(usecTimestampNow())
+{
+}
+
+ParticleScriptPool::~ParticleScriptPool() {
+    qDeleteAll(_contexts);
+}
+
+ParticleScriptContext* ParticleScriptPool::contextForParticle(const QString& script, Particle* particle) {
+    ParticleScriptContext* context = _contexts.value(script);
+
+    if (context) {
+        context->bindParticle(particle);
+    } else {
+        while (_contexts.size() >= std::max(_maxContexts, 1)) {
+            evictLeastRecentlyUsed();
+        }
+        context = new ParticleScriptContext(script, particle);
+        _contexts.insert(script, context);
+        _compiles++;
+    }
+
+    context->setLastUsed(usecTimestampNow());
+    return context;
+}
+
+void ParticleScriptPool::recordCall(ParticleScriptContext* context, quint64 usecs) {
+    context->recordCall(usecs);
+
+    quint64 now = usecTimestampNow();
+    if (now - _lastStatsReport > SCRIPT_STATS_REPORT_INTERVAL_USECS) {
+        printStats();
+        _lastStatsReport = now;
+    }
+}
+
+static bool moreTotalUsecs(const QPair<ParticleScriptContext*, QString>& a,
+                           const QPair<ParticleScriptContext*, QString>& b) {
+    return a.first->getTotalUsecs() > b.first->getTotalUsecs();
+}
+
+void ParticleScriptPool::printStats() {
+    QVector<QPair<ParticleScriptContext*, QString> > scripts;
+    quint64 totalCalls = 0;
+    quint64 totalUsecs = 0;
+
+    QHash<QString, ParticleScriptContext*>::const_iterator i;
+    for (i = _contexts.constBegin(); i != _contexts.constEnd(); i++) {
+        totalCalls += i.value()->getCalls();
+        totalUsecs += i.value()->getTotalUsecs();
+        scripts.append(qMakePair(i.value(), i.key()));
+    }
+
+    qDebug() << "Particle scripts:" << _contexts.size() << "of" << _maxContexts << "contexts cached," << _compiles
+        << "compiles," << _evictions << "evictions," << totalCalls << "calls took" << totalUsecs << "usecs.";
+
+    std::sort(scripts.begin(), scripts.end(), moreTotalUsecs);
+    for (int s = 0; s < scripts.size() && s < SCRIPT_STATS_REPORT_TOP_SCRIPTS; s++) {
+        ParticleScriptContext* context = scripts[s].first;
+        if (context->getCalls() == 0) {
+            break;
+        }
+        QString scriptName = scripts[s].second.simplified().left(SCRIPT_STATS_NAME_LENGTH);
+        qDebug() << "    " << context->getCalls() << "calls," << context->getTotalUsecs() / context->getCalls()
+            << "usecs average, compiled in" << context->getCompileUsecs() << "usecs -" << scriptName;
+    }
+
+    foreach (ParticleScriptContext* context, _contexts) {
+        context->resetStats();
+    }
+}
+
+void ParticleScriptPool::evictLeastRecentlyUsed() {
+    QHash<QString, ParticleScriptContext*>::iterator oldest = _contexts.end();
+    for (QHash<QString, ParticleScriptContext*>::iterator i = _contexts.begin(); i != _contexts.end(); i++) {
+        if (oldest == _contexts.end() || i.value()->getLastUsed() < oldest.value()->getLastUsed()) {
+            oldest = i;
+        }
+    }
+
+    if (oldest != _contexts.end()) {
+        delete oldest.value();
+        _contexts.erase(oldest);
+        _evictions++;
+    }
+}
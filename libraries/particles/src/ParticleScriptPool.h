@@ -0,0 +1,94 @@
+//
+//  ParticleScriptPool.h
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Keeps particle scripts compiled and running between updates and collisions instead of building a new script engine
+//  for every call.
+//
+
+#ifndef __hifi__ParticleScriptPool__
+#define __hifi__ParticleScriptPool__
+
+#include <QtCore/QHash>
+#include <QtCore/QString>
+
+class Particle;
+class ParticleScriptObject;
+class ScriptEngine;
+
+const int DEFAULT_MAX_PARTICLE_SCRIPT_CONTEXTS = 64;
+
+/// A script that has been evaluated once and stays alive. The "Particle" global is rebound to whichever particle the
+/// script is being run for, so the handlers the script connected when it was evaluated keep working across particles.
+class ParticleScriptContext {
+public:
+    ParticleScriptContext(const QString& script, Particle* particle);
+    ~ParticleScriptContext();
+
+    ScriptEngine* getEngine() const { return _engine; }
+    ParticleScriptObject* getParticleScriptable() const { return _particleScriptable; }
+
+    /// points the script's "Particle" global at the given particle
+    void bindParticle(Particle* particle);
+
+    /// unbinds the particle once a call is done, and stops the timers the call set up, since they would fire later
+    /// with some other particle, or none, bound
+    void endCall();
+
+    quint64 getLastUsed() const { return _lastUsed; }
+    void setLastUsed(quint64 lastUsed) { _lastUsed = lastUsed; }
+
+    void recordCall(quint64 usecs) { _calls++; _totalUsecs += usecs; }
+    quint64 getCalls() const { return _calls; }
+    quint64 getTotalUsecs() const { return _totalUsecs; }
+    quint64 getCompileUsecs() const { return _compileUsecs; }
+    void resetStats() { _calls = 0; _totalUsecs = 0; }
+
+private:
+    ScriptEngine* _engine;
+    ParticleScriptObject* _particleScriptable;
+    quint64 _lastUsed;
+    quint64 _calls;
+    quint64 _totalUsecs;
+    quint64 _compileUsecs;
+};
+
+/// Cache of ParticleScriptContexts keyed by script text. Every particle running the same script shares one context, so
+/// top level script variables are shared between them as well. Each thread that runs particle scripts gets its own pool
+/// since a script engine must only be used from one thread. When the pool is full the least recently used context is
+/// thrown away.
+class ParticleScriptPool {
+public:
+    /// the pool for the calling thread
+    static ParticleScriptPool* getInstance();
+
+    ParticleScriptPool();
+    ~ParticleScriptPool();
+
+    void setMaxContexts(int maxContexts) { _maxContexts = maxContexts; }
+    int getMaxContexts() const { return _maxContexts; }
+    int getContextCount() const { return _contexts.size(); }
+
+    /// returns the context for the script with the particle bound to it, compiling the script if it isn't cached
+    ParticleScriptContext* contextForParticle(const QString& script, Particle* particle);
+
+    /// charges time spent running a script to its context, and reports where script time went every so often
+    void recordCall(ParticleScriptContext* context, quint64 usecs);
+
+    void printStats();
+
+private:
+    void evictLeastRecentlyUsed();
+
+    QHash<QString, ParticleScriptContext*> _contexts;
+    int _maxContexts;
+
+    quint64 _compiles;
+    quint64 _evictions;
+    quint64 _lastStatsReport;
+};
+
+#endif /* defined(__hifi__ParticleScriptPool__) */
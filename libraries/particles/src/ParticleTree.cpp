@@ -6,11 +6,34 @@
 //  Copyright (c) 2013 High Fidelity, Inc. All rights reserved.
 //
 
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
+
 #include "ParticleTree.h"
 
 ParticleTree::ParticleTree(bool shouldReaverage) : Octree(shouldReaverage) {
     ParticleTreeElement* rootNode = createNewElement();
     _rootNode = rootNode;
+
+    // the thread calling update() simulates its share too
+    _simulationThreadPool.setMaxThreadCount(std::max(QThread::idealThreadCount() - 1, 1));
+}
+
+ParticleTree::~ParticleTree() {
+    // the elements take their particles out of the index as they're deleted, so they have to go while it's still here
+    delete _rootNode;
+    _rootNode = NULL;
+}
+
+void ParticleTree::setContainingElement(uint32_t particleID, ParticleTreeElement* element) {
+    _particleToElementMap.insert(particleID, element);
+}
+
+void ParticleTree::resetContainingElement(uint32_t particleID, ParticleTreeElement* element) {
+    QHash<uint32_t, ParticleTreeElement*>::iterator containingElement = _particleToElementMap.find(particleID);
+    if (containingElement != _particleToElementMap.end() && containingElement.value() == element) {
+        _particleToElementMap.erase(containingElement);
+    }
 }
 
 ParticleTreeElement* ParticleTree::createNewElement(unsigned char * octalCode) {
@@ -30,73 +53,13 @@ bool ParticleTree::handlesEditPacketType(PacketType packetType) const {
     }
 }
 
-class FindAndDeleteParticlesArgs {
-public:
-    QList<uint32_t> _idsToDelete;
-};
-
-bool ParticleTree::findAndDeleteOperation(OctreeElement* element, void* extraData) {
-    //qDebug() << "findAndDeleteOperation()";
-
-    FindAndDeleteParticlesArgs* args = static_cast< FindAndDeleteParticlesArgs*>(extraData);
-
-    // if we've found and deleted all our target particles, then we can stop looking
-    if (args->_idsToDelete.size() <= 0) {
-        return false;
-    }
-
-    ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
-
-    //qDebug() << "findAndDeleteOperation() args->_idsToDelete.size():" << args->_idsToDelete.size();
-
-    for (QList<uint32_t>::iterator it = args->_idsToDelete.begin(); it != args->_idsToDelete.end(); it++) {
-        uint32_t particleID = *it;
-        //qDebug() << "findAndDeleteOperation() particleID:" << particleID;
-
-        if (particleTreeElement->removeParticleWithID(particleID)) {
-            // if the particle was in this element, then remove it from our search list.
-            //qDebug() << "findAndDeleteOperation() it = args->_idsToDelete.erase(it)";
-            it = args->_idsToDelete.erase(it);
-        }
-
-        if (it == args->_idsToDelete.end()) {
-            //qDebug() << "findAndDeleteOperation() breaking";
-            break;
-        }
-    }
-
-    // if we've found and deleted all our target particles, then we can stop looking
-    if (args->_idsToDelete.size() <= 0) {
-        return false;
-    }
-    return true;
-}
-
-
-class FindAndUpdateParticleArgs {
-public:
-    const Particle& searchParticle;
-    bool found;
-};
-
-bool ParticleTree::findAndUpdateOperation(OctreeElement* element, void* extraData) {
-    FindAndUpdateParticleArgs* args = static_cast<FindAndUpdateParticleArgs*>(extraData);
-    ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
-    // Note: updateParticle() will only operate on correctly found particles
-    if (particleTreeElement->updateParticle(args->searchParticle)) {
-        args->found = true;
-        return false; // stop searching
-    }
-    return true;
-}
-
 void ParticleTree::storeParticle(const Particle& particle, Node* senderNode) {
     // First, look for the existing particle in the tree..
-    FindAndUpdateParticleArgs args = { particle, false };
-    recurseTreeWithOperation(findAndUpdateOperation, &args);
+    ParticleTreeElement* containingElement = getContainingElement(particle.getID());
+    bool found = containingElement && containingElement->updateParticle(particle);
 
     // if we didn't find it in the tree, then store it...
-    if (!args.found) {
+    if (!found) {
         glm::vec3 position = particle.getPosition();
         float size = std::max(MINIMUM_PARTICLE_ELEMENT_SIZE, particle.getRadius());
         ParticleTreeElement* element = (ParticleTreeElement*)getOrCreateChildElementAt(position.x, position.y, position.z, size);
@@ -133,10 +96,18 @@ bool ParticleTree::findAndUpdateWithIDandPropertiesOperation(OctreeElement* elem
 
 void ParticleTree::updateParticle(const ParticleID& particleID, const ParticleProperties& properties) {
     // First, look for the existing particle in the tree..
-    FindAndUpdateParticleWithIDandPropertiesArgs args = { particleID, properties, false };
-    recurseTreeWithOperation(findAndUpdateWithIDandPropertiesOperation, &args);
+    bool found = false;
+    if (particleID.isKnownID) {
+        ParticleTreeElement* containingElement = getContainingElement(particleID.id);
+        found = containingElement && containingElement->updateParticle(particleID, properties);
+    } else {
+        // particles are only indexed by their real ID, so one that's only known by its creator token has to be searched for
+        FindAndUpdateParticleWithIDandPropertiesArgs args = { particleID, properties, false };
+        recurseTreeWithOperation(findAndUpdateWithIDandPropertiesOperation, &args);
+        found = args.found;
+    }
     // if we found it in the tree, then mark the tree as dirty
-    if (args.found) {
+    if (found) {
         _isDirty = true;
     }
 }
@@ -158,9 +129,10 @@ void ParticleTree::addParticle(const ParticleID& particleID, const ParticlePrope
 
 void ParticleTree::deleteParticle(const ParticleID& particleID) {
     if (particleID.isKnownID) {
-        FindAndDeleteParticlesArgs args;
-        args._idsToDelete.push_back(particleID.id);
-        recurseTreeWithOperation(findAndDeleteOperation, &args);
+        ParticleTreeElement* containingElement = getContainingElement(particleID.id);
+        if (containingElement) {
+            containingElement->removeParticleWithID(particleID.id);
+        }
     }
 }
 
@@ -338,50 +310,19 @@ void ParticleTree::findParticlesForUpdate(const AABox& box, QVector<Particle*> f
     foundParticles.swap(args._foundParticles);
 }
 
-class FindByIDArgs {
-public:
-    uint32_t id;
-    bool found;
-    const Particle* foundParticle;
-};
-
-
-bool ParticleTree::findByIDOperation(OctreeElement* element, void* extraData) {
-//qDebug() << "ParticleTree::findByIDOperation()....";
-
-    FindByIDArgs* args = static_cast<FindByIDArgs*>(extraData);
-    ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
-
-    // if already found, stop looking
-    if (args->found) {
-        return false;
-    }
-
-    // as the tree element if it has this particle
-    const Particle* foundParticle = particleTreeElement->getParticleWithID(args->id);
-    if (foundParticle) {
-        args->foundParticle = foundParticle;
-        args->found = true;
-        return false;
-    }
-
-    // keep looking
-    return true;
-}
-
-
 const Particle* ParticleTree::findParticleByID(uint32_t id, bool alreadyLocked) {
-    FindByIDArgs args = { id, false, NULL };
     if (!alreadyLocked) {
-        //qDebug() << "ParticleTree::findParticleByID().... about to call lockForRead()....";
         lockForRead();
-        //qDebug() << "ParticleTree::findParticleByID().... after call lockForRead()....";
     }
-    recurseTreeWithOperation(findByIDOperation, &args);
+    const Particle* foundParticle = NULL;
+    ParticleTreeElement* containingElement = getContainingElement(id);
+    if (containingElement) {
+        foundParticle = containingElement->getParticleWithID(id);
+    }
     if (!alreadyLocked) {
         unlock();
     }
-    return args.foundParticle;
+    return foundParticle;
 }
 
 
@@ -441,13 +382,6 @@ void ParticleTree::removeNewlyCreatedHook(NewlyCreatedParticleHook* hook) {
 }
 
 
-bool ParticleTree::updateOperation(OctreeElement* element, void* extraData) {
-    ParticleTreeUpdateArgs* args = static_cast<ParticleTreeUpdateArgs*>(extraData);
-    ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
-    particleTreeElement->update(*args);
-    return true;
-}
-
 bool ParticleTree::pruneOperation(OctreeElement* element, void* extraData) {
     ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
     for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
@@ -459,11 +393,94 @@ bool ParticleTree::pruneOperation(OctreeElement* element, void* extraData) {
     return true;
 }
 
+class GatherSimulationElementsArgs {
+public:
+    QVector<ParticleTreeElement*> elements;
+    int particleCount;
+};
+
+bool ParticleTree::gatherSimulationElementsOperation(OctreeElement* element, void* extraData) {
+    GatherSimulationElementsArgs* args = static_cast<GatherSimulationElementsArgs*>(extraData);
+    ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
+
+    // every element is marked, whether or not it holds particles, just like a serial update would
+    particleTreeElement->markWithChangedTime();
+    if (particleTreeElement->hasParticles()) {
+        particleTreeElement->runParticleUpdateScripts();
+        args->elements.append(particleTreeElement);
+        args->particleCount += particleTreeElement->getParticles().size();
+    }
+    return true;
+}
+
+/// moves the particles of a run of elements, the elements aren't shared with any other task
+class ParticleSimulationTask : public QRunnable {
+public:
+    ParticleSimulationTask(ParticleTreeElement* const* elements, int elementCount, quint64 now,
+                           ParticleTreeUpdateArgs* args) :
+        _elements(elements), _elementCount(elementCount), _now(now), _args(args) { setAutoDelete(false); }
+
+    virtual void run() {
+        for (int i = 0; i < _elementCount; i++) {
+            _elements[i]->updateParticles(*_args, _now, false);
+        }
+    }
+
+private:
+    ParticleTreeElement* const* _elements;
+    int _elementCount;
+    quint64 _now;
+    ParticleTreeUpdateArgs* _args;
+};
+
 void ParticleTree::update() {
     _isDirty = true;
 
-    ParticleTreeUpdateArgs args = { };
-    recurseTreeWithOperation(updateOperation, &args);
+    // first, serially: mark the elements, age the particles and run the scripts, which can change anything about it
+    GatherSimulationElementsArgs gatherArgs;
+    gatherArgs.particleCount = 0;
+    recurseTreeWithOperation(gatherSimulationElementsOperation, &gatherArgs);
+
+    // then move the particles, split into tasks of about the same number of particles each
+    int taskCount = std::min(_simulationThreadPool.maxThreadCount() + 1,
+                             gatherArgs.particleCount / MIN_PARTICLES_PER_SIMULATION_TASK);
+    taskCount = std::max(taskCount, 1);
+
+    quint64 now = usecTimestampNow();
+    QVector<ParticleTreeUpdateArgs> taskArgs(taskCount);
+    QVector<ParticleSimulationTask*> tasks;
+
+    const QVector<ParticleTreeElement*>& elements = gatherArgs.elements;
+    int firstElement = 0;
+    int particlesAssigned = 0;
+    for (int task = 0; task < taskCount; task++) {
+        int particlesWanted = (int) ((qint64) gatherArgs.particleCount * (task + 1) / taskCount);
+        int endElement = firstElement;
+        while (endElement < elements.size() && (particlesAssigned < particlesWanted || task == taskCount - 1)) {
+            particlesAssigned += elements[endElement]->getParticles().size();
+            endElement++;
+        }
+        tasks.append(new ParticleSimulationTask(elements.constData() + firstElement, endElement - firstElement, now,
+                                                &taskArgs[task]));
+        firstElement = endElement;
+    }
+
+    for (int task = 1; task < taskCount; task++) {
+        _simulationThreadPool.start(tasks[task]);
+    }
+    tasks[0]->run();
+    _simulationThreadPool.waitForDone();
+    qDeleteAll(tasks);
+
+    // last, serially: gather the particles that left their elements
+    ParticleTreeUpdateArgs args;
+    for (int task = 0; task < taskCount; task++) {
+        args._movingParticles.append(taskArgs[task]._movingParticles);
+        args._movedFromElements += taskArgs[task]._movedFromElements;
+    }
+    for (int i = 0; i < args._movingParticles.size(); i++) {
+        resetContainingElement(args._movingParticles[i].getID(), args._movedFromElements[i]);
+    }
 
     // now add back any of the particles that moved elements....
     int movingParticles = args._movingParticles.size();
@@ -477,9 +494,8 @@ void ParticleTree::update() {
             storeParticle(args._movingParticles[i]);
         } else {
             uint32_t particleID = args._movingParticles[i].getID();
-            quint64 deletedAt = usecTimestampNow();
             _recentlyDeletedParticlesLock.lockForWrite();
-            _recentlyDeletedParticleIDs.insert(deletedAt, particleID);
+            _recentlyDeletedParticles.append(particleID);
             _recentlyDeletedParticlesLock.unlock();
         }
     }
@@ -489,109 +505,33 @@ void ParticleTree::update() {
 }
 
 
-bool ParticleTree::hasParticlesDeletedSince(quint64 sinceTime) {
-    // we can probably leverage the ordered nature of QMultiMap to do this quickly...
-    bool hasSomethingNewer = false;
-
+bool ParticleTree::hasParticlesDeletedSince(quint64 sinceSequence) {
     _recentlyDeletedParticlesLock.lockForRead();
-    QMultiMap<quint64, uint32_t>::const_iterator iterator = _recentlyDeletedParticleIDs.constBegin();
-    while (iterator != _recentlyDeletedParticleIDs.constEnd()) {
-        //qDebug() << "considering... time/key:" << iterator.key();
-        if (iterator.key() > sinceTime) {
-            //qDebug() << "YES newer... time/key:" << iterator.key();
-            hasSomethingNewer = true;
-        }
-        ++iterator;
-    }
+    bool hasSomethingNewer = _recentlyDeletedParticles.hasDeletionsSince(sinceSequence);
     _recentlyDeletedParticlesLock.unlock();
     return hasSomethingNewer;
 }
 
-// sinceTime is an in/out parameter - it will be side effected with the last time sent out
-bool ParticleTree::encodeParticlesDeletedSince(quint64& sinceTime, unsigned char* outputBuffer, size_t maxLength,
+// sinceSequence is an in/out parameter - it will be side effected with the first deletion not sent out
+bool ParticleTree::encodeParticlesDeletedSince(quint64& sinceSequence, unsigned char* outputBuffer, size_t maxLength,
                                                     size_t& outputLength) {
 
-    bool hasMoreToSend = true;
-
-    unsigned char* copyAt = outputBuffer;
     size_t numBytesPacketHeader = populatePacketHeader(reinterpret_cast<char*>(outputBuffer), PacketTypeParticleErase);
-    copyAt += numBytesPacketHeader;
     outputLength = numBytesPacketHeader;
 
-    uint16_t numberOfIds = 0; // placeholder for now
-    unsigned char* numberOfIDsAt = copyAt;
-    memcpy(copyAt, &numberOfIds, sizeof(numberOfIds));
-    copyAt += sizeof(numberOfIds);
-    outputLength += sizeof(numberOfIds);
-
-    // we keep a multi map of particle IDs to timestamps, we only want to include the particle IDs that have been
-    // deleted since we last sent to this node
     _recentlyDeletedParticlesLock.lockForRead();
-    QMultiMap<quint64, uint32_t>::const_iterator iterator = _recentlyDeletedParticleIDs.constBegin();
-    while (iterator != _recentlyDeletedParticleIDs.constEnd()) {
-        QList<uint32_t> values = _recentlyDeletedParticleIDs.values(iterator.key());
-        for (int valueItem = 0; valueItem < values.size(); ++valueItem) {
-
-            // if the timestamp is more recent then out last sent time, include it
-            if (iterator.key() > sinceTime) {
-                uint32_t particleID = values.at(valueItem);
-                memcpy(copyAt, &particleID, sizeof(particleID));
-                copyAt += sizeof(particleID);
-                outputLength += sizeof(particleID);
-                numberOfIds++;
-
-                // check to make sure we have room for one more id...
-                if (outputLength + sizeof(uint32_t) > maxLength) {
-                    break;
-                }
-            }
-        }
-
-        // check to make sure we have room for one more id...
-        if (outputLength + sizeof(uint32_t) > maxLength) {
-
-            // let our caller know how far we got
-            sinceTime = iterator.key();
-            break;
-        }
-        ++iterator;
-    }
-
-    // if we got to the end, then we're done sending
-    if (iterator == _recentlyDeletedParticleIDs.constEnd()) {
-        hasMoreToSend = false;
-    }
+    outputLength += _recentlyDeletedParticles.encodeRanges(sinceSequence, outputBuffer + numBytesPacketHeader,
+                                                           maxLength - numBytesPacketHeader);
+    bool hasMoreToSend = _recentlyDeletedParticles.hasDeletionsSince(sinceSequence);
     _recentlyDeletedParticlesLock.unlock();
 
-    // replace the correct count for ids included
-    memcpy(numberOfIDsAt, &numberOfIds, sizeof(numberOfIds));
-
     return hasMoreToSend;
 }
 
 // called by the server when it knows all nodes have been sent deleted packets
-
-void ParticleTree::forgetParticlesDeletedBefore(quint64 sinceTime) {
-    //qDebug() << "forgetParticlesDeletedBefore()";
-    QSet<quint64> keysToRemove;
-
+void ParticleTree::forgetParticlesDeletedBefore(quint64 sequence) {
     _recentlyDeletedParticlesLock.lockForWrite();
-    QMultiMap<quint64, uint32_t>::iterator iterator = _recentlyDeletedParticleIDs.begin();
-
-    // First find all the keys in the map that are older and need to be deleted
-    while (iterator != _recentlyDeletedParticleIDs.end()) {
-        if (iterator.key() <= sinceTime) {
-            keysToRemove << iterator.key();
-        }
-        ++iterator;
-    }
-
-    // Now run through the keysToRemove and remove them
-    foreach (quint64 value, keysToRemove) {
-        //qDebug() << "removing the key, _recentlyDeletedParticleIDs.remove(value); time/key:" << value;
-        _recentlyDeletedParticleIDs.remove(value);
-    }
-    
+    _recentlyDeletedParticles.forgetBefore(sequence);
     _recentlyDeletedParticlesLock.unlock();
 }
 
@@ -607,28 +547,13 @@ void ParticleTree::processEraseMessage(const QByteArray& dataByteArray, const Hi
     size_t processedBytes = numBytesPacketHeader;
     dataAt += numBytesPacketHeader;
 
-    uint16_t numberOfIds = 0; // placeholder for now
-    memcpy(&numberOfIds, dataAt, sizeof(numberOfIds));
-    dataAt += sizeof(numberOfIds);
-    processedBytes += sizeof(numberOfIds);
+    QVector<uint32_t> particleIDs;
+    DeletedParticleLog::decodeRanges(dataAt, packetLength - processedBytes, particleIDs);
 
-    if (numberOfIds > 0) {
-        FindAndDeleteParticlesArgs args;
-
-        for (size_t i = 0; i < numberOfIds; i++) {
-            if (processedBytes + sizeof(uint32_t) > packetLength) {
-                break; // bail to prevent buffer overflow
-            }
-
-            uint32_t particleID = 0; // placeholder for now
-            memcpy(&particleID, dataAt, sizeof(particleID));
-            dataAt += sizeof(particleID);
-            processedBytes += sizeof(particleID);
-
-            args._idsToDelete.push_back(particleID);
+    foreach (uint32_t particleID, particleIDs) {
+        ParticleTreeElement* containingElement = getContainingElement(particleID);
+        if (containingElement) {
+            containingElement->removeParticleWithID(particleID);
         }
-
-        // calling recurse to actually delete the particles
-        recurseTreeWithOperation(findAndDeleteOperation, &args);
     }
 }
@@ -9,9 +9,15 @@
 #ifndef __hifi__ParticleTree__
 #define __hifi__ParticleTree__
 
+#include <QtCore/QThreadPool>
+
 #include <Octree.h>
+#include "DeletedParticleLog.h"
 #include "ParticleTreeElement.h"
 
+/// the fewest particles worth handing to a simulation thread of their own
+const int MIN_PARTICLES_PER_SIMULATION_TASK = 256;
+
 class NewlyCreatedParticleHook {
 public:
     virtual void particleCreated(const Particle& newParticle, Node* senderNode) = 0;
@@ -21,6 +27,7 @@ class ParticleTree : public Octree {
     Q_OBJECT
 public:
     ParticleTree(bool shouldReaverage = false);
+    virtual ~ParticleTree();
 
     /// Implements our type specific root element factory
     virtual ParticleTreeElement* createNewElement(unsigned char * octalCode = NULL);
@@ -37,6 +44,9 @@ public:
     virtual int processEditPacketData(PacketType packetType, const unsigned char* packetData, int packetLength,
                     const unsigned char* editData, int maxLength, Node* senderNode);
 
+    /// Simulates one step. Scripts run first on the calling thread, since script engines belong to one thread, then
+    /// the particles are moved across the simulation threads an element at a time, and last the particles that died
+    /// or crossed element boundaries are re-stored on the calling thread.
     virtual void update();
 
     void storeParticle(const Particle& particle, Node* senderNode = NULL);
@@ -62,24 +72,35 @@ public:
     void addNewlyCreatedHook(NewlyCreatedParticleHook* hook);
     void removeNewlyCreatedHook(NewlyCreatedParticleHook* hook);
 
-    bool hasAnyDeletedParticles() const { return _recentlyDeletedParticleIDs.size() > 0; }
-    bool hasParticlesDeletedSince(quint64 sinceTime);
-    bool encodeParticlesDeletedSince(quint64& sinceTime, unsigned char* packetData, size_t maxLength, size_t& outputLength);
-    void forgetParticlesDeletedBefore(quint64 sinceTime);
+    /// Deleted particles are numbered in the order they're deleted. Each client remembers the sequence number of the
+    /// first deletion it hasn't been sent, and deletions are forgotten once every client is past them.
+    bool hasAnyDeletedParticles() const { return !_recentlyDeletedParticles.isEmpty(); }
+    bool hasParticlesDeletedSince(quint64 sinceSequence);
+
+    /// \param sinceSequence[in/out] the first deletion to send, set to the first deletion that didn't fit in the packet
+    /// \return true if there are deletions left to send
+    bool encodeParticlesDeletedSince(quint64& sinceSequence, unsigned char* packetData, size_t maxLength,
+                                     size_t& outputLength);
+    void forgetParticlesDeletedBefore(quint64 sequence);
 
     void processEraseMessage(const QByteArray& dataByteArray, const HifiSockAddr& senderSockAddr, Node* sourceNode);
     void handleAddParticleResponse(const QByteArray& packet);
 
+    /// the element a particle is stored in, or NULL if the tree doesn't have the particle. The elements keep this index
+    /// up to date as particles are stored, moved and removed, so finding a particle by ID doesn't search the tree.
+    ParticleTreeElement* getContainingElement(uint32_t particleID) const { return _particleToElementMap.value(particleID); }
+    void setContainingElement(uint32_t particleID, ParticleTreeElement* element);
+
+    /// forgets where the particle is, if it was indexed as being in the given element
+    void resetContainingElement(uint32_t particleID, ParticleTreeElement* element);
+
 private:
 
-    static bool updateOperation(OctreeElement* element, void* extraData);
-    static bool findAndUpdateOperation(OctreeElement* element, void* extraData);
+    static bool gatherSimulationElementsOperation(OctreeElement* element, void* extraData);
     static bool findAndUpdateWithIDandPropertiesOperation(OctreeElement* element, void* extraData);
     static bool findNearPointOperation(OctreeElement* element, void* extraData);
     static bool findInSphereOperation(OctreeElement* element, void* extraData);
     static bool pruneOperation(OctreeElement* element, void* extraData);
-    static bool findByIDOperation(OctreeElement* element, void* extraData);
-    static bool findAndDeleteOperation(OctreeElement* element, void* extraData);
     static bool findAndUpdateParticleIDOperation(OctreeElement* element, void* extraData);
 
     void notifyNewlyCreatedParticle(const Particle& newParticle, Node* senderNode);
@@ -89,7 +110,15 @@ private:
 
 
     QReadWriteLock _recentlyDeletedParticlesLock;
-    QMultiMap<quint64, uint32_t> _recentlyDeletedParticleIDs;
+    DeletedParticleLog _recentlyDeletedParticles;
+
+    // the particle ID index, see getContainingElement()
+    // TODO: particles are still stored as QList<Particle> values in their elements. Keeping their hot state (position,
+    // velocity, radius, lifetime) in contiguous arrays, with the elements holding slots into them, would make the
+    // simulation a tight loop, and this index would map IDs to slots.
+    QHash<uint32_t, ParticleTreeElement*> _particleToElementMap;
+
+    QThreadPool _simulationThreadPool;
 };
 
 #endif /* defined(__hifi__ParticleTree__) */
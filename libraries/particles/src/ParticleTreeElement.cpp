@@ -6,17 +6,24 @@
 //  Copyright (c) 2013 HighFidelity, Inc. All rights reserved.
 //
 
+#include <algorithm>
+
 #include <GeometryUtil.h>
 
 #include "ParticleTree.h"
 #include "ParticleTreeElement.h"
 
-ParticleTreeElement::ParticleTreeElement(unsigned char* octalCode) : OctreeElement(), _particles(NULL) {
+ParticleTreeElement::ParticleTreeElement(unsigned char* octalCode) : OctreeElement(), _myTree(NULL), _particles(NULL) {
     init(octalCode);
 };
 
 ParticleTreeElement::~ParticleTreeElement() {
     _voxelMemoryUsage -= sizeof(ParticleTreeElement);
+    if (_myTree) {
+        foreach (const Particle& particle, *_particles) {
+            _myTree->resetContainingElement(particle.getID(), this);
+        }
+    }
     delete _particles;
     _particles = NULL;
 }
@@ -63,20 +70,28 @@ bool ParticleTreeElement::appendElementData(OctreePacketData* packetData) const
     return success;
 }
 
-void ParticleTreeElement::update(ParticleTreeUpdateArgs& args) {
-    markWithChangedTime();
+void ParticleTreeElement::runParticleUpdateScripts() {
+    QList<Particle>::iterator particleItr = _particles->begin();
+    while (particleItr != _particles->end()) {
+        particleItr->runUpdateScripts();
+        ++particleItr;
+    }
+}
+
+void ParticleTreeElement::updateParticles(ParticleTreeUpdateArgs& args, quint64 now, bool runScripts) {
     // TODO: early exit when _particles is empty
 
     // update our contained particles
     QList<Particle>::iterator particleItr = _particles->begin();
     while(particleItr != _particles->end()) {
         Particle& particle = (*particleItr);
-        particle.update(_lastChanged);
+        particle.update(now, runScripts);
 
         // If the particle wants to die, or if it's left our bounding box, then move it
         // into the arguments moving particles. These will be added back or deleted completely
         if (particle.getShouldDie() || !_box.contains(particle.getPosition())) {
             args._movingParticles.push_back(particle);
+            args._movedFromElements.push_back(this);
 
             // erase this particle
             particleItr = _particles->erase(particleItr);
@@ -191,6 +206,7 @@ bool ParticleTreeElement::updateParticle(const ParticleID& particleID, const Par
 }
 
 void ParticleTreeElement::updateParticleID(FindAndUpdateParticleIDArgs* args) {
+    bool foundCreatorTokenHere = false;
     uint16_t numberOfParticles = _particles->size();
     for (uint16_t i = 0; i < numberOfParticles; i++) {
         Particle& thisParticle = (*_particles)[i];
@@ -198,14 +214,17 @@ void ParticleTreeElement::updateParticleID(FindAndUpdateParticleIDArgs* args) {
         if (!args->creatorTokenFound) {
             // first, we're looking for matching creatorTokenIDs, if we find that, then we fix it to know the actual ID
             if (thisParticle.getCreatorTokenID() == args->creatorTokenID) {
+                _myTree->resetContainingElement(thisParticle.getID(), this);
                 thisParticle.setID(args->particleID);
                 args->creatorTokenFound = true;
+                foundCreatorTokenHere = true;
             }
         }
         
         // if we're in an isViewing tree, we also need to look for an kill any viewed particles
         if (!args->viewedParticleFound && args->isViewing) {
             if (thisParticle.getCreatorTokenID() == UNKNOWN_TOKEN && thisParticle.getID() == args->particleID) {
+                _myTree->resetContainingElement(args->particleID, this);
                 _particles->removeAt(i); // remove the particle at this index
                 numberOfParticles--; // this means we have 1 fewer particle in this list
                 i--; // and we actually want to back up i as well.
@@ -213,10 +232,38 @@ void ParticleTreeElement::updateParticleID(FindAndUpdateParticleIDArgs* args) {
             }
         }
     }
+
+    // index the particle under its actual ID now, after any viewed copy of it has been taken out of the index
+    if (foundCreatorTokenHere) {
+        _myTree->setContainingElement(args->particleID, this);
+    }
 }
 
 
 
+float ParticleTreeElement::getSpatialItemDistance(int index, const glm::vec3& point) const {
+    const Particle& particle = (*_particles)[index];
+    return std::max(0.0f, glm::distance(point, particle.getPosition()) - particle.getRadius());
+}
+
+bool ParticleTreeElement::spatialItemTouches(int index, const AABox& box) const {
+    const Particle& particle = (*_particles)[index];
+    float radius = particle.getRadius();
+    AABox particleBox(particle.getPosition() - glm::vec3(radius, radius, radius), radius * 2.0f);
+    return particleBox.touches(box);
+}
+
+bool ParticleTreeElement::findSpatialItemRayIntersection(int index, const glm::vec3& origin, const glm::vec3& direction,
+                                                        float& distance) const {
+    const Particle& particle = (*_particles)[index];
+    return findRaySphereIntersection(origin, direction, particle.getPosition(), particle.getRadius(), distance);
+}
+
+ViewFrustum::location ParticleTreeElement::spatialItemInFrustum(int index, const ViewFrustum& viewFrustum) const {
+    const Particle& particle = (*_particles)[index];
+    return viewFrustum.sphereInFrustum(particle.getPosition() * (float)TREE_SCALE, particle.getRadius() * (float)TREE_SCALE);
+}
+
 const Particle* ParticleTreeElement::getClosestParticle(glm::vec3 position) const {
     const Particle* closestParticle = NULL;
     float closestParticleDistance = FLT_MAX;
@@ -261,7 +308,7 @@ void ParticleTreeElement::getParticlesForUpdate(const AABox& box, QVector<Partic
 }
 
 const Particle* ParticleTreeElement::getParticleWithID(uint32_t id) const {
-    // NOTE: this lookup is O(N) but maybe we don't care? (guaranteed that num particles per elemen is small?)
+    // NOTE: this lookup is O(N) in the particles of this element, the tree's index finds the element
     const Particle* foundParticle = NULL;
     uint16_t numberOfParticles = _particles->size();
     for (uint16_t i = 0; i < numberOfParticles; i++) {
@@ -280,6 +327,7 @@ bool ParticleTreeElement::removeParticleWithID(uint32_t id) {
         if ((*_particles)[i].getID() == id) {
             foundParticle = true;
             _particles->removeAt(i);
+            _myTree->resetContainingElement(id, this);
             break;
         }
     }
@@ -317,6 +365,16 @@ int ParticleTreeElement::readElementDataFromBuffer(const unsigned char* data, in
     return bytesRead;
 }
 
+quint64 ParticleTreeElement::hashElementData() const {
+    quint64 hash = 0;
+    for (int i = 0; i < _particles->size(); i++) {
+        const Particle& particle = (*_particles)[i];
+        hash = combineHashes(hash, particle.getID());
+        hash = combineHashes(hash, particle.getLastEdited());
+    }
+    return hash;
+}
+
 // will average a "common reduced LOD view" from the the child elements...
 void ParticleTreeElement::calculateAverageFromChildren() {
     // nothing to do here yet...
@@ -334,6 +392,7 @@ bool ParticleTreeElement::collapseChildren() {
 
 void ParticleTreeElement::storeParticle(const Particle& particle, Node* senderNode) {
     _particles->push_back(particle);
+    _myTree->setContainingElement(particle.getID(), this);
     markWithChangedTime();
 }
 
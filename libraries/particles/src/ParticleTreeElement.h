@@ -14,6 +14,7 @@
 
 #include <OctreeElement.h>
 #include <QList>
+#include <QVector>
 
 #include "Particle.h"
 #include "ParticleTree.h"
@@ -24,6 +25,7 @@ class ParticleTreeElement;
 class ParticleTreeUpdateArgs {
 public:
     QList<Particle> _movingParticles;
+    QVector<ParticleTreeElement*> _movedFromElements;
 };
 
 class FindAndUpdateParticleIDArgs {
@@ -80,6 +82,9 @@ public:
     /// from the network.
     virtual int readElementDataFromBuffer(const unsigned char* data, int bytesLeftToRead, ReadBitstreamToTreeParams& args);
 
+    /// Hashes the IDs and edit times of this element's particles, so that trees holding the same edits hash alike.
+    virtual quint64 hashElementData() const;
+
     /// Override to indicate that the item is currently rendered in the rendering engine. By default we assume that if
     /// the element should be rendered, then your rendering engine is rendering. But some rendering engines my have cases
     /// where an element is not actually rendering all should render elements. If the isRendered() state doesn't match the
@@ -90,11 +95,25 @@ public:
     virtual bool findSpherePenetration(const glm::vec3& center, float radius,
                         glm::vec3& penetration, void** penetratedObject) const;
 
+    /// each particle is a spatial item, and may reach outside of the element by up to the element's scale
+    virtual int getSpatialItemCount() const { return _particles->size(); }
+    virtual float getSpatialItemMargin() const { return getScale(); }
+    virtual float getSpatialItemDistance(int index, const glm::vec3& point) const;
+    virtual bool spatialItemTouches(int index, const AABox& box) const;
+    virtual bool findSpatialItemRayIntersection(int index, const glm::vec3& origin, const glm::vec3& direction,
+                                                float& distance) const;
+    virtual ViewFrustum::location spatialItemInFrustum(int index, const ViewFrustum& viewFrustum) const;
+
     const QList<Particle>& getParticles() const { return *_particles; }
     QList<Particle>& getParticles() { return *_particles; }
     bool hasParticles() const { return _particles->size() > 0; }
 
-    void update(ParticleTreeUpdateArgs& args);
+    /// ages our particles and runs the update scripts of the scripted ones, before they're moved by updateParticles()
+    void runParticleUpdateScripts();
+
+    /// Moves our particles and takes out the ones that died or left our bounds, without running scripts or touching
+    /// anything outside this element, so different elements can be updated on different threads at the same time.
+    void updateParticles(ParticleTreeUpdateArgs& args, quint64 now, bool runScripts);
     void setTree(ParticleTree* tree) { _myTree = tree; }
 
     bool updateParticle(const Particle& particle);
@@ -6,15 +6,28 @@
 //  Copyright (c) 2013 HighFidelity, Inc. All rights reserved.
 //
 
+#include <algorithm>
+
+#include <ViewFrustum.h>
+
 #include "ParticlesScriptingInterface.h"
 #include "ParticleTree.h"
+#include "ParticleTreeElement.h"
 
 ParticlesScriptingInterface::ParticlesScriptingInterface() :
     _nextCreatorTokenID(0),
-    _particleTree(NULL)
+    _particleTree(NULL),
+    _spatialQuery(NULL)
 {
 }
 
+void ParticlesScriptingInterface::setParticleTree(ParticleTree* particleTree) {
+    _particleTree = particleTree;
+
+    QMutexLocker locker(&_spatialQueryMutex);
+    _spatialQuery = OctreeSpatialQuery(particleTree);
+}
+
 
 void ParticlesScriptingInterface::queueParticleMessage(PacketType packetType,
         ParticleID particleID, const ParticleProperties& properties) {
@@ -41,6 +54,59 @@ ParticleID ParticlesScriptingInterface::addParticle(const ParticleProperties& pr
     return id;
 }
 
+QVector<ParticleID> ParticlesScriptingInterface::addParticles(const QVariantList& positions, const QVariantList& radii,
+                                                              const QVariantList& colors, const QVariantList& velocities) {
+    const int COMPONENTS_PER_VECTOR = 3;
+    const int COMPONENTS_PER_COLOR = 3;
+
+    int particleCount = positions.size() / COMPONENTS_PER_VECTOR;
+    bool hasRadiusPerParticle = radii.size() >= particleCount;
+    bool hasColorPerParticle = colors.size() >= particleCount * COMPONENTS_PER_COLOR;
+    bool hasVelocities = velocities.size() >= particleCount * COMPONENTS_PER_VECTOR;
+
+    QVector<ParticleID> ids;
+    if (radii.isEmpty() || (!colors.isEmpty() && colors.size() < COMPONENTS_PER_COLOR)) {
+        return ids;
+    }
+    ids.reserve(particleCount);
+
+    QVector<ParticleProperties> allProperties(particleCount);
+    for (int i = 0; i < particleCount; i++) {
+        ParticleProperties& properties = allProperties[i];
+        int vector = i * COMPONENTS_PER_VECTOR;
+        properties.setPosition(glm::vec3(positions.at(vector).toFloat(), positions.at(vector + 1).toFloat(),
+                                         positions.at(vector + 2).toFloat()));
+        properties.setRadius(radii.at(hasRadiusPerParticle ? i : 0).toFloat());
+        if (!colors.isEmpty()) {
+            int color = hasColorPerParticle ? i * COMPONENTS_PER_COLOR : 0;
+            xColor particleColor;
+            particleColor.red = colors.at(color).toInt();
+            particleColor.green = colors.at(color + 1).toInt();
+            particleColor.blue = colors.at(color + 2).toInt();
+            properties.setColor(particleColor);
+        }
+        if (hasVelocities) {
+            properties.setVelocity(glm::vec3(velocities.at(vector).toFloat(), velocities.at(vector + 1).toFloat(),
+                                             velocities.at(vector + 2).toFloat()));
+        }
+
+        ParticleID id(NEW_PARTICLE, Particle::getNextCreatorTokenID(), false);
+        queueParticleMessage(PacketTypeParticleAddOrEdit, id, properties);
+        ids.append(id);
+    }
+
+    // If we have a local particle tree set, then also update it, under one lock for all of them
+    if (_particleTree) {
+        _particleTree->lockForWrite();
+        for (int i = 0; i < particleCount; i++) {
+            _particleTree->addParticle(ids[i], allProperties[i]);
+        }
+        _particleTree->unlock();
+    }
+
+    return ids;
+}
+
 ParticleID ParticlesScriptingInterface::identifyParticle(ParticleID particleID) {
     uint32_t actualID = particleID.id;
 
@@ -171,3 +237,86 @@ QVector<ParticleID> ParticlesScriptingInterface::findParticles(const glm::vec3&
     return result;
 }
 
+QVector<ParticleID> ParticlesScriptingInterface::particleIDsForResults(const QVector<SpatialQueryResult>& results) const {
+    QVector<ParticleID> result;
+    result.reserve(results.size());
+    foreach (const SpatialQueryResult& found, results) {
+        if (found.element) {
+            const Particle& particle = static_cast<ParticleTreeElement*>(found.element)->getParticles().at(found.item);
+            result << ParticleID(particle.getID(), UNKNOWN_TOKEN, true);
+        } else {
+            result << ParticleID(UNKNOWN_PARTICLE_ID, UNKNOWN_TOKEN, false);
+        }
+    }
+    return result;
+}
+
+QVector<ParticleID> ParticlesScriptingInterface::findNearestParticles(const glm::vec3& center, int count, float maxDistance) {
+    QVector<ParticleID> result;
+    if (_particleTree) {
+        QMutexLocker locker(&_spatialQueryMutex);
+        _particleTree->lockForRead();
+        result = particleIDsForResults(_spatialQuery.findNearest(center / (float)TREE_SCALE, count,
+                                                                 maxDistance / (float)TREE_SCALE));
+        _particleTree->unlock();
+    }
+    return result;
+}
+
+QVector<ParticleID> ParticlesScriptingInterface::findParticlesInBox(const glm::vec3& corner, float scale) {
+    QVector<ParticleID> result;
+    if (_particleTree) {
+        QMutexLocker locker(&_spatialQueryMutex);
+        _particleTree->lockForRead();
+        result = particleIDsForResults(_spatialQuery.findInBox(AABox(corner / (float)TREE_SCALE, scale / (float)TREE_SCALE)));
+        _particleTree->unlock();
+    }
+    return result;
+}
+
+QVector<ParticleID> ParticlesScriptingInterface::findParticlesInFrustum(const glm::vec3& position, const glm::quat& orientation,
+                                                                        float fieldOfView, float aspectRatio,
+                                                                        float nearClip, float farClip) {
+    QVector<ParticleID> result;
+    if (_particleTree) {
+        ViewFrustum viewFrustum;
+        viewFrustum.setPosition(position);
+        viewFrustum.setOrientation(orientation);
+        viewFrustum.setFieldOfView(fieldOfView);
+        viewFrustum.setAspectRatio(aspectRatio);
+        viewFrustum.setNearClip(nearClip);
+        viewFrustum.setFarClip(farClip);
+        viewFrustum.calculate();
+
+        QMutexLocker locker(&_spatialQueryMutex);
+        _particleTree->lockForRead();
+        result = particleIDsForResults(_spatialQuery.findInView(viewFrustum));
+        _particleTree->unlock();
+    }
+    return result;
+}
+
+QVector<ParticleID> ParticlesScriptingInterface::findRayIntersections(const QVariantList& origins,
+                                                                      const QVariantList& directions) {
+    const int COMPONENTS_PER_VECTOR = 3;
+
+    QVector<ParticleID> result;
+    if (_particleTree) {
+        int rayCount = std::min(origins.size(), directions.size()) / COMPONENTS_PER_VECTOR;
+        QVector<glm::vec3> rayOrigins(rayCount);
+        QVector<glm::vec3> rayDirections(rayCount);
+        for (int i = 0; i < rayCount; i++) {
+            int vector = i * COMPONENTS_PER_VECTOR;
+            rayOrigins[i] = glm::vec3(origins.at(vector).toFloat(), origins.at(vector + 1).toFloat(),
+                                      origins.at(vector + 2).toFloat()) / (float)TREE_SCALE;
+            rayDirections[i] = glm::normalize(glm::vec3(directions.at(vector).toFloat(), directions.at(vector + 1).toFloat(),
+                                                        directions.at(vector + 2).toFloat()));
+        }
+
+        QMutexLocker locker(&_spatialQueryMutex);
+        _particleTree->lockForRead();
+        result = particleIDsForResults(_spatialQuery.findRayIntersections(rayOrigins, rayDirections));
+        _particleTree->unlock();
+    }
+    return result;
+}
@@ -9,9 +9,12 @@
 #ifndef __hifi__ParticlesScriptingInterface__
 #define __hifi__ParticlesScriptingInterface__
 
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
+#include <QtCore/QVariantList>
 
 #include <OctreeScriptingInterface.h>
+#include <OctreeSpatialQuery.h>
 #include "ParticleEditPacketSender.h"
 
 /// handles scripting of Particle commands from JS passed to assigned clients
@@ -24,13 +27,22 @@ public:
     virtual NodeType_t getServerNodeType() const { return NodeType::ParticleServer; }
     virtual OctreeEditPacketSender* createPacketSender() { return new ParticleEditPacketSender(); }
 
-    void setParticleTree(ParticleTree* particleTree) { _particleTree = particleTree; }
+    void setParticleTree(ParticleTree* particleTree);
     ParticleTree* getParticleTree(ParticleTree*) { return _particleTree; }
 
 public slots:
     /// adds a particle with the specific properties
     ParticleID addParticle(const ParticleProperties& properties);
 
+    /// adds many particles in one call, each with the default properties except for the ones given
+    /// \param positions the x, y, z coordinates of each particle one after another (in meter units)
+    /// \param radii the radius of each particle, or a single radius for all of them (in meter units)
+    /// \param colors the red, green, blue values of each particle one after another, or a single color for all of them, or
+    /// empty for the default color
+    /// \param velocities the x, y, z velocity of each particle one after another, or empty for no velocity (in meter units)
+    QVector<ParticleID> addParticles(const QVariantList& positions, const QVariantList& radii, const QVariantList& colors,
+                                     const QVariantList& velocities);
+
     /// identify a recently created particle to determine its true ID
     ParticleID identifyParticle(ParticleID particleID);
 
@@ -54,6 +66,28 @@ public slots:
     /// this function will not find any particles in script engine contexts which don't have access to particles
     QVector<ParticleID> findParticles(const glm::vec3& center, float radius) const;
 
+    /// finds up to count particles closest to the center point, closest first, no farther than maxDistance from it
+    /// (in meter units, measured to the surface of the particles)
+    /// this function will not find any particles in script engine contexts which don't have access to particles
+    QVector<ParticleID> findNearestParticles(const glm::vec3& center, int count, float maxDistance);
+
+    /// finds particles that touch the cube with the given corner and scale (in meter units)
+    /// this function will not find any particles in script engine contexts which don't have access to particles
+    QVector<ParticleID> findParticlesInBox(const glm::vec3& corner, float scale);
+
+    /// finds particles that are at least partly in the view of a camera with the given position and orientation,
+    /// field of view in degrees, and near and far clip distances (in meter units)
+    /// this function will not find any particles in script engine contexts which don't have access to particles
+    QVector<ParticleID> findParticlesInFrustum(const glm::vec3& position, const glm::quat& orientation, float fieldOfView,
+                                               float aspectRatio, float nearClip, float farClip);
+
+    /// finds the first particle each of many rays hits, one ParticleID per ray in the order of the rays, with
+    /// ParticleID.isKnownID = false for rays that hit nothing
+    /// \param origins the x, y, z coordinates of each ray's origin one after another (in meter units)
+    /// \param directions the x, y, z of each ray's direction one after another
+    /// this function will not find any particles in script engine contexts which don't have access to particles
+    QVector<ParticleID> findRayIntersections(const QVariantList& origins, const QVariantList& directions);
+
     /// inbound slots for external collision systems
     void forwardParticleCollisionWithVoxel(const ParticleID& particleID, const VoxelDetail& voxel) {
         emit particleCollisionWithVoxel(particleID, voxel);
@@ -69,9 +103,14 @@ signals:
 
 private:
     void queueParticleMessage(PacketType packetType, ParticleID particleID, const ParticleProperties& properties);
+    QVector<ParticleID> particleIDsForResults(const QVector<SpatialQueryResult>& results) const;
 
     uint32_t _nextCreatorTokenID;
     ParticleTree* _particleTree;
+
+    // the scripting interface is shared by every script engine, so the query's buffers are guarded by their own lock
+    OctreeSpatialQuery _spatialQuery;
+    QMutex _spatialQueryMutex;
 };
 
 #endif /* defined(__hifi__ParticlesScriptingInterface__) */
@@ -6,6 +6,9 @@
 //  Copyright (c) 2013 HighFidelity, Inc. All rights reserved.
 //
 
+#include <algorithm>
+
+#include <QtCore/QAbstractEventDispatcher>
 #include <QtCore/QCoreApplication>
 #include <QtCore/QEventLoop>
 #include <QtCore/QTimer>
@@ -15,6 +18,7 @@
 #include <QtNetwork/QNetworkReply>
 
 #include <AvatarData.h>
+#include <FrameScheduler.h>
 #include <NodeList.h>
 #include <PacketHeaders.h>
 #include <UUID.h>
@@ -26,8 +30,6 @@
 
 #include "ScriptEngine.h"
 
-const unsigned int VISUAL_DATA_CALLBACK_USECS = (1.0 / 60.0) * 1000 * 1000;
-
 int ScriptEngine::_scriptNumber = 1;
 VoxelsScriptingInterface ScriptEngine::_voxelsScriptingInterface;
 ParticlesScriptingInterface ScriptEngine::_particlesScriptingInterface;
@@ -45,7 +47,12 @@ ScriptEngine::ScriptEngine(const QString& scriptContents, bool wantMenuItems, co
                            AbstractControllerScriptingInterface* controllerScriptingInterface) :
     _isAvatar(false),
     _dataServerScriptingInterface(),
-    _avatarData(NULL)
+    _avatarData(NULL),
+    _releasesEditMessages(true),
+    _isEventDriven(true),
+    _busyUsecs(0),
+    _idleUsecs(0),
+    _blockedAt(0)
 {
     _scriptContents = scriptContents;
     _isFinished = false;
@@ -174,29 +181,38 @@ void ScriptEngine::evaluate() {
 }
 
 void ScriptEngine::run() {
-    if (!_isInitialized) {
-        init();
-    }
-    _isRunning = true;
+    quint64 startedAt = usecTimestampNow();
+    start();
 
-    QScriptValue result = _engine.evaluate(_scriptContents);
-    if (_engine.hasUncaughtException()) {
-        int line = _engine.uncaughtExceptionLineNumber();
-        qDebug() << "Uncaught exception at line" << line << ":" << result.toString();
+    // the visual data callback runs back to back until it has caught up on frames missed by a slow script
+    FrameScheduler frameScheduler("ScriptEngine", VISUAL_DATA_CALLBACK_USECS, FrameScheduler::CatchUpOverruns);
+    frameScheduler.start();
+
+    if (_isEventDriven) {
+        runEventDriven(frameScheduler);
+    } else {
+        runFixedInterval(frameScheduler);
     }
 
-    timeval startTime;
-    gettimeofday(&startTime, NULL);
+    frameScheduler.printStats();
+    finish();
 
-    int thisFrame = 0;
-    
-    NodeList* nodeList = NodeList::getInstance();
+    quint64 elapsed = usecTimestampNow() - startedAt;
+    _busyUsecs = elapsed - std::min(_idleUsecs, elapsed);
+    qDebug() << "Script" << _fileNameString << "was busy for" << _busyUsecs << "usecs and idle for" << _idleUsecs
+        << "usecs," << ((elapsed > 0) ? (100 * _busyUsecs / elapsed) : 0) << "percent busy.";
+
+    // If we were on a thread, then wait till it's done
+    if (thread()) {
+        thread()->quit();
+    }
+}
 
+void ScriptEngine::runFixedInterval(FrameScheduler& frameScheduler) {
     while (!_isFinished) {
-        int usecToSleep = usecTimestamp(&startTime) + (thisFrame++ * VISUAL_DATA_CALLBACK_USECS) - usecTimestampNow();
-        if (usecToSleep > 0) {
-            usleep(usecToSleep);
-        }
+        quint64 waitStartedAt = usecTimestampNow();
+        frameScheduler.waitForNextFrame();
+        _idleUsecs += usecTimestampNow() - waitStartedAt;
 
         if (_isFinished) {
             break;
@@ -208,51 +224,134 @@ void ScriptEngine::run() {
             break;
         }
 
-        if (_voxelsScriptingInterface.getVoxelPacketSender()->serversExist()) {
-            // release the queue of edit voxel messages.
-            _voxelsScriptingInterface.getVoxelPacketSender()->releaseQueuedMessages();
+        runFrame();
+    }
+}
+
+void ScriptEngine::runEventDriven(FrameScheduler& frameScheduler) {
+    // the dispatcher tells us when the thread is about to block waiting for events and when it wakes up, which is how
+    // the time spent idle is told apart from the time spent running the script
+    QAbstractEventDispatcher* dispatcher = QAbstractEventDispatcher::instance();
+    connect(dispatcher, SIGNAL(aboutToBlock()), this, SLOT(eventLoopAboutToBlock()), Qt::DirectConnection);
+    connect(dispatcher, SIGNAL(awake()), this, SLOT(eventLoopAwake()), Qt::DirectConnection);
+
+    // wakes the event loop when the next frame is due
+    QTimer frameTimer;
+    frameTimer.setSingleShot(true);
+    frameTimer.setTimerType(Qt::PreciseTimer);
 
-            // since we're in non-threaded mode, call process so that the packets are sent
-            if (!_voxelsScriptingInterface.getVoxelPacketSender()->isThreaded()) {
-                _voxelsScriptingInterface.getVoxelPacketSender()->process();
+    while (!_isFinished) {
+        bool wantsFrames = wantsVisualDataFrames();
+
+        if (!wantsFrames) {
+            // nothing to pace, sleep until a timer fires or something arrives, or the senders can send more
+            frameScheduler.idle();
+            if (_releasesEditMessages && hasEditPacketsToSend()) {
+                frameTimer.start(VISUAL_DATA_CALLBACK_USECS / 1000);
+            }
+            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+
+            // there's no frame coming to release what the script's timers and callbacks queued, so do it now
+            if (!_isFinished && _releasesEditMessages) {
+                releaseEditMessages();
             }
+            continue;
         }
 
-        if (_particlesScriptingInterface.getParticlePacketSender()->serversExist()) {
-            // release the queue of edit voxel messages.
-            _particlesScriptingInterface.getParticlePacketSender()->releaseQueuedMessages();
+        quint64 usecsUntilNextFrame = frameScheduler.getUsecsUntilNextFrame();
+        if (usecsUntilNextFrame > 0) {
+            frameTimer.start((usecsUntilNextFrame + 999) / 1000);
+            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+        } else {
+            // a frame is due now, handle what has arrived without waiting for more
+            QCoreApplication::processEvents();
+        }
 
-            // since we're in non-threaded mode, call process so that the packets are sent
-            if (!_particlesScriptingInterface.getParticlePacketSender()->isThreaded()) {
-                _particlesScriptingInterface.getParticlePacketSender()->process();
-            }
+        if (_isFinished) {
+            break;
         }
-        
-        if (_isAvatar && _avatarData) {
-            static QByteArray avatarPacket;
-            int numAvatarHeaderBytes = 0;
-            
-            if (avatarPacket.size() == 0) {
-                // pack the avatar header bytes the first time
-                // unlike the _avatar.getBroadcastData these won't change
-                numAvatarHeaderBytes = populatePacketHeader(avatarPacket, PacketTypeAvatarData);
-            }
-            
-            avatarPacket.resize(numAvatarHeaderBytes);
-            avatarPacket.append(_avatarData->toByteArray());
-            
-            nodeList->broadcastToNodes(avatarPacket, NodeSet() << NodeType::AvatarMixer);
+
+        // the events may have been a packet rather than the frame timer, in which case the frame isn't due yet
+        if (frameScheduler.startFrameIfDue()) {
+            runFrame();
         }
+    }
+
+    disconnect(dispatcher, SIGNAL(aboutToBlock()), this, SLOT(eventLoopAboutToBlock()));
+    disconnect(dispatcher, SIGNAL(awake()), this, SLOT(eventLoopAwake()));
+}
+
+bool ScriptEngine::wantsVisualDataFrames() {
+    return (_isAvatar && _avatarData) || receivers(SIGNAL(willSendVisualDataCallback())) > 0;
+}
+
+void ScriptEngine::eventLoopAboutToBlock() {
+    _blockedAt = usecTimestampNow();
+}
+
+void ScriptEngine::eventLoopAwake() {
+    if (_blockedAt != 0) {
+        _idleUsecs += usecTimestampNow() - _blockedAt;
+        _blockedAt = 0;
+    }
+}
+
+void ScriptEngine::start() {
+    if (!_isInitialized) {
+        init();
+    }
+    _isRunning = true;
+
+    QScriptValue result = _engine.evaluate(_scriptContents);
+    if (_engine.hasUncaughtException()) {
+        int line = _engine.uncaughtExceptionLineNumber();
+        qDebug() << "Uncaught exception at line" << line << ":" << result.toString();
+    }
+}
 
-        emit willSendVisualDataCallback();
+void ScriptEngine::runFrame() {
+    if (_releasesEditMessages) {
+        releaseEditMessages();
+    }
+
+    if (_isAvatar && _avatarData) {
+        int numAvatarHeaderBytes = 0;
 
-        if (_engine.hasUncaughtException()) {
-            int line = _engine.uncaughtExceptionLineNumber();
-            qDebug() << "Uncaught exception at line" << line << ":" << _engine.uncaughtException().toString();
+        if (_avatarPacket.size() == 0) {
+            // pack the avatar header bytes the first time
+            // unlike the _avatar.getBroadcastData these won't change
+            numAvatarHeaderBytes = populatePacketHeader(_avatarPacket, PacketTypeAvatarData);
         }
+
+        _avatarPacket.resize(numAvatarHeaderBytes);
+        _avatarPacket.append(_avatarData->toByteArray());
+
+        NodeList::getInstance()->broadcastToNodes(_avatarPacket, NodeSet() << NodeType::AvatarMixer);
+    }
+
+    emit willSendVisualDataCallback();
+
+    if (_engine.hasUncaughtException()) {
+        int line = _engine.uncaughtExceptionLineNumber();
+        qDebug() << "Uncaught exception at line" << line << ":" << _engine.uncaughtException().toString();
     }
+}
+
+void ScriptEngine::finish() {
     emit scriptEnding();
-    
+
+    if (_releasesEditMessages) {
+        releaseEditMessages();
+    }
+
+    cleanMenuItems();
+
+    emit finished(_fileNameString);
+
+    _isRunning = false;
+}
+
+void ScriptEngine::releaseEditMessages() {
     if (_voxelsScriptingInterface.getVoxelPacketSender()->serversExist()) {
         // release the queue of edit voxel messages.
         _voxelsScriptingInterface.getVoxelPacketSender()->releaseQueuedMessages();
@@ -272,21 +371,23 @@ void ScriptEngine::run() {
             _particlesScriptingInterface.getParticlePacketSender()->process();
         }
     }
-    
-    cleanMenuItems();
-
-    // If we were on a thread, then wait till it's done
-    if (thread()) {
-        thread()->quit();
-    }
+}
 
-    emit finished(_fileNameString);
-    
-    _isRunning = false;
+bool ScriptEngine::hasEditPacketsToSend() {
+    return (!_voxelsScriptingInterface.getVoxelPacketSender()->isThreaded()
+            && _voxelsScriptingInterface.getVoxelPacketSender()->hasPacketsToSend())
+        || (!_particlesScriptingInterface.getParticlePacketSender()->isThreaded()
+            && _particlesScriptingInterface.getParticlePacketSender()->hasPacketsToSend());
 }
 
 void ScriptEngine::stop() {
     _isFinished = true;
+
+    // an event driven engine may be blocked waiting for events on its thread
+    QAbstractEventDispatcher* dispatcher = QAbstractEventDispatcher::instance(thread());
+    if (dispatcher) {
+        dispatcher->wakeUp();
+    }
 }
 
 void ScriptEngine::timerFired() {
@@ -329,6 +430,12 @@ QObject* ScriptEngine::setTimeout(const QScriptValue& function, int timeoutMS) {
     return setupTimerWithInterval(function, timeoutMS, true);
 }
 
+void ScriptEngine::stopAllTimers() {
+    foreach (QTimer* timer, _timerFunctionMap.keys()) {
+        stopTimer(timer);
+    }
+}
+
 void ScriptEngine::stopTimer(QTimer *timer) {
     if (_timerFunctionMap.contains(timer)) {
         timer->stop();
@@ -21,6 +21,7 @@
 
 #include <AvatarData.h>
 
+class FrameScheduler;
 class ParticlesScriptingInterface;
 
 #include "AbstractControllerScriptingInterface.h"
@@ -29,6 +30,8 @@ class ParticlesScriptingInterface;
 
 const QString NO_SCRIPT("");
 
+const unsigned int VISUAL_DATA_CALLBACK_USECS = (1.0 / 60.0) * 1000 * 1000;
+
 class ScriptEngine : public QObject {
     Q_OBJECT
 public:
@@ -63,9 +66,46 @@ public:
     void init();
     void run(); /// runs continuously until Agent.stop() is called
     void evaluate(); /// initializes the engine, and evaluates the script, but then returns control to caller
+
+    /// Evaluates the script like run() does, but returns so that the caller can drive the engine with runFrame(). Used
+    /// by hosts that run many engines on a few threads.
+    void start();
+
+    /// Runs one visual data frame: sends the avatar and fires willSendVisualDataCallback. The caller processes the events
+    /// of the engine's thread, which is where the script's timers fire.
+    void runFrame();
+
+    /// fires scriptEnding and flushes the edits the script left queued, call once runFrame() is done with the engine
+    void finish();
+
+    bool isFinished() const { return _isFinished; }
+
+    /// Event driven engines block in run() until a timer is due, a packet or other event arrives, or a visual data frame
+    /// is due, and only run frames while the script listens for willSendVisualDataCallback or sends an avatar. Engines
+    /// that aren't event driven wake up for every frame. Event driven by default.
+    void setIsEventDriven(bool isEventDriven) { _isEventDriven = isEventDriven; }
+    bool isEventDriven() const { return _isEventDriven; }
+
+    /// the time run() spent running the script, known once it returns, and the time it has spent waiting for something
+    /// to do
+    quint64 getBusyUsecs() const { return _busyUsecs; }
+    quint64 getIdleUsecs() const { return _idleUsecs; }
+
+    /// Set to false when something else releases the queued edit messages of the shared edit senders, e.g. a host
+    /// that runs many engines and releases them once per frame for all of them.
+    void setReleasesEditMessages(bool releasesEditMessages) { _releasesEditMessages = releasesEditMessages; }
+
+    /// releases the queued messages of the voxel and particle edit senders and, if they're not threaded, sends them
+    static void releaseEditMessages();
+
+    /// whether a sender that isn't threaded has packets its rate limit held back, which only go out when it's called again
+    static bool hasEditPacketsToSend();
     
     void timerFired();
 
+    /// stops and forgets every timer the script has set up, for engines that only run the script in short calls
+    void stopAllTimers();
+
 public slots:
     void stop();
     
@@ -89,7 +129,17 @@ protected:
     bool _isAvatar;
     QHash<QTimer*, QScriptValue> _timerFunctionMap;
 
+private slots:
+    void eventLoopAboutToBlock();
+    void eventLoopAwake();
+
 private:
+    void runFixedInterval(FrameScheduler& frameScheduler);
+    void runEventDriven(FrameScheduler& frameScheduler);
+
+    /// true if there's something to do every frame: a script listening for willSendVisualDataCallback or an avatar
+    bool wantsVisualDataFrames();
+
     QObject* setupTimerWithInterval(const QScriptValue& function, int intervalMS, bool isSingleShot);
     void stopTimer(QTimer* timer);
     
@@ -99,6 +149,12 @@ private:
     AudioScriptingInterface _audioScriptingInterface;
     DataServerScriptingInterface _dataServerScriptingInterface;
     AvatarData* _avatarData;
+    QByteArray _avatarPacket;
+    bool _releasesEditMessages;
+    bool _isEventDriven;
+    quint64 _busyUsecs;
+    quint64 _idleUsecs;
+    quint64 _blockedAt;
     bool _wantMenuItems;
     QString _scriptMenuName;
     QString _fileNameString;
@@ -0,0 +1,97 @@
+//
+//  DatagramCapture.cpp
+//  shared
+//
+//  Created on 2/4/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <QtCore/QDebug>
+
+#include "SharedUtil.h"
+#include "DatagramCapture.h"
+
+DatagramCaptureWriter::DatagramCaptureWriter(const QString& filename) :
+    _file(filename),
+    _stream(),
+    _lastRecordUsecs(usecTimestampNow()),
+    _datagramsRecorded(0)
+{
+    if (_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        _stream.setDevice(&_file);
+        _stream << DATAGRAM_CAPTURE_MAGIC << DATAGRAM_CAPTURE_VERSION << _lastRecordUsecs;
+        qDebug() << "Capturing inbound datagrams to" << filename;
+    } else {
+        qDebug() << "Could not open" << filename << "for datagram capture -" << _file.errorString();
+    }
+}
+
+DatagramCaptureWriter::~DatagramCaptureWriter() {
+    if (_file.isOpen()) {
+        _file.close();
+        qDebug() << "Datagram capture closed after" << _datagramsRecorded << "datagrams.";
+    }
+}
+
+void DatagramCaptureWriter::recordDatagram(const QByteArray& datagram, const HifiSockAddr& senderSockAddr) {
+    if (!_file.isOpen()) {
+        return;
+    }
+
+    quint64 now = usecTimestampNow();
+    quint64 usecsSinceLastRecord = (now > _lastRecordUsecs) ? now - _lastRecordUsecs : 0;
+    _lastRecordUsecs = now;
+
+    _stream << usecsSinceLastRecord << (quint32) senderSockAddr.getAddress().toIPv4Address()
+        << senderSockAddr.getPort() << (quint16) datagram.size();
+    _stream.writeRawData(datagram.constData(), datagram.size());
+
+    _datagramsRecorded++;
+}
+
+DatagramCaptureReader::DatagramCaptureReader(const QString& filename) :
+    _file(filename),
+    _stream(),
+    _captureStartUsecs(0),
+    _usecsSinceStart(0)
+{
+    if (!_file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Could not open datagram capture" << filename << "-" << _file.errorString();
+        return;
+    }
+
+    _stream.setDevice(&_file);
+
+    quint32 magic = 0;
+    quint8 version = 0;
+    _stream >> magic >> version >> _captureStartUsecs;
+
+    if (magic != DATAGRAM_CAPTURE_MAGIC || version != DATAGRAM_CAPTURE_VERSION) {
+        qDebug() << filename << "is not a datagram capture this version can read.";
+        _file.close();
+    }
+}
+
+bool DatagramCaptureReader::readNext(CapturedDatagram& captured) {
+    if (!_file.isOpen() || _stream.atEnd()) {
+        return false;
+    }
+
+    quint64 usecsSinceLastRecord;
+    quint32 senderAddress;
+    quint16 senderPort, datagramSize;
+    _stream >> usecsSinceLastRecord >> senderAddress >> senderPort >> datagramSize;
+
+    captured.datagram.resize(datagramSize);
+    if (_stream.readRawData(captured.datagram.data(), datagramSize) != datagramSize
+        || _stream.status() != QDataStream::Ok) {
+        // a capture that was cut off while the server was still running, we're done with it
+        return false;
+    }
+
+    _usecsSinceStart += usecsSinceLastRecord;
+    captured.usecsSinceStart = _usecsSinceStart;
+    captured.senderSockAddr = HifiSockAddr(QHostAddress(senderAddress), senderPort);
+
+    return true;
+}
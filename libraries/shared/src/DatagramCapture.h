@@ -0,0 +1,73 @@
+//
+//  DatagramCapture.h
+//  shared
+//
+//  Created on 2/4/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Recording of inbound datagrams to a compact file, and reading them back for replay.
+//
+//  File layout (all values big endian, as written by QDataStream):
+//      header: quint32 magic, quint8 version, quint64 capture start usecs
+//      record: quint64 usecs since previous record, quint32 sender IPv4, quint16 sender port,
+//              quint16 datagram size, datagram bytes
+//
+//  The sending node's UUID is not stored separately, it is already part of the packet header of every datagram
+//  that has one.
+//
+
+#ifndef __shared__DatagramCapture__
+#define __shared__DatagramCapture__
+
+#include <QtCore/QDataStream>
+#include <QtCore/QFile>
+
+#include "HifiSockAddr.h"
+
+const quint32 DATAGRAM_CAPTURE_MAGIC = 0x48464443; // "HFDC"
+const quint8 DATAGRAM_CAPTURE_VERSION = 2; // 1 had a quint32 gap between records, which wrapped after 71 minutes
+
+struct CapturedDatagram {
+    quint64 usecsSinceStart;
+    HifiSockAddr senderSockAddr;
+    QByteArray datagram;
+};
+
+/// Appends received datagrams and the time they arrived to a capture file.
+class DatagramCaptureWriter {
+public:
+    DatagramCaptureWriter(const QString& filename);
+    ~DatagramCaptureWriter();
+
+    bool isOpen() const { return _file.isOpen(); }
+
+    /// \thread the thread that reads the socket
+    void recordDatagram(const QByteArray& datagram, const HifiSockAddr& senderSockAddr);
+
+    quint64 getDatagramsRecorded() const { return _datagramsRecorded; }
+private:
+    QFile _file;
+    QDataStream _stream;
+    quint64 _lastRecordUsecs;
+    quint64 _datagramsRecorded;
+};
+
+/// Reads back a file written by DatagramCaptureWriter one datagram at a time.
+class DatagramCaptureReader {
+public:
+    DatagramCaptureReader(const QString& filename);
+
+    bool isOpen() const { return _file.isOpen(); }
+
+    /// reads the next datagram, returns false once the end of the capture (or a truncated record) is reached
+    bool readNext(CapturedDatagram& captured);
+
+    quint64 getCaptureStartUsecs() const { return _captureStartUsecs; }
+private:
+    QFile _file;
+    QDataStream _stream;
+    quint64 _captureStartUsecs;
+    quint64 _usecsSinceStart;
+};
+
+#endif // __shared__DatagramCapture__
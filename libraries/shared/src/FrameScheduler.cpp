@@ -0,0 +1,203 @@
+//
+//  FrameScheduler.cpp
+//  shared
+//
+//  Created on 2/5/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <time.h>
+
+#include <QtCore/QDebug>
+
+#include "SharedUtil.h"
+#include "FrameScheduler.h"
+
+const quint64 FrameScheduler::LATENESS_BUCKET_LIMITS[FrameScheduler::NUM_LATENESS_BUCKETS - 1] = {
+    50, 100, 250, 500, 1000, 2000, 5000
+};
+
+// overruns are reported at most this often per scheduler so that a loop that is behind doesn't flood the log
+const quint64 OVERRUN_REPORT_INTERVAL_USECS = 5 * USECS_PER_SECOND;
+
+FrameScheduler::FrameScheduler(const QString& name, quint64 intervalUsecs, OverrunPolicy overrunPolicy) :
+    _name(name),
+    _intervalUsecs(intervalUsecs),
+    _overrunPolicy(overrunPolicy),
+    _isStarted(false),
+    _wasIdle(false),
+    _nextDeadline(0),
+    _frames(0),
+    _overruns(0),
+    _skippedFrames(0),
+    _maxOverrunUsecs(0),
+    _totalLatenessUsecs(0),
+    _lastOverrunReport(0),
+    _overrunsSinceReport(0),
+    _worstOverrunSinceReport(0)
+{
+    memset(_latenessHistogram, 0, sizeof(_latenessHistogram));
+}
+
+void FrameScheduler::start() {
+    _isStarted = true;
+    _wasIdle = false;
+    _nextDeadline = monotonicUsecs() + _intervalUsecs;
+}
+
+bool FrameScheduler::waitForNextFrame() {
+    if (!_isStarted) {
+        start();
+    }
+
+    _frames++;
+
+    quint64 now = monotonicUsecs();
+    bool isOnSchedule = true;
+
+    if (now < _nextDeadline) {
+        sleepUntil(_nextDeadline);
+
+        quint64 wokeUp = monotonicUsecs();
+        recordLateness((wokeUp > _nextDeadline) ? wokeUp - _nextDeadline : 0);
+
+        _nextDeadline += _intervalUsecs;
+    } else if (_wasIdle) {
+        // there was nothing to pace while we were idle, so this frame is simply due now
+        _nextDeadline = now + _intervalUsecs;
+    } else {
+        isOnSchedule = false;
+        handleOverrun(now);
+    }
+
+    _wasIdle = false;
+    return isOnSchedule;
+}
+
+quint64 FrameScheduler::getUsecsUntilNextFrame() {
+    if (!_isStarted) {
+        start();
+    }
+    quint64 now = monotonicUsecs();
+    return (now < _nextDeadline) ? _nextDeadline - now : 0;
+}
+
+bool FrameScheduler::startFrameIfDue() {
+    if (!_isStarted) {
+        start();
+    }
+
+    quint64 now = monotonicUsecs();
+    if (now < _nextDeadline) {
+        return false;
+    }
+
+    _frames++;
+
+    if (_wasIdle) {
+        // there was nothing to pace while we were idle, so this frame is simply due now
+        _nextDeadline = now + _intervalUsecs;
+    } else if (now - _nextDeadline < _intervalUsecs) {
+        // woken by whatever the loop blocks on, a little after the deadline
+        recordLateness(now - _nextDeadline);
+        _nextDeadline += _intervalUsecs;
+    } else {
+        handleOverrun(now);
+    }
+
+    _wasIdle = false;
+    return true;
+}
+
+void FrameScheduler::idle() {
+    _wasIdle = true;
+}
+
+void FrameScheduler::printStats() const {
+    quint64 framesSlept = 0;
+    for (int i = 0; i < NUM_LATENESS_BUCKETS; i++) {
+        framesSlept += _latenessHistogram[i];
+    }
+
+    qDebug() << _name << "ran" << _frames << "frames of" << _intervalUsecs << "usecs," << _overruns << "overran by up to"
+        << _maxOverrunUsecs << "usecs," << _skippedFrames << "skipped.";
+
+    if (framesSlept > 0) {
+        QDebug histogramDebug = qDebug();
+        histogramDebug << "    woke up" << _totalLatenessUsecs / framesSlept << "usecs late on average -";
+        for (int i = 0; i < NUM_LATENESS_BUCKETS - 1; i++) {
+            histogramDebug << "<" << LATENESS_BUCKET_LIMITS[i] << ":" << _latenessHistogram[i];
+        }
+        histogramDebug << ">=" << LATENESS_BUCKET_LIMITS[NUM_LATENESS_BUCKETS - 2] << ":"
+            << _latenessHistogram[NUM_LATENESS_BUCKETS - 1];
+    }
+}
+
+quint64 FrameScheduler::monotonicUsecs() {
+#ifdef __linux__
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (quint64) now.tv_sec * USECS_PER_SECOND + now.tv_nsec / 1000;
+#else
+    return usecTimestampNow();
+#endif
+}
+
+void FrameScheduler::sleepUntil(quint64 deadline) {
+#ifdef __linux__
+    timespec wakeUp;
+    wakeUp.tv_sec = deadline / USECS_PER_SECOND;
+    wakeUp.tv_nsec = (deadline % USECS_PER_SECOND) * 1000;
+
+    // sleeping to an absolute time means a signal interrupting us doesn't cost us the time already slept
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeUp, NULL) == EINTR) {}
+#else
+    quint64 now = monotonicUsecs();
+    if (deadline > now) {
+        usleep(deadline - now);
+    }
+#endif
+}
+
+void FrameScheduler::recordLateness(quint64 latenessUsecs) {
+    _totalLatenessUsecs += latenessUsecs;
+
+    int bucket = 0;
+    while (bucket < NUM_LATENESS_BUCKETS - 1 && latenessUsecs >= LATENESS_BUCKET_LIMITS[bucket]) {
+        bucket++;
+    }
+    _latenessHistogram[bucket]++;
+}
+
+void FrameScheduler::handleOverrun(quint64 now) {
+    quint64 overrunUsecs = now - _nextDeadline;
+    recordOverrun(now, overrunUsecs);
+
+    if (_overrunPolicy == SkipOverruns) {
+        if (_intervalUsecs > 0) {
+            _skippedFrames += overrunUsecs / _intervalUsecs;
+        }
+        _nextDeadline = now + _intervalUsecs;
+    } else {
+        _nextDeadline += _intervalUsecs;
+    }
+}
+
+void FrameScheduler::recordOverrun(quint64 now, quint64 overrunUsecs) {
+    _overruns++;
+    _overrunsSinceReport++;
+    _maxOverrunUsecs = std::max(_maxOverrunUsecs, overrunUsecs);
+    _worstOverrunSinceReport = std::max(_worstOverrunSinceReport, overrunUsecs);
+
+    if (now - _lastOverrunReport > OVERRUN_REPORT_INTERVAL_USECS) {
+        qDebug() << _name << "overran" << _overrunsSinceReport << "frames, the worst by" << _worstOverrunSinceReport
+            << "usecs.";
+
+        _lastOverrunReport = now;
+        _overrunsSinceReport = 0;
+        _worstOverrunSinceReport = 0;
+    }
+}
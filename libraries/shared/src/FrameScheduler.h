@@ -0,0 +1,99 @@
+//
+//  FrameScheduler.h
+//  shared
+//
+//  Created on 2/5/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Paces a loop on absolute deadlines so that time spent doing the work, and time overslept, never pushes
+//  later frames back.
+//
+
+#ifndef __shared__FrameScheduler__
+#define __shared__FrameScheduler__
+
+#include <QtCore/QString>
+
+/// Paces a thread's loop to a fixed interval. Deadlines are computed from the time the scheduler was started rather
+/// than from the end of the last frame, on CLOCK_MONOTONIC with clock_nanosleep where the platform has it. Keeps
+/// count of frames that overran their deadline and a histogram of how late the thread actually woke up.
+class FrameScheduler {
+public:
+    enum OverrunPolicy {
+        CatchUpOverruns, ///< frames missed by an overrun are run back to back until the loop is on schedule again
+        SkipOverruns ///< frames missed by an overrun are dropped, the next frame is due one interval from now
+    };
+
+    /// upper bounds, in usecs, of the wake up lateness histogram buckets, the last bucket takes everything later
+    static const int NUM_LATENESS_BUCKETS = 8;
+    static const quint64 LATENESS_BUCKET_LIMITS[NUM_LATENESS_BUCKETS - 1];
+
+    FrameScheduler(const QString& name, quint64 intervalUsecs, OverrunPolicy overrunPolicy = SkipOverruns);
+
+    /// changes the interval, takes effect from the next deadline
+    void setInterval(quint64 intervalUsecs) { _intervalUsecs = intervalUsecs; }
+    quint64 getInterval() const { return _intervalUsecs; }
+
+    /// anchors the schedule at the current time, the first frame will be due one interval from now. Called
+    /// implicitly by the first waitForNextFrame() if the loop never calls it.
+    void start();
+
+    /// Blocks until the next frame is due.
+    /// \return true if the loop was on schedule, false if the deadline had already passed and no time was slept
+    bool waitForNextFrame();
+
+    /// For loops that block on something else, e.g. an event loop, rather than in waitForNextFrame()
+    /// \return the usecs until the next frame is due, zero if it is due now
+    quint64 getUsecsUntilNextFrame();
+
+    /// For loops that block on something else, counts the frame if it is due and moves the deadline on, like
+    /// waitForNextFrame() does once it has slept. The time the loop woke up past the deadline is counted as lateness,
+    /// and as an overrun if it's more than an interval.
+    /// \return true if the frame is due and should be run now
+    bool startFrameIfDue();
+
+    /// Tells the scheduler the loop has been idle with nothing to pace, so that the next frame is due immediately if
+    /// its deadline has passed during that time and the gap is not counted as an overrun.
+    void idle();
+
+    const QString& getName() const { return _name; }
+    quint64 getFrames() const { return _frames; }
+    quint64 getOverruns() const { return _overruns; }
+    quint64 getSkippedFrames() const { return _skippedFrames; }
+    quint64 getMaxOverrunUsecs() const { return _maxOverrunUsecs; }
+    quint64 getLatenessBucket(int bucket) const { return _latenessHistogram[bucket]; }
+
+    /// prints frame, overrun and wake up lateness stats
+    void printStats() const;
+
+    /// the time on the clock the scheduler sleeps against, which is not related to usecTimestampNow()
+    static quint64 monotonicUsecs();
+private:
+    void sleepUntil(quint64 deadline);
+    void recordLateness(quint64 latenessUsecs);
+    void recordOverrun(quint64 now, quint64 overrunUsecs);
+
+    /// moves the deadline on from a frame that started past it, according to the overrun policy
+    void handleOverrun(quint64 now);
+
+    QString _name;
+    quint64 _intervalUsecs;
+    OverrunPolicy _overrunPolicy;
+
+    bool _isStarted;
+    bool _wasIdle;
+    quint64 _nextDeadline;
+
+    quint64 _frames;
+    quint64 _overruns;
+    quint64 _skippedFrames;
+    quint64 _maxOverrunUsecs;
+    quint64 _totalLatenessUsecs;
+    quint64 _latenessHistogram[NUM_LATENESS_BUCKETS];
+
+    quint64 _lastOverrunReport;
+    quint64 _overrunsSinceReport;
+    quint64 _worstOverrunSinceReport;
+};
+
+#endif // __shared__FrameScheduler__
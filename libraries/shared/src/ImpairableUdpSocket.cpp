@@ -0,0 +1,332 @@
+//
+//  ImpairableUdpSocket.cpp
+//  shared
+//
+//  Created on 2/3/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <cstring>
+
+#include <QtCore/QDebug>
+#include <QtCore/QStringList>
+
+#include "SharedUtil.h"
+#include "ImpairableUdpSocket.h"
+
+const int IMPAIRMENT_RELEASE_INTERVAL_MSECS = 1;
+const quint32 DEFAULT_IMPAIRMENT_SEED = 1;
+
+NetworkImpairment::NetworkImpairment() :
+    latencyUsecs(0),
+    jitterUsecs(0),
+    lossRate(0.0f),
+    reorderRate(0.0f),
+    bandwidthKbps(0)
+{
+}
+
+NetworkImpairment NetworkImpairment::fromString(const QString& spec) {
+    NetworkImpairment impairment;
+
+    foreach (const QString& pair, spec.split(',', QString::SkipEmptyParts)) {
+        QString key = pair.section('=', 0, 0).trimmed();
+        QString value = pair.section('=', 1, 1).trimmed();
+
+        if (key == "latency") {
+            impairment.latencyUsecs = value.toFloat() * USECS_PER_MSEC;
+        } else if (key == "jitter") {
+            impairment.jitterUsecs = value.toFloat() * USECS_PER_MSEC;
+        } else if (key == "loss") {
+            impairment.lossRate = value.toFloat();
+        } else if (key == "reorder") {
+            impairment.reorderRate = value.toFloat();
+        } else if (key == "kbps") {
+            impairment.bandwidthKbps = value.toInt();
+        } else {
+            qDebug() << "Ignoring unknown network impairment key" << key;
+        }
+    }
+
+    return impairment;
+}
+
+QDebug operator<<(QDebug debug, const NetworkImpairment& impairment) {
+    debug.nospace() << "latency " << impairment.latencyUsecs / USECS_PER_MSEC << "ms"
+        << " jitter " << impairment.jitterUsecs / USECS_PER_MSEC << "ms"
+        << " loss " << impairment.lossRate
+        << " reorder " << impairment.reorderRate
+        << " kbps " << impairment.bandwidthKbps;
+    return debug.space();
+}
+
+ImpairableUdpSocket::ImpairableUdpSocket(QObject* parent) :
+    QUdpSocket(parent),
+    _isImpaired(false),
+    _defaultImpairment(),
+    _peerImpairments(),
+    _impairmentMutex(),
+    _randomState(DEFAULT_IMPAIRMENT_SEED),
+    _outbound(),
+    _inbound(),
+    _outboundLinks(),
+    _inboundLinks(),
+    _releaseTimer(new QTimer(this)),
+    _writtenMutex(),
+    _datagramsWritten(0),
+    _bytesWritten(0),
+    _datagramsDropped(0),
+    _datagramsReordered(0),
+    _datagramsDelayed(0)
+{
+    connect(_releaseTimer, SIGNAL(timeout()), SLOT(releaseDueDatagrams()));
+}
+
+void ImpairableUdpSocket::parseImpairmentArguments(int argc, const char* argv[]) {
+    const char NET_IMPAIR_OPTION[] = "--netImpair";
+    const char NET_IMPAIR_PEER_OPTION[] = "--netImpairPeer";
+    const char NET_IMPAIR_SEED_OPTION[] = "--netImpairSeed";
+
+    const char* seedString = getCmdOption(argc, argv, NET_IMPAIR_SEED_OPTION);
+    if (seedString) {
+        setImpairmentSeed(atoi(seedString));
+    }
+
+    const char* defaultSpec = getCmdOption(argc, argv, NET_IMPAIR_OPTION);
+    if (defaultSpec) {
+        setDefaultImpairment(NetworkImpairment::fromString(defaultSpec));
+    }
+
+    // peer impairments look like 127.0.0.1:40102/latency=200,loss=0.1 and the option can be given more than once
+    for (int i = 0; i < argc - 1; i++) {
+        if (strcmp(argv[i], NET_IMPAIR_PEER_OPTION) == 0) {
+            QString peerSpec(argv[i + 1]);
+            QString peerAddress = peerSpec.section('/', 0, 0);
+            QString hostname = peerAddress.section(':', 0, 0);
+            quint16 port = peerAddress.section(':', 1, 1).toUShort();
+
+            if (hostname.isEmpty() || port == 0) {
+                qDebug() << "Could not parse network impairment peer" << peerSpec;
+                continue;
+            }
+
+            setPeerImpairment(HifiSockAddr(hostname, port), NetworkImpairment::fromString(peerSpec.section('/', 1)));
+        }
+    }
+}
+
+void ImpairableUdpSocket::setDefaultImpairment(const NetworkImpairment& impairment) {
+    QMutexLocker locker(&_impairmentMutex);
+    _defaultImpairment = impairment;
+    qDebug() << "Default network impairment set to" << impairment;
+    updateImpairedState();
+}
+
+void ImpairableUdpSocket::setPeerImpairment(const HifiSockAddr& peer, const NetworkImpairment& impairment) {
+    QMutexLocker locker(&_impairmentMutex);
+    _peerImpairments.insert(keyForSockAddr(peer), impairment);
+    qDebug() << "Network impairment for" << peer << "set to" << impairment;
+    updateImpairedState();
+}
+
+void ImpairableUdpSocket::setImpairmentSeed(quint32 seed) {
+    QMutexLocker locker(&_impairmentMutex);
+    // xorshift has a fixed point at zero
+    _randomState = (seed == 0) ? DEFAULT_IMPAIRMENT_SEED : seed;
+}
+
+void ImpairableUdpSocket::clearImpairments() {
+    QMutexLocker locker(&_impairmentMutex);
+    _defaultImpairment = NetworkImpairment();
+    _peerImpairments.clear();
+    updateImpairedState();
+}
+
+void ImpairableUdpSocket::updateImpairedState() {
+    bool wasImpaired = _isImpaired;
+    _isImpaired = !_defaultImpairment.isNull() || !_peerImpairments.isEmpty();
+
+    // once impairments are cleared the timer keeps running until whatever is still in flight has been delivered
+    if (_isImpaired && !wasImpaired) {
+        _releaseTimer->start(IMPAIRMENT_RELEASE_INTERVAL_MSECS);
+    }
+}
+
+quint64 ImpairableUdpSocket::keyForSockAddr(const HifiSockAddr& sockAddr) {
+    return ((quint64) sockAddr.getAddress().toIPv4Address() << 16) | sockAddr.getPort();
+}
+
+const NetworkImpairment& ImpairableUdpSocket::impairmentForPeer(quint64 peerKey) const {
+    QHash<quint64, NetworkImpairment>::const_iterator peerImpairment = _peerImpairments.constFind(peerKey);
+    return (peerImpairment != _peerImpairments.constEnd()) ? peerImpairment.value() : _defaultImpairment;
+}
+
+float ImpairableUdpSocket::randomUnit() {
+    // xorshift32 - cheap, and unlike rand() its sequence is ours alone so a given seed reproduces a given run
+    _randomState ^= _randomState << 13;
+    _randomState ^= _randomState >> 17;
+    _randomState ^= _randomState << 5;
+    return (float) _randomState / (float) 0xFFFFFFFFu;
+}
+
+void ImpairableUdpSocket::scheduleDatagram(const QByteArray& data, const HifiSockAddr& sockAddr,
+                                           DatagramSchedule& schedule, LinkStateHash& links) {
+    quint64 peerKey = keyForSockAddr(sockAddr);
+    const NetworkImpairment& impairment = impairmentForPeer(peerKey);
+    quint64 now = usecTimestampNow();
+
+    if (impairment.lossRate > 0.0f && randomUnit() < impairment.lossRate) {
+        _datagramsDropped++;
+        return;
+    }
+
+    LinkState& link = links[peerKey];
+
+    // the datagram can't start crossing the link until the previous one has been serialized onto it
+    quint64 sendTime = now;
+    if (impairment.bandwidthKbps > 0) {
+        sendTime = std::max(now, link.linkFreeUsecs);
+        const quint64 BITS_PER_BYTE = 8;
+        const quint64 BITS_PER_KILOBIT = 1000;
+        link.linkFreeUsecs = sendTime
+            + (data.size() * BITS_PER_BYTE * USECS_PER_SECOND) / (impairment.bandwidthKbps * BITS_PER_KILOBIT);
+    }
+
+    quint64 deliveryTime = sendTime + impairment.latencyUsecs;
+    if (impairment.jitterUsecs > 0) {
+        qint64 jitter = (qint64) ((randomUnit() * 2.0f - 1.0f) * impairment.jitterUsecs);
+        deliveryTime = (jitter < 0 && (quint64) -jitter > deliveryTime - now) ? now : deliveryTime + jitter;
+    }
+
+    if (impairment.reorderRate > 0.0f && randomUnit() < impairment.reorderRate) {
+        // hold this datagram back so that the ones sent after it overtake it
+        const quint64 MIN_REORDER_HOLD_USECS = 2 * USECS_PER_MSEC;
+        deliveryTime += std::max(impairment.jitterUsecs * 2, MIN_REORDER_HOLD_USECS);
+        _datagramsReordered++;
+    } else {
+        // jitter alone doesn't reorder a real link, so keep FIFO order with what has already been scheduled
+        // (strictly later, since datagrams sharing a delivery time come out of the schedule newest first)
+        if (link.lastDeliveryUsecs > 0) {
+            deliveryTime = std::max(deliveryTime, link.lastDeliveryUsecs + 1);
+        }
+        link.lastDeliveryUsecs = deliveryTime;
+    }
+
+    if (deliveryTime > now) {
+        _datagramsDelayed++;
+    }
+
+    ImpairedDatagram datagram;
+    datagram.data = data;
+    datagram.sockAddr = sockAddr;
+    schedule.insert(deliveryTime, datagram);
+}
+
+qint64 ImpairableUdpSocket::writeDatagram(const char* data, qint64 size, const QHostAddress& address, quint16 port) {
+    _writtenMutex.lock();
+    _datagramsWritten++;
+    _bytesWritten += size;
+    _writtenMutex.unlock();
+
+    if (!_isImpaired) {
+        return QUdpSocket::writeDatagram(data, size, address, port);
+    }
+
+    QMutexLocker locker(&_impairmentMutex);
+    scheduleDatagram(QByteArray(data, size), HifiSockAddr(address, port), _outbound, _outboundLinks);
+
+    // as far as the caller is concerned the datagram went out, just like a real lossy link
+    return size;
+}
+
+void ImpairableUdpSocket::pullPendingDatagrams() {
+    QByteArray datagram;
+    HifiSockAddr senderSockAddr;
+
+    while (QUdpSocket::hasPendingDatagrams()) {
+        datagram.resize(QUdpSocket::pendingDatagramSize());
+        QUdpSocket::readDatagram(datagram.data(), datagram.size(),
+                                 senderSockAddr.getAddressPointer(), senderSockAddr.getPortPointer());
+        scheduleDatagram(datagram, senderSockAddr, _inbound, _inboundLinks);
+    }
+}
+
+bool ImpairableUdpSocket::hasPendingDatagrams() {
+    if (!_isImpaired && _inbound.isEmpty()) {
+        return QUdpSocket::hasPendingDatagrams();
+    }
+
+    QMutexLocker locker(&_impairmentMutex);
+    pullPendingDatagrams();
+    return !_inbound.isEmpty() && _inbound.constBegin().key() <= usecTimestampNow();
+}
+
+qint64 ImpairableUdpSocket::pendingDatagramSize() {
+    if (!_isImpaired && _inbound.isEmpty()) {
+        return QUdpSocket::pendingDatagramSize();
+    }
+
+    QMutexLocker locker(&_impairmentMutex);
+    if (_inbound.isEmpty() || _inbound.constBegin().key() > usecTimestampNow()) {
+        return -1;
+    }
+    return _inbound.constBegin().value().data.size();
+}
+
+qint64 ImpairableUdpSocket::readDatagram(char* data, qint64 maxSize, QHostAddress* address, quint16* port) {
+    if (!_isImpaired && _inbound.isEmpty()) {
+        return QUdpSocket::readDatagram(data, maxSize, address, port);
+    }
+
+    QMutexLocker locker(&_impairmentMutex);
+    if (_inbound.isEmpty() || _inbound.constBegin().key() > usecTimestampNow()) {
+        return -1;
+    }
+
+    DatagramSchedule::iterator nextDatagram = _inbound.begin();
+    ImpairedDatagram datagram = nextDatagram.value();
+    _inbound.erase(nextDatagram);
+    qint64 bytesRead = std::min((qint64) datagram.data.size(), maxSize);
+    memcpy(data, datagram.data.constData(), bytesRead);
+
+    if (address) {
+        *address = datagram.sockAddr.getAddress();
+    }
+    if (port) {
+        *port = datagram.sockAddr.getPort();
+    }
+
+    return bytesRead;
+}
+
+void ImpairableUdpSocket::releaseDueDatagrams() {
+    bool hasDueInbound = false;
+
+    {
+        QMutexLocker locker(&_impairmentMutex);
+        quint64 now = usecTimestampNow();
+
+        while (!_outbound.isEmpty() && _outbound.constBegin().key() <= now) {
+            DatagramSchedule::iterator nextDatagram = _outbound.begin();
+            QUdpSocket::writeDatagram(nextDatagram.value().data, nextDatagram.value().sockAddr.getAddress(),
+                                      nextDatagram.value().sockAddr.getPort());
+            _outbound.erase(nextDatagram);
+        }
+
+        if (_isImpaired) {
+            // make sure datagrams keep flowing into the schedule even if no one is reading
+            pullPendingDatagrams();
+        } else if (_outbound.isEmpty() && _inbound.isEmpty()) {
+            // impairments were cleared and everything in flight has been delivered
+            _releaseTimer->stop();
+        }
+
+        hasDueInbound = !_inbound.isEmpty() && _inbound.constBegin().key() <= now;
+    }
+
+    if (hasDueInbound) {
+        // our readers only look for datagrams when the socket tells them to
+        emit readyRead();
+    }
+}
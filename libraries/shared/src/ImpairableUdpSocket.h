@@ -0,0 +1,132 @@
+//
+//  ImpairableUdpSocket.h
+//  shared
+//
+//  Created on 2/3/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  UDP socket used by the NodeList that can optionally emulate a WAN link (latency, jitter, loss, reordering and
+//  bandwidth caps) on its send and receive paths, so that mixers and servers can be benchmarked on a single box.
+//
+
+#ifndef __shared__ImpairableUdpSocket__
+#define __shared__ImpairableUdpSocket__
+
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <QtCore/QTimer>
+#include <QtNetwork/QUdpSocket>
+
+#include "HifiSockAddr.h"
+
+/// The characteristics of an emulated link. A default constructed NetworkImpairment is a perfect link.
+struct NetworkImpairment {
+    NetworkImpairment();
+
+    /// Parses a spec of the form "latency=80,jitter=10,loss=0.02,reorder=0.01,kbps=2000". Latency and jitter are in
+    /// msecs, loss and reorder are probabilities between 0 and 1, kbps is the link capacity in kilobits per second.
+    /// Unknown keys are ignored, missing keys keep their default (unimpaired) value.
+    static NetworkImpairment fromString(const QString& spec);
+
+    bool isNull() const { return latencyUsecs == 0 && jitterUsecs == 0 && lossRate <= 0.0f
+        && reorderRate <= 0.0f && bandwidthKbps == 0; }
+
+    quint64 latencyUsecs;
+    quint64 jitterUsecs;
+    float lossRate;
+    float reorderRate;
+    int bandwidthKbps;
+};
+
+QDebug operator<<(QDebug debug, const NetworkImpairment& impairment);
+
+/// A QUdpSocket that routes datagrams through an emulated link when impairments are configured. The datagram methods
+/// shadow the QUdpSocket ones, so callers going through NodeList::getNodeSocket() are impaired transparently. With no
+/// impairments configured every call goes straight to the QUdpSocket implementation.
+class ImpairableUdpSocket : public QUdpSocket {
+    Q_OBJECT
+public:
+    ImpairableUdpSocket(QObject* parent = 0);
+
+    /// Reads --netImpair <spec>, --netImpairPeer <host:port>/<spec> (may be repeated) and --netImpairSeed <seed>.
+    /// \thread the thread that owns this socket
+    void parseImpairmentArguments(int argc, const char* argv[]);
+
+    /// Sets the impairment applied to every peer that has no specific impairment of its own.
+    void setDefaultImpairment(const NetworkImpairment& impairment);
+
+    /// Sets the impairment applied to datagrams sent to and received from a single peer.
+    void setPeerImpairment(const HifiSockAddr& peer, const NetworkImpairment& impairment);
+
+    /// Re-seeds the random number generator that drives loss, jitter and reordering decisions.
+    void setImpairmentSeed(quint32 seed);
+
+    void clearImpairments();
+    bool isImpaired() const { return _isImpaired; }
+
+    qint64 writeDatagram(const char* data, qint64 size, const QHostAddress& address, quint16 port);
+    qint64 writeDatagram(const QByteArray& datagram, const QHostAddress& address, quint16 port)
+        { return writeDatagram(datagram.data(), datagram.size(), address, port); }
+
+    bool hasPendingDatagrams();
+    qint64 pendingDatagramSize();
+    qint64 readDatagram(char* data, qint64 maxSize, QHostAddress* address = 0, quint16* port = 0);
+
+    /// totals of everything handed to writeDatagram, whether or not an impairment let it onto the network
+    quint64 getDatagramsWritten() const { QMutexLocker locker(&_writtenMutex); return _datagramsWritten; }
+    quint64 getBytesWritten() const { QMutexLocker locker(&_writtenMutex); return _bytesWritten; }
+
+    quint64 getImpairedDatagramsDropped() const { return _datagramsDropped; }
+    quint64 getImpairedDatagramsReordered() const { return _datagramsReordered; }
+    quint64 getImpairedDatagramsDelayed() const { return _datagramsDelayed; }
+
+private slots:
+    void releaseDueDatagrams();
+
+private:
+    struct ImpairedDatagram {
+        QByteArray data;
+        HifiSockAddr sockAddr;
+    };
+
+    /// per-peer state of one direction of an emulated link
+    struct LinkState {
+        LinkState() : lastDeliveryUsecs(0), linkFreeUsecs(0) { }
+        quint64 lastDeliveryUsecs;
+        quint64 linkFreeUsecs;
+    };
+
+    typedef QMultiMap<quint64, ImpairedDatagram> DatagramSchedule;
+    typedef QHash<quint64, LinkState> LinkStateHash;
+
+    static quint64 keyForSockAddr(const HifiSockAddr& sockAddr);
+
+    const NetworkImpairment& impairmentForPeer(quint64 peerKey) const;
+    void scheduleDatagram(const QByteArray& data, const HifiSockAddr& sockAddr,
+                          DatagramSchedule& schedule, LinkStateHash& links);
+    void pullPendingDatagrams();
+    float randomUnit();
+    void updateImpairedState();
+
+    bool _isImpaired;
+    NetworkImpairment _defaultImpairment;
+    QHash<quint64, NetworkImpairment> _peerImpairments;
+
+    QMutex _impairmentMutex;
+    quint32 _randomState;
+    DatagramSchedule _outbound;
+    DatagramSchedule _inbound;
+    LinkStateHash _outboundLinks;
+    LinkStateHash _inboundLinks;
+    QTimer* _releaseTimer;
+
+    mutable QMutex _writtenMutex; // guards the totals written, since any thread can write to the node socket
+    quint64 _datagramsWritten;
+    quint64 _bytesWritten;
+    quint64 _datagramsDropped;
+    quint64 _datagramsReordered;
+    quint64 _datagramsDelayed;
+};
+
+#endif // __shared__ImpairableUdpSocket__
@@ -28,6 +28,7 @@
 #include <QtNetwork/QHostAddress>
 #include <QtNetwork/QUdpSocket>
 
+#include "ImpairableUdpSocket.h"
 #include "Node.h"
 
 const int MAX_PACKET_SIZE = 1500;
@@ -75,7 +76,7 @@ public:
     const QUuid& getOwnerUUID() const { return _ownerUUID; }
     void setOwnerUUID(const QUuid& ownerUUID) { _ownerUUID = ownerUUID; }
 
-    QUdpSocket& getNodeSocket() { return _nodeSocket; }
+    ImpairableUdpSocket& getNodeSocket() { return _nodeSocket; }
 
     void(*linkedDataCreateCallback)(Node *);
 
@@ -142,7 +143,7 @@ private:
     QMutex _nodeHashMutex;
     QString _domainHostname;
     HifiSockAddr _domainSockAddr;
-    QUdpSocket _nodeSocket;
+    ImpairableUdpSocket _nodeSocket;
     NodeType_t _ownerType;
     NodeSet _nodeTypesOfInterest;
     QUuid _ownerUUID;
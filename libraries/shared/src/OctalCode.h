@@ -33,6 +33,9 @@ const int UNKNOWN_OCTCODE_LENGTH = -2;
 /// \param int maxBytes number of bytes that octalCode is expected to be, -1 if unknown
 int numberOfThreeBitSectionsInCode(const unsigned char* octalCode, int maxBytes = UNKNOWN_OCTCODE_LENGTH);
 
+/// the child index, 0 to 7, that the code takes at the given depth
+char getOctalCodeSectionValue(const unsigned char* octalCode, int section);
+
 unsigned char* chopOctalCode(const unsigned char* originalOctalCode, int chopLevels);
 unsigned char* rebaseOctalCode(const unsigned char* originalOctalCode, const unsigned char* newParentOctalCode, 
                                bool includeColorSpace = false);
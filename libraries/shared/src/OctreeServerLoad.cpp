@@ -0,0 +1,54 @@
+//
+//  OctreeServerLoad.cpp
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <QtCore/QSet>
+
+#include "OctreeServerLoad.h"
+
+OctreeServerLoad::OctreeServerLoad() :
+    viewers(0),
+    encodeLoad(0.0f),
+    editsPerSecond(0.0f),
+    handoffSynced(false)
+{
+}
+
+QDataStream& operator<<(QDataStream& out, const OctreeServerLoad& load) {
+    return out << load.viewers << load.encodeLoad << load.editsPerSecond << load.jurisdictionRoot
+        << load.jurisdictionEndNodes << load.busiestChild << load.handoffSource << load.handoffSynced
+        << load.handoffTarget;
+}
+
+QDataStream& operator>>(QDataStream& in, OctreeServerLoad& load) {
+    return in >> load.viewers >> load.encodeLoad >> load.editsPerSecond >> load.jurisdictionRoot
+        >> load.jurisdictionEndNodes >> load.busiestChild >> load.handoffSource >> load.handoffSynced
+        >> load.handoffTarget;
+}
+
+// hex codes written by hand may be in either case, and their order doesn't matter
+static QSet<QString> hexCodeSet(const QStringList& hexCodes) {
+    QSet<QString> set;
+    foreach (const QString& hexCode, hexCodes) {
+        set.insert(hexCode.toUpper());
+    }
+    return set;
+}
+
+bool JurisdictionUpdate::isShownBy(const OctreeServerLoad& load) const {
+    return load.jurisdictionRoot.compare(root, Qt::CaseInsensitive) == 0
+        && hexCodeSet(load.jurisdictionEndNodes) == hexCodeSet(endNodes) && load.handoffSource == handoffSource
+        && load.handoffTarget == handoffTarget;
+}
+
+QDataStream& operator<<(QDataStream& out, const JurisdictionUpdate& update) {
+    return out << update.root << update.endNodes << update.handoffSource << update.handoffTarget << update.handoffRoot;
+}
+
+QDataStream& operator>>(QDataStream& in, JurisdictionUpdate& update) {
+    return in >> update.root >> update.endNodes >> update.handoffSource >> update.handoffTarget >> update.handoffRoot;
+}
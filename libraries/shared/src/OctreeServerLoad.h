@@ -0,0 +1,64 @@
+//
+//  OctreeServerLoad.h
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  What octree servers tell the domain-server about their load, and what it tells them back to move load between
+//  them, so that busy jurisdictions can be split and idle ones merged.
+//
+
+#ifndef __hifi__OctreeServerLoad__
+#define __hifi__OctreeServerLoad__
+
+#include <QtCore/QDataStream>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QUuid>
+
+/// how often octree servers report their load to the domain-server
+const int OCTREE_SERVER_LOAD_INTERVAL_MSECS = 1000;
+
+/// An octree server's load over the last interval, and the state of its jurisdiction. Sent to the domain-server in a
+/// PacketTypeOctreeServerLoad. Octal codes are hex strings, as in server configs.
+class OctreeServerLoad {
+public:
+    OctreeServerLoad();
+
+    quint32 viewers; // the agents whose cameras are in the jurisdiction, who are sent the most of it
+    float encodeLoad; // seconds spent encoding per second, summed over the send threads
+    float editsPerSecond;
+
+    QString jurisdictionRoot; // empty if the server has no jurisdiction, and has the whole tree
+    QStringList jurisdictionEndNodes;
+    QString busiestChild; // the child of the jurisdiction root with the most viewers in it, empty if there's none
+
+    QUuid handoffSource; // the server a subtree is being taken over from, null if none
+    bool handoffSynced; // whether the subtree has been brought up to date with the source's at least once
+    QUuid handoffTarget; // the server a subtree is being taken over by, null if none
+};
+
+QDataStream& operator<<(QDataStream& out, const OctreeServerLoad& load);
+QDataStream& operator>>(QDataStream& in, OctreeServerLoad& load);
+
+/// The jurisdiction the domain-server wants an octree server to have, sent in a PacketTypeJurisdictionUpdate until the
+/// server's load reports show it. A server can be told to take over the subtree under the handoff root from another
+/// server, which it does by syncing it from that server until it's told to stop. That other server is told the
+/// handoff target, the only server whose syncs of the subtree it answers.
+class JurisdictionUpdate {
+public:
+    QString root;
+    QStringList endNodes;
+    QUuid handoffSource;
+    QUuid handoffTarget;
+    QString handoffRoot;
+
+    /// whether a server reporting a load has this jurisdiction and handoff
+    bool isShownBy(const OctreeServerLoad& load) const;
+};
+
+QDataStream& operator<<(QDataStream& out, const JurisdictionUpdate& update);
+QDataStream& operator>>(QDataStream& in, JurisdictionUpdate& update);
+
+#endif /* defined(__hifi__OctreeServerLoad__) */
@@ -46,6 +46,8 @@ PacketVersion versionForPacketType(PacketType type) {
     switch (type) {
         case PacketTypeParticleData:
             return 1;
+        case PacketTypeParticleErase:
+            return 1;
         default:
             return 0;
     }
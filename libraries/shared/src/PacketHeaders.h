@@ -51,7 +51,11 @@ enum PacketType {
     PacketTypeParticleAddOrEdit,
     PacketTypeParticleErase,
     PacketTypeParticleAddResponse,
-    PacketTypeMetavoxelData
+    PacketTypeMetavoxelData,
+    PacketTypeOctreeSyncRequest,
+    PacketTypeOctreeSyncReply,
+    PacketTypeOctreeServerLoad,
+    PacketTypeJurisdictionUpdate
 };
 
 typedef char PacketVersion;
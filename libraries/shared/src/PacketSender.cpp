@@ -15,11 +15,10 @@
 #include "NodeList.h"
 #include "PacketSender.h"
 #include "SharedUtil.h"
+#include "Trace.h"
 
 const quint64 PacketSender::USECS_PER_SECOND = 1000 * 1000;
-const quint64 PacketSender::SENDING_INTERVAL_ADJUST = 200; // approaximate 200us
 const int PacketSender::TARGET_FPS = 60;
-const int PacketSender::MAX_SLEEP_INTERVAL = PacketSender::USECS_PER_SECOND;
 
 const int PacketSender::DEFAULT_PACKETS_PER_SECOND = 30;
 const int PacketSender::MINIMUM_PACKETS_PER_SECOND = 1;
@@ -39,7 +38,8 @@ PacketSender::PacketSender(int packetsPerSecond) :
     _totalPacketsSent(0),
     _totalBytesSent(0),
     _totalPacketsQueued(0),
-    _totalBytesQueued(0)
+    _totalBytesQueued(0),
+    _sendScheduler("PacketSender", USECS_PER_SECOND / std::max(MINIMUM_PACKETS_PER_SECOND, packetsPerSecond))
 {
 }
 
@@ -72,32 +72,16 @@ bool PacketSender::process() {
 bool PacketSender::threadedProcess() {
     bool hasSlept = false;
 
-    if (_lastSendTime == 0) {
-        _lastSendTime = usecTimestampNow();
-    }
-
     // in threaded mode, we keep running and just empty our packet queue sleeping enough to keep our PPS on target
     while (_packets.size() > 0) {
-        // Recalculate our SEND_INTERVAL_USECS each time, in case the caller has changed it on us..
+        // Recalculate our send interval each time, in case the caller has changed it on us..
         int packetsPerSecondTarget = (_packetsPerSecond > MINIMUM_PACKETS_PER_SECOND)
                                             ? _packetsPerSecond : MINIMUM_PACKETS_PER_SECOND;
+        _sendScheduler.setInterval(USECS_PER_SECOND / packetsPerSecondTarget);
 
-        quint64 intervalBetweenSends = USECS_PER_SECOND / packetsPerSecondTarget;
-        quint64 sleepInterval = (intervalBetweenSends > SENDING_INTERVAL_ADJUST) ?
-                    intervalBetweenSends - SENDING_INTERVAL_ADJUST : intervalBetweenSends;
-
-        // We'll sleep before we send, this way, we can set our last send time to be our ACTUAL last send time
-        quint64 now = usecTimestampNow();
-        quint64 elapsed = now - _lastSendTime;
-        int usecToSleep =  sleepInterval - elapsed;
-
-        // If we've never sent, or it's been a long time since we sent, then our elapsed time will be quite large
-        // and therefore usecToSleep will be less than 0 and we won't sleep before sending...
-        if (usecToSleep > 0) {
-            if (usecToSleep > MAX_SLEEP_INTERVAL) {
-                usecToSleep = MAX_SLEEP_INTERVAL;
-            }
-            usleep(usecToSleep);
+        // We'll sleep before we send, this way, we can set our last send time to be our ACTUAL last send time.
+        // If it's been a long time since we sent, then the next send is already due and we won't sleep before sending...
+        if (_sendScheduler.waitForNextFrame()) {
             hasSlept = true;
         }
 
@@ -109,6 +93,9 @@ bool PacketSender::threadedProcess() {
         }
     }
 
+    // the queue is empty, the time until more packets arrive is not time we fell behind on sending
+    _sendScheduler.idle();
+
     // if threaded and we haven't slept? We want to sleep a little so we don't hog the CPU, but
     // we don't want to sleep too long because how ever much we sleep will delay any future unsent
     // packets that arrive while we're sleeping. So we sleep 1/2 of our target fps interval
@@ -263,6 +250,7 @@ bool PacketSender::nonThreadedProcess() {
         unlock();
 
         // send the packet through the NodeList...
+        TRACE_SCOPE("packet sender send");
         NodeList::getInstance()->getNodeSocket().writeDatagram(temporary.getByteArray(),
                                                                temporary.getSockAddr().getAddress(),
                                                                temporary.getSockAddr().getPort());
@@ -11,6 +11,7 @@
 #ifndef __shared__PacketSender__
 #define __shared__PacketSender__
 
+#include "FrameScheduler.h"
 #include "GenericThread.h"
 #include "NetworkPacket.h"
 #include "SharedUtil.h"
@@ -21,9 +22,7 @@ class PacketSender : public GenericThread {
 public:
 
     static const quint64 USECS_PER_SECOND;
-    static const quint64 SENDING_INTERVAL_ADJUST;
     static const int TARGET_FPS;
-    static const int MAX_SLEEP_INTERVAL;
 
     static const int DEFAULT_PACKETS_PER_SECOND;
     static const int MINIMUM_PACKETS_PER_SECOND;
@@ -112,6 +111,8 @@ private:
 
     quint64 _totalPacketsQueued;
     quint64 _totalBytesQueued;
+
+    FrameScheduler _sendScheduler;
 };
 
 #endif // __shared__PacketSender__
@@ -51,6 +51,10 @@ PerformanceWarning::~PerformanceWarning() {
     if (_totalCalls) {
         *_totalCalls += 1;
     }
+    // every timed section also shows up in the trace when tracing is on
+    if (_traceBeginNsecs) {
+        Trace::record(_message, _traceBeginNsecs, Trace::nowNsecs());
+    }
 };
 
 
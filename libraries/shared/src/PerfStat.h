@@ -15,6 +15,7 @@
 
 #include <stdint.h>
 #include "SharedUtil.h"
+#include "Trace.h"
 
 #ifdef _WIN32
 #include "Systime.h"
@@ -34,6 +35,7 @@ private:
 	bool _alwaysDisplay;
 	quint64* _runningTotal;
 	quint64* _totalCalls;
+	quint64 _traceBeginNsecs;
 	static bool _suppressShortTimings;
 public:
 
@@ -44,7 +46,8 @@ public:
         _renderWarningsOn(renderWarnings),
         _alwaysDisplay(alwaysDisplay),
         _runningTotal(runningTotal),
-        _totalCalls(totalCalls) { }
+        _totalCalls(totalCalls),
+        _traceBeginNsecs(Trace::isEnabled() ? Trace::nowNsecs() : 0) { }
 
     ~PerformanceWarning();
 
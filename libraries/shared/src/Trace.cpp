@@ -0,0 +1,225 @@
+//
+//  Trace.cpp
+//  shared
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <time.h>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QThreadStorage>
+
+#include "SharedUtil.h"
+#include "Trace.h"
+
+TraceBuffer::TraceBuffer(int threadID, const QString& threadName) :
+    _threadID(threadID),
+    _threadName(threadName),
+    _isRetired(false),
+    _eventsRecorded(0),
+    _firstEventAfterClear(0)
+{
+}
+
+void TraceBuffer::record(const char* name, quint64 beginNsecs, quint64 endNsecs) {
+    quint32 eventIndex = (quint32) _eventsRecorded.load();
+    TraceEvent& event = _events[eventIndex % TRACE_BUFFER_EVENTS];
+
+    strncpy(event.name, name, TRACE_EVENT_NAME_LENGTH - 1);
+    event.name[TRACE_EVENT_NAME_LENGTH - 1] = '\0';
+    event.beginNsecs = beginNsecs;
+    event.endNsecs = endNsecs;
+
+    // publish the event only once it is completely written
+    _eventsRecorded.storeRelease(eventIndex + 1);
+}
+
+void TraceBuffer::copyEvents(QVector<TraceEvent>& events) const {
+    quint32 eventsRecorded = (quint32) _eventsRecorded.loadAcquire();
+    quint32 firstEvent = (quint32) _firstEventAfterClear.load();
+
+    quint32 eventsAvailable = std::min(eventsRecorded - firstEvent, (quint32) TRACE_BUFFER_EVENTS);
+    quint32 copyFrom = eventsRecorded - eventsAvailable;
+
+    int firstCopied = events.size();
+    for (quint32 i = copyFrom; i != eventsRecorded; i++) {
+        events.append(_events[i % TRACE_BUFFER_EVENTS]);
+    }
+
+    // the owning thread kept recording while we copied, the slots it has written, or may be writing now, since we
+    // started hold newer events than the ones we copied out of them
+    quint32 eventsRecordedAfterCopy = (quint32) _eventsRecorded.loadAcquire();
+    quint32 firstIntactEvent = eventsRecordedAfterCopy + 1 - TRACE_BUFFER_EVENTS;
+    if (eventsRecordedAfterCopy + 1 > (quint32) TRACE_BUFFER_EVENTS && (qint32) (firstIntactEvent - copyFrom) > 0) {
+        events.remove(firstCopied, std::min(firstIntactEvent - copyFrom, eventsAvailable));
+    }
+}
+
+void TraceBuffer::clear() {
+    _firstEventAfterClear.store(_eventsRecorded.loadAcquire());
+}
+
+void TraceBuffer::reuse(int threadID, const QString& threadName) {
+    _threadID = threadID;
+    _threadName = threadName;
+    _isRetired = false;
+    clear();
+}
+
+/// lives in a thread's local storage and hands its buffer back for reuse when the thread finishes
+class TraceBufferOwner {
+public:
+    TraceBufferOwner(TraceBuffer* buffer) : _buffer(buffer) { }
+    ~TraceBufferOwner();
+
+    TraceBuffer* getBuffer() const { return _buffer; }
+private:
+    TraceBuffer* _buffer;
+};
+
+// buffers are never freed, so events from finished threads can still be dumped until a new thread reuses them
+static QMutex traceBuffersMutex;
+static QList<TraceBuffer*> traceBuffers;
+static int nextTraceThreadID = 1;
+
+static QThreadStorage<TraceBufferOwner*> traceBufferOwners;
+
+TraceBufferOwner::~TraceBufferOwner() {
+    QMutexLocker locker(&traceBuffersMutex);
+    _buffer->setIsRetired(true);
+}
+
+volatile bool Trace::_isEnabled = false;
+
+void Trace::setEnabled(bool isEnabled) {
+    if (isEnabled != _isEnabled) {
+        qDebug() << "Tracing" << (isEnabled ? "enabled." : "disabled.");
+    }
+    _isEnabled = isEnabled;
+}
+
+quint64 Trace::nowNsecs() {
+#ifdef __linux__
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (quint64) now.tv_sec * 1000 * 1000 * 1000 + now.tv_nsec;
+#else
+    return usecTimestampNow() * 1000;
+#endif
+}
+
+void Trace::record(const char* name, quint64 beginNsecs, quint64 endNsecs) {
+    bufferForCurrentThread()->record(name, beginNsecs, endNsecs);
+}
+
+void Trace::clear() {
+    QMutexLocker locker(&traceBuffersMutex);
+    foreach (TraceBuffer* buffer, traceBuffers) {
+        buffer->clear();
+    }
+}
+
+TraceBuffer* Trace::bufferForCurrentThread() {
+    if (traceBufferOwners.hasLocalData()) {
+        return traceBufferOwners.localData()->getBuffer();
+    }
+
+    // first event from this thread, give it a buffer
+    QThread* thread = QThread::currentThread();
+    QString threadName = thread->objectName().isEmpty() ? thread->metaObject()->className() : thread->objectName();
+
+    QMutexLocker locker(&traceBuffersMutex);
+    int threadID = nextTraceThreadID++;
+
+    TraceBuffer* buffer = NULL;
+    foreach (TraceBuffer* retiredBuffer, traceBuffers) {
+        if (retiredBuffer->isRetired()) {
+            buffer = retiredBuffer;
+            buffer->reuse(threadID, threadName);
+            break;
+        }
+    }
+
+    if (!buffer) {
+        buffer = new TraceBuffer(threadID, threadName);
+        traceBuffers.append(buffer);
+    }
+
+    traceBufferOwners.setLocalData(new TraceBufferOwner(buffer));
+    return buffer;
+}
+
+static void appendEscapedJSONString(QByteArray& json, const QByteArray& string) {
+    json.append('"');
+    foreach (char character, string) {
+        if (character == '"' || character == '\\') {
+            json.append('\\');
+        }
+        if (character >= ' ') {
+            json.append(character);
+        }
+    }
+    json.append('"');
+}
+
+QByteArray Trace::toChromeTraceJSON() {
+    const double NSECS_PER_USEC = 1000.0;
+    const int TIMESTAMP_DECIMALS = 3;
+
+    QByteArray processID = QByteArray::number(QCoreApplication::applicationPid());
+
+    QByteArray json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool isFirstEvent = true;
+
+    QMutexLocker locker(&traceBuffersMutex);
+
+    QVector<TraceEvent> events;
+    foreach (TraceBuffer* buffer, traceBuffers) {
+        events.resize(0);
+        buffer->copyEvents(events);
+
+        QByteArray threadID = QByteArray::number(buffer->getThreadID());
+
+        // metadata event so the viewer labels the thread
+        json.append(isFirstEvent ? "" : ",");
+        json.append("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + processID + ",\"tid\":" + threadID
+                    + ",\"args\":{\"name\":");
+        appendEscapedJSONString(json, buffer->getThreadName().toUtf8());
+        json.append("}}");
+        isFirstEvent = false;
+
+        foreach (const TraceEvent& event, events) {
+            json.append(",{\"name\":");
+            appendEscapedJSONString(json, QByteArray(event.name));
+            json.append(",\"ph\":\"X\",\"ts\":");
+            json.append(QByteArray::number(event.beginNsecs / NSECS_PER_USEC, 'f', TIMESTAMP_DECIMALS));
+            json.append(",\"dur\":");
+            json.append(QByteArray::number((event.endNsecs - event.beginNsecs) / NSECS_PER_USEC, 'f', TIMESTAMP_DECIMALS));
+            json.append(",\"pid\":" + processID + ",\"tid\":" + threadID + "}");
+        }
+    }
+
+    json.append("]}");
+    return json;
+}
+
+bool Trace::writeChromeTraceFile(const QString& filename) {
+    QFile traceFile(filename);
+    if (!traceFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "Could not open" << filename << "to write trace -" << traceFile.errorString();
+        return false;
+    }
+
+    traceFile.write(toChromeTraceJSON());
+    qDebug() << "Wrote trace events to" << filename;
+    return true;
+}
@@ -0,0 +1,108 @@
+//
+//  Trace.h
+//  shared
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Low overhead recording of timed scopes, dumped as Chrome trace event JSON (load it in chrome://tracing).
+//
+//  Each thread records into its own ring buffer of the most recent events so recording never takes a lock. When
+//  tracing is disabled a TRACE_SCOPE costs a single check of a flag.
+//
+
+#ifndef __shared__Trace__
+#define __shared__Trace__
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+const int TRACE_EVENT_NAME_LENGTH = 40;
+const int TRACE_BUFFER_EVENTS = 4096;
+
+struct TraceEvent {
+    char name[TRACE_EVENT_NAME_LENGTH];
+    quint64 beginNsecs;
+    quint64 endNsecs;
+};
+
+/// The most recent events recorded by one thread. Only the owning thread writes to it, readers copy events out and
+/// throw away any that were overwritten while they were copying.
+class TraceBuffer {
+public:
+    TraceBuffer(int threadID, const QString& threadName);
+
+    /// \thread the owning thread only
+    void record(const char* name, quint64 beginNsecs, quint64 endNsecs);
+
+    /// copies out the events recorded since the last clear, oldest first
+    /// \thread any thread
+    void copyEvents(QVector<TraceEvent>& events) const;
+
+    /// \thread any thread
+    void clear();
+
+    /// hands the buffer to a new thread once its previous thread has finished
+    void reuse(int threadID, const QString& threadName);
+
+    int getThreadID() const { return _threadID; }
+    const QString& getThreadName() const { return _threadName; }
+
+    bool isRetired() const { return _isRetired; }
+    void setIsRetired(bool isRetired) { _isRetired = isRetired; }
+private:
+    int _threadID;
+    QString _threadName;
+    bool _isRetired;
+
+    TraceEvent _events[TRACE_BUFFER_EVENTS];
+    QAtomicInt _eventsRecorded;
+    QAtomicInt _firstEventAfterClear;
+};
+
+class Trace {
+public:
+    static void setEnabled(bool isEnabled);
+    static bool isEnabled() { return _isEnabled; }
+
+    /// the clock trace events are stamped with, monotonic where the platform has it
+    static quint64 nowNsecs();
+
+    /// records a finished scope for the calling thread
+    static void record(const char* name, quint64 beginNsecs, quint64 endNsecs);
+
+    /// forgets every event recorded so far
+    static void clear();
+
+    /// the recorded events of all threads in the Chrome trace event format
+    static QByteArray toChromeTraceJSON();
+    static bool writeChromeTraceFile(const QString& filename);
+private:
+    static TraceBuffer* bufferForCurrentThread();
+
+    static volatile bool _isEnabled;
+};
+
+/// Records the time from its construction to its destruction as one trace event, use through TRACE_SCOPE.
+class TraceScope {
+public:
+    TraceScope(const char* name) : _name(name), _beginNsecs(Trace::isEnabled() ? Trace::nowNsecs() : 0) { }
+    ~TraceScope() {
+        if (_beginNsecs) {
+            Trace::record(_name, _beginNsecs, Trace::nowNsecs());
+        }
+    }
+private:
+    const char* _name;
+    quint64 _beginNsecs;
+};
+
+#define TRACE_SCOPE_JOIN(prefix, line) prefix##line
+#define TRACE_SCOPE_VARIABLE(line) TRACE_SCOPE_JOIN(traceScope, line)
+
+/// traces the rest of the enclosing block under the given name
+#define TRACE_SCOPE(name) TraceScope TRACE_SCOPE_VARIABLE(__LINE__)(name)
+
+#endif // __shared__Trace__
@@ -83,9 +83,7 @@ TagByteArray::TagByteArray(std::stringstream &ss) : Tag(TAG_Byte_Array, ss) {
     _size = ss.get() << 24 | ss.get() << 16 | ss.get() << 8 | ss.get();
 
     _data = new char[_size];
-    for (int i = 0; i < _size; ++i) {
-        _data[i] = ss.get();
-    }
+    ss.read(_data, _size);
 }
 
 TagString::TagString(std::stringstream &ss) : Tag(TAG_String, ss) {
@@ -173,8 +171,7 @@ int retrieveData(std::string filename, std::stringstream &ss) {
 
     int type = file.peek();
     if (type == 0x0A) {
-        ss.flush();
-        ss << file;
+        ss << file.rdbuf();
         return 0;
     }
 
@@ -188,74 +185,49 @@ int retrieveData(std::string filename, std::stringstream &ss) {
 }
 
 int ungzip(std::ifstream &file, std::stringstream &ss) {
-    std::string gzipedBytes;
-    gzipedBytes.clear();
-    ss.flush();
-
-    while (!file.eof()) {
-        gzipedBytes += (char) file.get();
-    }
-    file.close();
-
-    if (gzipedBytes.size() == 0) {
-        ss << gzipedBytes;
-        return 0;
-    }
-
-    unsigned int full_length  = gzipedBytes.size();
-    unsigned int half_length  = gzipedBytes.size()/2;
-    unsigned int uncompLength = full_length;
-
-    char* uncomp = (char*) calloc(sizeof(char), uncompLength);
+    // inflates the file a buffer at a time as it's read, rather than reading all of it first
+    const int GZIP_BUFFER_SIZE = 64 * 1024;
+    char compressed[GZIP_BUFFER_SIZE];
+    char uncompressed[GZIP_BUFFER_SIZE];
 
     z_stream strm;
-    strm.next_in   = (Bytef *) gzipedBytes.c_str();
-    strm.avail_in  = full_length;
-    strm.total_out = 0;
+    strm.next_in   = Z_NULL;
+    strm.avail_in  = 0;
     strm.zalloc    = Z_NULL;
     strm.zfree     = Z_NULL;
-
-    bool done = false;
+    strm.opaque    = Z_NULL;
 
     if (inflateInit2(&strm, (16 + MAX_WBITS)) != Z_OK) {
-        free(uncomp);
         return 1;
     }
 
-    while (!done) {
-        // If our output buffer is too small
-        if (strm.total_out >= uncompLength) {
-            // Increase size of output buffer
-            char* uncomp2 = (char*) calloc(sizeof(char), uncompLength + half_length);
-            memcpy(uncomp2, uncomp, uncompLength);
-            uncompLength += half_length;
-            free(uncomp);
-            uncomp = uncomp2;
+    int err = Z_OK;
+    while (err != Z_STREAM_END) {
+        if (strm.avail_in == 0) {
+            file.read(compressed, GZIP_BUFFER_SIZE);
+            strm.next_in  = (Bytef *) compressed;
+            strm.avail_in = file.gcount();
+            if (strm.avail_in == 0) {
+                break; // the file ended before the stream did
+            }
         }
 
-        strm.next_out  = (Bytef *) (uncomp + strm.total_out);
-        strm.avail_out = uncompLength - strm.total_out;
+        strm.next_out  = (Bytef *) uncompressed;
+        strm.avail_out = GZIP_BUFFER_SIZE;
 
         // Inflate another chunk.
-        int err = inflate (&strm, Z_SYNC_FLUSH);
-        if (err == Z_STREAM_END) {
-            done = true;
-        } else if (err != Z_OK) {
+        err = inflate(&strm, Z_NO_FLUSH);
+        if (err != Z_OK && err != Z_STREAM_END) {
             break;
         }
+        ss.write(uncompressed, GZIP_BUFFER_SIZE - strm.avail_out);
     }
+    file.close();
 
-    if (inflateEnd (&strm) != Z_OK) {
-        free(uncomp);
+    if (inflateEnd(&strm) != Z_OK) {
         return 1;
     }
-
-    for (size_t i = 0; i < strm.total_out; ++i) {
-        ss << uncomp[i];
-    }
-    free(uncomp);
-
-    return 0;
+    return (err == Z_STREAM_END) ? 0 : 1;
 }
 
 
@@ -9,6 +9,7 @@
 
 void registerVoxelMetaTypes(QScriptEngine* engine) {
     qScriptRegisterMetaType(engine, voxelDetailToScriptValue, voxelDetailFromScriptValue);
+    qScriptRegisterSequenceMetaType<QVector<VoxelDetail> >(engine);
 }
 
 QScriptValue voxelDetailToScriptValue(QScriptEngine* engine, const VoxelDetail& voxelDetail) {
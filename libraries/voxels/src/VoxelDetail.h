@@ -10,6 +10,7 @@
 #ifndef __hifi__VoxelDetail__
 #define __hifi__VoxelDetail__
 
+#include <QtCore/QVector>
 #include <QtScript/QScriptEngine>
 
 #include <SharedUtil.h>
@@ -26,6 +27,7 @@ struct VoxelDetail {
 };
 
 Q_DECLARE_METATYPE(VoxelDetail)
+Q_DECLARE_METATYPE(QVector<VoxelDetail>)
 
 void registerVoxelMetaTypes(QScriptEngine* engine);
 
@@ -9,6 +9,8 @@
 //
 
 #include <assert.h>
+#include <limits>
+
 #include <PerfStat.h>
 #include <OctalCode.h>
 #include <PacketHeaders.h>
@@ -143,8 +145,9 @@ void VoxelEditPacketSender::queueVoxelEditMessages(PacketType type, int numberOf
     }
 
     for (int i = 0; i < numberOfDetails; i++) {
-        // use MAX_PACKET_SIZE since it's static and guarenteed to be larger than _maxPacketSize
-        static unsigned char bufferOut[MAX_PACKET_SIZE]; 
+        // use MAX_PACKET_SIZE since it's guarenteed to be larger than _maxPacketSize, on the stack since several
+        // scripts may be queueing edits at once
+        unsigned char bufferOut[MAX_PACKET_SIZE];
         int sizeOut = 0;
         
         if (encodeVoxelEditMessageDetails(type, 1, &details[i], &bufferOut[0], _maxPacketSize, sizeOut)) {
@@ -152,3 +155,15 @@ void VoxelEditPacketSender::queueVoxelEditMessages(PacketType type, int numberOf
         }
     }    
 }
+
+QByteArray VoxelEditPacketSender::getEditMessageKey(PacketType type, const unsigned char* editMessage,
+                                                   ssize_t length) const {
+    switch (type) {
+        case PacketTypeVoxelSet:
+        case PacketTypeVoxelSetDestructive:
+        case PacketTypeVoxelErase:
+            return octalCodeSections(editMessage, length, std::numeric_limits<int>::max());
+        default:
+            return QByteArray();
+    }
+}
@@ -46,5 +46,8 @@ public:
 
     // My server type is the voxel server
     virtual unsigned char getMyNodeType() const { return NodeType::VoxelServer; }
+
+    /// voxel edits are keyed by the voxel's octal code
+    virtual QByteArray getEditMessageKey(PacketType type, const unsigned char* editMessage, ssize_t length) const;
 };
 #endif // __shared__VoxelEditPacketSender__
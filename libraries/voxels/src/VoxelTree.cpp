@@ -11,9 +11,13 @@
 #include <glm/gtc/noise.hpp>
 
 #include <QtCore/QDebug>
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
 #include <QImage>
 #include <QRgb>
 
+#include <OctreePager.h>
 
 #include "VoxelTree.h"
 #include "Tags.h"
@@ -263,12 +267,235 @@ void VoxelTree::nudgeSubTree(VoxelTreeElement* elementToNudge, const glm::vec3&
     recurseNodeForNudge(elementToNudge, nudgeCheck, &args);
 }
 
+// the depth of the elements an import is split into, each of which is built on a worker thread, 3 gives up to 512 of them
+const int IMPORT_REGION_LEVEL = 3;
 
+// elements in memory at once per core, enough to keep every core busy while the importing tree grafts them in
+const int IMPORT_JOBS_PER_THREAD = 2;
 
+/// Builds the imported voxels of a column of the elements at the import region level on a worker thread, into a tree of
+/// its own for each element of the column, since a tree isn't safe to build on many threads at once. The elements'
+/// subtrees are then grafted into the importing tree on the importing thread.
+class ImportRegionJob : public QRunnable {
+public:
+    ImportRegionJob(int regionX, int regionZ, int firstRegionY, int regionCount, int regionsPerSide,
+                    const bool& stopImport) :
+        _regionX(regionX),
+        _regionZ(regionZ),
+        _firstRegionY(firstRegionY),
+        _regionsPerSide(regionsPerSide),
+        _trees(regionCount, NULL),
+        _voxelCount(0),
+        _stopImport(stopImport) {
+        setAutoDelete(false);
+    }
+
+    ~ImportRegionJob() { qDeleteAll(_trees); }
+
+    int getVoxelCount() const { return _voxelCount; }
+
+    /// copies the subtrees that were built into the same elements of the importing tree
+    void graftInto(VoxelTree& tree) {
+        float regionSize = 1.0f / _regionsPerSide;
+        for (int i = 0; i < _trees.size(); i++) {
+            if (_trees.at(i)) {
+                OctreeElement* region = tree.getOrCreateChildElementAt((_regionX + 0.5f) * regionSize,
+                    (_firstRegionY + i + 0.5f) * regionSize, (_regionZ + 0.5f) * regionSize, regionSize);
+                tree.copyFromTreeIntoSubTree(_trees.at(i), region, false);
+            }
+        }
+    }
+
+protected:
+    /// creates a voxel, given where it is in the importing tree, in the tree of the element of the column it's in
+    void createVoxel(float x, float y, float z, float s, unsigned char red, unsigned char green, unsigned char blue) {
+        int regionY = (int)(y * _regionsPerSide);
+        if (regionY < _firstRegionY || regionY >= _firstRegionY + _trees.size()) {
+            return; // above the tree
+        }
+        VoxelTree*& tree = _trees[regionY - _firstRegionY];
+        if (!tree) {
+            tree = new VoxelTree();
+        }
+        tree->createVoxel(x * _regionsPerSide - _regionX, y * _regionsPerSide - regionY, z * _regionsPerSide - _regionZ,
+                          s * _regionsPerSide, red, green, blue, true);
+        _voxelCount++;
+    }
+
+    int _regionX;
+    int _regionZ;
+    int _firstRegionY;
+    int _regionsPerSide;
+    QVector<VoxelTree*> _trees;
+    int _voxelCount;
+    const bool& _stopImport;
+};
+
+/// the columns of pixels of an image that are in a column of elements
+class ImageImportJob : public ImportRegionJob {
+public:
+    ImageImportJob(const QImage& image, int minAlpha, float size, int voxelsPerRegion, int regionX, int regionZ,
+                   int regionsPerSide, const bool& stopImport) :
+        ImportRegionJob(regionX, regionZ, 0, regionsPerSide, regionsPerSide, stopImport),
+        _image(image),
+        _minAlpha(minAlpha),
+        _size(size),
+        _voxelsPerRegion(voxelsPerRegion) { }
+
+    virtual void run() {
+        const QImage& pngImage = _image;
+        float size = _size;
+        int iEnd = std::min((_regionX + 1) * _voxelsPerRegion, pngImage.width());
+        int jEnd = std::min((_regionZ + 1) * _voxelsPerRegion, pngImage.height());
+
+        QRgb pixel;
+        int minNeighborhoodAlpha;
+
+        for (int i = _regionX * _voxelsPerRegion; i < iEnd && !_stopImport; ++i) {
+            for (int j = _regionZ * _voxelsPerRegion; j < jEnd; ++j) {
+                pixel = pngImage.pixel(i, j);
+                minNeighborhoodAlpha = qAlpha(pixel) - 1;
+
+                if (i != 0) {
+                    minNeighborhoodAlpha = std::min(minNeighborhoodAlpha, qAlpha(pngImage.pixel(i - 1, j)));
+                }
+                if (j != 0) {
+                    minNeighborhoodAlpha = std::min(minNeighborhoodAlpha, qAlpha(pngImage.pixel(i, j - 1)));
+                }
+                if (i < pngImage.width() - 1) {
+                    minNeighborhoodAlpha = std::min(minNeighborhoodAlpha, qAlpha(pngImage.pixel(i + 1, j)));
+                }
+                if (j < pngImage.height() - 1) {
+                    minNeighborhoodAlpha = std::min(minNeighborhoodAlpha, qAlpha(pngImage.pixel(i, j + 1)));
+                }
+
+                while (qAlpha(pixel) > minNeighborhoodAlpha) {
+                    ++minNeighborhoodAlpha;
+                    createVoxel(i * size,
+                                (minNeighborhoodAlpha - _minAlpha) * size,
+                                j * size,
+                                size,
+                                qRed(pixel),
+                                qGreen(pixel),
+                                qBlue(pixel));
+                }
+            }
+        }
+    }
 
+private:
+    const QImage& _image;
+    int _minAlpha;
+    float _size;
+    int _voxelsPerRegion;
+};
+
+/// the blocks of a schematic that are in one element
+class SchematicImportJob : public ImportRegionJob {
+public:
+    SchematicImportJob(const TagCompound& schematics, float size, int voxelsPerRegion, int regionX, int regionY,
+                       int regionZ, int regionsPerSide, const bool& stopImport) :
+        ImportRegionJob(regionX, regionZ, regionY, 1, regionsPerSide, stopImport),
+        _schematics(schematics),
+        _size(size),
+        _voxelsPerRegion(voxelsPerRegion) { }
+
+    virtual void run() {
+        const TagCompound& schematics = _schematics;
+        float size = _size;
+        int yEnd = std::min((_firstRegionY + 1) * _voxelsPerRegion, schematics.getHeight());
+        int zEnd = std::min((_regionZ + 1) * _voxelsPerRegion, schematics.getLength());
+        int xEnd = std::min((_regionX + 1) * _voxelsPerRegion, schematics.getWidth());
+
+        int create = 1;
+        int red = 128, green = 128, blue = 128;
+
+        for (int y = _firstRegionY * _voxelsPerRegion; y < yEnd && !_stopImport; ++y) {
+            for (int z = _regionZ * _voxelsPerRegion; z < zEnd; ++z) {
+                for (int x = _regionX * _voxelsPerRegion; x < xEnd; ++x) {
+                    int pos  = ((y * schematics.getLength()) + z) * schematics.getWidth() + x;
+                    int id   = schematics.getBlocksId()[pos];
+                    int data = schematics.getBlocksData()[pos];
+
+                    create = 1;
+                    computeBlockColor(id, data, red, green, blue, create);
+
+                    switch (create) {
+                        case 1:
+                            createVoxel(size * x, size * y, size * z, size, red, green, blue);
+                            break;
+                        case 2:
+                            switch (data) {
+                                case 0:
+                                    createVoxel(size * x + size / 2, size * y + size / 2, size * z           , size / 2, red, green, blue);
+                                    createVoxel(size * x + size / 2, size * y + size / 2, size * z + size / 2, size / 2, red, green, blue);
+                                    break;
+                                case 1:
+                                    createVoxel(size * x           , size * y + size / 2, size * z           , size / 2, red, green, blue);
+                                    createVoxel(size * x           , size * y + size / 2, size * z + size / 2, size / 2, red, green, blue);
+                                    break;
+                                case 2:
+                                    createVoxel(size * x           , size * y + size / 2, size * z + size / 2, size / 2, red, green, blue);
+                                    createVoxel(size * x + size / 2, size * y + size / 2, size * z + size / 2, size / 2, red, green, blue);
+                                    break;
+                                case 3:
+                                    createVoxel(size * x           , size * y + size / 2, size * z           , size / 2, red, green, blue);
+                                    createVoxel(size * x + size / 2, size * y + size / 2, size * z           , size / 2, red, green, blue);
+                                    break;
+                            }
+                            // There's no break on purpose.
+                        case 3:
+                            createVoxel(size * x           , size * y, size * z           , size / 2, red, green, blue);
+                            createVoxel(size * x + size / 2, size * y, size * z           , size / 2, red, green, blue);
+                            createVoxel(size * x           , size * y, size * z + size / 2, size / 2, red, green, blue);
+                            createVoxel(size * x + size / 2, size * y, size * z + size / 2, size / 2, red, green, blue);
+                            break;
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    const TagCompound& _schematics;
+    float _size;
+    int _voxelsPerRegion;
+};
+
+int VoxelTree::runImportJobs(const QVector<ImportRegionJob*>& jobs) {
+    QThreadPool workers;
+    int batchSize = QThread::idealThreadCount() * IMPORT_JOBS_PER_THREAD;
+    int voxelCount = 0;
+
+    for (int batchStart = 0; batchStart < jobs.size(); batchStart += batchSize) {
+        int batchEnd = std::min(batchStart + batchSize, jobs.size());
+        for (int i = batchStart; i < batchEnd; i++) {
+            workers.start(jobs.at(i));
+        }
+        workers.waitForDone();
+
+        for (int i = batchStart; i < batchEnd; i++) {
+            if (!_stopImport) {
+                jobs.at(i)->graftInto(*this);
+            }
+            voxelCount += jobs.at(i)->getVoxelCount();
+            delete jobs.at(i);
+        }
+        emit importProgress((100 * batchEnd) / jobs.size());
+    }
+    return voxelCount;
+}
+
+void reportImportThroughput(const char* importName, int voxelCount, quint64 startedAt) {
+    float elapsedSeconds = (float)(usecTimestampNow() - startedAt) / USECS_PER_SECOND;
+    qDebug("Created %d voxels from %s import in %.3f seconds, %.0f voxels/second.", voxelCount, importName,
+           elapsedSeconds, elapsedSeconds > 0.0f ? voxelCount / elapsedSeconds : 0.0f);
+}
 
 bool VoxelTree::readFromSquareARGB32Pixels(const char* filename) {
+    _stopImport = false;
     emit importProgress(0);
+    quint64 startedAt = usecTimestampNow();
     int minAlpha = INT_MAX;
 
     QImage pngImage = QImage(filename);
@@ -287,52 +514,32 @@ bool VoxelTree::readFromSquareARGB32Pixels(const char* filename) {
 
     emit importSize(size * pngImage.width(), 1.0f, size * pngImage.height());
 
-    QRgb pixel;
-    int minNeighborhoodAlpha;
-
-    for (int i = 0; i < pngImage.width(); ++i) {
-        for (int j = 0; j < pngImage.height(); ++j) {
-            emit importProgress((100 * (i * pngImage.height() + j)) /
-                                (pngImage.width() * pngImage.height()));
-
-            pixel = pngImage.pixel(i, j);
-            minNeighborhoodAlpha = qAlpha(pixel) - 1;
-
-            if (i != 0) {
-                minNeighborhoodAlpha = std::min(minNeighborhoodAlpha, qAlpha(pngImage.pixel(i - 1, j)));
-            }
-            if (j != 0) {
-                minNeighborhoodAlpha = std::min(minNeighborhoodAlpha, qAlpha(pngImage.pixel(i, j - 1)));
-            }
-            if (i < pngImage.width() - 1) {
-                minNeighborhoodAlpha = std::min(minNeighborhoodAlpha, qAlpha(pngImage.pixel(i + 1, j)));
-            }
-            if (j < pngImage.height() - 1) {
-                minNeighborhoodAlpha = std::min(minNeighborhoodAlpha, qAlpha(pngImage.pixel(i, j + 1)));
-            }
-
-            while (qAlpha(pixel) > minNeighborhoodAlpha) {
-                ++minNeighborhoodAlpha;
-                createVoxel(i * size,
-                            (minNeighborhoodAlpha - minAlpha) * size,
-                            j * size,
-                            size,
-                            qRed(pixel),
-                            qGreen(pixel),
-                            qBlue(pixel),
-                            true);
-            }
-
+    // each job takes the pixels under a column of elements, and the voxels stacked on them
+    int regionsPerSide = std::min(scale, 1 << IMPORT_REGION_LEVEL);
+    int voxelsPerRegion = scale / regionsPerSide;
+    QVector<ImportRegionJob*> jobs;
+    for (int x = 0; x * voxelsPerRegion < pngImage.width(); x++) {
+        for (int z = 0; z * voxelsPerRegion < pngImage.height(); z++) {
+            jobs.append(new ImageImportJob(pngImage, minAlpha, size, voxelsPerRegion, x, z, regionsPerSide, _stopImport));
         }
     }
+    int count = runImportJobs(jobs);
+
+    if (_stopImport) {
+        qDebug("[DEBUG] Canceled import at %d voxels.", count);
+        _stopImport = false;
+        return true;
+    }
 
     emit importProgress(100);
+    reportImportThroughput("image", count, startedAt);
     return true;
 }
 
 bool VoxelTree::readFromSchematicFile(const char *fileName) {
     _stopImport = false;
     emit importProgress(0);
+    quint64 startedAt = usecTimestampNow();
 
     std::stringstream ss;
     int err = retrieveData(std::string(fileName), ss);
@@ -359,68 +566,28 @@ bool VoxelTree::readFromSchematicFile(const char *fileName) {
                     size * schematics.getHeight(),
                     size * schematics.getLength());
 
-    int create = 1;
-    int red = 128, green = 128, blue = 128;
-    int count = 0;
-
-    for (int y = 0; y < schematics.getHeight(); ++y) {
-        for (int z = 0; z < schematics.getLength(); ++z) {
-            emit importProgress((int) 100 * (y * schematics.getLength() + z) / (schematics.getHeight() * schematics.getLength()));
-
-            for (int x = 0; x < schematics.getWidth(); ++x) {
-                if (_stopImport) {
-                    qDebug("[DEBUG] Canceled import at %d voxels.", count);
-                    _stopImport = false;
-                    return true;
-                }
-
-                int pos  = ((y * schematics.getLength()) + z) * schematics.getWidth() + x;
-                int id   = schematics.getBlocksId()[pos];
-                int data = schematics.getBlocksData()[pos];
-
-                create = 1;
-                computeBlockColor(id, data, red, green, blue, create);
-
-                switch (create) {
-                    case 1:
-                        createVoxel(size * x, size * y, size * z, size, red, green, blue, true);
-                        ++count;
-                        break;
-                    case 2:
-                        switch (data) {
-                            case 0:
-                                createVoxel(size * x + size / 2, size * y + size / 2, size * z           , size / 2, red, green, blue, true);
-                                createVoxel(size * x + size / 2, size * y + size / 2, size * z + size / 2, size / 2, red, green, blue, true);
-                                break;
-                            case 1:
-                                createVoxel(size * x           , size * y + size / 2, size * z           , size / 2, red, green, blue, true);
-                                createVoxel(size * x           , size * y + size / 2, size * z + size / 2, size / 2, red, green, blue, true);
-                                break;
-                            case 2:
-                                createVoxel(size * x           , size * y + size / 2, size * z + size / 2, size / 2, red, green, blue, true);
-                                createVoxel(size * x + size / 2, size * y + size / 2, size * z + size / 2, size / 2, red, green, blue, true);
-                                break;
-                            case 3:
-                                createVoxel(size * x           , size * y + size / 2, size * z           , size / 2, red, green, blue, true);
-                                createVoxel(size * x + size / 2, size * y + size / 2, size * z           , size / 2, red, green, blue, true);
-                                break;
-                        }
-                        count += 2;
-                        // There's no break on purpose.
-                    case 3:
-                        createVoxel(size * x           , size * y, size * z           , size / 2, red, green, blue, true);
-                        createVoxel(size * x + size / 2, size * y, size * z           , size / 2, red, green, blue, true);
-                        createVoxel(size * x           , size * y, size * z + size / 2, size / 2, red, green, blue, true);
-                        createVoxel(size * x + size / 2, size * y, size * z + size / 2, size / 2, red, green, blue, true);
-                        count += 4;
-                        break;
-                }
+    // each job takes the blocks in one element
+    int regionsPerSide = std::min(scale, 1 << IMPORT_REGION_LEVEL);
+    int voxelsPerRegion = scale / regionsPerSide;
+    QVector<ImportRegionJob*> jobs;
+    for (int y = 0; y * voxelsPerRegion < schematics.getHeight(); y++) {
+        for (int z = 0; z * voxelsPerRegion < schematics.getLength(); z++) {
+            for (int x = 0; x * voxelsPerRegion < schematics.getWidth(); x++) {
+                jobs.append(new SchematicImportJob(schematics, size, voxelsPerRegion, x, y, z, regionsPerSide,
+                                                   _stopImport));
             }
         }
     }
+    int count = runImportJobs(jobs);
+
+    if (_stopImport) {
+        qDebug("[DEBUG] Canceled import at %d voxels.", count);
+        _stopImport = false;
+        return true;
+    }
 
     emit importProgress(100);
-    qDebug("Created %d voxels from minecraft import.", count);
+    reportImportThroughput("minecraft", count, startedAt);
 
     return true;
 }
@@ -521,6 +688,36 @@ bool VoxelTree::handlesEditPacketType(PacketType packetType) const {
     }
 }
 
+// every kind of voxel edit is a list of octal codes followed by colors, erases included
+bool VoxelTree::splitEditPacket(const QByteArray& packet, const unsigned char* rootOctalCode,
+                                QByteArray& insidePacket, QByteArray& outsidePacket) const {
+    int headerBytes = numBytesForPacketHeader(packet) + sizeof(unsigned short int) + sizeof(quint64);
+    insidePacket = packet.left(headerBytes);
+    outsidePacket = packet.left(headerBytes);
+    int atByte = headerBytes;
+    while (atByte < packet.size()) {
+        const unsigned char* voxelCode = (const unsigned char*)packet.constData() + atByte;
+        int codeLength = numberOfThreeBitSectionsInCode(voxelCode, packet.size() - atByte);
+        if (codeLength == OVERFLOWED_OCTCODE_BUFFER) {
+            break;
+        }
+        int voxelDataSize = bytesRequiredForCodeLength(codeLength) + SIZE_OF_COLOR_DATA;
+        if (atByte + voxelDataSize > packet.size()) {
+            break;
+        }
+        QByteArray& splitPacket = isAncestorOf(rootOctalCode, voxelCode) ? insidePacket : outsidePacket;
+        splitPacket.append(packet.constData() + atByte, voxelDataSize);
+        atByte += voxelDataSize;
+    }
+    if (insidePacket.size() == headerBytes) {
+        insidePacket.clear();
+    }
+    if (outsidePacket.size() == headerBytes) {
+        outsidePacket.clear();
+    }
+    return true;
+}
+
 int VoxelTree::processEditPacketData(PacketType packetType, const unsigned char* packetData, int packetLength,
                     const unsigned char* editData, int maxLength, Node* senderNode) {
     
@@ -547,6 +744,10 @@ int VoxelTree::processEditPacketData(PacketType packetType, const unsigned char*
                 return 0;
             }
 
+            // the page the edit lands in has to be in the tree first
+            if (getPager()) {
+                getPager()->willEditOctalCode(editData, false);
+            }
             readCodeColorBufferToTree(editData, destructive);
 
             return voxelDataSize;
@@ -22,6 +22,7 @@
 #include "VoxelSceneStats.h"
 #include "VoxelEditPacketSender.h"
 
+class ImportRegionJob;
 class ReadCodeColorBufferToTreeArgs;
 
 class VoxelTree : public Octree {
@@ -43,16 +44,19 @@ public:
     void nudgeSubTree(VoxelTreeElement* elementToNudge, const glm::vec3& nudgeAmount, VoxelEditPacketSender& voxelEditSender);
 
 
-    /// reads voxels from square image with alpha as a Y-axis
+    /// reads voxels from square image with alpha as a Y-axis, building columns of the image on all cores
     bool readFromSquareARGB32Pixels(const char *filename);
 
-    /// reads from minecraft file
+    /// reads from minecraft file, building regions of the schematic on all cores
     bool readFromSchematicFile(const char* filename);
 
     void readCodeColorBufferToTree(const unsigned char* codeColorBuffer, bool destructive = false);
 
     virtual PacketType expectedDataPacketType() const { return PacketTypeVoxelData; }
     virtual bool handlesEditPacketType(PacketType packetType) const;
+    virtual bool canBePaged() const { return true; }
+    virtual bool splitEditPacket(const QByteArray& packet, const unsigned char* rootOctalCode,
+                                 QByteArray& insidePacket, QByteArray& outsidePacket) const;
     virtual int processEditPacketData(PacketType packetType, const unsigned char* packetData, int packetLength,
                     const unsigned char* editData, int maxLength, Node* senderNode);
     void processSetVoxelsBitstream(const unsigned char* bitstream, int bufferSizeBytes);
@@ -67,6 +71,9 @@ public slots:
 **/
 
 private:
+    /// runs the jobs of an import a batch at a time and grafts what they build into the tree, returns the voxels built
+    int runImportJobs(const QVector<ImportRegionJob*>& jobs);
+
     // helper functions for nudgeSubTree
     void recurseNodeForNudge(VoxelTreeElement* element, RecurseOctreeOperation operation, void* extraData);
     static bool nudgeCheck(OctreeElement* element, void* extraData);
@@ -77,6 +77,13 @@ int VoxelTreeElement::readElementDataFromBuffer(const unsigned char* data, int b
     return BYTES_PER_COLOR;
 }
 
+quint64 VoxelTreeElement::hashElementData() const {
+    // the true color, since false colors are only for showing things on the client, and whether it's colored, so
+    // that an uncolored element doesn't hash like a black one
+    return combineHashes(0, ((quint64)_trueColor[3] << 24) | (_trueColor[0] << 16) | (_trueColor[1] << 8)
+                         | _trueColor[2]);
+}
+
 
 const uint8_t INDEX_FOR_NULL = 0;
 uint8_t VoxelTreeElement::_nextIndex = INDEX_FOR_NULL + 1; // start at 1, 0 is reserved for NULL
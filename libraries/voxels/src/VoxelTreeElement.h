@@ -42,6 +42,7 @@ public:
     virtual bool requiresSplit() const;
     virtual bool appendElementData(OctreePacketData* packetData) const;
     virtual int readElementDataFromBuffer(const unsigned char* data, int bytesLeftToRead, ReadBitstreamToTreeParams& args);
+    virtual quint64 hashElementData() const;
     virtual void calculateAverageFromChildren();
     virtual bool collapseChildren();
     virtual bool findSpherePenetration(const glm::vec3& center, float radius, 
@@ -6,8 +6,27 @@
 //  Copyright (c) 2013 HighFidelity, Inc. All rights reserved.
 //
 
+#include <algorithm>
+
+#include <ViewFrustum.h>
+
+#include "VoxelTree.h"
+#include "VoxelTreeElement.h"
 #include "VoxelsScriptingInterface.h"
 
+VoxelsScriptingInterface::VoxelsScriptingInterface() :
+    _voxelTree(NULL),
+    _spatialQuery(NULL)
+{
+}
+
+void VoxelsScriptingInterface::setVoxelTree(VoxelTree* voxelTree) {
+    _voxelTree = voxelTree;
+
+    QMutexLocker locker(&_spatialQueryMutex);
+    _spatialQuery = OctreeSpatialQuery(voxelTree);
+}
+
 void VoxelsScriptingInterface::queueVoxelAdd(PacketType addPacketType, VoxelDetail& addVoxelDetails) {
     getVoxelPacketSender()->queueVoxelEditMessages(addPacketType, 1, &addVoxelDetails);
 }
@@ -41,3 +60,175 @@ void VoxelsScriptingInterface::eraseVoxel(float x, float y, float z, float scale
     getVoxelPacketSender()->queueVoxelEditMessages(PacketTypeVoxelErase, 1, &deleteVoxelDetail);
 }
 
+
+int VoxelsScriptingInterface::queueVoxels(PacketType packetType, const QVariantList& positions, const QVariantList& scales,
+                                          const QVariantList& colors) {
+    const int COMPONENTS_PER_POSITION = 3;
+    const int COMPONENTS_PER_COLOR = 3;
+
+    int voxelCount = positions.size() / COMPONENTS_PER_POSITION;
+    bool hasScalePerVoxel = scales.size() >= voxelCount;
+    bool hasColorPerVoxel = colors.size() >= voxelCount * COMPONENTS_PER_COLOR;
+    if (voxelCount == 0 || scales.isEmpty() || (!colors.isEmpty() && colors.size() < COMPONENTS_PER_COLOR)) {
+        return 0;
+    }
+
+    QVector<VoxelDetail> details(voxelCount);
+    for (int i = 0; i < voxelCount; i++) {
+        VoxelDetail& detail = details[i];
+        detail.x = positions.at(i * COMPONENTS_PER_POSITION).toFloat() / (float)TREE_SCALE;
+        detail.y = positions.at(i * COMPONENTS_PER_POSITION + 1).toFloat() / (float)TREE_SCALE;
+        detail.z = positions.at(i * COMPONENTS_PER_POSITION + 2).toFloat() / (float)TREE_SCALE;
+        detail.s = scales.at(hasScalePerVoxel ? i : 0).toFloat() / (float)TREE_SCALE;
+
+        if (colors.isEmpty()) {
+            detail.red = detail.green = detail.blue = 0;
+        } else {
+            int color = hasColorPerVoxel ? i * COMPONENTS_PER_COLOR : 0;
+            detail.red = colors.at(color).toInt();
+            detail.green = colors.at(color + 1).toInt();
+            detail.blue = colors.at(color + 2).toInt();
+        }
+    }
+
+    getVoxelPacketSender()->queueVoxelEditMessages(packetType, voxelCount, details.data());
+    return voxelCount;
+}
+
+int VoxelsScriptingInterface::setVoxels(const QVariantList& positions, const QVariantList& scales,
+                                        const QVariantList& colors) {
+    if (colors.isEmpty()) {
+        return 0;
+    }
+    return queueVoxels(PacketTypeVoxelSetDestructive, positions, scales, colors);
+}
+
+int VoxelsScriptingInterface::eraseVoxels(const QVariantList& positions, const QVariantList& scales) {
+    return queueVoxels(PacketTypeVoxelErase, positions, scales, QVariantList());
+}
+
+int VoxelsScriptingInterface::setVoxelGrid(float x, float y, float z, float scale, int width, int height, int depth,
+                                           const QVariantList& colors) {
+    const int COMPONENTS_PER_COLOR = 3;
+    if (width <= 0 || height <= 0 || depth <= 0 || colors.size() < width * height * depth * COMPONENTS_PER_COLOR) {
+        return 0;
+    }
+
+    QVector<VoxelDetail> details;
+    details.reserve(width * height * depth);
+
+    VoxelDetail detail;
+    detail.s = scale / (float)TREE_SCALE;
+    int color = 0;
+    for (int k = 0; k < depth; k++) {
+        detail.z = (z + k * scale) / (float)TREE_SCALE;
+        for (int j = 0; j < height; j++) {
+            detail.y = (y + j * scale) / (float)TREE_SCALE;
+            for (int i = 0; i < width; i++, color += COMPONENTS_PER_COLOR) {
+                int red = colors.at(color).toInt();
+                if (red < 0) {
+                    continue;
+                }
+                detail.x = (x + i * scale) / (float)TREE_SCALE;
+                detail.red = red;
+                detail.green = colors.at(color + 1).toInt();
+                detail.blue = colors.at(color + 2).toInt();
+                details.append(detail);
+            }
+        }
+    }
+
+    getVoxelPacketSender()->queueVoxelEditMessages(PacketTypeVoxelSetDestructive, details.size(), details.data());
+    return details.size();
+}
+
+QVector<VoxelDetail> VoxelsScriptingInterface::voxelDetailsForResults(const QVector<SpatialQueryResult>& results) const {
+    QVector<VoxelDetail> details(results.size());
+    for (int i = 0; i < results.size(); i++) {
+        VoxelDetail& detail = details[i];
+        const VoxelTreeElement* voxel = static_cast<const VoxelTreeElement*>(results.at(i).element);
+        if (voxel) {
+            detail.x = voxel->getCorner().x;
+            detail.y = voxel->getCorner().y;
+            detail.z = voxel->getCorner().z;
+            detail.s = voxel->getScale();
+            detail.red = voxel->getColor()[RED_INDEX];
+            detail.green = voxel->getColor()[GREEN_INDEX];
+            detail.blue = voxel->getColor()[BLUE_INDEX];
+        } else {
+            detail.x = detail.y = detail.z = detail.s = 0.0f;
+            detail.red = detail.green = detail.blue = 0;
+        }
+    }
+    return details;
+}
+
+QVector<VoxelDetail> VoxelsScriptingInterface::findNearestVoxels(const glm::vec3& center, int count, float maxDistance) {
+    QVector<VoxelDetail> result;
+    if (_voxelTree) {
+        QMutexLocker locker(&_spatialQueryMutex);
+        _voxelTree->lockForRead();
+        result = voxelDetailsForResults(_spatialQuery.findNearest(center / (float)TREE_SCALE, count,
+                                                                  maxDistance / (float)TREE_SCALE));
+        _voxelTree->unlock();
+    }
+    return result;
+}
+
+QVector<VoxelDetail> VoxelsScriptingInterface::findVoxelsInBox(const glm::vec3& corner, float scale) {
+    QVector<VoxelDetail> result;
+    if (_voxelTree) {
+        QMutexLocker locker(&_spatialQueryMutex);
+        _voxelTree->lockForRead();
+        result = voxelDetailsForResults(_spatialQuery.findInBox(AABox(corner / (float)TREE_SCALE, scale / (float)TREE_SCALE)));
+        _voxelTree->unlock();
+    }
+    return result;
+}
+
+QVector<VoxelDetail> VoxelsScriptingInterface::findVoxelsInFrustum(const glm::vec3& position, const glm::quat& orientation,
+                                                                   float fieldOfView, float aspectRatio,
+                                                                   float nearClip, float farClip) {
+    QVector<VoxelDetail> result;
+    if (_voxelTree) {
+        ViewFrustum viewFrustum;
+        viewFrustum.setPosition(position);
+        viewFrustum.setOrientation(orientation);
+        viewFrustum.setFieldOfView(fieldOfView);
+        viewFrustum.setAspectRatio(aspectRatio);
+        viewFrustum.setNearClip(nearClip);
+        viewFrustum.setFarClip(farClip);
+        viewFrustum.calculate();
+
+        QMutexLocker locker(&_spatialQueryMutex);
+        _voxelTree->lockForRead();
+        result = voxelDetailsForResults(_spatialQuery.findInView(viewFrustum));
+        _voxelTree->unlock();
+    }
+    return result;
+}
+
+QVector<VoxelDetail> VoxelsScriptingInterface::findRayIntersections(const QVariantList& origins,
+                                                                    const QVariantList& directions) {
+    const int COMPONENTS_PER_VECTOR = 3;
+
+    QVector<VoxelDetail> result;
+    if (_voxelTree) {
+        int rayCount = std::min(origins.size(), directions.size()) / COMPONENTS_PER_VECTOR;
+        QVector<glm::vec3> rayOrigins(rayCount);
+        QVector<glm::vec3> rayDirections(rayCount);
+        for (int i = 0; i < rayCount; i++) {
+            int vector = i * COMPONENTS_PER_VECTOR;
+            rayOrigins[i] = glm::vec3(origins.at(vector).toFloat(), origins.at(vector + 1).toFloat(),
+                                      origins.at(vector + 2).toFloat()) / (float)TREE_SCALE;
+            rayDirections[i] = glm::normalize(glm::vec3(directions.at(vector).toFloat(), directions.at(vector + 1).toFloat(),
+                                                        directions.at(vector + 2).toFloat()));
+        }
+
+        QMutexLocker locker(&_spatialQueryMutex);
+        _voxelTree->lockForRead();
+        result = voxelDetailsForResults(_spatialQuery.findRayIntersections(rayOrigins, rayDirections));
+        _voxelTree->unlock();
+    }
+    return result;
+}
@@ -9,22 +9,33 @@
 #ifndef __hifi__VoxelsScriptingInterface__
 #define __hifi__VoxelsScriptingInterface__
 
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
+#include <QtCore/QVariantList>
 
 #include <OctreeScriptingInterface.h>
+#include <OctreeSpatialQuery.h>
 
 #include "VoxelConstants.h"
 #include "VoxelEditPacketSender.h"
 
+class VoxelTree;
+
 /// handles scripting of voxel commands from JS passed to assigned clients
 class VoxelsScriptingInterface : public OctreeScriptingInterface {
     Q_OBJECT
-public:    
+public:
+    VoxelsScriptingInterface();
+
     VoxelEditPacketSender* getVoxelPacketSender() { return (VoxelEditPacketSender*)getPacketSender(); }
 
     virtual NodeType_t getServerNodeType() const { return NodeType::VoxelServer; }
     virtual OctreeEditPacketSender* createPacketSender() { return new VoxelEditPacketSender(); }
 
+    /// sets the local voxel tree the find functions search, in contexts that have one
+    void setVoxelTree(VoxelTree* voxelTree);
+    VoxelTree* getVoxelTree() { return _voxelTree; }
+
 public slots:
     /// queues the creation of a voxel which will be sent by calling process on the PacketSender
     /// \param x the x-coordinate of the voxel (in meter units)
@@ -53,8 +64,65 @@ public slots:
     /// \param scale the scale of the voxel (in meter units)
     void eraseVoxel(float x, float y, float z, float scale);
 
+    /// queues the destructive creation of many voxels in one call
+    /// \param positions the x, y, z coordinates of each voxel one after another (in meter units)
+    /// \param scales the scale of each voxel, or a single scale for all of them (in meter units)
+    /// \param colors the red, green, blue values of each voxel one after another, or a single color for all of them
+    /// \return the number of voxels queued
+    int setVoxels(const QVariantList& positions, const QVariantList& scales, const QVariantList& colors);
+
+    /// queues the deletion of many voxels in one call
+    /// \param positions the x, y, z coordinates of each voxel one after another (in meter units)
+    /// \param scales the scale of each voxel, or a single scale for all of them (in meter units)
+    /// \return the number of voxels queued
+    int eraseVoxels(const QVariantList& positions, const QVariantList& scales);
+
+    /// queues the destructive creation of a box of equally sized voxels
+    /// \param x the x-coordinate of the corner of the box (in meter units)
+    /// \param y the y-coordinate of the corner of the box (in meter units)
+    /// \param z the z-coordinate of the corner of the box (in meter units)
+    /// \param scale the scale of each voxel (in meter units)
+    /// \param width the number of voxels along x
+    /// \param height the number of voxels along y
+    /// \param depth the number of voxels along z
+    /// \param colors the red, green, blue values of each voxel one after another, x fastest then y then z, a negative red
+    /// leaves that voxel alone
+    /// \return the number of voxels queued
+    int setVoxelGrid(float x, float y, float z, float scale, int width, int height, int depth, const QVariantList& colors);
+
+    /// finds up to count voxels closest to the center point, closest first, no farther than maxDistance from it
+    /// (in meter units, measured to the surface of the voxels)
+    /// this function will not find any voxels in script engine contexts which don't have a local voxel tree
+    QVector<VoxelDetail> findNearestVoxels(const glm::vec3& center, int count, float maxDistance);
+
+    /// finds voxels that touch the cube with the given corner and scale (in meter units)
+    /// this function will not find any voxels in script engine contexts which don't have a local voxel tree
+    QVector<VoxelDetail> findVoxelsInBox(const glm::vec3& corner, float scale);
+
+    /// finds voxels that are at least partly in the view of a camera with the given position and orientation, field of
+    /// view in degrees, and near and far clip distances (in meter units)
+    /// this function will not find any voxels in script engine contexts which don't have a local voxel tree
+    QVector<VoxelDetail> findVoxelsInFrustum(const glm::vec3& position, const glm::quat& orientation, float fieldOfView,
+                                             float aspectRatio, float nearClip, float farClip);
+
+    /// finds the first voxel each of many rays hits, one VoxelDetail per ray in the order of the rays, with a zero
+    /// scale for rays that hit nothing
+    /// \param origins the x, y, z coordinates of each ray's origin one after another (in meter units)
+    /// \param directions the x, y, z of each ray's direction one after another
+    /// this function will not find any voxels in script engine contexts which don't have a local voxel tree
+    QVector<VoxelDetail> findRayIntersections(const QVariantList& origins, const QVariantList& directions);
+
 private:
     void queueVoxelAdd(PacketType addPacketType, VoxelDetail& addVoxelDetails);
+    int queueVoxels(PacketType packetType, const QVariantList& positions, const QVariantList& scales,
+                    const QVariantList& colors);
+    QVector<VoxelDetail> voxelDetailsForResults(const QVector<SpatialQueryResult>& results) const;
+
+    VoxelTree* _voxelTree;
+
+    // the scripting interface is shared by every script engine, so the query's buffers are guarded by their own lock
+    OctreeSpatialQuery _spatialQuery;
+    QMutex _spatialQueryMutex;
 };
 
 #endif /* defined(__hifi__VoxelsScriptingInterface__) */
@@ -0,0 +1,201 @@
+//
+//  LoadTester.cpp
+//  hifi
+//
+//  Created on 2/5/14.
+//  Copyright (c) 2014 HighFidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include <QtCore/QDebug>
+#include <QtCore/QStringList>
+
+#include <NodeList.h>
+#include <SharedUtil.h>
+
+#include "LoadTester.h"
+
+const int DEFAULT_AGENTS = 100;
+const int AGENTS_PER_SPAWN = 10;
+const int AGENT_SPAWN_INTERVAL_MSECS = 100;
+
+// agents catch up on any audio frames they missed, so this only needs to be comfortably under one audio frame
+const int AGENT_SIMULATE_INTERVAL_MSECS = 5;
+
+const int DEFAULT_REPORT_INTERVAL_SECONDS = 5;
+
+LoadTester::LoadTester(int &argc, char **argv) :
+    QCoreApplication(argc, argv),
+    _domainSockAddr(),
+    _targetAgents(DEFAULT_AGENTS),
+    _editsPerSecond(0.0f),
+    _wantPerAgentReport(false),
+    _agents(),
+    _spawnTimer(),
+    _simulateTimer(),
+    _reportTimer(),
+    _lastReportUsecs(usecTimestampNow())
+{
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    const char* AGENTS_OPTION = "--agents";
+    const char* agentsString = getCmdOption(argc, (const char**) argv, AGENTS_OPTION);
+    if (agentsString) {
+        _targetAgents = atoi(agentsString);
+    }
+
+    // --domain takes a hostname with an optional port, --local is shorthand for this machine
+    QString domainHostname = DEFAULT_DOMAIN_HOSTNAME;
+    quint16 domainPort = DEFAULT_DOMAIN_SERVER_PORT;
+
+    const char* DOMAIN_OPTION = "--domain";
+    const char* LOCAL_OPTION = "--local";
+    const char* domainString = getCmdOption(argc, (const char**) argv, DOMAIN_OPTION);
+    if (domainString) {
+        QStringList hostnameAndPort = QString(domainString).split(':');
+        domainHostname = hostnameAndPort[0];
+        if (hostnameAndPort.size() > 1) {
+            domainPort = hostnameAndPort[1].toUShort();
+        }
+    } else if (cmdOptionExists(argc, (const char**) argv, LOCAL_OPTION)) {
+        domainHostname = "127.0.0.1";
+    }
+
+    _domainSockAddr = HifiSockAddr(domainHostname, domainPort);
+    if (_domainSockAddr.getAddress().isNull()) {
+        qDebug() << "Could not resolve domain-server hostname" << domainHostname;
+    }
+
+    const char* EDITS_OPTION = "--editsPerSecond";
+    const char* editsString = getCmdOption(argc, (const char**) argv, EDITS_OPTION);
+    if (editsString) {
+        _editsPerSecond = atof(editsString);
+    }
+
+    const char* PER_AGENT_REPORT_OPTION = "--perAgentReport";
+    _wantPerAgentReport = cmdOptionExists(argc, (const char**) argv, PER_AGENT_REPORT_OPTION);
+
+    int reportIntervalSeconds = DEFAULT_REPORT_INTERVAL_SECONDS;
+    const char* REPORT_INTERVAL_OPTION = "--reportInterval";
+    const char* reportIntervalString = getCmdOption(argc, (const char**) argv, REPORT_INTERVAL_OPTION);
+    if (reportIntervalString) {
+        reportIntervalSeconds = atoi(reportIntervalString);
+    }
+
+    qDebug() << "Load testing" << _domainSockAddr << "with" << _targetAgents << "agents,"
+        << _editsPerSecond << "edits per second per agent.";
+
+    // bring the agents up a few at a time so the domain-server is not hit by all of their first check-ins at once
+    connect(&_spawnTimer, SIGNAL(timeout()), SLOT(spawnAgents()));
+    _spawnTimer.start(AGENT_SPAWN_INTERVAL_MSECS);
+
+    _simulateTimer.setTimerType(Qt::PreciseTimer);
+    connect(&_simulateTimer, SIGNAL(timeout()), SLOT(simulateAgents()));
+    _simulateTimer.start(AGENT_SIMULATE_INTERVAL_MSECS);
+
+    connect(&_reportTimer, SIGNAL(timeout()), SLOT(printIntervalReport()));
+    _reportTimer.start(reportIntervalSeconds * 1000);
+
+    const char* DURATION_OPTION = "--duration";
+    const char* durationString = getCmdOption(argc, (const char**) argv, DURATION_OPTION);
+    if (durationString) {
+        QTimer::singleShot(atoi(durationString) * 1000, this, SLOT(finish()));
+    }
+}
+
+void LoadTester::spawnAgents() {
+    for (int i = 0; i < AGENTS_PER_SPAWN && _agents.size() < _targetAgents; i++) {
+        _agents.append(new SyntheticAgent(_agents.size(), _domainSockAddr, _editsPerSecond, this));
+    }
+
+    if (_agents.size() >= _targetAgents) {
+        _spawnTimer.stop();
+        qDebug() << "All" << _agents.size() << "agents are running.";
+    }
+}
+
+void LoadTester::simulateAgents() {
+    quint64 now = usecTimestampNow();
+    foreach (SyntheticAgent* agent, _agents) {
+        agent->simulate(now);
+    }
+}
+
+void LoadTester::printIntervalReport() {
+    quint64 now = usecTimestampNow();
+    float intervalSeconds = (float) (now - _lastReportUsecs) / USECS_PER_SECOND;
+    _lastReportUsecs = now;
+
+    if (_agents.isEmpty() || intervalSeconds <= 0.0f) {
+        return;
+    }
+
+    AgentStats totals;
+    int agentsWithServers = 0;
+    int agentsWithScenes = 0;
+    quint64 totalFirstSceneUsecs = 0;
+
+    foreach (SyntheticAgent* agent, _agents) {
+        AgentStats stats = agent->takeIntervalStats();
+
+        if (_wantPerAgentReport) {
+            printAgentReport(agent, stats, intervalSeconds);
+        }
+
+        for (int i = 0; i < NUM_AGENT_STREAMS; i++) {
+            totals.bytesReceived[i] += stats.bytesReceived[i];
+        }
+        totals.bytesSent += stats.bytesSent;
+        totals.serversConnected += stats.serversConnected;
+        totals.pingSamples += stats.pingSamples;
+        totals.totalPingUsecs += stats.totalPingUsecs;
+        totals.maxPingUsecs = std::max(totals.maxPingUsecs, stats.maxPingUsecs);
+
+        if (stats.serversConnected > 0) {
+            agentsWithServers++;
+        }
+        if (stats.scenesCompleted > 0) {
+            agentsWithScenes++;
+            totalFirstSceneUsecs += stats.firstSceneUsecs;
+        }
+    }
+
+    int numAgents = _agents.size();
+    float kbpsScale = 8.0f / 1000.0f / intervalSeconds / numAgents;
+
+    qDebug("%d agents, %d connected to at least one server, %.1f servers per agent",
+           numAgents, agentsWithServers, (float) totals.serversConnected / numAgents);
+    qDebug("    per agent kbps in - audio %.1f avatars %.1f octree %.1f other %.1f, out %.1f",
+           totals.bytesReceived[AudioStream] * kbpsScale, totals.bytesReceived[AvatarStream] * kbpsScale,
+           totals.bytesReceived[OctreeStream] * kbpsScale, totals.bytesReceived[OtherStream] * kbpsScale,
+           totals.bytesSent * kbpsScale);
+    qDebug("    ping msecs - avg %.1f max %.1f over %d samples",
+           totals.pingSamples > 0 ? (float) totals.totalPingUsecs / totals.pingSamples / USECS_PER_MSEC : 0.0f,
+           (float) totals.maxPingUsecs / USECS_PER_MSEC, totals.pingSamples);
+    qDebug("    %d of %d agents have a complete scene, first one took %.2f seconds on average",
+           agentsWithScenes, numAgents,
+           agentsWithScenes > 0 ? (float) totalFirstSceneUsecs / agentsWithScenes / USECS_PER_SECOND : 0.0f);
+}
+
+void LoadTester::printAgentReport(const SyntheticAgent* agent, const AgentStats& stats, float intervalSeconds) {
+    float kbpsScale = 8.0f / 1000.0f / intervalSeconds;
+
+    qDebug("    agent %d %s - servers %d, kbps in audio %.1f avatars %.1f octree %.1f, ping avg %.1f max %.1f msecs,"
+           " scenes %d, elements %lu, first scene %.2f secs",
+           agent->getAgentIndex(), agent->getUUID().toString().toLocal8Bit().constData(), stats.serversConnected,
+           stats.bytesReceived[AudioStream] * kbpsScale, stats.bytesReceived[AvatarStream] * kbpsScale,
+           stats.bytesReceived[OctreeStream] * kbpsScale,
+           stats.pingSamples > 0 ? (float) stats.totalPingUsecs / stats.pingSamples / USECS_PER_MSEC : 0.0f,
+           (float) stats.maxPingUsecs / USECS_PER_MSEC, stats.scenesCompleted, stats.lastSceneElements,
+           (float) stats.firstSceneUsecs / USECS_PER_SECOND);
+}
+
+void LoadTester::finish() {
+    // the last report always breaks things down by agent
+    _wantPerAgentReport = true;
+    printIntervalReport();
+    quit();
+}
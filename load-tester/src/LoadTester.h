@@ -0,0 +1,47 @@
+//
+//  LoadTester.h
+//  hifi
+//
+//  Created on 2/5/14.
+//  Copyright (c) 2014 HighFidelity, Inc. All rights reserved.
+//
+//  Runs a fleet of SyntheticAgents against a domain and reports what they receive.
+//
+
+#ifndef __hifi__LoadTester__
+#define __hifi__LoadTester__
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QList>
+#include <QtCore/QTimer>
+
+#include <HifiSockAddr.h>
+
+#include "SyntheticAgent.h"
+
+class LoadTester : public QCoreApplication {
+    Q_OBJECT
+public:
+    LoadTester(int &argc, char **argv);
+private slots:
+    void spawnAgents();
+    void simulateAgents();
+    void printIntervalReport();
+    void finish();
+private:
+    void printAgentReport(const SyntheticAgent* agent, const AgentStats& stats, float intervalSeconds);
+
+    HifiSockAddr _domainSockAddr;
+    int _targetAgents;
+    float _editsPerSecond;
+    bool _wantPerAgentReport;
+
+    QList<SyntheticAgent*> _agents;
+    QTimer _spawnTimer;
+    QTimer _simulateTimer;
+    QTimer _reportTimer;
+
+    quint64 _lastReportUsecs;
+};
+
+#endif /* defined(__hifi__LoadTester__) */
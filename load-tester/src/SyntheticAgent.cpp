@@ -0,0 +1,429 @@
+//
+//  SyntheticAgent.cpp
+//  hifi
+//
+//  Created on 2/5/14.
+//  Copyright (c) 2014 HighFidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <cstring>
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDebug>
+
+#include <AudioRingBuffer.h>
+#include <NodeList.h>
+#include <OctalCode.h>
+#include <OctreeConstants.h>
+#include <OctreeSceneStats.h>
+#include <Particle.h>
+#include <SharedUtil.h>
+
+#include "SyntheticAgent.h"
+
+const quint64 AGENT_PING_INTERVAL_USECS = 1 * USECS_PER_SECOND;
+const quint64 AGENT_AVATAR_DATA_INTERVAL_USECS = USECS_PER_SECOND / 60;
+
+// agents walk in circles around a random spot in the first corner of the domain so their frusta keep changing
+const float AGENT_AREA_SCALE = 50.0f;
+const float AGENT_ORBIT_RADIUS = 5.0f;
+const float AGENT_ORBIT_SECONDS = 20.0f;
+const float AGENT_EYE_HEIGHT = 1.6f;
+
+const float AGENT_CAMERA_FOV = 90.0f;
+const float AGENT_CAMERA_ASPECT_RATIO = 16.0f / 9.0f;
+const float AGENT_CAMERA_NEAR_CLIP = 0.08f;
+const float AGENT_CAMERA_FAR_CLIP = 50.0f * TREE_SCALE;
+
+const float AGENT_TONE_BASE_FREQUENCY = 220.0f;
+const float AGENT_TONE_AMPLITUDE = 4000.0f;
+
+const float AGENT_EDIT_VOXEL_SIZE = 0.25f;
+const float AGENT_EDIT_PARTICLE_LIFETIME = 10.0f;
+
+AgentStats::AgentStats() :
+    bytesSent(0),
+    serversConnected(0),
+    pingSamples(0),
+    totalPingUsecs(0),
+    maxPingUsecs(0),
+    scenesCompleted(0),
+    firstSceneUsecs(0),
+    lastSceneElements(0)
+{
+    memset(bytesReceived, 0, sizeof(bytesReceived));
+}
+
+SyntheticAgent::SyntheticAgent(int agentIndex, const HifiSockAddr& domainSockAddr, float editsPerSecond, QObject* parent) :
+    QObject(parent),
+    _agentIndex(agentIndex),
+    _uuid(QUuid::createUuid()),
+    _socket(),
+    _domainSockAddr(domainSockAddr),
+    _servers(),
+    _avatarData(),
+    _voxelQuery(),
+    _orbitCenter(randFloat() * AGENT_AREA_SCALE, 0.0f, randFloat() * AGENT_AREA_SCALE),
+    _orbitPhase(randFloat() * 2.0f * PIf),
+    _editsPerSecond(editsPerSecond),
+    _editSequence(0),
+    _audioSamplesSent(0),
+    _startUsecs(usecTimestampNow()),
+    _nextCheckInUsecs(_startUsecs),
+    _nextPingUsecs(_startUsecs),
+    _nextAudioUsecs(_startUsecs),
+    _nextAvatarUsecs(_startUsecs),
+    _nextEditUsecs(_startUsecs),
+    _firstQueryUsecs(0),
+    _intervalStats(),
+    _scenesCompleted(0),
+    _firstSceneUsecs(0),
+    _lastSceneElements(0)
+{
+    _socket.bind(QHostAddress::AnyIPv4, 0);
+    connect(&_socket, SIGNAL(readyRead()), SLOT(readPendingDatagrams()));
+
+    _voxelQuery.setCameraFov(AGENT_CAMERA_FOV);
+    _voxelQuery.setCameraAspectRatio(AGENT_CAMERA_ASPECT_RATIO);
+    _voxelQuery.setCameraNearClip(AGENT_CAMERA_NEAR_CLIP);
+    _voxelQuery.setCameraFarClip(AGENT_CAMERA_FAR_CLIP);
+}
+
+void SyntheticAgent::simulate(quint64 now) {
+    if (now >= _nextCheckInUsecs) {
+        sendDomainServerCheckIn();
+        _nextCheckInUsecs += DOMAIN_SERVER_CHECK_IN_USECS;
+    }
+
+    if (now >= _nextPingUsecs) {
+        sendPings(now);
+        _nextPingUsecs += AGENT_PING_INTERVAL_USECS;
+    }
+
+    updateMotion(now);
+
+    // audio goes out at the network frame rate, catch up if we were held off for more than one frame
+    while (now >= _nextAudioUsecs) {
+        sendAudio();
+        _nextAudioUsecs += BUFFER_SEND_INTERVAL_USECS;
+    }
+
+    if (now >= _nextAvatarUsecs) {
+        sendAvatarData();
+        sendOctreeQueries();
+        _nextAvatarUsecs = now + AGENT_AVATAR_DATA_INTERVAL_USECS;
+    }
+
+    if (_editsPerSecond > 0.0f && now >= _nextEditUsecs) {
+        sendEdits(now);
+        _nextEditUsecs = now + USECS_PER_SECOND / _editsPerSecond;
+    }
+}
+
+AgentStats SyntheticAgent::takeIntervalStats() {
+    AgentStats stats = _intervalStats;
+
+    foreach (const AgentServer& server, _servers) {
+        if (!server.activeSocket.isNull()) {
+            stats.serversConnected++;
+        }
+    }
+
+    stats.scenesCompleted = _scenesCompleted;
+    stats.firstSceneUsecs = _firstSceneUsecs;
+    stats.lastSceneElements = _lastSceneElements;
+
+    _intervalStats = AgentStats();
+    return stats;
+}
+
+void SyntheticAgent::readPendingDatagrams() {
+    static QByteArray receivedPacket;
+    static HifiSockAddr senderSockAddr;
+
+    while (_socket.hasPendingDatagrams()) {
+        receivedPacket.resize(_socket.pendingDatagramSize());
+        _socket.readDatagram(receivedPacket.data(), receivedPacket.size(),
+                             senderSockAddr.getAddressPointer(), senderSockAddr.getPortPointer());
+
+        if (!packetVersionMatch(receivedPacket)) {
+            continue;
+        }
+
+        PacketType packetType = packetTypeForPacket(receivedPacket);
+        _intervalStats.bytesReceived[streamForPacketType(packetType)] += receivedPacket.size();
+
+        switch (packetType) {
+            case PacketTypeDomainList:
+                processDomainServerList(receivedPacket);
+                break;
+            case PacketTypePing: {
+                // servers ping us to find out which of our sockets they can reach, answer as the interface would
+                QDataStream pingStream(receivedPacket);
+                pingStream.skipRawData(numBytesForPacketHeader(receivedPacket));
+
+                quint64 timeFromOriginalPing;
+                pingStream >> timeFromOriginalPing;
+
+                QByteArray replyPacket = byteArrayWithPopluatedHeader(PacketTypePingReply, _uuid);
+                QDataStream replyStream(&replyPacket, QIODevice::Append);
+                replyStream << timeFromOriginalPing << usecTimestampNow();
+
+                _socket.writeDatagram(replyPacket, senderSockAddr.getAddress(), senderSockAddr.getPort());
+                _intervalStats.bytesSent += replyPacket.size();
+                break;
+            }
+            case PacketTypePingReply:
+                processPingReply(receivedPacket, senderSockAddr);
+                break;
+            case PacketTypeOctreeStats:
+                processOctreeStats(receivedPacket);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void SyntheticAgent::sendDomainServerCheckIn() {
+    QByteArray domainServerPacket = byteArrayWithPopluatedHeader(PacketTypeDomainListRequest, _uuid);
+    QDataStream packetStream(&domainServerPacket, QIODevice::Append);
+
+    // a null public address asks the domain-server to act as our STUN server, so hundreds of agents don't
+    // each have to go out and hit the real one
+    packetStream << NodeType::Agent << HifiSockAddr(QHostAddress(), _socket.localPort())
+        << HifiSockAddr(QHostAddress(getHostOrderLocalAddress()), _socket.localPort());
+
+    const NodeSet AGENT_NODE_TYPES_OF_INTEREST = NodeSet() << NodeType::AudioMixer << NodeType::AvatarMixer
+        << NodeType::VoxelServer << NodeType::ParticleServer;
+
+    packetStream << (quint8) AGENT_NODE_TYPES_OF_INTEREST.size();
+    foreach (NodeType_t nodeTypeOfInterest, AGENT_NODE_TYPES_OF_INTEREST) {
+        packetStream << nodeTypeOfInterest;
+    }
+
+    _socket.writeDatagram(domainServerPacket, _domainSockAddr.getAddress(), _domainSockAddr.getPort());
+    _intervalStats.bytesSent += domainServerPacket.size();
+}
+
+void SyntheticAgent::processDomainServerList(const QByteArray& packet) {
+    qint8 nodeType;
+    QUuid nodeUUID;
+    HifiSockAddr nodePublicSocket;
+    HifiSockAddr nodeLocalSocket;
+
+    QDataStream packetStream(packet);
+    packetStream.skipRawData(numBytesForPacketHeader(packet));
+
+    while (packetStream.device()->pos() < packet.size()) {
+        packetStream >> nodeType >> nodeUUID >> nodePublicSocket >> nodeLocalSocket;
+
+        // if the public socket address is 0 then it's reachable at the same IP as the domain server
+        if (nodePublicSocket.getAddress().isNull()) {
+            nodePublicSocket.setAddress(_domainSockAddr.getAddress());
+        }
+
+        AgentServer& server = _servers[nodeUUID];
+        if (server.publicSocket != nodePublicSocket || server.localSocket != nodeLocalSocket) {
+            server.type = nodeType;
+            server.publicSocket = nodePublicSocket;
+            server.localSocket = nodeLocalSocket;
+            server.activeSocket = HifiSockAddr();
+        }
+    }
+}
+
+void SyntheticAgent::sendPings(quint64 now) {
+    QByteArray pingPacket = byteArrayWithPopluatedHeader(PacketTypePing, _uuid);
+    QDataStream packetStream(&pingPacket, QIODevice::Append);
+    packetStream << now;
+
+    foreach (const AgentServer& server, _servers) {
+        if (!server.activeSocket.isNull()) {
+            _socket.writeDatagram(pingPacket, server.activeSocket.getAddress(), server.activeSocket.getPort());
+            _intervalStats.bytesSent += pingPacket.size();
+        } else {
+            // we don't know which socket reaches this server yet, try both and keep the one that answers
+            _socket.writeDatagram(pingPacket, server.publicSocket.getAddress(), server.publicSocket.getPort());
+            _socket.writeDatagram(pingPacket, server.localSocket.getAddress(), server.localSocket.getPort());
+            _intervalStats.bytesSent += 2 * pingPacket.size();
+        }
+    }
+}
+
+void SyntheticAgent::processPingReply(const QByteArray& packet, const HifiSockAddr& senderSockAddr) {
+    QUuid senderUUID;
+    deconstructPacketHeader(packet, senderUUID);
+
+    QHash<QUuid, AgentServer>::iterator server = _servers.find(senderUUID);
+    if (server == _servers.end()) {
+        return;
+    }
+
+    if (server->activeSocket.isNull()
+        && (senderSockAddr == server->publicSocket || senderSockAddr == server->localSocket)) {
+        server->activeSocket = senderSockAddr;
+    }
+
+    QDataStream packetStream(packet);
+    packetStream.skipRawData(numBytesForPacketHeader(packet));
+
+    quint64 ourOriginalTime, othersReplyTime;
+    packetStream >> ourOriginalTime >> othersReplyTime;
+
+    quint64 pingUsecs = usecTimestampNow() - ourOriginalTime;
+    _intervalStats.pingSamples++;
+    _intervalStats.totalPingUsecs += pingUsecs;
+    _intervalStats.maxPingUsecs = std::max(_intervalStats.maxPingUsecs, pingUsecs);
+}
+
+void SyntheticAgent::processOctreeStats(const QByteArray& packet) {
+    OctreeSceneStats stats;
+    stats.unpackFromMessage(reinterpret_cast<const unsigned char*>(packet.data()), packet.size());
+
+    // the servers send stats at the end of every scene, a scene that was not sent at the moving LOD is as complete
+    // as the server is going to make it for this view
+    if (!stats.isMoving()) {
+        _scenesCompleted++;
+        _lastSceneElements = stats.getTotalElements();
+
+        if (_firstSceneUsecs == 0 && _firstQueryUsecs != 0) {
+            _firstSceneUsecs = usecTimestampNow() - _firstQueryUsecs;
+        }
+    }
+}
+
+void SyntheticAgent::sendAudio() {
+    static int numBytesPacketHeader = numBytesForPacketHeaderGivenPacketType(PacketTypeMicrophoneAudioNoEcho);
+    static int leadingBytes = numBytesPacketHeader + sizeof(glm::vec3) + sizeof(glm::quat);
+
+    QByteArray audioPacket(leadingBytes + NETWORK_BUFFER_LENGTH_BYTES_PER_CHANNEL, 0);
+    char* currentPacketPtr = audioPacket.data() + populatePacketHeader(audioPacket, PacketTypeMicrophoneAudioNoEcho, _uuid);
+
+    glm::vec3 headPosition = _avatarData.getPosition() + glm::vec3(0.0f, AGENT_EYE_HEIGHT, 0.0f);
+    memcpy(currentPacketPtr, &headPosition, sizeof(headPosition));
+    currentPacketPtr += sizeof(headPosition);
+
+    glm::quat headOrientation = _avatarData.getOrientation();
+    memcpy(currentPacketPtr, &headOrientation, sizeof(headOrientation));
+    currentPacketPtr += sizeof(headOrientation);
+
+    // each agent hums its own note so the mix is not a wall of identical samples
+    float frequency = AGENT_TONE_BASE_FREQUENCY * (1.0f + (_agentIndex % 12) / 12.0f);
+    int16_t* samples = reinterpret_cast<int16_t*>(currentPacketPtr);
+    for (int i = 0; i < NETWORK_BUFFER_LENGTH_SAMPLES_PER_CHANNEL; i++) {
+        samples[i] = AGENT_TONE_AMPLITUDE * sinf(2.0f * PIf * frequency * (_audioSamplesSent++) / SAMPLE_RATE);
+    }
+
+    sendToServers(NodeType::AudioMixer, audioPacket);
+}
+
+void SyntheticAgent::sendAvatarData() {
+    QByteArray avatarPacket = byteArrayWithPopluatedHeader(PacketTypeAvatarData, _uuid);
+    avatarPacket.append(_avatarData.toByteArray());
+
+    sendToServers(NodeType::AvatarMixer, avatarPacket);
+}
+
+void SyntheticAgent::sendOctreeQueries() {
+    static unsigned char queryPacket[MAX_PACKET_SIZE];
+
+    _voxelQuery.setCameraPosition(_avatarData.getPosition() + glm::vec3(0.0f, AGENT_EYE_HEIGHT, 0.0f));
+    _voxelQuery.setCameraOrientation(_avatarData.getOrientation());
+
+    int packetLength = populatePacketHeader(reinterpret_cast<char*>(queryPacket), PacketTypeVoxelQuery, _uuid);
+    packetLength += _voxelQuery.getBroadcastData(&queryPacket[packetLength]);
+    sendToServers(NodeType::VoxelServer, QByteArray(reinterpret_cast<char*>(queryPacket), packetLength));
+
+    // the particle query carries the same view
+    packetLength = populatePacketHeader(reinterpret_cast<char*>(queryPacket), PacketTypeParticleQuery, _uuid);
+    packetLength += _voxelQuery.getBroadcastData(&queryPacket[packetLength]);
+    sendToServers(NodeType::ParticleServer, QByteArray(reinterpret_cast<char*>(queryPacket), packetLength));
+
+    if (_firstQueryUsecs == 0) {
+        _firstQueryUsecs = usecTimestampNow();
+    }
+}
+
+void SyntheticAgent::sendEdits(quint64 now) {
+    static unsigned char editPacket[MAX_PACKET_SIZE];
+
+    // alternate between a voxel at our feet and a short lived particle thrown ahead of us
+    bool sendVoxel = (_editSequence % 2 == 0);
+    PacketType editType = sendVoxel ? PacketTypeVoxelSet : PacketTypeParticleAddOrEdit;
+
+    // edit packets are the header, a sequence number and a timestamp, followed by the edit details
+    int packetLength = populatePacketHeader(reinterpret_cast<char*>(editPacket), editType, _uuid);
+    memcpy(&editPacket[packetLength], &_editSequence, sizeof(_editSequence));
+    packetLength += sizeof(_editSequence);
+    memcpy(&editPacket[packetLength], &now, sizeof(now));
+    packetLength += sizeof(now);
+    _editSequence++;
+
+    if (sendVoxel) {
+        glm::vec3 voxelPosition = _avatarData.getPosition() / (float) TREE_SCALE;
+        unsigned char* voxelData = pointToVoxel(voxelPosition.x, voxelPosition.y, voxelPosition.z,
+                                                AGENT_EDIT_VOXEL_SIZE / TREE_SCALE, 255, _agentIndex % 256, 0);
+        int lengthOfVoxelData = bytesRequiredForCodeLength(*voxelData) + sizeof(rgbColor);
+        memcpy(&editPacket[packetLength], voxelData, lengthOfVoxelData);
+        packetLength += lengthOfVoxelData;
+        delete[] voxelData;
+
+        sendToServers(NodeType::VoxelServer, QByteArray(reinterpret_cast<char*>(editPacket), packetLength));
+    } else {
+        ParticleProperties properties;
+        properties.setPosition(_avatarData.getPosition() + glm::vec3(0.0f, AGENT_EYE_HEIGHT, 0.0f));
+        properties.setVelocity(_avatarData.getOrientation() * IDENTITY_FRONT);
+        properties.setRadius(AGENT_EDIT_VOXEL_SIZE);
+        properties.setLifetime(AGENT_EDIT_PARTICLE_LIFETIME);
+
+        ParticleID newParticleID(NEW_PARTICLE, Particle::getNextCreatorTokenID(), false);
+
+        int detailsLength = 0;
+        if (Particle::encodeParticleEditMessageDetails(editType, newParticleID, properties, &editPacket[packetLength],
+                                                       MAX_PACKET_SIZE - packetLength, detailsLength)) {
+            packetLength += detailsLength;
+            sendToServers(NodeType::ParticleServer, QByteArray(reinterpret_cast<char*>(editPacket), packetLength));
+        }
+    }
+}
+
+void SyntheticAgent::updateMotion(quint64 now) {
+    float secondsSinceStart = (float) (now - _startUsecs) / USECS_PER_SECOND;
+    float orbitAngle = _orbitPhase + 2.0f * PIf * secondsSinceStart / AGENT_ORBIT_SECONDS;
+
+    _avatarData.setPosition(_orbitCenter + AGENT_ORBIT_RADIUS * glm::vec3(cosf(orbitAngle), 0.0f, sinf(orbitAngle)));
+
+    // face along the direction of travel, which is a quarter turn ahead of the angle around the circle
+    _avatarData.setBodyYaw(-glm::degrees(orbitAngle));
+}
+
+void SyntheticAgent::sendToServers(NodeType_t serverType, const QByteArray& packet) {
+    foreach (const AgentServer& server, _servers) {
+        if (server.type == serverType && !server.activeSocket.isNull()) {
+            _socket.writeDatagram(packet, server.activeSocket.getAddress(), server.activeSocket.getPort());
+            _intervalStats.bytesSent += packet.size();
+        }
+    }
+}
+
+AgentStream SyntheticAgent::streamForPacketType(PacketType type) const {
+    switch (type) {
+        case PacketTypeMixedAudio:
+            return AudioStream;
+        case PacketTypeBulkAvatarData:
+        case PacketTypeKillAvatar:
+            return AvatarStream;
+        case PacketTypeVoxelData:
+        case PacketTypeParticleData:
+        case PacketTypeParticleErase:
+        case PacketTypeParticleAddResponse:
+        case PacketTypeOctreeStats:
+        case PacketTypeEnvironmentData:
+        case PacketTypeJurisdiction:
+            return OctreeStream;
+        default:
+            return OtherStream;
+    }
+}
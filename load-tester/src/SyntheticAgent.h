@@ -0,0 +1,117 @@
+//
+//  SyntheticAgent.h
+//  hifi
+//
+//  Created on 2/5/14.
+//  Copyright (c) 2014 HighFidelity, Inc. All rights reserved.
+//
+//  A headless stand-in for an interface client. Each agent owns its own socket and UUID so that hundreds of them
+//  can live in one process and still look like separate nodes to the domain-server, mixers and octree servers.
+//
+
+#ifndef __hifi__SyntheticAgent__
+#define __hifi__SyntheticAgent__
+
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+#include <QtCore/QUuid>
+#include <QtNetwork/QUdpSocket>
+
+#include <AvatarData.h>
+#include <HifiSockAddr.h>
+#include <Node.h>
+#include <PacketHeaders.h>
+#include <VoxelQuery.h>
+
+enum AgentStream {
+    AudioStream,
+    AvatarStream,
+    OctreeStream,
+    OtherStream,
+    NUM_AGENT_STREAMS
+};
+
+/// what an agent saw since the last time its stats were taken
+struct AgentStats {
+    AgentStats();
+
+    quint64 bytesReceived[NUM_AGENT_STREAMS];
+    quint64 bytesSent;
+    int serversConnected;
+    int pingSamples;
+    quint64 totalPingUsecs;
+    quint64 maxPingUsecs;
+    int scenesCompleted;
+    quint64 firstSceneUsecs; // from the first query to the first completed scene, 0 until there is one
+    unsigned long lastSceneElements;
+};
+
+struct AgentServer {
+    NodeType_t type;
+    HifiSockAddr publicSocket;
+    HifiSockAddr localSocket;
+    HifiSockAddr activeSocket; // null until one of the two answered a ping
+};
+
+class SyntheticAgent : public QObject {
+    Q_OBJECT
+public:
+    /// \param editsPerSecond how many voxel and particle edits this agent sends, 0 for none
+    SyntheticAgent(int agentIndex, const HifiSockAddr& domainSockAddr, float editsPerSecond, QObject* parent = 0);
+
+    int getAgentIndex() const { return _agentIndex; }
+    const QUuid& getUUID() const { return _uuid; }
+
+    /// sends whatever is due at this time, called by the LoadTester at least once per audio frame
+    void simulate(quint64 now);
+
+    /// returns the stats gathered since the last call and starts a new interval
+    AgentStats takeIntervalStats();
+private slots:
+    void readPendingDatagrams();
+private:
+    void sendDomainServerCheckIn();
+    void processDomainServerList(const QByteArray& packet);
+    void sendPings(quint64 now);
+    void processPingReply(const QByteArray& packet, const HifiSockAddr& senderSockAddr);
+    void processOctreeStats(const QByteArray& packet);
+
+    void sendAudio();
+    void sendAvatarData();
+    void sendOctreeQueries();
+    void sendEdits(quint64 now);
+
+    void updateMotion(quint64 now);
+    void sendToServers(NodeType_t serverType, const QByteArray& packet);
+    AgentStream streamForPacketType(PacketType type) const;
+
+    int _agentIndex;
+    QUuid _uuid;
+    QUdpSocket _socket;
+    HifiSockAddr _domainSockAddr;
+    QHash<QUuid, AgentServer> _servers;
+
+    AvatarData _avatarData;
+    VoxelQuery _voxelQuery;
+    glm::vec3 _orbitCenter;
+    float _orbitPhase;
+
+    float _editsPerSecond;
+    short _editSequence;
+    quint64 _audioSamplesSent;
+
+    quint64 _startUsecs;
+    quint64 _nextCheckInUsecs;
+    quint64 _nextPingUsecs;
+    quint64 _nextAudioUsecs;
+    quint64 _nextAvatarUsecs;
+    quint64 _nextEditUsecs;
+    quint64 _firstQueryUsecs;
+
+    AgentStats _intervalStats;
+    int _scenesCompleted;
+    quint64 _firstSceneUsecs;
+    unsigned long _lastSceneElements;
+};
+
+#endif /* defined(__hifi__SyntheticAgent__) */
@@ -0,0 +1,14 @@
+//
+//  main.cpp
+//  Load Tester
+//
+//  Created on 2/5/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include "LoadTester.h"
+
+int main(int argc, char * argv[]) {
+    LoadTester loadTester(argc, argv);
+    return loadTester.exec();
+}
@@ -0,0 +1,668 @@
+//
+//  StreamingSVOTools.cpp
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <climits>
+
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+
+#include <ChunkedSVOFile.h>
+#include <JurisdictionMap.h>
+#include <OctalCode.h>
+#include <SharedUtil.h>
+#include <VoxelTree.h>
+
+#include "StreamingSVOTools.h"
+
+// chunks in memory at once per core, enough to keep every core busy while the main thread writes
+const int JOBS_PER_THREAD = 2;
+
+QString outputFileNameFor(const char* prefix, const char* inputFile) {
+    QFileInfo inputInfo(inputFile);
+    return inputInfo.dir().filePath(prefix + inputInfo.fileName());
+}
+
+static QByteArray octalCodeBytes(const unsigned char* octalCode) {
+    return QByteArray((const char*)octalCode, bytesRequiredForCodeLength(numberOfThreeBitSectionsInCode(octalCode)));
+}
+
+// reads a chunk into a tree, false if the chunk is damaged
+static bool readChunkIntoTree(ChunkedSVOReader& reader, int chunkIndex, VoxelTree& tree) {
+    QByteArray bitstream;
+    if (!reader.readChunk(chunkIndex, bitstream)) {
+        qDebug() << "Skipping damaged chunk" << chunkIndex << "rooted at"
+            << octalCodeToHexString((const unsigned char*)reader.getChunks().at(chunkIndex).octalCode.constData());
+        return false;
+    }
+    ReadBitstreamToTreeParams args(WANT_COLOR, NO_EXISTS_BITS);
+    tree.readBitstreamToTree((const unsigned char*)bitstream.constData(), bitstream.size(), args);
+    return true;
+}
+
+static VoxelTreeElement* elementForOctalCode(VoxelTree& tree, const QByteArray& octalCode) {
+    VoxelPositionSize details;
+    voxelDetailsForCode((const unsigned char*)octalCode.constData(), details);
+    return tree.getVoxelAt(details.x, details.y, details.z, details.s);
+}
+
+// Recomputes the average colors of the elements of a subtree that have children, from the leaves up. This is
+// Octree::reaverageOctreeElements() without its shared recursion count, so that it can run on many trees at once.
+static void reaverageSubTree(OctreeElement* element) {
+    bool hasChildren = false;
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        OctreeElement* child = element->getChildAtIndex(i);
+        if (child) {
+            reaverageSubTree(child);
+            hasChildren = true;
+        }
+    }
+    if (hasChildren) {
+        element->calculateAverageFromChildren();
+    }
+}
+
+/// The work on one chunk, run on a worker thread. Each job builds a tree of its own if it needs one, since a tree isn't
+/// safe to build on many threads at once.
+class StreamedChunkJob : public QRunnable {
+public:
+    StreamedChunkJob(const QByteArray& octalCode, bool isTopChunk) : _octalCode(octalCode), _isTopChunk(isTopChunk) {
+        setAutoDelete(false);
+    }
+
+    bool isTopChunk() const { return _isTopChunk; }
+    const QVector<SVOChunk>& getResults() const { return _results; }
+    const QVector<int>& getResultOutputs() const { return _resultOutputs; }
+
+protected:
+    /// compresses a bitstream on the worker thread, and keeps it for the main thread to write to an output
+    void addResult(const QByteArray& bitstream, int output = 0) {
+        if (bitstream.isEmpty()) {
+            return;
+        }
+        SVOChunk chunk;
+        chunk.octalCode = _octalCode;
+        ChunkedSVOFile::prepareChunk(chunk, bitstream, true);
+        _results.append(chunk);
+        _resultOutputs.append(output);
+    }
+
+    QByteArray _octalCode;
+    bool _isTopChunk;
+    QVector<SVOChunk> _results;
+    QVector<int> _resultOutputs;
+};
+
+/// Runs chunk jobs on all cores a batch at a time, writing what each batch produces before starting the next, so that
+/// only a batch of chunks is ever in memory.
+class StreamedChunkJobQueue {
+public:
+    StreamedChunkJobQueue(const QVector<ChunkedSVOWriter*>& outputs) :
+        _outputs(outputs),
+        _batchSize(QThread::idealThreadCount() * JOBS_PER_THREAD) { }
+
+    ~StreamedChunkJobQueue() { finish(); }
+
+    void add(StreamedChunkJob* job) {
+        _jobs.append(job);
+        _workers.start(job);
+        if (_jobs.size() >= _batchSize) {
+            finish();
+        }
+    }
+
+    /// waits for the jobs that are running and writes what they produced
+    void finish() {
+        _workers.waitForDone();
+        foreach (StreamedChunkJob* job, _jobs) {
+            for (int i = 0; i < job->getResults().size(); i++) {
+                const SVOChunk& chunk = job->getResults().at(i);
+                _outputs.at(job->getResultOutputs().at(i))->writeChunk(chunk, chunk.bitstream, job->isTopChunk());
+            }
+            delete job;
+        }
+        _jobs.clear();
+    }
+
+private:
+    QVector<ChunkedSVOWriter*> _outputs;
+    QThreadPool _workers;
+    QVector<StreamedChunkJob*> _jobs;
+    int _batchSize;
+};
+
+// copies a chunk to an output as it's stored, without decoding it
+static void copyStoredChunk(ChunkedSVOReader& reader, int chunkIndex, ChunkedSVOWriter& output,
+                            bool isTopChunk = false) {
+    QByteArray storedBytes;
+    if (reader.readStoredBytes(chunkIndex, storedBytes)) {
+        output.writeChunk(reader.getChunks().at(chunkIndex), storedBytes, isTopChunk);
+    }
+}
+
+class SVOStats {
+public:
+    SVOStats() : chunks(0), damagedChunks(0), storedBytes(0), bitstreamBytes(0), voxels(0), leaves(0) { }
+
+    void countVoxel(int level) {
+        if (level >= voxelsAtLevel.size()) {
+            voxelsAtLevel.resize(level + 1);
+        }
+        voxelsAtLevel[level]++;
+        voxels++;
+    }
+
+    void add(const SVOStats& other) {
+        chunks += other.chunks;
+        damagedChunks += other.damagedChunks;
+        storedBytes += other.storedBytes;
+        bitstreamBytes += other.bitstreamBytes;
+        voxels += other.voxels;
+        leaves += other.leaves;
+        if (other.voxelsAtLevel.size() > voxelsAtLevel.size()) {
+            voxelsAtLevel.resize(other.voxelsAtLevel.size());
+        }
+        for (int level = 0; level < other.voxelsAtLevel.size(); level++) {
+            voxelsAtLevel[level] += other.voxelsAtLevel.at(level);
+        }
+    }
+
+    int chunks;
+    int damagedChunks;
+    quint64 storedBytes;
+    quint64 bitstreamBytes;
+    quint64 voxels;
+    quint64 leaves; // colored voxels with nothing encoded below them
+    QVector<quint64> voxelsAtLevel;
+};
+
+// Counts the voxels in an element's data, which is its children's colors and then their data, as
+// Octree::readNodeData() reads it. Returns the bytes of the data.
+static int countElementData(const unsigned char* data, int length, int childLevel, SVOStats& stats) {
+    if (length < (int)sizeof(unsigned char)) {
+        return length;
+    }
+    unsigned char colorMask = data[0];
+    int bytesRead = sizeof(colorMask);
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        if (oneAtBit(colorMask, i)) {
+            stats.countVoxel(childLevel);
+            bytesRead += BYTES_PER_COLOR;
+        }
+    }
+    if (bytesRead >= length) {
+        return length;
+    }
+    unsigned char childMask = data[bytesRead];
+    bytesRead += sizeof(childMask);
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        if (oneAtBit(colorMask, i) && !oneAtBit(childMask, i)) {
+            stats.leaves++;
+        }
+    }
+    for (int i = 0; i < NUMBER_OF_CHILDREN && bytesRead < length; i++) {
+        if (oneAtBit(childMask, i)) {
+            bytesRead += countElementData(data + bytesRead, length - bytesRead, childLevel + 1, stats);
+        }
+    }
+    return bytesRead;
+}
+
+// counts the voxels in a bitstream of root relative octal codes each followed by the data of its element
+static void countBitstream(const unsigned char* bitstream, int length, SVOStats& stats) {
+    int bytesRead = 0;
+    while (bytesRead < length) {
+        int sections = numberOfThreeBitSectionsInCode(bitstream + bytesRead, length - bytesRead);
+        if (sections == OVERFLOWED_OCTCODE_BUFFER) {
+            break;
+        }
+        bytesRead += bytesRequiredForCodeLength(sections);
+        int elementBytes = countElementData(bitstream + bytesRead, length - bytesRead, sections + 1, stats);
+        if (elementBytes <= 0) {
+            break;
+        }
+        bytesRead += elementBytes;
+    }
+    stats.bitstreamBytes += length;
+}
+
+class StatsChunkJob : public QRunnable {
+public:
+    StatsChunkJob(ChunkedSVOReader& reader, int chunkIndex) : _reader(reader), _chunkIndex(chunkIndex) {
+        setAutoDelete(false);
+    }
+
+    virtual void run() {
+        stats.chunks = 1;
+        stats.storedBytes = _reader.getChunks().at(_chunkIndex).storedSize;
+        QByteArray bitstream;
+        if (_reader.readChunk(_chunkIndex, bitstream)) {
+            countBitstream((const unsigned char*)bitstream.constData(), bitstream.size(), stats);
+        } else {
+            stats.damagedChunks = 1;
+        }
+    }
+
+    SVOStats stats;
+
+private:
+    ChunkedSVOReader& _reader;
+    int _chunkIndex;
+};
+
+void processStreamStatsSVOFile(const char* svoFile) {
+    qDebug("streamStatsSVO: %s", svoFile);
+
+    ChunkedSVOReader reader(svoFile);
+    if (!reader.isOpen()) {
+        qDebug("Couldn't open %s.", svoFile);
+        return;
+    }
+
+    SVOStats stats;
+    if (reader.isChunked()) {
+        // the stats of a chunk are small, so every chunk is queued at once and the pool keeps a core's worth in memory
+        QThreadPool workers;
+        QVector<StatsChunkJob*> jobs;
+        for (int i = 0; i < reader.getChunks().size(); i++) {
+            jobs.append(new StatsChunkJob(reader, i));
+            workers.start(jobs.last());
+        }
+        workers.waitForDone();
+        foreach (StatsChunkJob* job, jobs) {
+            stats.add(job->stats);
+            delete job;
+        }
+        qDebug("Chunk level %d", reader.getHeader().chunkLevel);
+    } else {
+        QByteArray fileData = reader.getMappedData();
+        if (fileData.isEmpty()) {
+            qDebug("Couldn't map %s, version 1 files are counted from a mapping.", svoFile);
+            return;
+        }
+        stats.storedBytes = fileData.size();
+        countBitstream((const unsigned char*)fileData.constData(), fileData.size(), stats);
+        qDebug("Version 1 file");
+    }
+
+    qDebug() << "Chunks:" << stats.chunks << "(" << stats.damagedChunks << "damaged )";
+    qDebug() << "Stored bytes:" << stats.storedBytes << "Bitstream bytes:" << stats.bitstreamBytes;
+    qDebug() << "Voxels:" << stats.voxels << "Leaves:" << stats.leaves;
+    for (int level = 0; level < stats.voxelsAtLevel.size(); level++) {
+        if (stats.voxelsAtLevel.at(level) > 0) {
+            qDebug() << "    Level" << level << ":" << stats.voxelsAtLevel.at(level) << "voxels";
+        }
+    }
+}
+
+const int SPLIT_ROOT_OUTPUT = 0;
+
+/// Splits a chunk that end nodes are inside of, between their outputs and the root's.
+class SplitChunkJob : public StreamedChunkJob {
+public:
+    SplitChunkJob(ChunkedSVOReader& reader, int chunkIndex, const QVector<QByteArray>& endNodes,
+                  const QVector<int>& endNodeOutputs) :
+        StreamedChunkJob(reader.getChunks().at(chunkIndex).octalCode, false),
+        _reader(reader),
+        _chunkIndex(chunkIndex),
+        _endNodes(endNodes),
+        _endNodeOutputs(endNodeOutputs) { }
+
+    virtual void run() {
+        VoxelTree tree;
+        if (!readChunkIntoTree(_reader, _chunkIndex, tree)) {
+            return;
+        }
+        for (int i = 0; i < _endNodes.size(); i++) {
+            VoxelTreeElement* endNode = elementForOctalCode(tree, _endNodes.at(i));
+            if (endNode) {
+                QByteArray bitstream;
+                tree.encodeSubTreeToBuffer(endNode, INT_MAX, bitstream);
+                addResult(bitstream, _endNodeOutputs.at(i));
+                tree.deleteOctalCodeFromTree((const unsigned char*)_endNodes.at(i).constData(), COLLAPSE_EMPTY_TREE);
+            }
+        }
+        VoxelTreeElement* chunkRoot = elementForOctalCode(tree, _octalCode);
+        if (chunkRoot) {
+            QByteArray bitstream;
+            tree.encodeSubTreeToBuffer(chunkRoot, INT_MAX, bitstream);
+            addResult(bitstream, SPLIT_ROOT_OUTPUT);
+        }
+    }
+
+private:
+    ChunkedSVOReader& _reader;
+    int _chunkIndex;
+    QVector<QByteArray> _endNodes;
+    QVector<int> _endNodeOutputs;
+};
+
+void processStreamSplitSVOFile(const char* svoFile, const char* jurisdictionRoot, const char* jurisdictionEndNodes) {
+    qDebug("streamSplitSVO: %s Jurisdictions Root: %s EndNodes: %s", svoFile, jurisdictionRoot, jurisdictionEndNodes);
+
+    ChunkedSVOReader reader(svoFile);
+    if (!reader.isChunked()) {
+        qDebug("%s isn't a chunked SVO file, compact it with --streamCompactSVO first.", svoFile);
+        return;
+    }
+    const ChunkedSVOHeader& header = reader.getHeader();
+    JurisdictionMap jurisdiction(jurisdictionRoot, jurisdictionEndNodes);
+
+    // the root's output, then one for each end node
+    QVector<ChunkedSVOWriter*> outputs;
+    QVector<QByteArray> endNodes;
+    QString outputFileName = outputFileNameFor("splitROOT", svoFile);
+    qDebug() << "outputFile:" << outputFileName;
+    outputs.append(new ChunkedSVOWriter(outputFileName, header.dataType, header.dataVersion, header.chunkLevel));
+    for (int i = 0; i < jurisdiction.getEndNodeCount(); i++) {
+        endNodes.append(octalCodeBytes(jurisdiction.getEndNodeOctalCode(i)));
+        outputFileName = outputFileNameFor(qPrintable(QString("splitENDNODE%1").arg(i)), svoFile);
+        qDebug() << "outputFile:" << outputFileName;
+        outputs.append(new ChunkedSVOWriter(outputFileName, header.dataType, header.dataVersion, header.chunkLevel));
+    }
+
+    // every server gets the top of the tree, which is what it shows of the others' jurisdictions
+    foreach (ChunkedSVOWriter* output, outputs) {
+        copyStoredChunk(reader, 0, *output, true);
+    }
+
+    {
+        StreamedChunkJobQueue jobs(outputs);
+        for (int i = 1; i < reader.getChunks().size(); i++) {
+            const unsigned char* chunkRoot = (const unsigned char*)reader.getChunks().at(i).octalCode.constData();
+
+            int wholeChunkOutput = SPLIT_ROOT_OUTPUT;
+            QVector<QByteArray> endNodesInside;
+            QVector<int> endNodeOutputs;
+            for (int j = 0; j < endNodes.size(); j++) {
+                const unsigned char* endNode = (const unsigned char*)endNodes.at(j).constData();
+                if (isAncestorOf(endNode, chunkRoot)) {
+                    wholeChunkOutput = j + 1;
+                    break;
+                }
+                if (isAncestorOf(chunkRoot, endNode)) {
+                    endNodesInside.append(endNodes.at(j));
+                    endNodeOutputs.append(j + 1);
+                }
+            }
+
+            if (wholeChunkOutput != SPLIT_ROOT_OUTPUT || endNodesInside.isEmpty()) {
+                copyStoredChunk(reader, i, *outputs.at(wholeChunkOutput));
+            } else {
+                jobs.add(new SplitChunkJob(reader, i, endNodesInside, endNodeOutputs));
+            }
+        }
+    }
+
+    foreach (ChunkedSVOWriter* output, outputs) {
+        if (!output->finish()) {
+            qDebug("Writing a split file failed.");
+        }
+        delete output;
+    }
+    qDebug("exiting now");
+}
+
+/// where a chunk of one of several files is
+class SVOChunkSource {
+public:
+    ChunkedSVOReader* reader;
+    int chunkIndex;
+};
+
+/// Reads chunks with the same root, or the top chunks, into a tree and encodes it again.
+class ReencodeChunkJob : public StreamedChunkJob {
+public:
+    ReencodeChunkJob(const QByteArray& octalCode, const QVector<SVOChunkSource>& sources, bool isTopChunk,
+                     int chunkLevel) :
+        StreamedChunkJob(octalCode, isTopChunk),
+        _sources(sources),
+        _chunkLevel(chunkLevel) { }
+
+    virtual void run() {
+        VoxelTree tree;
+        foreach (const SVOChunkSource& source, _sources) {
+            readChunkIntoTree(*source.reader, source.chunkIndex, tree);
+        }
+        OctreeElement* chunkRoot = _isTopChunk ? tree.getRoot() : elementForOctalCode(tree, _octalCode);
+        if (chunkRoot) {
+            QByteArray bitstream;
+            tree.encodeSubTreeToBuffer(chunkRoot, _isTopChunk ? _chunkLevel : INT_MAX, bitstream);
+            addResult(bitstream);
+        }
+    }
+
+private:
+    QVector<SVOChunkSource> _sources;
+    int _chunkLevel;
+};
+
+void processStreamMergeSVOFiles(const char* outputFile, const QStringList& inputFiles) {
+    qDebug() << "streamMergeSVO:" << outputFile << "from" << inputFiles;
+
+    QVector<ChunkedSVOReader*> readers;
+    foreach (const QString& inputFile, inputFiles) {
+        readers.append(new ChunkedSVOReader(inputFile));
+    }
+    bool inputsOk = !readers.isEmpty();
+    foreach (ChunkedSVOReader* reader, readers) {
+        if (!reader->isChunked() || reader->getHeader().chunkLevel != readers.first()->getHeader().chunkLevel
+                || reader->getHeader().dataType != readers.first()->getHeader().dataType) {
+            inputsOk = false;
+        }
+    }
+    if (!inputsOk) {
+        qDebug("Merged files must all be chunked SVO files of the same type and chunk level, "
+               "compact them with --streamCompactSVO first.");
+        qDeleteAll(readers);
+        return;
+    }
+    const ChunkedSVOHeader& header = readers.first()->getHeader();
+
+    // where each chunk root is in the files, in the order the files were given
+    QVector<QByteArray> chunkRoots;
+    QHash<QByteArray, QVector<SVOChunkSource> > sources;
+    QVector<SVOChunkSource> topSources;
+    foreach (ChunkedSVOReader* reader, readers) {
+        for (int i = 0; i < reader->getChunks().size(); i++) {
+            SVOChunkSource source = { reader, i };
+            if (i == 0) {
+                topSources.append(source);
+                continue;
+            }
+            const QByteArray& octalCode = reader->getChunks().at(i).octalCode;
+            if (!sources.contains(octalCode)) {
+                chunkRoots.append(octalCode);
+            }
+            sources[octalCode].append(source);
+        }
+    }
+
+    ChunkedSVOWriter output(outputFile, header.dataType, header.dataVersion, header.chunkLevel);
+    {
+        QVector<ChunkedSVOWriter*> outputs(1, &output);
+        StreamedChunkJobQueue jobs(outputs);
+        const QByteArray& topOctalCode = readers.first()->getChunks().at(0).octalCode;
+        jobs.add(new ReencodeChunkJob(topOctalCode, topSources, true, header.chunkLevel));
+        foreach (const QByteArray& octalCode, chunkRoots) {
+            const QVector<SVOChunkSource>& chunkSources = sources.value(octalCode);
+            if (chunkSources.size() == 1) {
+                copyStoredChunk(*chunkSources.first().reader, chunkSources.first().chunkIndex, output);
+            } else {
+                jobs.add(new ReencodeChunkJob(octalCode, chunkSources, false, header.chunkLevel));
+            }
+        }
+    }
+
+    if (output.finish()) {
+        qDebug() << "Merged" << output.getChunkCount() << "chunks into" << outputFile;
+    } else {
+        qDebug("Writing %s failed.", outputFile);
+    }
+    qDeleteAll(readers);
+}
+
+void processStreamCompactSVOFile(const char* inputFile, const char* outputFile, int chunkLevel) {
+    qDebug("streamCompactSVO: %s to %s at chunk level %d", inputFile, outputFile, chunkLevel);
+
+    ChunkedSVOReader reader(inputFile);
+    if (!reader.isChunked() || reader.getHeader().chunkLevel != chunkLevel) {
+        // a version 1 file or a new chunk level has to be read whole once, to find the new chunks
+        qDebug("Reading %s whole to write it at a new chunk level.", inputFile);
+        VoxelTree tree;
+        tree.readFromSVOFile(inputFile);
+        if (!tree.writeToChunkedSVOFile(outputFile, NULL, true, chunkLevel)) {
+            qDebug("Writing %s failed.", outputFile);
+        }
+        return;
+    }
+    const ChunkedSVOHeader& header = reader.getHeader();
+
+    ChunkedSVOWriter output(outputFile, header.dataType, header.dataVersion, header.chunkLevel);
+    {
+        QVector<ChunkedSVOWriter*> outputs(1, &output);
+        StreamedChunkJobQueue jobs(outputs);
+        for (int i = 0; i < reader.getChunks().size(); i++) {
+            SVOChunkSource source = { &reader, i };
+            QVector<SVOChunkSource> sources(1, source);
+            jobs.add(new ReencodeChunkJob(reader.getChunks().at(i).octalCode, sources, i == 0, header.chunkLevel));
+        }
+    }
+
+    quint64 bytesWritten = output.getBytesWritten();
+    if (output.finish()) {
+        qDebug() << "Compacted" << QFileInfo(inputFile).size() << "bytes to" << bytesWritten << "bytes";
+    } else {
+        qDebug("Writing %s failed.", outputFile);
+    }
+}
+
+/// the average a chunk's root has once the chunk has been reaveraged, for the top of the tree
+class ChunkRootAverage {
+public:
+    nodeColor color;
+    float density;
+};
+
+/// Reaverages a chunk, and keeps its root's average for reaveraging the top of the tree.
+class RebuildLODChunkJob : public StreamedChunkJob {
+public:
+    RebuildLODChunkJob(ChunkedSVOReader& reader, int chunkIndex, QHash<QByteArray, ChunkRootAverage>& averages,
+                       QMutex& averagesMutex) :
+        StreamedChunkJob(reader.getChunks().at(chunkIndex).octalCode, false),
+        _reader(reader),
+        _chunkIndex(chunkIndex),
+        _averages(averages),
+        _averagesMutex(averagesMutex) { }
+
+    virtual void run() {
+        VoxelTree tree;
+        if (!readChunkIntoTree(_reader, _chunkIndex, tree)) {
+            return;
+        }
+        VoxelTreeElement* chunkRoot = elementForOctalCode(tree, _octalCode);
+        if (!chunkRoot) {
+            return;
+        }
+        reaverageSubTree(chunkRoot);
+
+        ChunkRootAverage average;
+        memcpy(average.color, chunkRoot->getTrueColor(), sizeof(average.color));
+        average.density = chunkRoot->getDensity();
+        {
+            QMutexLocker locker(&_averagesMutex);
+            _averages.insert(_octalCode, average);
+        }
+
+        QByteArray bitstream;
+        tree.encodeSubTreeToBuffer(chunkRoot, INT_MAX, bitstream);
+        addResult(bitstream);
+    }
+
+private:
+    ChunkedSVOReader& _reader;
+    int _chunkIndex;
+    QHash<QByteArray, ChunkRootAverage>& _averages;
+    QMutex& _averagesMutex;
+};
+
+/// Reaverages the top of the tree from the averages of the chunks' roots.
+class RebuildLODTopChunkJob : public StreamedChunkJob {
+public:
+    RebuildLODTopChunkJob(ChunkedSVOReader& reader, const QHash<QByteArray, ChunkRootAverage>& averages) :
+        StreamedChunkJob(reader.getChunks().at(0).octalCode, true),
+        _reader(reader),
+        _averages(averages) { }
+
+    virtual void run() {
+        VoxelTree tree;
+        if (!readChunkIntoTree(_reader, 0, tree)) {
+            return;
+        }
+        QHash<QByteArray, ChunkRootAverage>::const_iterator average = _averages.constBegin();
+        for (; average != _averages.constEnd(); ++average) {
+            VoxelTreeElement* chunkRoot = elementForOctalCode(tree, average.key());
+            if (chunkRoot) {
+                chunkRoot->setColor(average->color);
+                chunkRoot->setDensity(average->density);
+            }
+        }
+        reaverageSubTree(tree.getRoot());
+
+        QByteArray bitstream;
+        tree.encodeSubTreeToBuffer(tree.getRoot(), _reader.getHeader().chunkLevel, bitstream);
+        addResult(bitstream);
+    }
+
+private:
+    ChunkedSVOReader& _reader;
+    const QHash<QByteArray, ChunkRootAverage>& _averages;
+};
+
+void processStreamRebuildLODSVOFile(const char* inputFile, const char* outputFile) {
+    qDebug("streamRebuildLODSVO: %s to %s", inputFile, outputFile);
+
+    ChunkedSVOReader reader(inputFile);
+    if (!reader.isChunked()) {
+        qDebug("Reading %s whole since it isn't chunked.", inputFile);
+        VoxelTree tree(true); // reaveraging
+        tree.readFromSVOFile(inputFile);
+        tree.reaverageOctreeElements();
+        if (!tree.writeToChunkedSVOFile(outputFile)) {
+            qDebug("Writing %s failed.", outputFile);
+        }
+        return;
+    }
+    const ChunkedSVOHeader& header = reader.getHeader();
+
+    ChunkedSVOWriter output(outputFile, header.dataType, header.dataVersion, header.chunkLevel);
+    QHash<QByteArray, ChunkRootAverage> averages;
+    QMutex averagesMutex;
+    {
+        QVector<ChunkedSVOWriter*> outputs(1, &output);
+        StreamedChunkJobQueue jobs(outputs);
+        for (int i = 1; i < reader.getChunks().size(); i++) {
+            jobs.add(new RebuildLODChunkJob(reader, i, averages, averagesMutex));
+        }
+
+        // the top of the tree averages the chunks' roots, so it's done once they all are
+        jobs.finish();
+        jobs.add(new RebuildLODTopChunkJob(reader, averages));
+    }
+
+    if (output.finish()) {
+        qDebug() << "Rebuilt the levels of detail of" << output.getChunkCount() << "chunks";
+    } else {
+        qDebug("Writing %s failed.", outputFile);
+    }
+}
@@ -0,0 +1,44 @@
+//
+//  StreamingSVOTools.h
+//  hifi
+//
+//  Created on 2/6/14.
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Offline tools for chunked (version 2) SVO files that work through a file a chunk at a time, so that worlds bigger
+//  than memory can be preprocessed. Chunks are independent subtrees, so they're decoded, reworked and compressed on
+//  all cores, a batch at a time, while the main thread writes the results. Chunks that a tool doesn't need to change
+//  are copied as they're stored, without being decoded at all.
+//
+//  The tools that need a tree to work on give each chunk a tree of its own, so only a batch of chunks is ever in
+//  memory. Version 1 files have no chunks to work through, so the tools that rewrite them read them whole once and
+//  write them out chunked, after which they can be streamed.
+//
+
+#ifndef __hifi__StreamingSVOTools__
+#define __hifi__StreamingSVOTools__
+
+#include <QtCore/QStringList>
+
+/// the input file's name with a prefix, in the input file's directory
+QString outputFileNameFor(const char* prefix, const char* inputFile);
+
+/// Counts the voxels of a file, per level, without building a tree. Works on version 1 files too.
+void processStreamStatsSVOFile(const char* svoFile);
+
+/// Splits a file into one file for the jurisdiction of each end node and one for the rest, as --splitSVO does. Chunks
+/// wholly under an end node are copied as they are, and only the chunks an end node is inside of are decoded.
+void processStreamSplitSVOFile(const char* svoFile, const char* jurisdictionRoot, const char* jurisdictionEndNodes);
+
+/// Merges files with the same chunk level into one, with later files winning where they overlap. Chunks that only one
+/// of the files has are copied as they are.
+void processStreamMergeSVOFiles(const char* outputFile, const QStringList& inputFiles);
+
+/// Re-encodes and recompresses every chunk of a file, which drops whatever later bitstreams in a chunk overwrote, or
+/// converts a file to the chunked format or to another chunk level.
+void processStreamCompactSVOFile(const char* inputFile, const char* outputFile, int chunkLevel);
+
+/// Recomputes the average colors of every element above the leaves, chunk by chunk and then the top of the tree.
+void processStreamRebuildLODSVOFile(const char* inputFile, const char* outputFile);
+
+#endif /* defined(__hifi__StreamingSVOTools__) */
@@ -6,13 +6,18 @@
 //  Copyright (c) 2013 High Fidelity, Inc. All rights reserved.
 //
 
+#include <OctreeSpatialQuery.h>
+#include <OctreeSync.h>
 #include <VoxelTree.h>
 #include <SharedUtil.h>
 #include <SceneUtils.h>
 #include <JurisdictionMap.h>
+#include <QFileInfo>
 #include <QString>
 #include <QStringList>
 
+#include "StreamingSVOTools.h"
+
 
 int _nodeCount=0;
 bool countVoxelsOperation(VoxelTreeElement* node, void* extraData) {
@@ -233,6 +238,236 @@ void processFillSVOFile(const char* fillSVOFile) {
     qDebug("exiting now");
 }
 
+const int BENCHMARK_QUERY_COUNT = 1000;
+const int BENCHMARK_NEAREST_COUNT = 16;
+const int BENCHMARK_RAYS_PER_BATCH = 64;
+const float BENCHMARK_BOX_SCALE = 1.0f / 64.0f;
+
+void reportBenchmark(const char* queryName, quint64 elapsedUsecs, quint64 elementsVisited, quint64 resultCount) {
+    qDebug("%s: %f usecs per query, %f elements visited per query, %f results per query", queryName,
+        (float)elapsedUsecs / BENCHMARK_QUERY_COUNT, (float)elementsVisited / BENCHMARK_QUERY_COUNT,
+        (float)resultCount / BENCHMARK_QUERY_COUNT);
+}
+
+// Times each kind of spatial query over random places in the tree of an SVO file.
+void processBenchmarkQueriesSVOFile(const char* benchmarkSVOFile) {
+    qDebug("benchmarkQueries: %s", benchmarkSVOFile);
+
+    VoxelTree tree;
+    tree.readFromSVOFile(benchmarkSVOFile);
+    qDebug("Nodes after loading %lu nodes", tree.getOctreeElementsCount());
+
+    // one query object for every query, as the scripting interfaces use them, so that its buffers are reused
+    OctreeSpatialQuery query(&tree);
+
+    quint64 elementsVisited = 0;
+    quint64 resultCount = 0;
+    quint64 start = usecTimestampNow();
+    for (int i = 0; i < BENCHMARK_QUERY_COUNT; i++) {
+        glm::vec3 point(randFloat(), randFloat(), randFloat());
+        resultCount += query.findNearest(point, BENCHMARK_NEAREST_COUNT).size();
+        elementsVisited += query.getElementsVisited();
+    }
+    reportBenchmark("findNearest", usecTimestampNow() - start, elementsVisited, resultCount);
+
+    elementsVisited = 0;
+    resultCount = 0;
+    start = usecTimestampNow();
+    for (int i = 0; i < BENCHMARK_QUERY_COUNT; i++) {
+        glm::vec3 corner(randFloat(), randFloat(), randFloat());
+        resultCount += query.findInBox(AABox(corner * (1.0f - BENCHMARK_BOX_SCALE), BENCHMARK_BOX_SCALE)).size();
+        elementsVisited += query.getElementsVisited();
+    }
+    reportBenchmark("findInBox", usecTimestampNow() - start, elementsVisited, resultCount);
+
+    const float BENCHMARK_FIELD_OF_VIEW = 45.0f;
+    const float BENCHMARK_NEAR_CLIP = 0.1f;
+    const float BENCHMARK_FAR_CLIP = TREE_SCALE / 8.0f;
+    const float HALF_TURN = 3.14159265f; // radians
+    elementsVisited = 0;
+    resultCount = 0;
+    start = usecTimestampNow();
+    for (int i = 0; i < BENCHMARK_QUERY_COUNT; i++) {
+        ViewFrustum viewFrustum;
+        viewFrustum.setPosition(glm::vec3(randFloat(), randFloat(), randFloat()) * (float)TREE_SCALE);
+        viewFrustum.setOrientation(glm::quat(glm::vec3(randFloatInRange(-HALF_TURN, HALF_TURN),
+            randFloatInRange(-HALF_TURN, HALF_TURN), 0.0f)));
+        viewFrustum.setFieldOfView(BENCHMARK_FIELD_OF_VIEW);
+        viewFrustum.setAspectRatio(1.0f);
+        viewFrustum.setNearClip(BENCHMARK_NEAR_CLIP);
+        viewFrustum.setFarClip(BENCHMARK_FAR_CLIP);
+        viewFrustum.calculate();
+        resultCount += query.findInView(viewFrustum).size();
+        elementsVisited += query.getElementsVisited();
+    }
+    reportBenchmark("findInView", usecTimestampNow() - start, elementsVisited, resultCount);
+
+    QVector<glm::vec3> origins(BENCHMARK_RAYS_PER_BATCH);
+    QVector<glm::vec3> directions(BENCHMARK_RAYS_PER_BATCH);
+    elementsVisited = 0;
+    resultCount = 0;
+    start = usecTimestampNow();
+    for (int i = 0; i < BENCHMARK_QUERY_COUNT; i++) {
+        for (int j = 0; j < BENCHMARK_RAYS_PER_BATCH; j++) {
+            origins[j] = glm::vec3(randFloat(), randFloat(), randFloat());
+            directions[j] = glm::normalize(glm::vec3(randFloatInRange(-1.0f, 1.0f), randFloatInRange(-1.0f, 1.0f),
+                                                     randFloatInRange(-1.0f, 1.0f)));
+        }
+        const QVector<SpatialQueryResult>& hits = query.findRayIntersections(origins, directions);
+        foreach (const SpatialQueryResult& hit, hits) {
+            if (hit.element) {
+                resultCount++;
+            }
+        }
+        elementsVisited += query.getElementsVisited();
+    }
+    reportBenchmark("findRayIntersections (batches of 64)", usecTimestampNow() - start, elementsVisited, resultCount);
+}
+
+const int BENCHMARK_JURISDICTION_LOOKUPS = 1000000;
+const int BENCHMARK_JURISDICTION_CODES = 4096;
+const int BENCHMARK_JURISDICTION_END_NODE_LEVEL = 6;
+const int BENCHMARK_JURISDICTION_MAX_CODE_LEVEL = 12;
+
+unsigned char* randomOctalCode(int sections) {
+    unsigned char* octalCode = new unsigned char[1];
+    *octalCode = 0;
+    for (int i = 0; i < sections; i++) {
+        unsigned char* childCode = childOctalCode(octalCode, randIntInRange(0, NUMBER_OF_CHILDREN - 1));
+        delete[] octalCode;
+        octalCode = childCode;
+    }
+    return octalCode;
+}
+
+// Times finding whether random elements are in a jurisdiction of the whole tree with many random end nodes, as the
+// encoder does for every element it sends, with the trie and with the scan of the end nodes it replaced.
+void processBenchmarkJurisdiction(int endNodeCount) {
+    qDebug("benchmarkJurisdiction: %d end nodes", endNodeCount);
+
+    std::vector<unsigned char*> endNodes;
+    for (int i = 0; i < endNodeCount; i++) {
+        endNodes.push_back(randomOctalCode(BENCHMARK_JURISDICTION_END_NODE_LEVEL));
+    }
+    JurisdictionMap jurisdiction(randomOctalCode(0), endNodes);
+
+    QVector<unsigned char*> octalCodes;
+    for (int i = 0; i < BENCHMARK_JURISDICTION_CODES; i++) {
+        octalCodes << randomOctalCode(randIntInRange(0, BENCHMARK_JURISDICTION_MAX_CODE_LEVEL));
+    }
+
+    int mismatches = 0;
+    int within = 0;
+    foreach (unsigned char* octalCode, octalCodes) {
+        JurisdictionMap::Area area = jurisdiction.isMyJurisdiction(octalCode, CHECK_NODE_ONLY);
+        if (area != jurisdiction.isMyJurisdictionByScan(octalCode, CHECK_NODE_ONLY)) {
+            mismatches++;
+        }
+        if (area == JurisdictionMap::WITHIN) {
+            within++;
+        }
+    }
+
+    int found = 0;
+    quint64 start = usecTimestampNow();
+    for (int i = 0; i < BENCHMARK_JURISDICTION_LOOKUPS; i++) {
+        found += jurisdiction.isMyJurisdiction(octalCodes[i % BENCHMARK_JURISDICTION_CODES], CHECK_NODE_ONLY);
+    }
+    quint64 trieUsecs = usecTimestampNow() - start;
+
+    start = usecTimestampNow();
+    for (int i = 0; i < BENCHMARK_JURISDICTION_LOOKUPS; i++) {
+        found += jurisdiction.isMyJurisdictionByScan(octalCodes[i % BENCHMARK_JURISDICTION_CODES], CHECK_NODE_ONLY);
+    }
+    quint64 scanUsecs = usecTimestampNow() - start;
+
+    qDebug("trie: %f usecs per lookup, scan: %f usecs per lookup", (float)trieUsecs / BENCHMARK_JURISDICTION_LOOKUPS,
+        (float)scanUsecs / BENCHMARK_JURISDICTION_LOOKUPS);
+    qDebug("%d of %d codes within, %d mismatches between the trie and the scan (checksum %d)", within,
+        BENCHMARK_JURISDICTION_CODES, mismatches, found);
+
+    foreach (unsigned char* octalCode, octalCodes) {
+        delete[] octalCode;
+    }
+}
+
+// Times importing an image or a minecraft schematic, which logs the voxels per second it built.
+void processBenchmarkImport(const char* importFile) {
+    qDebug("benchmarkImport: %s", importFile);
+
+    VoxelTree tree;
+    QString fileName(importFile);
+    quint64 start = usecTimestampNow();
+    if (fileName.endsWith(".png", Qt::CaseInsensitive)) {
+        tree.readFromSquareARGB32Pixels(importFile);
+    } else if (fileName.endsWith(".schematic", Qt::CaseInsensitive)) {
+        tree.readFromSchematicFile(importFile);
+    } else {
+        qDebug("Only .png and .schematic files are imported.");
+        return;
+    }
+    quint64 elapsedUsecs = usecTimestampNow() - start;
+    qDebug("Imported %lu elements in %f seconds", tree.getOctreeElementsCount(), (float)elapsedUsecs / USECS_PER_SECOND);
+}
+
+// Lists the shallowest elements where the trees of two SVO files differ.
+void processDiffSVOFiles(const char* svoFile, const char* otherSVOFile) {
+    qDebug("diffSVO: %s with %s", svoFile, otherSVOFile);
+
+    VoxelTree tree;
+    tree.readFromSVOFile(svoFile);
+    VoxelTree otherTree;
+    otherTree.readFromSVOFile(otherSVOFile);
+
+    QVector<QByteArray> differences = findOctreeDifferences(&tree, &otherTree);
+    foreach (const QByteArray& octalCode, differences) {
+        qDebug() << "    differs at" << octalCodeToHexString((const unsigned char*)octalCode.constData());
+    }
+    qDebug("%d differences", differences.size());
+}
+
+// Brings the tree of one SVO file up to date with another's by syncing it in this process, and reports how much of the
+// source had to be sent to do it.
+void processSyncSVOFile(const char* sourceSVOFile, const char* targetSVOFile, const char* outputSVOFile) {
+    qDebug("syncSVO: %s to %s", sourceSVOFile, targetSVOFile);
+
+    VoxelTree sourceTree;
+    sourceTree.readFromSVOFile(sourceSVOFile);
+    VoxelTree targetTree;
+    targetTree.readFromSVOFile(targetSVOFile);
+
+    OctreeSyncSource source(&sourceTree);
+    OctreeSyncTarget target(&targetTree);
+    quint64 start = usecTimestampNow();
+    int requests = 0;
+    while (!target.isFinished()) {
+        QByteArray request = target.getNextRequest();
+        if (request.isEmpty()) {
+            break;
+        }
+        requests++;
+        if (!target.handleReply(source.handleRequest(request))) {
+            qDebug("Couldn't read the reply to request %d.", requests);
+            return;
+        }
+    }
+    quint64 elapsedUsecs = usecTimestampNow() - start;
+
+    qDebug("Synced in %f seconds with %d requests", (float)elapsedUsecs / USECS_PER_SECOND, requests);
+    qDebug("    elements compared: %d", target.getElementsCompared());
+    qDebug("    layers received: %d, subtrees received: %d, subtrees deleted: %d", target.getLayersReceived(),
+        target.getSubtreesReceived(), target.getSubtreesDeleted());
+    qDebug("    bytes requested: %llu, bytes received: %llu, source file: %lld bytes", target.getBytesRequested(),
+        target.getBytesReceived(), QFileInfo(sourceSVOFile).size());
+
+    bool matches = sourceTree.getSubtreeHash(sourceTree.getRoot()) == targetTree.getSubtreeHash(targetTree.getRoot());
+    qDebug(matches ? "The trees match." : "The trees still differ!");
+
+    if (outputSVOFile) {
+        targetTree.writeToSVOFile(outputSVOFile);
+    }
+}
+
 void unitTest(VoxelTree * tree);
 
 
@@ -324,6 +559,98 @@ int main(int argc, const char * argv[])
         return 0;
     }
 
+    // Handles timing spatial queries over the voxels of an SVO.
+    const char* BENCHMARK_QUERIES = "--benchmarkQueries";
+    const char* benchmarkSVOFile = getCmdOption(argc, argv, BENCHMARK_QUERIES);
+    if (benchmarkSVOFile) {
+        processBenchmarkQueriesSVOFile(benchmarkSVOFile);
+        return 0;
+    }
+
+    // Handles timing jurisdiction lookups with a number of end nodes.
+    const char* BENCHMARK_JURISDICTION = "--benchmarkJurisdiction";
+    const char* benchmarkJurisdictionEndNodes = getCmdOption(argc, argv, BENCHMARK_JURISDICTION);
+    if (benchmarkJurisdictionEndNodes) {
+        processBenchmarkJurisdiction(atoi(benchmarkJurisdictionEndNodes));
+        return 0;
+    }
+
+    // Handles timing the image and minecraft importers.
+    const char* BENCHMARK_IMPORT = "--benchmarkImport";
+    const char* benchmarkImportFile = getCmdOption(argc, argv, BENCHMARK_IMPORT);
+    if (benchmarkImportFile) {
+        processBenchmarkImport(benchmarkImportFile);
+        return 0;
+    }
+
+    // Handles the streaming tools for chunked SVOs, which work through a file a chunk at a time on all cores so that
+    // files bigger than memory can be processed.
+    const char* STREAM_STATS_SVO = "--streamStatsSVO";
+    const char* streamStatsSVOFile = getCmdOption(argc, argv, STREAM_STATS_SVO);
+    if (streamStatsSVOFile) {
+        processStreamStatsSVOFile(streamStatsSVOFile);
+        return 0;
+    }
+
+    const char* STREAM_SPLIT_SVO = "--streamSplitSVO";
+    const char* streamSplitSVOFile = getCmdOption(argc, argv, STREAM_SPLIT_SVO);
+    if (streamSplitSVOFile && splitJurisdictionRoot && splitJurisdictionEndNodes) {
+        processStreamSplitSVOFile(streamSplitSVOFile, splitJurisdictionRoot, splitJurisdictionEndNodes);
+        return 0;
+    }
+
+    const char* OUTPUT_SVO = "--outputSVO";
+    const char* outputSVOFile = getCmdOption(argc, argv, OUTPUT_SVO);
+
+    // Handles comparing two SVOs by the hashes of their subtrees, and syncing one with the other.
+    const char* DIFF_SVO = "--diffSVO";
+    const char* DIFF_WITH = "--diffWith";
+    const char* diffSVOFile = getCmdOption(argc, argv, DIFF_SVO);
+    const char* diffWithFile = getCmdOption(argc, argv, DIFF_WITH);
+    if (diffSVOFile && diffWithFile) {
+        processDiffSVOFiles(diffSVOFile, diffWithFile);
+        return 0;
+    }
+
+    const char* SYNC_SVO = "--syncSVO";
+    const char* SYNC_TARGET = "--syncTarget";
+    const char* syncSVOFile = getCmdOption(argc, argv, SYNC_SVO);
+    const char* syncTargetFile = getCmdOption(argc, argv, SYNC_TARGET);
+    if (syncSVOFile && syncTargetFile) {
+        processSyncSVOFile(syncSVOFile, syncTargetFile, outputSVOFile);
+        return 0;
+    }
+
+    const char* STREAM_MERGE_SVO = "--streamMergeSVO";
+    const char* MERGE_INPUTS = "--mergeInputs";
+    const char* streamMergeSVOFile = getCmdOption(argc, argv, STREAM_MERGE_SVO);
+    const char* mergeInputs = getCmdOption(argc, argv, MERGE_INPUTS);
+    if (streamMergeSVOFile && mergeInputs) {
+        processStreamMergeSVOFiles(streamMergeSVOFile, QString(mergeInputs).split(",", QString::SkipEmptyParts));
+        return 0;
+    }
+
+    const char* STREAM_COMPACT_SVO = "--streamCompactSVO";
+    const char* CHUNK_LEVEL = "--chunkLevel";
+    const char* streamCompactSVOFile = getCmdOption(argc, argv, STREAM_COMPACT_SVO);
+    if (streamCompactSVOFile) {
+        const char* chunkLevel = getCmdOption(argc, argv, CHUNK_LEVEL);
+        QString compactedSVOFile = outputSVOFile ? QString(outputSVOFile)
+            : outputFileNameFor("compact", streamCompactSVOFile);
+        processStreamCompactSVOFile(streamCompactSVOFile, qPrintable(compactedSVOFile),
+                                    chunkLevel ? atoi(chunkLevel) : DEFAULT_SVO_CHUNK_LEVEL);
+        return 0;
+    }
+
+    const char* STREAM_REBUILD_LOD_SVO = "--streamRebuildLODSVO";
+    const char* streamRebuildLODSVOFile = getCmdOption(argc, argv, STREAM_REBUILD_LOD_SVO);
+    if (streamRebuildLODSVOFile) {
+        QString rebuiltSVOFile = outputSVOFile ? QString(outputSVOFile)
+            : outputFileNameFor("lod", streamRebuildLODSVOFile);
+        processStreamRebuildLODSVOFile(streamRebuildLODSVOFile, qPrintable(rebuiltSVOFile));
+        return 0;
+    }
+
     const char* DONT_CREATE_FILE = "--dontCreateSceneFile";
     bool dontCreateFile = cmdOptionExists(argc, argv, DONT_CREATE_FILE);
 